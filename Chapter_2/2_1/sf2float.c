@@ -1,4 +1,5 @@
 #include <portsf.h>
+#include <psfext.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -39,7 +40,7 @@ int main(int argc, char* argv[])
     }
     
     //Open our infile
-    ifd = psf_sndOpen(argv[ARG_INFILE], &props, 0);
+    ifd = psf_sndOpenEx(argv[ARG_INFILE], &props, 0, PSF_OPEN_READAHEAD);
 
     if(ifd < 0 )
     {
@@ -0,0 +1,177 @@
+/* sfconv.c: copy a soundfile into another container (WAVE, AIFF, AIFC, raw, compressed), keeping the sample type.
+   16, 24 and 32bit samples are copied as integers: only the byte order changes, so the copy is exact.
+   With -s the samples are converted to a new rate on the way, as floats. */
+#include <portsf.h>
+#include <psfext.h>
+#include <psfsrc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+    ARG_PROGNAME,
+    ARG_INFILE,
+    ARG_OUTFILE,
+    ARG_NARGS
+};
+
+const unsigned long FRAMES_PER_WRITE = 16384;
+
+/* copy nFrames of whatever the files hold. Return frames copied, 0 at end, or < 0 on error */
+static long copy_frames(int ifd, int ofd, psf_stype samptype, void* buf, long nFrames)
+{
+    long framesread;
+
+    switch(samptype)
+    {
+    case PSF_SAMP_16:
+        framesread = psf_sndReadInt16Frames(ifd, (short*) buf, nFrames);
+        if(framesread > 0 && psf_sndWriteInt16Frames(ofd, (const short*) buf, framesread) != framesread)
+            return -1;
+        break;
+    case PSF_SAMP_24:
+        framesread = psf_sndReadInt24Frames(ifd, (int*) buf, nFrames);
+        if(framesread > 0 && psf_sndWriteInt24Frames(ofd, (const int*) buf, framesread) != framesread)
+            return -1;
+        break;
+    case PSF_SAMP_32:
+        framesread = psf_sndReadInt32Frames(ifd, (int*) buf, nFrames);
+        if(framesread > 0 && psf_sndWriteInt32Frames(ofd, (const int*) buf, framesread) != framesread)
+            return -1;
+        break;
+    default:
+        framesread = psf_sndReadFloatFrames(ifd, (float*) buf, nFrames);
+        if(framesread > 0 && psf_sndWriteFloatFrames(ofd, (const float*) buf, framesread) != framesread)
+            return -1;
+        break;
+    }
+    return framesread;
+}
+
+int main(int argc, char* argv[])
+{
+    PSF_PROPS props;
+    long framesread, totalread = 0;
+    int ifd = -1, ofd = -1;
+    int error = 0;
+    const char* rawspec = NULL;
+    long outrate = 0;
+    int quality = PSF_SRC_MEDIUM;
+    psf_stype copytype;
+    psf_format outformat = PSF_FMT_UNKNOWN;
+    void* buf = NULL;
+
+    /* -rsrate,chans,type: what a raw infile holds; -ssrate[,quality]: the new rate */
+    while(argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0')
+    {
+        if(argv[1][1] == 'r')
+            rawspec = argv[1] + 2;
+        else if(argv[1][1] == 's')
+        {
+            if(sscanf(argv[1] + 2, "%ld,%d", &outrate, &quality) < 1 || outrate <= 0
+               || quality < PSF_SRC_FAST || quality > PSF_SRC_BEST)
+            {
+                fprintf(stderr, "Error: bad -s value %s\n", argv[1] + 2);
+                return 1;
+            }
+        }
+        else
+            break;
+        argc--;
+        argv++;
+    }
+    if(argc > ARG_OUTFILE)
+        psf_stdoutSamples(argv[ARG_OUTFILE]);
+
+    if(argc < ARG_NARGS)
+    {
+        printf("insufficient arguments. \nusage: ./sfconv [-rsrate,chans,type] [-ssrate[,quality]] <infile> <outfile>\n"
+               "       -r: infile is raw (.raw, .pcm, or - for stdin): srate,chans,type (16, 24, 32 or float)\n"
+               "       -s: convert to srate; quality 0 (fast), 1 (default) or 2 (best)\n"
+               "       outfile: format from the extension (.wav .aif .aiff .afc .aifc .raw .pcm .lac); - writes raw samples to stdout\n");
+        return 1;
+    }
+
+    if(psf_init())
+    {
+        printf("Unable to start up portsf\n");
+        return 1;
+    }
+
+    if(psf_getFormatExt(argv[ARG_INFILE]) == PSF_RAW)
+    {
+        if(rawspec == NULL || psf_rawProps(rawspec, &props))
+        {
+            printf("Error: raw infile %s needs -rsrate,chans,type (type 16, 24, 32 or float)\n", argv[ARG_INFILE]);
+            return 1;
+        }
+        ifd = psf_sndOpenRaw(argv[ARG_INFILE], &props, PSF_OPEN_MMAP);
+    }
+    else
+        ifd = psf_sndOpenEx(argv[ARG_INFILE], &props, 0, PSF_OPEN_MMAP);
+
+    if(ifd < 0)
+    {
+        printf("Error: unable to open infile %s\n", argv[ARG_INFILE]);
+        return 1;
+    }
+
+    copytype = props.samptype;
+    if(outrate && outrate != props.srate)
+    {
+        if(psf_sndSetRate(ifd, outrate, quality))
+        {
+            printf("Error: unable to convert %s to %ld Hz\n", argv[ARG_INFILE], outrate);
+            error++;
+            goto exit;
+        }
+        props.srate = outrate;
+        copytype = PSF_SAMP_IEEE_FLOAT;
+    }
+
+    outformat = psf_getFormatExt(argv[ARG_OUTFILE]);
+    if(outformat == PSF_FMT_UNKNOWN)
+    {
+        printf("outfile name %s has unknown format.\n Use any of .wav .aiff .aif .afc .aifc .raw .pcm .lac\n", argv[ARG_OUTFILE]);
+        error++;
+        goto exit;
+    }
+    props.format = outformat;
+    /* the sample type stays as it is, so clip floats only if the infile did */
+    ofd = psf_sndCreate(argv[ARG_OUTFILE], &props, 0, 0, PSF_CREATE_RDWR);
+    if(ofd < 0)
+    {
+        printf("Error: unable to create outfile %s\n", argv[ARG_OUTFILE]);
+        error++;
+        goto exit;
+    }
+
+    /* room for the widest sample: floats and ints are the same size */
+    buf = malloc(FRAMES_PER_WRITE * props.chans * sizeof(int));
+    if(buf == NULL)
+    {
+        printf("No memory!\n");
+        error++;
+        goto exit;
+    }
+
+    while((framesread = copy_frames(ifd, ofd, copytype, buf, FRAMES_PER_WRITE)) > 0)
+        totalread += framesread;
+
+    if(framesread < 0)
+    {
+        printf("Error copying to outfile. Outfile is incomplete.\n");
+        error++;
+    }
+    else
+        printf("Done. %ld sample frames copied to %s\n", totalread, argv[ARG_OUTFILE]);
+
+exit:
+    if(ifd >= 0)
+        psf_sndClose(ifd);
+    if(ofd >= 0)
+        psf_sndClose(ofd);
+    if(buf)
+        free(buf);
+    psf_finish();
+    return error;
+}
@@ -1,14 +1,20 @@
 #include <portsf.h>
+#include <psfext.h>
+#include <psfindex.h>
+#include <psfoverview.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
 
 enum {
     ARG_PROGNAME,
     ARG_INFILE,
     ARG_OUTFILE,
     ARG_AMPFACE,
-    ARG_NARGS
+    ARG_NARGS,
+    ARG_INDEX = ARG_NARGS   /* optional: index written by sfscan */
 };
 
 void print_file_properties(PSF_PROPS props, char* filename)
@@ -23,7 +29,7 @@ void print_file_properties(PSF_PROPS props, char* filename)
 }
 
 /* Finds the max sample value in a buffer */
-double maxsamp(float*buf, unsigned long blocksize)
+double maxsamp(const float*buf, unsigned long blocksize)
 {
     double absval, peak = 0.0;
     unsigned long i;
@@ -37,8 +43,72 @@ double maxsamp(float*buf, unsigned long blocksize)
     return peak;
 }
 
+/* the peak of the whole file, from its overview sidecar if it has a current one. Returns 1 if found */
+int peak_from_overview(const char* path, int chans, double* peak)
+{
+    PSF_OVERVIEW* ov = NULL;
+    PSF_OVWSTATS* stats;
+    int i, found = 0;
+
+    if(psf_overviewLoad(path, &ov) != PSF_E_NOERROR)
+        return 0;
+    stats = (PSF_OVWSTATS*) malloc(chans * sizeof(PSF_OVWSTATS));
+    if(stats && ov->chans == chans && psf_overviewQuery(ov, 0, ov->nFrames, stats) == PSF_E_NOERROR)
+    {
+        for(i = 0; i < chans; i++)
+        {
+            if(stats[i].peak > *peak)
+                *peak = stats[i].peak;
+        }
+        found = 1;
+    }
+    free(stats);
+    psf_overviewFree(ov);
+    return found;
+}
+
 const unsigned long FRAMES_PER_WRITE = 1024;
 
+/* stdin, or any pipe, can only be read once: copy it to a temporary raw file of floats, finding
+   the peak on the way, and read that back instead. Returns the temporary file opened for reading,
+   or < 0 on error. tmppath gets its name, to remove when done */
+int spool_stream(int ifd, const PSF_PROPS* inprops, float* buf, char* tmppath, double* peak)
+{
+    PSF_PROPS props = *inprops;
+    const char* tmpdir = getenv("TMPDIR");
+    long framesread;
+    int fd, tfd;
+
+    if(tmpdir == NULL || *tmpdir == '\0')
+        tmpdir = "/tmp";
+    sprintf(tmppath, "%.1000s/sfgainXXXXXX.raw", tmpdir);
+    fd = mkstemps(tmppath, 4);
+    if(fd < 0)
+    {
+        tmppath[0] = '\0';
+        return -1;
+    }
+    close(fd);
+    props.format = PSF_RAW;
+    props.samptype = PSF_SAMP_IEEE_FLOAT;
+    tfd = psf_sndCreate(tmppath, &props, 0, 0, PSF_CREATE_WRONLY);
+    if(tfd < 0)
+        return tfd;
+    while((framesread = psf_sndReadFloatFrames(ifd, buf, FRAMES_PER_WRITE)) > 0)
+    {
+        double thispeak = maxsamp(buf, framesread * props.chans);
+        if(thispeak > *peak)
+            *peak = thispeak;
+        if(psf_sndWriteFloatFrames(tfd, buf, framesread) != framesread)
+        {
+            framesread = -1;
+            break;
+        }
+    }
+    if(psf_sndClose(tfd) || framesread < 0)
+        return -1;
+    return psf_sndOpenRaw(tmppath, &props, PSF_OPEN_MMAP | PSF_OPEN_READAHEAD);
+}
 
 /*
 sfgain.c takes an infile and a copies it to an outfile
@@ -52,18 +122,39 @@ int main(int argc, char* argv[])
     /* init all resource vars to default states */
     int ifd = -1, ofd = -1; /* input file and output file IDS */
     int error = 0;
+    const char* rawspec = NULL;
+    int overview = 0;   /* -o: write an overview sidecar for the outfile */
     int i;
     psf_format outformat = PSF_FMT_UNKNOWN;
     PSF_CHPEAK* peaks = NULL;
     float* frame = NULL;
     float amplitude_factor, scalefac;
     double dbval, inpeak = 0.0;
+    int havepeak = 0;  /* from the index, or a stream we have copied */
+    char tmppath[1100] = "";    /* a stream infile, copied */
+
+    /* -rsrate,chans,type: what a raw infile holds; -o: overview of the outfile */
+    while(argc > 1 && argv[1][0] == '-' && (argv[1][1] == 'r' || strcmp(argv[1], "-o") == 0))
+    {
+        if(argv[1][1] == 'r')
+            rawspec = argv[1] + 2;
+        else
+            overview = 1;
+        argc--;
+        argv++;
+    }
+    if(argc > ARG_OUTFILE)
+        psf_stdoutSamples(argv[ARG_OUTFILE]);
 
     printf("\nSFGAIN: Change level of soundfile\n");
 
     if(argc < ARG_NARGS)
     {
-        printf("insufficient arguments. \nusage: ./sf2float <infile> <outfile> <dbval>\n");
+        printf("insufficient arguments. \nusage: ./sfgain [-rsrate,chans,type] [-o] <infile> <outfile> <dbval> [index]\n"
+               "       -r: infile is raw (.raw, .pcm, or - for stdin): srate,chans,type (16, 24, 32 or float)\n"
+               "       -o: also write outfile.ovw, an overview of the outfile levels (see psfoverview.h)\n"
+               "       outfile: - writes raw samples to stdout\n"
+               "       index: made by sfscan, to look up the infile peaks instead of scanning it\n");
         return 1;
     }
 
@@ -83,8 +174,18 @@ int main(int argc, char* argv[])
         return 1;
     }
     
-    //Open our infile
-    ifd = psf_sndOpen(argv[ARG_INFILE], &props, 0);
+    //Open our infile, mapped (without PEAK data we read it twice) and read ahead
+    if(psf_getFormatExt(argv[ARG_INFILE]) == PSF_RAW)
+    {
+        if(rawspec == NULL || psf_rawProps(rawspec, &props))
+        {
+            printf("Error: raw infile %s needs -rsrate,chans,type (type 16, 24, 32 or float)\n", argv[ARG_INFILE]);
+            return 1;
+        }
+        ifd = psf_sndOpenRaw(argv[ARG_INFILE], &props, PSF_OPEN_MMAP | PSF_OPEN_READAHEAD);
+    }
+    else
+        ifd = psf_sndOpenEx(argv[ARG_INFILE], &props, 0, PSF_OPEN_MMAP | PSF_OPEN_READAHEAD);
 
     if(ifd < 0 )
     {
@@ -95,9 +196,57 @@ int main(int argc, char* argv[])
     /* allocate space for sample buffer */
     frame = (float*)malloc(FRAMES_PER_WRITE * (props.chans * sizeof(float))); // Buffer to hold our data for processing/writing
 
-    
-    //Find the peak value of our infile
-    if(psf_sndReadPeaks(ifd, peaks, NULL) > 0) // If our file has data for the peak values
+    /* allocate space for PEAK info */
+    peaks = (PSF_CHPEAK*) malloc(props.chans* sizeof(PSF_CHPEAK));
+
+    if(peaks == NULL) {
+        puts("No memory!\n");
+        error++;
+        goto exit;
+    }
+
+    //A stream has no length until we have read it all: copy it to a file we can read twice
+    if(psf_sndSize64(ifd) < 0)
+    {
+        int sfd;
+
+        if(frame == NULL || (sfd = spool_stream(ifd, &props, frame, tmppath, &inpeak)) < 0)
+        {
+            printf("Error: unable to copy infile %s to a temporary file\n", argv[ARG_INFILE]);
+            error++;
+            goto exit;
+        }
+        psf_sndClose(ifd);
+        ifd = sfd;
+        havepeak = 1;
+    }
+    //Find the peak value of our infile: from the index if we have one and it is up to date
+    else if(argc > ARG_INDEX)
+    {
+        PSF_INDEX* index = psf_indexNew();
+        const PSF_INDEXENTRY* entry = NULL;
+
+        if(index && psf_indexLoad(index, argv[ARG_INDEX]) >= 0)
+            entry = psf_indexLookup(index, argv[ARG_INFILE]);
+        if(entry && entry->haspeaks && entry->props.chans == props.chans)
+        {
+            long i;
+            for(i = 0; i < props.chans; i++)
+            {
+                if(entry->peaks[i].val > inpeak)
+                    inpeak = entry->peaks[i].val;
+            }
+            havepeak = 1;
+        }
+        else
+            printf("%s not in index %s: finding peak from the file\n", argv[ARG_INFILE], argv[ARG_INDEX]);
+        psf_indexFree(index);
+    }
+    if(havepeak)
+    {
+        /* nothing more to do */
+    }
+    else if(psf_sndReadPeaks(ifd, peaks, NULL) > 0) // If our file has data for the peak values
     {
         long i;
         for(i = 0; i < props.chans; i++)
@@ -106,19 +255,25 @@ int main(int argc, char* argv[])
                 inpeak = peaks[i].val;
         }
     }
-    else //Otherwise, find the peak value ourselves.
+    //No PEAK chunk: an up to date overview sidecar (infile.ovw) knows the peak of the whole file
+    else if(peak_from_overview(argv[ARG_INFILE], props.chans, &inpeak))
     {
-        framesread = psf_sndReadFloatFrames(ifd, frame, FRAMES_PER_WRITE);
+        printf("peak found from %s%s\n", argv[ARG_INFILE], PSF_OVW_EXT);
+    }
+    else //Otherwise, find the peak value ourselves, looking at the samples in place.
+    {
+        const float* view;
+        framesread = psf_sndReadFloatView(ifd, &view, FRAMES_PER_WRITE);
         while(framesread > 0)
         {
             double thispeak;
             int blocksize = props.chans * framesread;
-            thispeak = maxsamp(frame,blocksize);
+            thispeak = maxsamp(view,blocksize);
             if(thispeak > inpeak)
             {
                 inpeak = thispeak;
             }
-            framesread = psf_sndReadFloatFrames(ifd, frame, FRAMES_PER_WRITE);
+            framesread = psf_sndReadFloatView(ifd, &view, FRAMES_PER_WRITE);
         }
 
         /* Now rewind the file for copying */
@@ -141,7 +296,7 @@ int main(int argc, char* argv[])
 
     if(outformat == PSF_FMT_UNKNOWN)
     {
-        printf("outfile name %s has unknown format. \n Use any of .wav .aiff. .aif .afc .aifc\n", argv[ARG_OUTFILE]);
+        printf("outfile name %s has unknown format. \n Use any of .wav .aiff. .aif .afc .aifc .raw, or - for stdout\n", argv[ARG_OUTFILE]);
         error++;
         goto exit;
     }
@@ -154,6 +309,8 @@ int main(int argc, char* argv[])
         error++;
         goto exit;
     }
+    if(overview && psf_sndSetOverview(ofd, 0) != PSF_E_NOERROR)
+        printf("Warning: no overview for outfile %s\n", argv[ARG_OUTFILE]);
 
     if(frame == NULL) {
         puts("No memory!\n");
@@ -161,15 +318,6 @@ int main(int argc, char* argv[])
         goto exit;
     }
 
-    /* allocate space for PEAK info */
-    peaks = (PSF_CHPEAK*) malloc(props.chans* sizeof(PSF_CHPEAK));
-
-    if(peaks == NULL) {
-        puts("No memory!\n");
-        error++;
-        goto exit;
-    }
-
     puts("copying... \n");
     
     /* Audio Programming book, Exercise 2.1.1
@@ -200,7 +348,7 @@ int main(int argc, char* argv[])
             error++;
             break;
         }
-        framesread = psf_sndReadFloatFrames(ifd,frame,FRAMES_PER_WRITE);
+        framesread = psf_sndReadFloatFrames(ifd, frame, FRAMES_PER_WRITE);
     }
     //If the samplerate is not divisible by the number of Frames we write, then we will have some leftover frames
     //We need to add on after our main loop.
@@ -253,6 +401,10 @@ exit:
     {
         free(peaks);
     }
+    if(tmppath[0])
+    {
+        remove(tmppath);
+    }
 
     //Clean up the library
     psf_finish();
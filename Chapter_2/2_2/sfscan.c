@@ -0,0 +1,323 @@
+/* sfscan.c: index the soundfiles under one or more directories, so that sfgain and friends
+   can look up properties, durations and peaks without opening each file.
+   An existing index is updated in place: files whose mtime and size have not changed
+   are taken from it as they are, and only new or changed files are read. */
+#include <portsf.h>
+#include <psfext.h>
+#include <psfindex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#define SCAN_DEFTHREADS (4)
+#define SCAN_MAXTHREADS (64)
+#define SCAN_MAXCHANS   (1024)
+#define SCAN_FRAMES     (16384)
+
+typedef struct scanjob
+{
+    char* path;
+    const PSF_INDEXENTRY* reuse;    /* unchanged: the old entry */
+    PSF_INDEXENTRY entry;           /* otherwise, what we found */
+    int rc;
+} SCANJOB;
+
+typedef struct scanlist
+{
+    SCANJOB* jobs;
+    int njobs;
+    int maxjobs;
+} SCANLIST;
+
+/* shared by the workers */
+static SCANLIST joblist;
+static const PSF_INDEX* oldindex;
+static int quick = 0;
+static int nextjob = 0;
+static pthread_mutex_t joblock = PTHREAD_MUTEX_INITIALIZER;
+
+static int addjob(const char* path)
+{
+    SCANJOB* job;
+
+    if(joblist.njobs == joblist.maxjobs)
+    {
+        int newmax = joblist.maxjobs ? joblist.maxjobs * 2 : 1024;
+        job = (SCANJOB*) realloc(joblist.jobs, newmax * sizeof(SCANJOB));
+        if(job == NULL)
+            return -1;
+        joblist.jobs = job;
+        joblist.maxjobs = newmax;
+    }
+    job = joblist.jobs + joblist.njobs;
+    memset(job, 0, sizeof(SCANJOB));
+    job->path = (char*) malloc(strlen(path) + 1);
+    if(job->path == NULL)
+        return -1;
+    strcpy(job->path, path);
+    joblist.njobs++;
+    return 0;
+}
+
+/* collect every file with a soundfile extension. Symbolic links are not followed,
+   so each file is indexed once, by its real path */
+static int walk(const char* dir)
+{
+    DIR* dp;
+    struct dirent* de;
+    struct stat st;
+    char path[PATH_MAX];
+    int rc = 0;
+
+    if((dp = opendir(dir)) == NULL)
+    {
+        fprintf(stderr, "sfscan: cannot read directory %s\n", dir);
+        return 0;
+    }
+    while(rc == 0 && (de = readdir(dp)) != NULL)
+    {
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        if(snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >= (int) sizeof(path))
+            continue;
+        if(lstat(path, &st))
+            continue;
+        if(S_ISDIR(st.st_mode))
+            rc = walk(path);
+        else if(S_ISREG(st.st_mode))
+        {
+            /* raw files have no header to index */
+            psf_format fmt = psf_getFormatExt(path);
+            if(fmt != PSF_FMT_UNKNOWN && fmt != PSF_RAW)
+                rc = addjob(path);
+        }
+    }
+    closedir(dp);
+    return rc;
+}
+
+/* no PEAK chunk: find the peaks ourselves */
+static int scanpeaks(const char* path, int chans, PSF_CHPEAK* peaks)
+{
+    PSF_PROPS props;
+    int ifd, ch;
+    long i, framesread;
+    DWORD framepos = 0;
+    const float* view;
+
+    ifd = psf_sndOpenEx(path, &props, 0, PSF_OPEN_MMAP);
+    if(ifd < 0)
+        return ifd;
+    for(ch = 0; ch < chans; ch++)
+    {
+        peaks[ch].val = 0.0f;
+        peaks[ch].pos = 0;
+    }
+    while((framesread = psf_sndReadFloatView(ifd, &view, SCAN_FRAMES)) > 0)
+    {
+        for(i = 0; i < framesread; i++)
+        {
+            for(ch = 0; ch < chans; ch++)
+            {
+                float val = (float) fabs(view[i * chans + ch]);
+                if(val > peaks[ch].val)
+                {
+                    peaks[ch].val = val;
+                    peaks[ch].pos = framepos + (DWORD) i;
+                }
+            }
+        }
+        framepos += (DWORD) framesread;
+    }
+    psf_sndClose(ifd);
+    return framesread < 0 ? (int) framesread : PSF_E_NOERROR;
+}
+
+static void scanfile(SCANJOB* job, PSF_CHPEAK* peaks)
+{
+    PSF_INDEXENTRY* e = &job->entry;
+    PSF_PROBEINFO info;
+    const PSF_INDEXENTRY* old;
+
+    e->path = job->path;
+    job->rc = psf_indexStat(job->path, &e->mtime, &e->size);
+    if(job->rc < PSF_E_NOERROR)
+        return;
+    old = oldindex ? psf_indexFind(oldindex, job->path) : NULL;
+    if(old && old->mtime == e->mtime && old->size == e->size && (old->haspeaks || quick))
+    {
+        job->reuse = old;
+        return;
+    }
+    info.peaks = peaks;
+    info.maxpeaks = SCAN_MAXCHANS;
+    job->rc = psf_sndProbe(job->path, &e->props, &info);
+    if(job->rc < PSF_E_NOERROR)
+        return;
+    e->nFrames = info.nFrames;
+    e->haspeaks = info.haspeaks && e->props.chans <= SCAN_MAXCHANS;
+    if(!e->haspeaks && !quick && e->props.chans <= SCAN_MAXCHANS)
+        e->haspeaks = scanpeaks(job->path, e->props.chans, peaks) == PSF_E_NOERROR;
+    if(e->haspeaks)
+    {
+        e->peaks = (PSF_CHPEAK*) malloc(e->props.chans * sizeof(PSF_CHPEAK));
+        if(e->peaks == NULL)
+        {
+            job->rc = PSF_E_NOMEM;
+            return;
+        }
+        memcpy(e->peaks, peaks, e->props.chans * sizeof(PSF_CHPEAK));
+    }
+}
+
+static void* worker(void* arg)
+{
+    PSF_CHPEAK* peaks = (PSF_CHPEAK*) malloc(SCAN_MAXCHANS * sizeof(PSF_CHPEAK));
+    int i;
+
+    if(peaks == NULL)
+        return NULL;
+    for(;;)
+    {
+        pthread_mutex_lock(&joblock);
+        i = nextjob++;
+        pthread_mutex_unlock(&joblock);
+        if(i >= joblist.njobs)
+            break;
+        scanfile(joblist.jobs + i, peaks);
+    }
+    free(peaks);
+    return NULL;
+}
+
+static void usage(void)
+{
+    printf("usage: sfscan [-jN] [-q] indexfile dir [dir ...]\n"
+           "       -jN: use N threads (default %d)\n"
+           "       -q:  headers only: files without PEAK data are indexed without peaks\n"
+           "  Updates indexfile if it exists: unchanged files are not read again.\n", SCAN_DEFTHREADS);
+}
+
+int main(int argc, char* argv[])
+{
+    PSF_INDEX* oldidx = NULL;
+    PSF_INDEX* newidx = NULL;
+    pthread_t threads[SCAN_MAXTHREADS];
+    int i, nthreads = SCAN_DEFTHREADS, nstarted = 0;
+    int nreused = 0, nread = 0, nfailed = 0, error = 0;
+    char dir[PATH_MAX];
+
+    while(argc > 1 && argv[1][0] == '-')
+    {
+        if(argv[1][1] == 'j')
+        {
+            nthreads = atoi(argv[1] + 2);
+            if(nthreads < 1 || nthreads > SCAN_MAXTHREADS)
+            {
+                fprintf(stderr, "sfscan: threads must be between 1 and %d\n", SCAN_MAXTHREADS);
+                return 1;
+            }
+        }
+        else if(argv[1][1] == 'q')
+            quick = 1;
+        else
+        {
+            usage();
+            return 1;
+        }
+        argc--;
+        argv++;
+    }
+    if(argc < 3)
+    {
+        usage();
+        return 1;
+    }
+    if(psf_init())
+    {
+        puts("unable to start portsf");
+        return 1;
+    }
+    oldidx = psf_indexNew();
+    newidx = psf_indexNew();
+    if(oldidx == NULL || newidx == NULL)
+    {
+        puts("no memory");
+        return 1;
+    }
+    /* no index yet is fine: everything is new */
+    if(psf_indexLoad(oldidx, argv[1]) >= 0)
+        oldindex = oldidx;
+    for(i = 2; i < argc; i++)
+    {
+        if(realpath(argv[i], dir) == NULL)
+        {
+            fprintf(stderr, "sfscan: cannot find directory %s\n", argv[i]);
+            continue;
+        }
+        if(walk(dir))
+        {
+            puts("no memory");
+            return 1;
+        }
+    }
+    for(i = 0; i < nthreads; i++)
+    {
+        if(pthread_create(&threads[i], NULL, worker, NULL))
+            break;
+        nstarted++;
+    }
+    /* no threads at all: do it ourselves */
+    if(nstarted == 0)
+        worker(NULL);
+    for(i = 0; i < nstarted; i++)
+        pthread_join(threads[i], NULL);
+
+    for(i = 0; i < joblist.njobs && !error; i++)
+    {
+        SCANJOB* job = joblist.jobs + i;
+        if(job->reuse)
+        {
+            error = psf_indexAdd(newidx, job->reuse) < PSF_E_NOERROR;
+            nreused++;
+        }
+        else if(job->rc < PSF_E_NOERROR)
+        {
+            fprintf(stderr, "sfscan: skipping %s (error %d)\n", job->path, job->rc);
+            nfailed++;
+        }
+        else
+        {
+            error = psf_indexAdd(newidx, &job->entry) < PSF_E_NOERROR;
+            nread++;
+        }
+    }
+    if(error)
+        puts("no memory");
+    else if(psf_indexSave(newidx, argv[1]) < PSF_E_NOERROR)
+    {
+        fprintf(stderr, "sfscan: cannot write index %s\n", argv[1]);
+        error++;
+    }
+    else
+        printf("%s: %d files (%d read, %d unchanged), %d skipped\n",
+               argv[1], newidx->nentries, nread, nreused, nfailed);
+
+    for(i = 0; i < joblist.njobs; i++)
+    {
+        free(joblist.jobs[i].path);
+        free(joblist.jobs[i].entry.peaks);
+    }
+    free(joblist.jobs);
+    psf_indexFree(oldidx);
+    psf_indexFree(newidx);
+    psf_finish();
+    return error ? 1 : 0;
+}
@@ -1,6 +1,8 @@
 #include <portsf.h>
+#include <psfext.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "portsf/breakpoints.h"
 
@@ -88,11 +90,13 @@ int main(int argc, char* argv[])
     /* init all resource vars to default states */
     int ifd = -1, ofd = -1; /* input file and output file IDS */
     int error = 0;
+    const char* rawspec = NULL;
     int i;
     psf_format outformat = PSF_FMT_UNKNOWN;
     PSF_CHPEAK* peaks = NULL;
     float* frame = NULL;
     float* outframe = NULL;
+    float* outchans[2];
     float amplitude_factor, scalefac;
     double pos, inpeak = 0.0;
 
@@ -102,11 +106,21 @@ int main(int argc, char* argv[])
     FILE* fp = NULL;
     unsigned long size;
     breakpoint* points = NULL;
+    /* -rsrate,chans,type: what a raw infile holds */
+    if(argc > 1 && strncmp(argv[1], "-r", 2) == 0)
+    {
+        rawspec = argv[1] + 2;
+        argc--;
+        argv++;
+    }
+    if(argc > ARG_OUTFILE)
+        psf_stdoutSamples(argv[ARG_OUTFILE]);
+
     printf("\nSFPAN: Change level of soundfile\n");
 
     if(argc < ARG_NARGS)
     {
-        printf("insufficient arguments. \nusage: ./sf2float <infile> <outfile> <posfile.brk>\n");
+        printf("insufficient arguments. \nusage: ./sfpan [-rsrate,chans,type] <infile> <outfile> <posfile.brk>\n");
         return 1;
     }
 
@@ -161,7 +175,17 @@ int main(int argc, char* argv[])
     }
     
     //Open our infile
-    ifd = psf_sndOpen(argv[ARG_INFILE], &inprops, 0);
+    if(psf_getFormatExt(argv[ARG_INFILE]) == PSF_RAW)
+    {
+        if(rawspec == NULL || psf_rawProps(rawspec, &inprops))
+        {
+            printf("Error: raw infile %s needs -rsrate,chans,type (type 16, 24, 32 or float)\n", argv[ARG_INFILE]);
+            return 1;
+        }
+        ifd = psf_sndOpenRaw(argv[ARG_INFILE], &inprops, PSF_OPEN_READAHEAD);
+    }
+    else
+        ifd = psf_sndOpenEx(argv[ARG_INFILE], &inprops, 0, PSF_OPEN_READAHEAD);
 
     if(ifd < 0 )
     {
@@ -182,15 +206,17 @@ int main(int argc, char* argv[])
     /* allocate space for sample buffer */
     frame = (float*)malloc(FRAMES_PER_WRITE * (inprops.chans * sizeof(float))); // Buffer to hold our data for processing/writing
 
-    /* allocate space for outframe */
+    /* allocate space for outframe: left then right, written planar */
     outframe = (float*)malloc(FRAMES_PER_WRITE * (outprops.chans * sizeof(float)));
+    outchans[0] = outframe;
+    outchans[1] = outframe + FRAMES_PER_WRITE;
 
     /* check outfile extension is one we know about */
     outformat = psf_getFormatExt(argv[ARG_OUTFILE]);
 
     if(outformat == PSF_FMT_UNKNOWN)
     {
-        printf("outfile name %s has unknown format. \n Use any of .wav .aiff. .aif .afc .aifc\n", argv[ARG_OUTFILE]);
+        printf("outfile name %s has unknown format. \n Use any of .wav .aiff. .aif .afc .aifc .raw, or - for stdout\n", argv[ARG_OUTFILE]);
         error++;
         goto exit;
     }
@@ -204,7 +230,7 @@ int main(int argc, char* argv[])
         goto exit;
     }
 
-    if(frame == NULL) {
+    if(frame == NULL || outframe == NULL) {
         puts("No memory!\n");
         error++;
         goto exit;
@@ -232,7 +258,6 @@ int main(int argc, char* argv[])
 
     while(framesread > 0){
 
-        int out_i = 0;
         double stereopos;
         totalread += framesread;
 
@@ -241,12 +266,12 @@ int main(int argc, char* argv[])
         {
             stereopos = val_at_brktime(points, size, sampletime);
             thispos = constpowerpan(stereopos); //TODO(Tanner): Document what simple_pan does again
-            outframe[out_i++] = (float)(frame[i] * thispos.left);
-            outframe[out_i++] = (float)(frame[i] * thispos.right);
+            outchans[0][i] = (float)(frame[i] * thispos.left);
+            outchans[1][i] = (float)(frame[i] * thispos.right);
             sampletime += timeincr;
         }
 
-        if(psf_sndWriteFloatFrames(ofd,outframe,framesread) != framesread   ) /* Write to our outfile in this line */
+        if(psf_sndWriteFloatPlanar(ofd,(const float* const*)outchans,framesread) != framesread   ) /* Write to our outfile in this line */
         {
             puts("Error Writing to outfile \n");
             error++;
@@ -1,6 +1,8 @@
 #include <portsf.h>
+#include <psfext.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "portsf/breakpoints.h"
 
@@ -95,6 +97,7 @@ int main(int argc, char* argv[])
     /* init all resource vars to default states */
     int ifd = -1, ofd = -1; /* input file and output file IDS */
     int error = 0;
+    const char* rawspec = NULL;
     int i;
     psf_format outformat = PSF_FMT_UNKNOWN;
     PSF_CHPEAK* peaks = NULL;
@@ -114,11 +117,21 @@ int main(int argc, char* argv[])
     FILE* fp = NULL;
     unsigned long size;
     breakpoint* points = NULL;
+    /* -rsrate,chans,type: what a raw infile holds */
+    if(argc > 1 && strncmp(argv[1], "-r", 2) == 0)
+    {
+        rawspec = argv[1] + 2;
+        argc--;
+        argv++;
+    }
+    if(argc > ARG_OUTFILE)
+        psf_stdoutSamples(argv[ARG_OUTFILE]);
+
     printf("\nSFENV: Change level of soundfile\n");
 
     if(argc < ARG_NARGS)
     {
-        printf("insufficient arguments. \nusage: ./sf2float <infile> <outfile> <posfile.brk>\n");
+        printf("insufficient arguments. \nusage: ./sfenv [-rsrate,chans,type] <infile> <outfile> <posfile.brk>\n");
         return 1;
     }
 
@@ -173,7 +186,17 @@ int main(int argc, char* argv[])
     }
     
     //Open our infile
-    ifd = psf_sndOpen(argv[ARG_INFILE], &inprops, 0);
+    if(psf_getFormatExt(argv[ARG_INFILE]) == PSF_RAW)
+    {
+        if(rawspec == NULL || psf_rawProps(rawspec, &inprops))
+        {
+            printf("Error: raw infile %s needs -rsrate,chans,type (type 16, 24, 32 or float)\n", argv[ARG_INFILE]);
+            return 1;
+        }
+        ifd = psf_sndOpenRaw(argv[ARG_INFILE], &inprops, PSF_OPEN_READAHEAD);
+    }
+    else
+        ifd = psf_sndOpenEx(argv[ARG_INFILE], &inprops, 0, PSF_OPEN_READAHEAD);
 
     if(ifd < 0 )
     {
@@ -202,7 +225,7 @@ int main(int argc, char* argv[])
 
     if(outformat == PSF_FMT_UNKNOWN)
     {
-        printf("outfile name %s has unknown format. \n Use any of .wav .aiff. .aif .afc .aifc\n", argv[ARG_OUTFILE]);
+        printf("outfile name %s has unknown format. \n Use any of .wav .aiff. .aif .afc .aifc .raw, or - for stdout\n", argv[ARG_OUTFILE]);
         error++;
         goto exit;
     }
@@ -1,4 +1,5 @@
 #include <portsf.h>
+#include <psfext.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -23,7 +24,7 @@ typedef struct pan_position_t {
 #define FRAMES_PER_WRITE 1024
 #define DEFAULT_WINDOW_MSECS 15
 pan_position constpowerpan(double position);
-double maxsamp(float*buf, unsigned long blocksize);
+double maxsamp(const float*buf, unsigned long blocksize);
 
 int main(int argc, char* argv[])
 {
@@ -33,7 +34,7 @@ int main(int argc, char* argv[])
     int ifd = -1;  /* input file and output file IDS */
     int error = 0;
     int i;
-    float* frame = NULL;
+    const float* frame = NULL; /* points at samples owned by portsf */
     double win_duration = DEFAULT_WINDOW_MSECS; /*default of the window in msecs */
     unsigned long winsize;
     double break_time;
@@ -85,7 +86,7 @@ int main(int argc, char* argv[])
     }
 
     //TODO: Open and Verify Infile for this application
-    ifd = psf_sndOpen(argv[ARG_INFILE], &inprops, 0);
+    ifd = psf_sndOpenEx(argv[ARG_INFILE], &inprops, 0, PSF_OPEN_MMAP);
 
     if(ifd < 0 )
     {
@@ -112,18 +113,9 @@ int main(int argc, char* argv[])
     win_duration /= 1000.0; //Convert to seconds
     winsize = (unsigned long)(win_duration * inprops.srate); /* Winsize is how many frames we are going to read at a time */
 
-    /* allocate space for sample buffer */
-    frame = (float*)malloc(winsize*sizeof(float)); // Buffer to hold our data for processing/writing
-
-    if(frame == NULL) {
-        puts("No memory!\n");
-        error++;
-        goto exit;
-    }
-
     break_time = 0.0;
     npoints = 0;
-    while((framesread = psf_sndReadFloatFrames(ifd, frame, winsize)) > 0)
+    while((framesread = psf_sndReadFloatView(ifd, &frame, winsize)) > 0)
     {
         double amp; 
         amp = maxsamp(frame, framesread);
@@ -149,11 +141,6 @@ exit:
     {
         psf_sndClose(ifd);
     }
-    if(frame)
-    {
-        free(frame);
-    }
-    
     if(fp)
     {
         if(fclose(fp))
@@ -198,7 +185,7 @@ void print_file_properties(PSF_PROPS props, char* filename)
 }
 
 /* Finds the max sample value in a buffer */
-double maxsamp(float*buf, unsigned long blocksize)
+double maxsamp(const float*buf, unsigned long blocksize)
 {
     double absval, peak = 0.0;
     unsigned long i;
@@ -26,6 +26,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include <stdlib.h>
 #include <math.h>
 #include <portsf.h>
+#include <psfext.h>
 #include "wave.h"
 #include "portsf/breakpoints.h"
 #include <time.h>
@@ -388,6 +389,12 @@ int main(int argc, char* argv[])
 		error++;
 		goto exit;
 	}
+	/* write each block in the background while the next is computed */
+	if(psf_sndSetAsync(ofd,4) < 0){
+		printf("Error: unable to start background writes to outfile %s\n",argv[ARG_OUTFILE]);
+		error++;
+		goto exit;
+	}
     osc = oscil();
     InitOscillator(osc, sample_rate);
 
@@ -0,0 +1,7293 @@
+/* Copyright (c) 2009,2010 Richard Dobson
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* fopencookie, for files in memory */
+#if defined(unix) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#ifdef unix
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <fcntl.h>
+#endif
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "ieee80.h"
+#ifdef _DEBUG
+#include <assert.h>
+#endif
+/* all x86-64 compilers define this; 32bit builds need e.g. -msse2 */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+/* wider kernels, chosen at run time (see psf_selectKernels) */
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define PSF_DISPATCH
+#include <immintrin.h>
+#endif
+
+#include "portsf.h"
+#include "psfext.h"
+#include "psfsrc.h"
+#include "psflac.h"
+#include "psfoverview.h"
+
+#ifndef DBGFPRINTF
+# ifdef _DEBUG
+# define DBGFPRINTF(a) fprintf a
+# else
+# define DBGFPRINTF(a)
+# endif
+#endif
+
+#ifndef max
+#define max(x,y) ((x) > (y) ? (x) : (y))
+#endif
+#ifndef min
+#define min(x,y) ((x) < (y) ? (x) : (y))
+#endif
+
+#ifndef BITS_PER_BYTE
+#define BITS_PER_BYTE (8)
+#endif
+#ifndef WIN32
+#include <ctype.h>
+int stricmp(const char *a, const char *b);
+int strnicmp(const char *a, const char *b, const int length);
+#endif
+/* to the best of my knowledge,m ~only~ linux defines fpos_t as a struct */
+#ifdef linux
+#define POS64(x) (x.__pos)
+#else
+#define POS64(x) (x)
+#endif
+
+
+/* probably no good for 64bit platforms */
+#define REVDWBYTES(t)	( (((t)&0xff) << 24) | (((t)&0xff00) << 8) | (((t)&0xff0000) >> 8) | (((t)>>24) & 0xff) )
+#define REVWBYTES(t)	( (((t)&0xff) << 8) | (((t)>>8) &0xff) )
+#define TAG(a,b,c,d)	( ((a)<<24) | ((b)<<16) | ((c)<<8) | (d) )
+/* these give bit-acccurate conversions */
+#define MAX_16BIT  (32768.0)
+#define MAX_32BIT  (2147483648.0)		 
+#define AIFC_VERSION_1 (0xA2805140)
+/*pstring for AIFC	- includes the pad byte*/
+static const char aifc_floatstring[10] = { 0x08,'F','l','o','a','t',0x20,'3','2',0x00};
+static const char aifc_notcompressed[16] = {0x0e,'n','o','t',0x20,'c','o','m','p','r','e','s','s','e','d',0x00};
+
+
+/* we need the standard Windows defs, when compiling on other platforms.
+   <windows.h> defines _INC_WINDOWS 
+ */
+#ifndef _INC_WINDOWS
+
+#define WAVE_FORMAT_PCM			(0x0001)
+
+typedef struct _GUID 
+{ 
+    unsigned int        Data1; 
+    unsigned short       Data2; 
+    unsigned short       Data3; 
+    unsigned char        Data4[8]; 
+} GUID; 
+
+
+typedef struct  {
+	WORD  wFormatTag; 
+    WORD  nChannels; 
+    DWORD nSamplesPerSec; 
+    DWORD nAvgBytesPerSec; 
+    WORD  nBlockAlign; 
+    WORD  wBitsPerSample; 
+
+} WAVEFORMAT;
+
+
+typedef struct { 
+    WORD  wFormatTag; 
+    WORD  nChannels; 
+    DWORD nSamplesPerSec; 
+    DWORD nAvgBytesPerSec; 
+    WORD  nBlockAlign; 
+    WORD  wBitsPerSample; 
+    WORD  cbSize; 
+} WAVEFORMATEX; 
+#endif
+
+
+/* basic support for WAVE_FORMAT_EXTENSIBLE */
+
+typedef struct {
+    WAVEFORMATEX    Format;				/* 18 bytes */
+    union {
+        WORD wValidBitsPerSample;       /* bits of precision  */
+        WORD wSamplesPerBlock;          /* valid if wBitsPerSample==0 */
+        WORD wReserved;                 /* If neither applies, set to */
+                                        /* zero. */
+    } Samples;
+    DWORD    dwChannelMask;				/* which channels are */
+                                        /* present in stream  */
+    GUID     SubFormat;
+} WAVEFORMATEXTENSIBLE;
+
+/* sizeof(WAVEFORMATEXTENSIBLE) gives size plus alignment padding; not good here */
+/* size = 18 + 2 + 4 + 16 */
+#define sizeof_WFMTEX  (40)
+
+/* std WAVE-EX GUIDS from <ksmedia.h> */
+static const GUID  KSDATAFORMAT_SUBTYPE_PCM = {0x00000001,0x0000,0x0010,
+								{0x80,
+								0x00,
+								0x00,
+								0xaa,
+								0x00,
+								0x38,
+								0x9b,
+								0x71}};
+
+static const GUID  KSDATAFORMAT_SUBTYPE_IEEE_FLOAT = {0x00000003,0x0000,0x0010,
+								{0x80,
+								0x00,
+								0x00,
+								0xaa,
+								0x00,
+								0x38,
+								0x9b,
+								0x71}};
+
+static const GUID SUBTYPE_AMBISONIC_B_FORMAT_PCM = { 0x00000001, 0x0721, 0x11d3, 
+												{ 0x86,
+												0x44,
+												0xc8,
+												0xc1,
+												0xca,
+												0x0,
+												0x0,
+												0x0 } };
+
+
+static const GUID SUBTYPE_AMBISONIC_B_FORMAT_IEEE_FLOAT = { 0x00000003, 0x0721, 0x11d3, 
+												{ 0x86,
+												0x44,
+												0xc8,
+												0xc1,
+												0xca,
+												0x0,
+												0x0,
+												0x0 } };
+
+#ifndef WAVE_FORMAT_IEEE_FLOAT
+#define WAVE_FORMAT_IEEE_FLOAT	(0x0003)
+#endif
+#ifndef WAVE_FORMAT_EXTENSIBLE
+#define WAVE_FORMAT_EXTENSIBLE	(0xfffe)
+#endif
+
+/******** the private structure holding all sfile stuff */
+enum lastop {PSF_OP_READ,PSF_OP_WRITE};
+
+/* psf_sndGetStats: as PSF_STATS, with the times in nanoseconds */
+typedef struct psf_counts {
+	psf_int64	bytesread,byteswritten;
+	psf_int64	framesread,frameswritten;
+	psf_int64	nreads,nwrites,nseeks;
+	psf_int64	ionanos,convnanos,waitnanos;
+} PSF_COUNTS;
+
+typedef struct psffile {
+	FILE			*file;
+	char			*filename;
+	psf_int64		curframepos;	/* for read operations */
+	psf_int64		nFrames;		/* multi-channel sample frames */
+	int			    isRead;			/* how we are using it */
+	int			    clip_floats;
+	int			    rescale;
+	float			rescale_fac;
+	psf_format		riff_format;
+	/*int				isSeekable;*/	 /* any use ? */
+	int			    is_little_endian;		
+	psf_stype		samptype;		/* = nBlockAlign / nChannels */
+	fpos_t			dataoffset;		/* = sizeof(header) */
+	fpos_t			fmtoffset;
+	fpos_t			peakoffset;
+	WAVEFORMATEXTENSIBLE fmt;			/* serves all WAVE,AIFF support.*/
+	psf_channelformat chformat;
+	PSF_CHPEAK		*pPeaks;
+	time_t			peaktime;
+	fpos_t			lastwritepos;
+	int			    lastop;			/* last op was read or write? */
+	int			    dithertype;
+	unsigned int	ditherstate[4];	/* xorshift32 generators, one per SSE2 lane */
+	float			*ditherbuf;		/* a block of noise */
+	DWORD			ditherbufsize;
+	float			*shapeerr;		/* PSF_DITHER_SHAPED: recent errors, per channel */
+	unsigned char	*iobuf;			/* staging buffer for block (de)coding */
+	DWORD			iobufsize;
+	float			*fltbuf;		/* scratch floats: double writes, decoded views */
+	DWORD			fltbufsize;		/* in samples */
+	unsigned char	*mapbase;		/* PSF_OPEN_MMAP: the mapping, from a page boundary */
+	size_t			maplen;
+	unsigned char	*mapdata;		/* start of the sample data, within the mapping */
+	size_t			mapsize;		/* bytes of sample data */
+	size_t			mappos;			/* read position in the data, replaces the FILE position */
+	int				minheader;
+	fpos_t			ds64offset;		/* WAVE: JUNK chunk we can turn into ds64, if the file passes 4GB */
+	int				is_rf64;
+	struct psf_async *async;		/* writer thread, if psf_sndSetAsync */
+	struct psf_readahead *readahead;	/* reader thread, started by the first read */
+	int				ra_nblocks;		/* 0 = no read-ahead */
+	DWORD			ra_blockframes;
+	int				isstream;		/* raw data from stdin or a pipe: no seeks, length unknown until EOF */
+	int				iomode;			/* psf_sndSetIO */
+	char			*vbuf;			/* our stdio buffer, if not PSF_IO_DEFAULT */
+	DWORD			iodone;			/* PSF_IO_DIRECT: bytes moved since the cache was last trimmed */
+	psf_int64		trimpos;		/* ... and where the trimmed part ends */
+	PSF_SRC			*src;			/* psf_sndSetRate: converter between the caller and the file */
+	long			srcrate;		/* the caller's rate */
+	int				srceof;			/* reading: all the file has gone in */
+	psf_int64		srcpos;			/* reading: position at the caller's rate */
+	DWORD			srcskip;		/* reading: frames to discard after a seek */
+	float			*srcbuf;		/* file-rate frames on their way in or out */
+	PSF_LACFILE		*lac;			/* PSF_LAC: the coder, which owns the file position */
+	struct psf_memfile *mem;		/* psf_sndOpenMem, psf_sndCreateMem: the bytes behind file */
+	PSF_OVERVIEW	*ovw;			/* psf_sndSetOverview: built as we write, saved at close */
+	PSF_COUNTS		stats;			/* psf_sndGetStats */
+	psf_int64		callnanos;		/* the caller's I/O and waits, in the current call */
+#ifdef unix
+	pthread_mutex_t	lock;			/* held by every public call on this file */
+	pthread_mutex_t	statlock;		/* stats: the reader and writer threads count too */
+#endif
+} PSFFILE;
+
+#ifdef unix
+/* a file in memory, behind a FILE from fopencookie */
+struct psf_memfile {
+	unsigned char	*buf;
+	size_t			size;			/* the image: bytes read from, or written so far */
+	size_t			cap;
+	size_t			pos;
+	int				grow;			/* buf is ours: grown as needed, and freed with the file */
+};
+#endif
+
+static int psf_asyncSync(PSFFILE *sfdat);
+static int psf_asyncStop(PSFFILE *sfdat);
+static int psf_raStop(PSFFILE *sfdat);
+static void psf_ioDrop(PSFFILE *sfdat);
+static int psf_rateRead(PSFFILE *sfdat, float *buf, DWORD nFrames);
+static int psf_rateWrite(PSFFILE *sfdat, const float *buf, DWORD nFrames);
+static int psf_rateFinish(PSFFILE *sfdat);
+static psf_int64 psf_rateSize(PSFFILE *sfdat);
+static int psf_rateSeek(PSFFILE *sfdat, psf_int64 offset, int mode);
+static void psf_ditherSeed(PSFFILE *sfdat, unsigned int seed);
+static void psf_selectKernels(void);
+/* PSF_OPEN_READAHEAD ring */
+#define PSF_RA_DEFBLOCKS	(4)
+#define PSF_RA_DEFFRAMES	(4096)
+/* first allocation of a growable file in memory */
+#define PSF_MEM_MINSIZE		((size_t) 64 * 1024)
+/* nFrames of a raw stream, until we find the end */
+#define PSF_STREAMFRAMES	((psf_int64) 1 << 62)
+
+
+static int compare_guids(const GUID *gleft, const GUID *gright)
+{
+	const char *left = (const char *) gleft, *right = (const char *) gright;
+	return !memcmp(left,right,sizeof(GUID));
+}
+
+
+
+/* The handle table grows a chunk at a time, up to PSF_MAXCHUNKS chunks. Chunks never move
+   (until psf_finish), so psf_getFile needs no lock: chunks and files are published with release
+   stores, under psf_tablock, and psf_getFile reads them with acquire loads. Free handles are kept on a stack,
+   so opening and closing a file are O(1), under psf_tablock.
+   Threads: files can be opened and closed from any thread, and different files used at once.
+   Calls on the same file are serialized by its own lock; but a file must not be closed
+   while another thread is still using it. */
+#define PSF_TABCHUNK	(64)
+#define PSF_MAXCHUNKS	(1024)
+
+static PSFFILE **psf_chunks[PSF_MAXCHUNKS];
+static int psf_nchunks = 0;
+static int *psf_freehandles = NULL;
+static int psf_nfree = 0;
+
+#ifdef unix
+static pthread_mutex_t psf_tablock = PTHREAD_MUTEX_INITIALIZER;
+#define psf_lockTable()		pthread_mutex_lock(&psf_tablock)
+#define psf_unlockTable()	pthread_mutex_unlock(&psf_tablock)
+#define psf_lockFile(p)		pthread_mutex_lock(&(p)->lock)
+#define psf_unlockFile(p)	pthread_mutex_unlock(&(p)->lock)
+#define psf_lockStats(p)	pthread_mutex_lock(&(p)->statlock)
+#define psf_unlockStats(p)	pthread_mutex_unlock(&(p)->statlock)
+#else
+#define psf_lockTable()
+#define psf_unlockTable()
+#define psf_lockFile(p)
+#define psf_unlockFile(p)
+#define psf_lockStats(p)
+#define psf_unlockStats(p)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define psf_loadAcquire(p)		__atomic_load_n((p),__ATOMIC_ACQUIRE)
+#define psf_storeRelease(p,v)	__atomic_store_n((p),(v),__ATOMIC_RELEASE)
+#else
+#define psf_loadAcquire(p)		(*(p))
+#define psf_storeRelease(p,v)	(*(p) = (v))
+#endif
+
+static PSFFILE *psf_getFile(int sfd)
+{
+	PSFFILE **chunk;
+
+	if(sfd < 0 || sfd >= PSF_TABCHUNK * PSF_MAXCHUNKS)
+		return NULL;
+	chunk = psf_loadAcquire(&psf_chunks[sfd / PSF_TABCHUNK]);
+	if(chunk==NULL)
+		return NULL;
+	return psf_loadAcquire(&chunk[sfd % PSF_TABCHUNK]);
+}
+
+/* give sfdat a handle, growing the table if we must. Return handle, or PSF_E_ value */
+static int psf_newHandle(PSFFILE *sfdat)
+{
+	int i,sfd,*handles;
+	PSFFILE **chunk;
+
+	psf_lockTable();
+	if(psf_nfree==0){
+		if(psf_nchunks==PSF_MAXCHUNKS){
+			psf_unlockTable();
+			return PSF_E_TOOMANYFILES;
+		}
+		chunk = (PSFFILE **) calloc(PSF_TABCHUNK,sizeof(PSFFILE *));
+		handles = (int *) realloc(psf_freehandles,(psf_nchunks + 1) * PSF_TABCHUNK * sizeof(int));
+		if(chunk==NULL || handles==NULL){
+			free(chunk);
+			if(handles)
+				psf_freehandles = handles;
+			psf_unlockTable();
+			return PSF_E_NOMEM;
+		}
+		psf_freehandles = handles;
+		/* stacked so the lowest handle comes first */
+		for(i=PSF_TABCHUNK-1;i >= 0;i--)
+			psf_freehandles[psf_nfree++] = psf_nchunks * PSF_TABCHUNK + i;
+		psf_storeRelease(&psf_chunks[psf_nchunks],chunk);
+		psf_nchunks++;
+	}
+	sfd = psf_freehandles[--psf_nfree];
+	psf_storeRelease(&psf_chunks[sfd / PSF_TABCHUNK][sfd % PSF_TABCHUNK],sfdat);
+	psf_unlockTable();
+	return sfd;
+}
+
+static void psf_freeHandle(int sfd)
+{
+	psf_lockTable();
+	psf_storeRelease(&psf_chunks[sfd / PSF_TABCHUNK][sfd % PSF_TABCHUNK],(PSFFILE *) NULL);
+	psf_freehandles[psf_nfree++] = sfd;
+	psf_unlockTable();
+}
+
+static void psf_freeFile(PSFFILE *sfdat)
+{
+#ifdef unix
+	pthread_mutex_destroy(&sfdat->lock);
+	pthread_mutex_destroy(&sfdat->statlock);
+#endif
+	free(sfdat);
+}
+
+/* return 0 for success, non-zero for error	*/
+int psf_init(void)
+{
+	/* the handle table starts empty, and grows as files are opened */
+	psf_selectKernels();
+	return 0;
+}
+
+/* the real stdout, for samples written to "-", once psf_stdoutSamples has given stdout to messages */
+static FILE *psf_sampout = NULL;
+
+/* return zero for success, non-zero for error*/
+static int psf_release_file(PSFFILE *psff)
+{
+	int rc = 0;	
+#ifdef _DEBUG
+	assert(psff);
+#endif
+   /* lose nothing still queued */
+   psf_asyncStop(psff);
+   psf_raStop(psff);
+   psf_ioDrop(psff);
+   if(psff->lac){
+       psf_lacFree(psff->lac);
+       psff->lac = NULL;
+   }
+   if(psff->file){
+       /* stdin and stdout are not ours to close */
+       if(psff->file==stdin)
+           rc = 0;
+       else if(psff->file==stdout || psff->file==psf_sampout)
+           rc = fflush(psff->file);
+       else
+           rc = fclose(psff->file);
+       if(rc)
+            return rc;
+        psff->file = NULL;
+   }
+#ifdef unix
+   /* the bytes go with the FILE, unless handed over by psf_sndCloseMem */
+   if(psff->mem && psff->file==NULL){
+       if(psff->mem->grow)
+           free(psff->mem->buf);
+       free(psff->mem);
+       psff->mem = NULL;
+   }
+#endif
+   if(psff->filename){
+	   free(psff->filename);
+	   psff->filename = NULL;
+   }
+   if(psff->pPeaks) {
+       free(psff->pPeaks);
+       psff->pPeaks = NULL;
+   }
+   /* only now that stdio has finished with it */
+   if(psff->vbuf && psff->file==NULL) {
+       free(psff->vbuf);
+       psff->vbuf = NULL;
+   }
+   if(psff->iobuf) {
+       free(psff->iobuf);
+       psff->iobuf = NULL;
+       psff->iobufsize = 0;
+   }
+   if(psff->fltbuf) {
+       free(psff->fltbuf);
+       psff->fltbuf = NULL;
+       psff->fltbufsize = 0;
+   }
+   if(psff->src) {
+       psf_srcFree(psff->src);
+       psff->src = NULL;
+   }
+   if(psff->srcbuf) {
+       free(psff->srcbuf);
+       psff->srcbuf = NULL;
+   }
+   if(psff->ditherbuf) {
+       free(psff->ditherbuf);
+       psff->ditherbuf = NULL;
+       psff->ditherbufsize = 0;
+   }
+   if(psff->shapeerr) {
+       free(psff->shapeerr);
+       psff->shapeerr = NULL;
+   }
+   if(psff->ovw) {
+       psf_overviewFree(psff->ovw);
+       psff->ovw = NULL;
+   }
+#ifdef unix
+   if(psff->mapbase) {
+       munmap(psff->mapbase,psff->maplen);
+       psff->mapbase = NULL;
+       psff->mapdata = NULL;
+   }
+#endif
+   return rc;
+}
+
+/* return zero for success, non-zero for error*/
+int psf_finish(void)
+{
+	int i,j,rc = 0;
+	PSFFILE *sfdat;
+
+	psf_lockTable();
+	for(i=0;i < psf_nchunks;i++) {
+		for(j=0;j < PSF_TABCHUNK;j++){
+			sfdat = psf_chunks[i][j];
+			if(sfdat == NULL)
+				continue;
+#ifdef _DEBUG
+			printf("sfile %s not closed: closing.\n",sfdat->filename);
+#endif
+            rc = psf_release_file(sfdat);
+            /* an alternative is to continue, and write error info to a logfile */
+            if(rc){
+				psf_unlockTable();
+                return rc;
+			}
+			psf_freeFile(sfdat);
+			psf_storeRelease(&psf_chunks[i][j],(PSFFILE *) NULL);
+		}
+		free(psf_chunks[i]);
+		psf_storeRelease(&psf_chunks[i],(PSFFILE **) NULL);
+	}
+	psf_nchunks = 0;
+	free(psf_freehandles);
+	psf_freehandles = NULL;
+	psf_nfree = 0;
+	psf_unlockTable();
+	return rc;
+}
+
+
+/* thanks to the SNDAN programmers for this! */
+/* return 0 for big-endian machine, 1 for little-endian machine*/
+/* probably no good for 16bit swapping though */
+static int byte_order()					
+{						    
+  int   one = 1;
+  char* endptr = (char *) &one;
+  return (*endptr);
+}
+
+ 
+static void fmtSwapBytes(PSFFILE *sfdat)
+{
+	WAVEFORMATEX  *pfmt	= (WAVEFORMATEX *) &(sfdat->fmt.Format);
+	
+	pfmt->wFormatTag	= (WORD) REVWBYTES(pfmt->wFormatTag);
+	pfmt->nChannels		= (WORD) REVWBYTES(pfmt->nChannels);
+	pfmt->nSamplesPerSec	= REVDWBYTES(pfmt->nSamplesPerSec);
+	pfmt->nAvgBytesPerSec	= REVDWBYTES(pfmt->nAvgBytesPerSec);
+	pfmt->nBlockAlign	= (WORD) REVWBYTES(pfmt->nBlockAlign);
+	pfmt->wBitsPerSample	= (WORD) REVWBYTES(pfmt->wBitsPerSample);	
+}
+
+static void fmtExSwapBytes(PSFFILE *sfdat)
+{
+	WAVEFORMATEXTENSIBLE  *pfmtEx =  &(sfdat->fmt);
+	WAVEFORMATEX          *pfmt   = &(pfmtEx->Format);
+
+	pfmt->wFormatTag	= (WORD) REVWBYTES(pfmt->wFormatTag);
+	pfmt->nChannels		= (WORD) REVWBYTES(pfmt->nChannels);
+	pfmt->nSamplesPerSec	= REVDWBYTES(pfmt->nSamplesPerSec);
+	pfmt->nAvgBytesPerSec	= REVDWBYTES(pfmt->nAvgBytesPerSec);
+	pfmt->nBlockAlign	= (WORD) REVWBYTES(pfmt->nBlockAlign);
+	pfmt->wBitsPerSample	= (WORD) REVWBYTES(pfmt->wBitsPerSample);
+	pfmt->cbSize			= (WORD) REVWBYTES(pfmt->cbSize);
+    pfmtEx->Samples.wValidBitsPerSample = (WORD) REVWBYTES(pfmtEx->Samples.wValidBitsPerSample);
+    pfmtEx->dwChannelMask     = (DWORD) REVDWBYTES(pfmtEx->dwChannelMask);
+	/* we swap numeric fields of GUID, but not the char string */		
+	pfmtEx->SubFormat.Data1 = REVDWBYTES(pfmtEx->SubFormat.Data1);
+	pfmtEx->SubFormat.Data2 = (WORD) REVWBYTES(pfmtEx->SubFormat.Data2);
+	pfmtEx->SubFormat.Data3 = (WORD) REVWBYTES(pfmtEx->SubFormat.Data3);
+}
+
+static int check_guid(PSFFILE *sfdat)
+{
+	/* expects a GUID to be loaded already into sfdat.*/
+	if(sfdat->riff_format != PSF_WAVE_EX)		
+		return 1;
+
+	if(compare_guids(&(sfdat->fmt.SubFormat),&(KSDATAFORMAT_SUBTYPE_PCM))){
+		switch(sfdat->fmt.Format.wBitsPerSample){
+		case(16):
+			sfdat->samptype = PSF_SAMP_16;
+			break;
+		case(24):
+			/* only support packed format for now */
+			if((sfdat->fmt.Format.nBlockAlign / sfdat->fmt.Format.nChannels) != 3){
+				sfdat->samptype = PSF_SAMP_UNKNOWN;
+				return 1;
+			}
+			sfdat->samptype = PSF_SAMP_24;
+			break;
+		case(32):
+			sfdat->samptype = PSF_SAMP_32;
+			break;
+		default:
+			sfdat->samptype = PSF_SAMP_UNKNOWN;
+			return 1;
+		}
+		return 0;
+	}
+	if(compare_guids(&(sfdat->fmt.SubFormat),&(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT)))
+		if(sfdat->fmt.Format.wBitsPerSample == 32) {
+			sfdat->samptype = PSF_SAMP_IEEE_FLOAT;
+			return 0;	
+		}
+	/* add other recognised GUIDs here... */
+    if(compare_guids(&(sfdat->fmt.SubFormat),&(SUBTYPE_AMBISONIC_B_FORMAT_IEEE_FLOAT)))
+		if(sfdat->fmt.Format.wBitsPerSample == 32) {
+			sfdat->samptype = PSF_SAMP_IEEE_FLOAT;
+			sfdat->chformat = MC_BFMT;
+			return 0;	
+		}
+	if(compare_guids(&(sfdat->fmt.SubFormat),&(SUBTYPE_AMBISONIC_B_FORMAT_PCM))) {
+		switch(sfdat->fmt.Format.wBitsPerSample){
+		case(16):
+			sfdat->samptype = PSF_SAMP_16;
+			break;
+		case(24):
+			/* only support packed format for now */
+			if((sfdat->fmt.Format.nBlockAlign / sfdat->fmt.Format.nChannels) != 3){
+				sfdat->samptype = PSF_SAMP_UNKNOWN;
+				return 1;
+			}
+			sfdat->samptype = PSF_SAMP_24;
+			break;
+		case(32):
+			sfdat->samptype = PSF_SAMP_32;
+			break;
+		default:
+			sfdat->samptype = PSF_SAMP_UNKNOWN;
+			return 1;
+		}
+		sfdat->chformat = MC_BFMT;
+		return 0;
+	}
+	return 1;	
+}
+/* return actual validbits */
+static int psf_bitsize(psf_stype type)
+{
+	int size = 0;
+	switch(type){	
+	case(PSF_SAMP_16):
+		size = 16;
+		break;
+	case (PSF_SAMP_24):	
+		size = 24;
+		break;
+	case(PSF_SAMP_32):
+	case(PSF_SAMP_IEEE_FLOAT):
+		size = 32;
+		break;
+	default:
+		break;
+	}
+	return size;
+}
+/* return sample size in bytes */
+static int psf_wordsize(psf_stype type)
+{
+	int size = 0;
+	switch(type){
+	case(PSF_SAMP_16):
+		size = 2;
+		break;
+	case (PSF_SAMP_24):
+		size = 3;
+		break;	
+	case(PSF_SAMP_32):
+	case(PSF_SAMP_IEEE_FLOAT):
+		size = 4;
+		break;		
+	default:
+		break;
+	}
+	return size;
+
+}
+
+
+#if defined _WIN32 && defined _MSC_VER
+/* fast convergent rounding */
+__inline long psf_round(double fval)
+{
+	int result;
+	_asm{
+		fld	fval
+		fistp	result
+		mov	eax,result
+	}
+	return result;
+}
+
+#else
+/* slow convergent rounding ! */
+/* TODO: implement IEEE round-to-even */
+long psf_round(double val);
+
+long psf_round(double val)
+{
+	long k;
+	k = (long)(fabs(val)+0.5);
+	if(val < 0.0)
+		k = -k;
+	return k;
+}
+#endif
+
+#ifndef WIN32
+int stricmp(const char *a, const char *b)
+{
+	while(*a != '\0' && *b != '\0') {
+		int ca = islower(*a) ? toupper(*a) : *a;
+		int cb = islower(*b) ? toupper(*b) : *b;
+
+		if(ca < cb)
+			return -1;
+		if(ca > cb)
+			return 1;
+
+		a++;
+		b++;
+	}
+	if(*a == '\0' && *b == '\0')
+		return 0;
+	if(*a != '\0')
+		return 1;
+	return -1;
+}
+
+int
+strnicmp(const char *a, const char *b, const int length)
+{
+	int len = length;
+
+	while(*a != '\0' && *b != '\0') {
+		int ca = islower(*a) ? toupper(*a) : *a;
+		int cb = islower(*b) ? toupper(*b) : *b;
+
+		if(len-- < 1)
+			return 0;
+
+		if(ca < cb)
+			return -1;
+		if(ca > cb)
+			return 1;
+
+		a++;
+		b++;
+	}
+	if(*a == '\0' && *b == '\0')
+		return 0;
+	if(*a != '\0')
+		return 1;
+	return -1;
+}
+#endif
+
+/* create a new soundfile, from input props, or with default format  if props==NULL */
+/* current default = sr 44100, ch 1, WAVE, 16bit */
+/* could have func to define a new default format...*/
+
+static PSFFILE *psf_newFile(const PSF_PROPS *props)
+{
+	PSFFILE *sfdat;	
+
+	if(props){
+		if(props->srate <=0)
+			return NULL;
+		if(props->chans <=0)
+			return NULL;
+		/* NO support for PSF_SAMP_8 yet...*/
+		if(props->samptype < PSF_SAMP_16 || props->samptype > PSF_SAMP_IEEE_FLOAT)
+			return NULL;
+		if(props->format	<= PSF_FMT_UNKNOWN || props->format > PSF_LAC)
+			return NULL;
+		if(props->chformat < STDWAVE || props->chformat > MC_WAVE_EX)
+			return NULL;
+	}
+
+
+	sfdat = (PSFFILE *) malloc(sizeof(PSFFILE));
+	if(sfdat==NULL)
+		return sfdat;
+#ifdef unix
+	pthread_mutex_init(&sfdat->lock,NULL);
+	pthread_mutex_init(&sfdat->statlock,NULL);
+#endif
+
+	POS64(sfdat->lastwritepos)		= 0;
+	sfdat->file			= NULL;
+	sfdat->filename			= NULL;
+	sfdat->nFrames			= 0;
+	sfdat->curframepos		= 0;				
+	sfdat->isRead			= 1;				/* OK. who knows?    */
+	/* or use platform default format.... */
+	sfdat->riff_format		= props ? props->format : PSF_STDWAVE;		/* almost certainly! */
+	/*sfdat->isSeekable		= 1;*/
+	sfdat->clip_floats		= 1;
+	sfdat->rescale			= 0;
+	sfdat->rescale_fac		= 1.0f;
+	sfdat->is_little_endian	= byte_order();			
+	sfdat->samptype			= props ? props->samptype : PSF_SAMP_16;		/* reasonable...     */
+	POS64(sfdat->dataoffset)		= 0;
+	POS64(sfdat->fmtoffset)		= 0;
+	POS64(sfdat->peakoffset)		= 0;
+	sfdat->chformat			= props ? props->chformat : STDWAVE;
+	/*setup Format */
+	if(props)
+		sfdat->fmt.Format.wFormatTag  = (WORD) (props->samptype == PSF_SAMP_IEEE_FLOAT ?  WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM); 
+	else
+		sfdat->fmt.Format.wFormatTag  = WAVE_FORMAT_PCM;
+    sfdat->fmt.Format.nChannels		  = (WORD) (props ?  props->chans : 1); 
+    sfdat->fmt.Format.nSamplesPerSec  = props ? props->srate : 44100;      
+    sfdat->fmt.Format.nBlockAlign	  = (WORD) (props  ?  sfdat->fmt.Format.nChannels * psf_wordsize(props->samptype) : sfdat->fmt.Format.nChannels * sizeof(short)); 
+    sfdat->fmt.Format.wBitsPerSample  = (WORD) (props ?  psf_bitsize(props->samptype)  : sizeof(short) * BITS_PER_BYTE);
+	sfdat->fmt.Format.nAvgBytesPerSec = sfdat->fmt.Format.nSamplesPerSec  
+				 *sfdat->fmt.Format.nChannels 
+				 * (sfdat->fmt.Format.wBitsPerSample / BITS_PER_BYTE);
+	sfdat->pPeaks			= NULL;
+	sfdat->peaktime			= 0;
+	sfdat->fmt.Format.cbSize = 0;
+	/* set initial defaults for WAVE-EX stuff; may change */
+	/* but nobody should look at these fields unless we have a real WAVE-EX file anyway... */
+	sfdat->fmt.dwChannelMask = SPKRS_UNASSIGNED;
+	sfdat->fmt.Samples.wValidBitsPerSample  = sfdat->fmt.Format.wBitsPerSample;
+	/* 0 should be a guaranteed non-valid GUID! */
+	memset((char *) &(sfdat->fmt.SubFormat),0,sizeof(GUID));
+
+	if(props && (props->format == PSF_WAVE_EX)) {
+		sfdat->fmt.Format.cbSize = 22;
+		/* NB we will set the GUID from wFormatTag in waveExWriteHeader() */		
+		/* should really flag an error if user sets this */
+		if(sfdat->chformat==STDWAVE)
+			sfdat->chformat = MC_STD;
+
+		/* set wavex speaker mask */
+		/* TODO: support custom speaker masks, wordsizes, etc */
+		switch(sfdat->chformat){			
+		case MC_MONO:
+			if(props->chans != 1){			
+				//rsferrstr = "conflicting channel configuration for WAVE-EX file";
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_MONO;
+			break;
+		case MC_STEREO:
+			if(props->chans != 2){			
+				//rsferrstr = "conflicting channel configuration for WAVE-EX file";
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_STEREO;
+			break;
+		case MC_QUAD:
+			if(props->chans != 4){				
+				//rsferrstr = "conflicting channel configuration for WAVE-EX file";
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_GENERIC_QUAD;
+			break;	
+		case MC_LCRS:
+			if(props->chans != 4){
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_SURROUND_LCRS;
+			break;
+		case MC_DOLBY_5_1:
+			if(props->chans != 6){			
+				//rsferrstr = "conflicting channel configuration for WAVE-EX file";
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_DOLBY5_1;	   
+			break;
+        case MC_SURR_5_0:
+            if(props->chans != 5){			
+				//rsferrstr = "conflicting channel configuration for WAVE-EX file";
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_SURR_5_0;
+            break;
+        case MC_SURR_7_1:
+            if(props->chans != 8){			
+				//rsferrstr = "conflicting channel configuration for WAVE-EX file";
+				free(sfdat);
+				return NULL;
+			}
+			sfdat->fmt.dwChannelMask = SPKRS_7_1;
+            break;
+		default:
+			/*MC_STD, MC_BFMT */			
+			sfdat->fmt.dwChannelMask = SPKRS_UNASSIGNED;
+			break;
+		}
+	}
+	/* no dither, by default */
+	sfdat->dithertype = PSF_DITHER_OFF;
+	sfdat->ditherbuf = NULL;
+	sfdat->ditherbufsize = 0;
+	sfdat->shapeerr = NULL;
+	psf_ditherSeed(sfdat,0);
+	sfdat->ovw = NULL;
+	sfdat->iobuf = NULL;
+	sfdat->iobufsize = 0;
+	sfdat->fltbuf = NULL;
+	sfdat->fltbufsize = 0;
+	sfdat->mapbase = NULL;
+	sfdat->maplen = 0;
+	sfdat->mapdata = NULL;
+	sfdat->mapsize = 0;
+	sfdat->mappos = 0;
+	sfdat->minheader = 0;
+	POS64(sfdat->ds64offset) = 0;
+	sfdat->is_rf64 = 0;
+	sfdat->async = NULL;
+	sfdat->readahead = NULL;
+	sfdat->ra_nblocks = 0;
+	sfdat->ra_blockframes = 0;
+	sfdat->isstream = 0;
+	sfdat->iomode = PSF_IO_DEFAULT;
+	sfdat->vbuf = NULL;
+	sfdat->iodone = 0;
+	sfdat->trimpos = 0;
+	sfdat->src = NULL;
+	sfdat->srcrate = 0;
+	sfdat->srceof = 0;
+	sfdat->srcpos = 0;
+	sfdat->srcskip = 0;
+	sfdat->srcbuf = NULL;
+	sfdat->lac = NULL;
+	sfdat->mem = NULL;
+	memset(&sfdat->stats,0,sizeof(PSF_COUNTS));
+	sfdat->callnanos = 0;
+	return sfdat;
+}
+
+/* RF64 (EBU Tech 3306): the RIFF and data chunk sizes are set to 0xffffffff, 
+   and the true 64bit sizes go in a ds64 chunk, which must be the first chunk in the file.
+   We write a JUNK chunk of the same size there, and turn it into ds64 only if we need to. */
+#define PSF_RF64_MARKER		(0xffffffff)
+#define PSF_DS64_SIZE		(28)		/* riffSize, dataSize, sampleCount, tableLength */
+
+static int wavDoWrite(PSFFILE *sfdat, const void* buf, DWORD nBytes);
+static int wavDoRead(PSFFILE *sfdat, void* buf, DWORD nBytes);
+
+/* 64bit value as two DWORDS, low first */
+static int wavWriteQword(PSFFILE *sfdat, psf_int64 val)
+{
+	DWORD lo = (DWORD)(val & 0xffffffff), hi = (DWORD)((val >> 32) & 0xffffffff);
+
+	if(!sfdat->is_little_endian){
+		lo = REVDWBYTES(lo);
+		hi = REVDWBYTES(hi);
+	}
+	if(wavDoWrite(sfdat,(char *)&lo,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&hi,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	return PSF_E_NOERROR;
+}
+
+static int wavReadQword(PSFFILE *sfdat, psf_int64 *pval)
+{
+	DWORD lo,hi;
+
+	if(wavDoRead(sfdat,(char *)&lo,sizeof(DWORD))
+		|| wavDoRead(sfdat,(char *)&hi,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(!sfdat->is_little_endian){
+		lo = REVDWBYTES(lo);
+		hi = REVDWBYTES(hi);
+	}
+	*pval = ((psf_int64) hi << 32) | lo;
+	return PSF_E_NOERROR;
+}
+
+/* called by the WAVE header writers, straight after the WAVE tag */
+static int wavReserveDs64(PSFFILE *sfdat)
+{
+	DWORD tag = TAG('J','U','N','K'), size = PSF_DS64_SIZE;
+	char zeros[PSF_DS64_SIZE];
+	fpos_t bytepos;
+
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	if(!sfdat->is_little_endian)
+		size = REVDWBYTES(size);
+	else
+		tag = REVDWBYTES(tag);
+	memset(zeros,0,PSF_DS64_SIZE);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+		|| wavDoWrite(sfdat,zeros,PSF_DS64_SIZE))
+		return PSF_E_CANT_WRITE;
+	sfdat->ds64offset = bytepos;
+	return PSF_E_NOERROR;
+}
+
+/* plain RIFF and AIFF files have 32bit sizes: refuse to write past 4GB, unless we can go to RF64 */
+static int psf_checkLength(PSFFILE *sfdat, DWORD nFrames)
+{
+	psf_int64 endpos;
+
+	endpos = (psf_int64) POS64(sfdat->dataoffset) 
+		+ ((psf_int64) POS64(sfdat->lastwritepos) + nFrames) * sfdat->fmt.Format.nBlockAlign;
+	if(endpos <= (psf_int64) 0xffffffff || sfdat->riff_format==PSF_RAW || sfdat->riff_format==PSF_LAC)
+		return PSF_E_NOERROR;
+	if((sfdat->riff_format==PSF_STDWAVE || sfdat->riff_format==PSF_WAVE_EX) && POS64(sfdat->ds64offset) != 0)
+		return PSF_E_NOERROR;
+	DBGFPRINTF((stderr, "%s: file would exceed 4GB\n", sfdat->filename));
+	return PSF_E_CANT_WRITE;
+}
+
+/* complete header before closing file; return PSF_E_NOERROR[= 0] on success */
+static int wavUpdate(PSFFILE *sfdat)
+{
+	DWORD tag,riffsize,datasize;
+	psf_int64 riffsize64,datasize64;
+	fpos_t bytepos;
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(POS64(sfdat->dataoffset) != 0);	
+#endif		
+	datasize64 = sfdat->nFrames * sfdat->fmt.Format.nBlockAlign;
+	riffsize64 = datasize64 + (psf_int64) POS64(sfdat->dataoffset) - 2 * sizeof(DWORD);
+	/* switch to RF64 once the sizes no longer fit */
+	if(riffsize64 > (psf_int64) 0xffffffff){
+		if(POS64(sfdat->ds64offset)==0)
+			return PSF_E_CANT_WRITE;
+		sfdat->is_rf64 = 1;
+	}
+	riffsize = sfdat->is_rf64 ? PSF_RF64_MARKER : (DWORD) riffsize64;
+	datasize = sfdat->is_rf64 ? PSF_RF64_MARKER : (DWORD) datasize64;
+    POS64(bytepos) = 0;
+	if((fsetpos(sfdat->file,&bytepos))==0) {			 
+		tag = sfdat->is_rf64 ? TAG('R','F','6','4') : TAG('R','I','F','F');
+		if(!sfdat->is_little_endian)
+			riffsize = REVDWBYTES(riffsize);
+		else
+			tag = REVDWBYTES(tag);
+		if(fwrite((char *) &tag,sizeof(DWORD),1,sfdat->file) != 1
+			|| fwrite((char *) &riffsize,sizeof(DWORD),1,sfdat->file) != 1)
+			return PSF_E_CANT_WRITE;
+	}
+	else
+	    return PSF_E_CANT_SEEK;
+	if(sfdat->is_rf64){
+		if((fsetpos(sfdat->file,&sfdat->ds64offset))==0) {
+			tag = TAG('d','s','6','4');
+			if(sfdat->is_little_endian)
+				tag = REVDWBYTES(tag);
+			if(fwrite((char *) &tag,sizeof(DWORD),1,sfdat->file) != 1)
+				return PSF_E_CANT_WRITE;
+			/* skip size, already set */
+			if(fseek(sfdat->file,sizeof(DWORD),SEEK_CUR))
+				return PSF_E_CANT_SEEK;
+			if(wavWriteQword(sfdat,riffsize64)
+				|| wavWriteQword(sfdat,datasize64)
+				|| wavWriteQword(sfdat,sfdat->nFrames))
+				return PSF_E_CANT_WRITE;
+			/* tableLength stays 0 */
+		}
+		else
+			return PSF_E_CANT_SEEK;
+	}
+	if(sfdat->pPeaks){
+		if(POS64(sfdat->peakoffset)==0)
+			return PSF_E_BADARG;
+		
+		/*do byterev if necessary...*/
+		if((fsetpos(sfdat->file,&sfdat->peakoffset))==0){
+			/*set current time*/
+			DWORD *pblock;
+			int i;
+			time_t now = time(0);
+			if(!sfdat->is_little_endian){
+				now = REVDWBYTES(now);
+				pblock = (DWORD *) (sfdat->pPeaks);
+				for(i=0;i < sfdat->fmt.Format.nChannels * 2; i++)
+					pblock[i] = REVDWBYTES(pblock[i]);
+			}
+			if((fwrite((char*)&now,sizeof(DWORD),1,sfdat->file)) != 1)
+				return PSF_E_CANT_WRITE;
+
+			if((fwrite((char *) (sfdat->pPeaks),sizeof(PSF_CHPEAK),sfdat->fmt.Format.nChannels,sfdat->file))
+				!= sfdat->fmt.Format.nChannels )
+				return PSF_E_CANT_WRITE;
+		}
+		else
+		    return PSF_E_CANT_SEEK;
+	}
+	POS64(bytepos) = POS64(sfdat->dataoffset) -  sizeof(int);
+	if((fsetpos(sfdat->file,&bytepos))==0) {			
+		if(!sfdat->is_little_endian)
+			datasize = REVDWBYTES(datasize);
+		if(fwrite((char *) & datasize,sizeof(DWORD),1,sfdat->file) != 1)
+			return PSF_E_CANT_WRITE;	
+	}
+	if(fseek(sfdat->file,0,SEEK_END)){
+		/*DBGFPRINTF((stderr,"wavUpdate: error reseeking to end of file\n"));*/
+		return PSF_E_CANT_SEEK;
+	}
+
+	return PSF_E_NOERROR;
+}
+
+/* ditto for AIFF... */
+
+/* NB: the AIFF spec is unclear on type of size field. We decide on unsigned long (DWORD) here;
+   on the principle that a COMM chunk with an unsigned long nSampleFrames really needs the 
+   chunk size to be unsigned long too!.
+
+  */
+static int aiffUpdate(PSFFILE *sfdat)
+{
+	DWORD aiffsize,datasize,rev_datasize,frames;
+	fpos_t bytepos,filesize;
+	unsigned char pad = 0x00;
+
+	if(sfdat==NULL || sfdat->file== NULL)
+		return PSF_E_BADARG;
+
+	if(POS64(sfdat->dataoffset)  == 0)
+		return PSF_E_BADARG;
+	POS64(bytepos) = sizeof(int);
+	if((fsetpos(sfdat->file,&bytepos))==0) {
+		/* RWD 26:10:2002 */
+            /* RWD Nov 2003: dataoffset includes first two DWORDS in file, which must not be counted here! */
+		aiffsize = (sfdat->nFrames * sfdat->fmt.Format.nBlockAlign) 
+            + (MYLONG) POS64(sfdat->dataoffset) - (2 * sizeof(DWORD));
+		if(sfdat->is_little_endian)
+			aiffsize = REVDWBYTES(aiffsize);
+		if(fwrite((char *) &aiffsize,sizeof(DWORD),1,sfdat->file) != 1)
+			return PSF_E_CANT_WRITE;
+	}
+	else
+		return PSF_E_CANT_SEEK;	
+    POS64(bytepos)  = POS64(sfdat->fmtoffset) + sizeof(WORD);
+	if((fsetpos(sfdat->file,&bytepos))==0) {
+		frames = sfdat->nFrames;		
+		if(sfdat->is_little_endian)
+			frames = REVDWBYTES(frames);
+		if(fwrite((char *) &frames,sizeof(DWORD),1,sfdat->file) != 1)
+			return PSF_E_CANT_WRITE;
+	}
+	else
+		return PSF_E_CANT_SEEK;
+	if(sfdat->pPeaks){		
+        if(POS64(sfdat->peakoffset)==0)
+			return PSF_E_BADARG;
+		
+		/*do byterev if necessary...*/
+		if((fsetpos(sfdat->file,&sfdat->peakoffset))==0){
+			/*set current time*/
+			DWORD *pblock;
+			int i;
+			time_t now = time(0);
+			if(sfdat->is_little_endian){
+				now = REVDWBYTES(now);
+				pblock = (DWORD *) (sfdat->pPeaks);
+				for(i=0;i < sfdat->fmt.Format.nChannels * 2; i++)
+					pblock[i] = REVDWBYTES(pblock[i]);
+			}
+			if((fwrite((char*)&now,sizeof(DWORD),1,sfdat->file)) != 1)
+				return PSF_E_CANT_WRITE;
+
+			if((fwrite((char *) (sfdat->pPeaks),sizeof(PSF_CHPEAK),sfdat->fmt.Format.nChannels,sfdat->file))
+				!= sfdat->fmt.Format.nChannels )
+				return PSF_E_CANT_WRITE;
+		}
+		else
+			return PSF_E_CANT_SEEK;
+	}	
+    POS64(bytepos) = POS64(sfdat->dataoffset) - (3 * sizeof(int));
+	if((fsetpos(sfdat->file,&bytepos))==0) {			
+		datasize = sfdat->nFrames * sfdat->fmt.Format.nBlockAlign;
+		datasize += 2* sizeof(DWORD);	/* add offset and blocksize fields */
+		rev_datasize = datasize; /* preserve this for the seek later on */
+		if(sfdat->is_little_endian)
+			rev_datasize = REVDWBYTES(datasize);
+		if(fwrite((char *) & rev_datasize,sizeof(DWORD),1,sfdat->file) != 1)
+			return PSF_E_CANT_WRITE;	
+	}
+	else
+		return PSF_E_CANT_SEEK;
+	/* datachunk needs added pad byte if odd, not included in saved chunksize*/
+    POS64(bytepos) = POS64(sfdat->dataoffset) + datasize;
+	if((fsetpos(sfdat->file,&bytepos))){
+		return PSF_E_CANT_SEEK;
+	}
+	if(fgetpos(sfdat->file,&filesize))
+	      return PSF_E_CANT_SEEK;
+#ifdef _DEBUG	
+    assert(POS64(filesize) == POS64(bytepos));
+#endif	
+    if(POS64(filesize) % 2)
+		if(fwrite(&pad,sizeof(unsigned char),1,sfdat->file) != 1)
+			return PSF_E_CANT_WRITE;
+
+	return PSF_E_NOERROR;
+}
+
+
+/******** I/O policy ***********/
+/* PSF_IO_DIRECT keeps a long pass through a file out of the page cache: every PSF_IO_TRIMBYTES,
+   what we have read, or written and synced, is dropped from the cache. Mapped files are only
+   marked sequential, and dropped at close. */
+#define PSF_IO_ALIGN		(4096)
+#define PSF_IO_DEFBUFSIZE	(1024 * 1024)
+#define PSF_IO_TRIMBYTES	(8 * 1024 * 1024)
+
+#if defined(unix) && defined(POSIX_FADV_DONTNEED)
+/* called by whoever is using the FILE: the caller, or the writer or reader thread */
+static void psf_ioTrim(PSFFILE *sfdat, DWORD nbytes)
+{
+	fpos_t pos;
+	psf_int64 end;
+	int fd;
+
+	if(sfdat->iomode != PSF_IO_DIRECT || sfdat->isstream)
+		return;
+	sfdat->iodone += nbytes;
+	if(sfdat->iodone < PSF_IO_TRIMBYTES)
+		return;
+	sfdat->iodone = 0;
+	fd = fileno(sfdat->file);
+	/* dirty pages cannot be dropped: write them out first */
+	if(!sfdat->isRead && (fflush(sfdat->file) || fdatasync(fd)))
+		return;
+	if(fgetpos(sfdat->file,&pos))
+		return;
+	end = (psf_int64) POS64(pos);
+	end -= end % PSF_IO_ALIGN;
+	if(end > sfdat->trimpos){
+		posix_fadvise(fd,(off_t) sfdat->trimpos,(off_t)(end - sfdat->trimpos),POSIX_FADV_DONTNEED);
+		sfdat->trimpos = end;
+	}
+}
+
+/* at close, after the header update: the whole file goes, header pages too */
+static void psf_ioDrop(PSFFILE *sfdat)
+{
+	int fd;
+
+	if(sfdat->iomode != PSF_IO_DIRECT || sfdat->isstream || sfdat->file==NULL)
+		return;
+	fd = fileno(sfdat->file);
+	if(fflush(sfdat->file) || (!sfdat->isRead && fdatasync(fd)))
+		return;
+	if(sfdat->mapbase){
+		munmap(sfdat->mapbase,sfdat->maplen);
+		sfdat->mapbase = NULL;
+		sfdat->mapdata = NULL;
+	}
+	posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+}
+
+static void psf_ioAdvise(PSFFILE *sfdat)
+{
+	if(sfdat->iomode != PSF_IO_DIRECT || sfdat->isstream)
+		return;
+	sfdat->iodone = 0;
+	sfdat->trimpos = 0;
+	posix_fadvise(fileno(sfdat->file),0,0,POSIX_FADV_SEQUENTIAL);
+	if(sfdat->mapbase)
+		madvise(sfdat->mapbase,sfdat->maplen,MADV_SEQUENTIAL);
+}
+#else
+/* no cache advice: PSF_IO_DIRECT is just PSF_IO_BUFFERED */
+static void psf_ioTrim(PSFFILE *sfdat, DWORD nbytes)	{ }
+static void psf_ioDrop(PSFFILE *sfdat)	{ }
+static void psf_ioAdvise(PSFFILE *sfdat)	{ }
+#endif
+
+static int psf_setIO(PSFFILE *sfdat, int mode, DWORD bufsize)
+{
+	fpos_t pos;
+	char *vbuf = NULL;
+	int rc;
+
+	if(mode < PSF_IO_DEFAULT || mode > PSF_IO_DIRECT)
+		return PSF_E_BADARG;
+	/* the reader and writer threads use the FILE too */
+	rc = psf_raStop(sfdat);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	rc = psf_asyncSync(sfdat);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	if(fflush(sfdat->file))
+		return PSF_E_CANT_WRITE;
+	if(!sfdat->isstream && fgetpos(sfdat->file,&pos))
+		return PSF_E_CANT_SEEK;
+	if(mode != PSF_IO_DEFAULT){
+		if(bufsize==0)
+			bufsize = PSF_IO_DEFBUFSIZE;
+		bufsize = (bufsize + PSF_IO_ALIGN - 1) / PSF_IO_ALIGN * PSF_IO_ALIGN;
+#ifdef unix
+		if(posix_memalign((void **) &vbuf,PSF_IO_ALIGN,bufsize))
+			vbuf = NULL;
+#else
+		vbuf = (char *) malloc(bufsize);
+#endif
+		if(vbuf==NULL)
+			return PSF_E_NOMEM;
+	}
+	if(setvbuf(sfdat->file,vbuf,_IOFBF,vbuf ? bufsize : BUFSIZ)){
+		free(vbuf);
+		return PSF_E_NOMEM;
+	}
+	free(sfdat->vbuf);
+	sfdat->vbuf = vbuf;
+	sfdat->iomode = mode;
+	if(!sfdat->isstream && fsetpos(sfdat->file,&pos))
+		return PSF_E_CANT_SEEK;
+	psf_ioAdvise(sfdat);
+	return PSF_E_NOERROR;
+}
+
+int psf_sndSetIO(int sfd, int mode, DWORD bufsize)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_setIO(sfdat,mode,bufsize);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/******** statistics (psf_sndGetStats) ***********/
+/* The caller counts its own I/O in wavDoRead and wavDoWrite, adding it to callnanos, so each
+   public frames call can put the rest of its time down to conversion. The reader and writer
+   threads count what they do as they go, so the counts have a lock of their own. */
+#ifdef unix
+static psf_int64 psf_nanos(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (psf_int64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#else
+static psf_int64 psf_nanos(void)
+{
+	return (psf_int64)((double) clock() * (1.0e9 / CLOCKS_PER_SEC));
+}
+#endif
+
+/* one read or write of nbytes, which took ionanos, and convnanos converting them */
+static void psf_statsIO(PSFFILE *sfdat, int op, psf_int64 nbytes, psf_int64 ionanos, psf_int64 convnanos)
+{
+	psf_lockStats(sfdat);
+	if(op==PSF_OP_READ){
+		sfdat->stats.nreads++;
+		sfdat->stats.bytesread += nbytes;
+	}
+	else {
+		sfdat->stats.nwrites++;
+		sfdat->stats.byteswritten += nbytes;
+	}
+	sfdat->stats.ionanos += ionanos;
+	sfdat->stats.convnanos += convnanos;
+	psf_unlockStats(sfdat);
+}
+
+static void psf_statsSeek(PSFFILE *sfdat)
+{
+	psf_lockStats(sfdat);
+	sfdat->stats.nseeks++;
+	psf_unlockStats(sfdat);
+}
+
+/* the caller waited nanos for the reader or writer thread */
+static void psf_statsWait(PSFFILE *sfdat, psf_int64 nanos)
+{
+	sfdat->callnanos += nanos;
+	psf_lockStats(sfdat);
+	sfdat->stats.waitnanos += nanos;
+	psf_unlockStats(sfdat);
+}
+
+/* frames read or written by the caller, with convnanos of converting them */
+static void psf_statsFrames(PSFFILE *sfdat, int op, int frames, psf_int64 convnanos)
+{
+	psf_lockStats(sfdat);
+	if(frames > 0){
+		if(op==PSF_OP_READ)
+			sfdat->stats.framesread += frames;
+		else
+			sfdat->stats.frameswritten += frames;
+	}
+	sfdat->stats.convnanos += max(convnanos,0);
+	psf_unlockStats(sfdat);
+}
+
+/* around a public frames call, which returned frames */
+static psf_int64 psf_statsBegin(PSFFILE *sfdat)
+{
+	sfdat->callnanos = 0;
+	return psf_nanos();
+}
+
+static void psf_statsEnd(PSFFILE *sfdat, int op, psf_int64 start, int frames)
+{
+	psf_statsFrames(sfdat,op,frames,psf_nanos() - start - sfdat->callnanos);
+}
+
+/* only the stats lock: any thread may ask, even while another is reading or writing */
+int psf_sndGetStats(int sfd, PSF_STATS *stats)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	PSF_COUNTS counts;
+
+	if(sfdat==NULL || stats==NULL)
+		return PSF_E_BADARG;
+	psf_lockStats(sfdat);
+	counts = sfdat->stats;
+	psf_unlockStats(sfdat);
+	stats->bytesread		= counts.bytesread;
+	stats->byteswritten		= counts.byteswritten;
+	stats->framesread		= counts.framesread;
+	stats->frameswritten	= counts.frameswritten;
+	stats->nreads			= counts.nreads;
+	stats->nwrites			= counts.nwrites;
+	stats->nseeks			= counts.nseeks;
+	stats->iotime			= (double) counts.ionanos * 1.0e-9;
+	stats->convtime			= (double) counts.convnanos * 1.0e-9;
+	stats->waittime			= (double) counts.waitnanos * 1.0e-9;
+	return PSF_E_NOERROR;
+}
+
+/* internal write func: return 0 for success */
+static int wavDoWrite(PSFFILE *sfdat, const void* buf, DWORD nBytes)
+{
+	
+	DWORD written = 0;
+	psf_int64 t;
+	int rc = PSF_E_NOERROR;
+	if(sfdat==NULL || buf==NULL)
+		return PSF_E_BADARG;
+
+	if(sfdat->file==NULL)
+		return PSF_E_CANT_WRITE;
+	t = psf_nanos();
+	/* compressed: the coder writes whole blocks itself */
+	if(sfdat->lac)
+		rc = psf_lacWrite(sfdat->lac,buf,nBytes);
+	else if((written = fwrite(buf,sizeof(char),nBytes,sfdat->file)) != nBytes) {
+		DBGFPRINTF((stderr, "wavDoWrite: wanted %d got %d.\n",
+                    (int) nBytes,(int) written));
+        return PSF_E_CANT_WRITE;
+    }
+	else
+		psf_ioTrim(sfdat,nBytes);
+	sfdat->lastop  = PSF_OP_WRITE;
+	t = psf_nanos() - t;
+	sfdat->callnanos += t;
+	psf_statsIO(sfdat,PSF_OP_WRITE,nBytes,t,0);
+	return rc;
+}
+
+static int wavDoRead(PSFFILE *sfdat, void* buf, DWORD nBytes)
+{
+	
+	DWORD got = 0;
+	psf_int64 t;
+	int rc = PSF_E_NOERROR;
+	if(sfdat==NULL || buf==NULL)
+		return PSF_E_BADARG;
+	t = psf_nanos();
+	/* mapped file: just copy from the data chunk */
+	if(sfdat->mapdata){
+		if(nBytes > sfdat->mapsize - sfdat->mappos){
+			DBGFPRINTF((stderr, "wavDoRead: wanted %d, only %d left in mapping.\n",
+						(int) nBytes,(int)(sfdat->mapsize - sfdat->mappos)));
+			return PSF_E_CANT_READ;
+		}
+		memcpy(buf,sfdat->mapdata + sfdat->mappos,nBytes);
+		sfdat->mappos += nBytes;
+	}
+	else if(sfdat->file==NULL)
+		return PSF_E_CANT_READ;
+	else if(sfdat->lac)
+		rc = psf_lacRead(sfdat->lac,buf,nBytes);
+	else if((got = fread(buf,sizeof(char),nBytes,sfdat->file)) != nBytes) {
+		DBGFPRINTF((stderr, "wavDoRead: wanted %d got %d.\n",
+                    (int) nBytes,(int) got));
+        return PSF_E_CANT_READ;
+    }
+	else
+		psf_ioTrim(sfdat,nBytes);
+	sfdat->lastop = PSF_OP_READ;
+	t = psf_nanos() - t;
+	sfdat->callnanos += t;
+	psf_statsIO(sfdat,PSF_OP_READ,nBytes,t,0);
+	return rc;
+}
+
+/* get the per-file staging buffer, growing it if necessary. return NULL if no memory */
+/* so each frames call can move the whole block with a single read or write */
+static unsigned char *psf_getIObuf(PSFFILE *sfdat, DWORD nBytes)
+{
+	unsigned char *newbuf;
+
+	if(nBytes <= sfdat->iobufsize)
+		return sfdat->iobuf;
+	newbuf = (unsigned char *) realloc(sfdat->iobuf,nBytes);
+	if(newbuf==NULL)
+		return NULL;
+	sfdat->iobuf = newbuf;
+	sfdat->iobufsize = nBytes;
+	return newbuf;
+}
+
+/******** asynchronous writes (psf_sndSetAsync) ***********/
+/* The caller still tracks peaks and encodes each block, into one of a ring of slots,
+   and a writer thread fwrite()s them in order. Each side owns its own ring index,
+   and the two semaphores count free and filled slots, so the ring needs no lock:
+   the caller only waits when every slot is full. Anything else that touches the file
+   (seek, tell, read, close) first waits for the writer to empty the ring.
+   A write error is kept, and reported by the next write, psf_sndSetAsync or close. */
+#ifdef unix
+typedef struct psf_async {
+	pthread_t		thread;
+	sem_t			freeslots;		/* slots the caller may fill */
+	sem_t			fullslots;		/* slots waiting for the writer */
+	int				nslots;
+	unsigned char	**slot;
+	DWORD			*slotsize;		/* allocated */
+	DWORD			*slotbytes;		/* queued; 0 tells the writer to quit */
+	int				head;			/* next slot to fill: caller only */
+	int				tail;			/* next slot to write: writer only */
+	int				err;			/* set by the writer only: psf_storeRelease/psf_loadAcquire */
+} PSF_ASYNC;
+
+static void *psf_asyncWriter(void *arg)
+{
+	PSFFILE *sfdat = (PSFFILE *) arg;
+	PSF_ASYNC *as = sfdat->async;
+	DWORD nbytes;
+	psf_int64 t;
+	int rc;
+
+	for(;;){
+		sem_wait(&as->fullslots);
+		nbytes = as->slotbytes[as->tail];
+		if(nbytes==0)
+			break;
+		t = psf_nanos();
+		/* (a PSF_LAC file is compressed here, off the caller's thread) */
+		if(as->err==PSF_E_NOERROR && sfdat->lac){
+			if((rc = psf_lacWrite(sfdat->lac,as->slot[as->tail],nbytes)) < PSF_E_NOERROR)
+				psf_storeRelease(&as->err,rc);
+		}
+		else if(as->err==PSF_E_NOERROR
+			&& fwrite(as->slot[as->tail],sizeof(char),nbytes,sfdat->file) != nbytes)
+			psf_storeRelease(&as->err,PSF_E_CANT_WRITE);
+		psf_ioTrim(sfdat,nbytes);
+		psf_statsIO(sfdat,PSF_OP_WRITE,nbytes,psf_nanos() - t,0);
+		as->tail = (as->tail + 1) % as->nslots;
+		sem_post(&as->freeslots);
+	}
+	return NULL;
+}
+
+/* the caller's sem_wait: any time spent waiting for the thread is counted */
+static void psf_semWait(PSFFILE *sfdat, sem_t *sem)
+{
+	psf_int64 t;
+
+	if(sem_trywait(sem)==0)
+		return;
+	t = psf_nanos();
+	sem_wait(sem);
+	psf_statsWait(sfdat,psf_nanos() - t);
+}
+
+/* wait for the writer to finish everything queued. Return any write error */
+static int psf_asyncSync(PSFFILE *sfdat)
+{
+	PSF_ASYNC *as = sfdat->async;
+	int i;
+
+	if(as==NULL)
+		return PSF_E_NOERROR;
+	for(i=0;i < as->nslots;i++)
+		psf_semWait(sfdat,&as->freeslots);
+	for(i=0;i < as->nslots;i++)
+		sem_post(&as->freeslots);
+	return as->err;
+}
+
+/* get the next free slot, with room for nBytes: may wait for the writer */
+static unsigned char *psf_asyncSlot(PSFFILE *sfdat, DWORD nBytes)
+{
+	PSF_ASYNC *as = sfdat->async;
+	unsigned char *newbuf;
+	int i = as->head;
+
+	psf_semWait(sfdat,&as->freeslots);
+	if(nBytes > as->slotsize[i]){
+		newbuf = (unsigned char *) realloc(as->slot[i],nBytes);
+		if(newbuf==NULL){
+			sem_post(&as->freeslots);
+			return NULL;
+		}
+		as->slot[i] = newbuf;
+		as->slotsize[i] = nBytes;
+	}
+	return as->slot[i];
+}
+
+/* hand the slot from psf_asyncSlot to the writer; nBytes = 0 gives it back unused */
+static int psf_asyncQueue(PSFFILE *sfdat, DWORD nBytes)
+{
+	PSF_ASYNC *as = sfdat->async;
+
+	if(nBytes==0){
+		sem_post(&as->freeslots);
+		return PSF_E_NOERROR;
+	}
+	as->slotbytes[as->head] = nBytes;
+	as->head = (as->head + 1) % as->nslots;
+	sem_post(&as->fullslots);
+	sfdat->lastop = PSF_OP_WRITE;
+	/* no semaphore orders this read against the writer: it may see an error a block late */
+	return psf_loadAcquire(&as->err);
+}
+
+/* drain the queue, stop the writer and free everything. Return any write error */
+static int psf_asyncStop(PSFFILE *sfdat)
+{
+	PSF_ASYNC *as = sfdat->async;
+	int i,rc;
+
+	if(as==NULL)
+		return PSF_E_NOERROR;
+	psf_semWait(sfdat,&as->freeslots);
+	as->slotbytes[as->head] = 0;
+	sem_post(&as->fullslots);
+	pthread_join(as->thread,NULL);
+	rc = as->err;
+	sem_destroy(&as->freeslots);
+	sem_destroy(&as->fullslots);
+	for(i=0;i < as->nslots;i++)
+		free(as->slot[i]);
+	free(as->slot);
+	free(as->slotsize);
+	free(as->slotbytes);
+	free(as);
+	sfdat->async = NULL;
+	return rc;
+}
+
+static int psf_asyncStart(PSFFILE *sfdat, int nslots)
+{
+	PSF_ASYNC *as;
+
+	as = (PSF_ASYNC *) malloc(sizeof(PSF_ASYNC));
+	if(as==NULL)
+		return PSF_E_NOMEM;
+	as->nslots = nslots;
+	as->slot = (unsigned char **) calloc(nslots,sizeof(unsigned char *));
+	as->slotsize = (DWORD *) calloc(nslots,sizeof(DWORD));
+	as->slotbytes = (DWORD *) calloc(nslots,sizeof(DWORD));
+	if(as->slot==NULL || as->slotsize==NULL || as->slotbytes==NULL){
+		free(as->slot);
+		free(as->slotsize);
+		free(as->slotbytes);
+		free(as);
+		return PSF_E_NOMEM;
+	}
+	as->head = as->tail = 0;
+	as->err = PSF_E_NOERROR;
+	/* (unnamed semaphores are not supported everywhere) */
+	if(sem_init(&as->freeslots,0,nslots)){
+		free(as->slot);
+		free(as->slotsize);
+		free(as->slotbytes);
+		free(as);
+		return PSF_E_UNSUPPORTED;
+	}
+	if(sem_init(&as->fullslots,0,0)){
+		sem_destroy(&as->freeslots);
+		free(as->slot);
+		free(as->slotsize);
+		free(as->slotbytes);
+		free(as);
+		return PSF_E_UNSUPPORTED;
+	}
+	/* flush anything stdio is holding from the caller's side first */
+	fflush(sfdat->file);
+	sfdat->async = as;
+	if(pthread_create(&as->thread,NULL,psf_asyncWriter,sfdat)){
+		sfdat->async = NULL;
+		sem_destroy(&as->freeslots);
+		sem_destroy(&as->fullslots);
+		free(as->slot);
+		free(as->slotsize);
+		free(as->slotbytes);
+		free(as);
+		return PSF_E_UNSUPPORTED;
+	}
+	return PSF_E_NOERROR;
+}
+#else
+/* no threads: every write is synchronous */
+static int psf_asyncSync(PSFFILE *sfdat)	{ return PSF_E_NOERROR; }
+static int psf_asyncStop(PSFFILE *sfdat)	{ return PSF_E_NOERROR; }
+static unsigned char *psf_asyncSlot(PSFFILE *sfdat, DWORD nBytes) { return NULL; }
+static int psf_asyncQueue(PSFFILE *sfdat, DWORD nBytes) { return PSF_E_UNSUPPORTED; }
+#endif
+
+static int psf_setAsync(PSFFILE *sfdat, int nblocks)
+{
+	int rc;
+
+	if(nblocks < 0)
+		return PSF_E_BADARG;
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	rc = psf_asyncStop(sfdat);
+	if(rc < PSF_E_NOERROR || nblocks==0)
+		return rc;
+#ifdef unix
+	return psf_asyncStart(sfdat,nblocks);
+#else
+	return PSF_E_UNSUPPORTED;
+#endif
+}
+
+int psf_sndSetAsync(int sfd, int nblocks)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_setAsync(sfdat,nblocks);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+static int psf_setOverview(PSFFILE *sfdat, DWORD blockframes)
+{
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	if(sfdat->isstream || sfdat->mem)
+		return PSF_E_UNSUPPORTED;
+	if(POS64(sfdat->lastwritepos) != 0 || sfdat->nFrames != 0 || (blockframes & (blockframes - 1)))
+		return PSF_E_BADARG;
+	psf_overviewFree(sfdat->ovw);
+	sfdat->ovw = psf_overviewNew(sfdat->fmt.Format.nChannels,(int) sfdat->fmt.Format.nSamplesPerSec,blockframes);
+	return sfdat->ovw ? PSF_E_NOERROR : PSF_E_NOMEM;
+}
+
+int psf_sndSetOverview(int sfd, DWORD blockframes)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_setOverview(sfdat,blockframes);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/******** block decoders: raw samples (file byte order) -> float ***********/
+/* Each decoder runs an SSE2 loop where available, and finishes (or does everything)
+   with a plain loop. Samples are picked up with unaligned loads or memcpy, so src need not be aligned.
+   The scale factors are powers of two, so each result is exactly what
+   (float)((double) samp / MAX_nBIT) gave us before. */
+
+#ifdef __SSE2__
+/* swap the bytes in each 16bit or 32bit lane */
+#define PSF_BSWAP16_SSE(v)	_mm_or_si128(_mm_slli_epi16((v),8),_mm_srli_epi16((v),8))
+#define PSF_BSWAP32_SSE(v)	_mm_shufflehi_epi16(_mm_shufflelo_epi16(PSF_BSWAP16_SSE(v),0xB1),0xB1)
+#endif
+
+static void psf_decode16(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const float fac = (float)(1.0 / MAX_16BIT);
+#ifdef __SSE2__
+	const __m128 vfac = _mm_set1_ps(fac);
+
+	for(;i + 8 <= nsamps;i += 8){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(short)));
+		if(do_reverse)
+			v = PSF_BSWAP16_SSE(v);
+		/* sign-extend to 32 bits: put each short in the top half, then shift back down */
+		_mm_storeu_ps(dst + i,    _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v,v),16)),vfac));
+		_mm_storeu_ps(dst + i + 4,_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v,v),16)),vfac));
+	}
+#endif
+	if(do_reverse){
+		for(;i < nsamps;i++){
+			unsigned short wsamp;
+			memcpy(&wsamp,src + i * sizeof(short),sizeof(short));
+			wsamp = (unsigned short) REVWBYTES(wsamp);
+			dst[i] = (float)(short) wsamp * fac;
+		}
+	}
+	else {
+		for(;i < nsamps;i++){
+			short ssamp;
+			memcpy(&ssamp,src + i * sizeof(short),sizeof(short));
+			dst[i] = (float) ssamp * fac;
+		}
+	}
+}
+
+/* 24bit is assembled bytewise, so we only need to know the file byte order:
+   do_shift is set for (little-endian) WAVE, as elsewhere */
+/* no SSE2 version: repacking 3-byte samples wants a byte shuffle (SSSE3) */
+static void psf_decode24(float *dst, const unsigned char *src, DWORD nsamps, int do_shift)
+{
+	DWORD i;
+	const float fac = (float)(1.0 / MAX_32BIT);
+
+	if(do_shift){
+		for(i=0;i < nsamps;i++, src += 3){
+			int lsamp = (int)(((DWORD) src[0] << 8) | ((DWORD) src[1] << 16) | ((DWORD) src[2] << 24));
+			dst[i] = (float) lsamp * fac;
+		}
+	}
+	else {
+		for(i=0;i < nsamps;i++, src += 3){
+			int lsamp = (int)(((DWORD) src[2] << 8) | ((DWORD) src[1] << 16) | ((DWORD) src[0] << 24));
+			dst[i] = (float) lsamp * fac;
+		}
+	}
+}
+
+static void psf_decode32(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const float fac = (float)(1.0 / MAX_32BIT);
+#ifdef __SSE2__
+	const __m128 vfac = _mm_set1_ps(fac);
+
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(int)));
+		if(do_reverse)
+			v = PSF_BSWAP32_SSE(v);
+		_mm_storeu_ps(dst + i,_mm_mul_ps(_mm_cvtepi32_ps(v),vfac));
+	}
+#endif
+	if(do_reverse){
+		for(;i < nsamps;i++){
+			DWORD dwsamp;
+			memcpy(&dwsamp,src + i * sizeof(int),sizeof(int));
+			dwsamp = REVDWBYTES(dwsamp);
+			dst[i] = (float)(int) dwsamp * fac;
+		}
+	}
+	else {
+		for(;i < nsamps;i++){
+			int lsamp;
+			memcpy(&lsamp,src + i * sizeof(int),sizeof(int));
+			dst[i] = (float) lsamp * fac;
+		}
+	}
+}
+
+/* byte-reversed floats; native floats are read straight into the user buffer */
+static void psf_decodeFloatRev(float *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(float)));
+		_mm_storeu_si128((__m128i *)(dst + i),PSF_BSWAP32_SSE(v));
+	}
+#endif
+	for(;i < nsamps;i++){
+		DWORD dwsamp;
+		memcpy(&dwsamp,src + i * sizeof(float),sizeof(float));
+		dwsamp = REVDWBYTES(dwsamp);
+		memcpy(dst + i,&dwsamp,sizeof(float));
+	}
+}
+
+static void psf_scaleFloats(float *buf, DWORD nsamps, float fac)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	const __m128 vfac = _mm_set1_ps(fac);
+
+	for(;i + 4 <= nsamps;i += 4)
+		_mm_storeu_ps(buf + i,_mm_mul_ps(_mm_loadu_ps(buf + i),vfac));
+#endif
+	for(;i < nsamps;i++)
+		buf[i] *= fac;
+}
+
+/* the same decoders, to double. Integer samples are converted exactly: 
+   32bit files keep all their bits, where the float decoders round to 24 */
+#ifdef __SSE2__
+/* four ints to four scaled doubles */
+#define PSF_CVTEPI32X4_PD(dst,v,vfac)	\
+	(_mm_storeu_pd((dst),_mm_mul_pd(_mm_cvtepi32_pd(v),(vfac))),	\
+	 _mm_storeu_pd((dst) + 2,_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128((v),8)),(vfac))))
+#endif
+
+static void psf_decode16Double(double *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const double fac = 1.0 / MAX_16BIT;
+#ifdef __SSE2__
+	const __m128d vfac = _mm_set1_pd(fac);
+
+	for(;i + 8 <= nsamps;i += 8){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(short)));
+		if(do_reverse)
+			v = PSF_BSWAP16_SSE(v);
+		PSF_CVTEPI32X4_PD(dst + i,    _mm_srai_epi32(_mm_unpacklo_epi16(v,v),16),vfac);
+		PSF_CVTEPI32X4_PD(dst + i + 4,_mm_srai_epi32(_mm_unpackhi_epi16(v,v),16),vfac);
+	}
+#endif
+	if(do_reverse){
+		for(;i < nsamps;i++){
+			unsigned short wsamp;
+			memcpy(&wsamp,src + i * sizeof(short),sizeof(short));
+			wsamp = (unsigned short) REVWBYTES(wsamp);
+			dst[i] = (double)(short) wsamp * fac;
+		}
+	}
+	else {
+		for(;i < nsamps;i++){
+			short ssamp;
+			memcpy(&ssamp,src + i * sizeof(short),sizeof(short));
+			dst[i] = (double) ssamp * fac;
+		}
+	}
+}
+
+static void psf_decode24Double(double *dst, const unsigned char *src, DWORD nsamps, int do_shift)
+{
+	DWORD i;
+	const double fac = 1.0 / MAX_32BIT;
+
+	if(do_shift){
+		for(i=0;i < nsamps;i++, src += 3){
+			int lsamp = (int)(((DWORD) src[0] << 8) | ((DWORD) src[1] << 16) | ((DWORD) src[2] << 24));
+			dst[i] = (double) lsamp * fac;
+		}
+	}
+	else {
+		for(i=0;i < nsamps;i++, src += 3){
+			int lsamp = (int)(((DWORD) src[2] << 8) | ((DWORD) src[1] << 16) | ((DWORD) src[0] << 24));
+			dst[i] = (double) lsamp * fac;
+		}
+	}
+}
+
+static void psf_decode32Double(double *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const double fac = 1.0 / MAX_32BIT;
+#ifdef __SSE2__
+	const __m128d vfac = _mm_set1_pd(fac);
+
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(int)));
+		if(do_reverse)
+			v = PSF_BSWAP32_SSE(v);
+		PSF_CVTEPI32X4_PD(dst + i,v,vfac);
+	}
+#endif
+	if(do_reverse){
+		for(;i < nsamps;i++){
+			DWORD dwsamp;
+			memcpy(&dwsamp,src + i * sizeof(int),sizeof(int));
+			dwsamp = REVDWBYTES(dwsamp);
+			dst[i] = (double)(int) dwsamp * fac;
+		}
+	}
+	else {
+		for(;i < nsamps;i++){
+			int lsamp;
+			memcpy(&lsamp,src + i * sizeof(int),sizeof(int));
+			dst[i] = (double) lsamp * fac;
+		}
+	}
+}
+
+/* floats in either byte order, widened and scaled (fac = 1.0 for no rescale) */
+static void psf_decodeFloatDouble(double *dst, const unsigned char *src, DWORD nsamps, int do_reverse, double fac)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	const __m128d vfac = _mm_set1_pd(fac);
+
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(float)));
+		__m128 f;
+		if(do_reverse)
+			v = PSF_BSWAP32_SSE(v);
+		f = _mm_castsi128_ps(v);
+		_mm_storeu_pd(dst + i,    _mm_mul_pd(_mm_cvtps_pd(f),vfac));
+		_mm_storeu_pd(dst + i + 2,_mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(f,f)),vfac));
+	}
+#endif
+	for(;i < nsamps;i++){
+		DWORD dwsamp;
+		float fsamp;
+		memcpy(&dwsamp,src + i * sizeof(float),sizeof(float));
+		if(do_reverse)
+			dwsamp = REVDWBYTES(dwsamp);
+		memcpy(&fsamp,&dwsamp,sizeof(float));
+		dst[i] = (double) fsamp * fac;
+	}
+}
+
+static float *psf_getFloatBuf(PSFFILE *sfdat, DWORD nsamps)
+{
+	float *newbuf;
+
+	if(nsamps <= sfdat->fltbufsize)
+		return sfdat->fltbuf;
+	newbuf = (float *) realloc(sfdat->fltbuf,nsamps * sizeof(float));
+	if(newbuf==NULL)
+		return NULL;
+	sfdat->fltbuf = newbuf;
+	sfdat->fltbufsize = nsamps;
+	return newbuf;
+}
+
+/******** dither ***********/
+/* Each file has four xorshift32 generators, stepped together (one per SSE2 lane), so the SSE2
+   and plain loops make the same noise, four samples at a time. A uniform [0,1) float comes from
+   the top 23 bits; TPDF noise is the sum of two, less one, on (-1,1) as trirand() gave.
+   PSF_DITHER_SHAPED feeds the quantization error back through Lipshitz's 5-tap filter, 
+   pushing the noise up to where the ear is least sensitive (designed for 44.1kHz). */
+#define PSF_SHAPETAPS	(5)
+static const float psf_shapecoefs[PSF_SHAPETAPS] = { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f };
+
+static void psf_ditherSeed(PSFFILE *sfdat, unsigned int seed)
+{
+	int k;
+
+	for(k=0;k < 4;k++){
+		unsigned int x = (seed * 4 + k + 1) * 0x9e3779b9u;
+		x ^= x >> 16;
+		sfdat->ditherstate[k] = x ? x : 0x2545f491u;
+	}
+}
+
+#ifdef __SSE2__
+static __m128i psf_xorshift_sse(__m128i x)
+{
+	x = _mm_xor_si128(x,_mm_slli_epi32(x,13));
+	x = _mm_xor_si128(x,_mm_srli_epi32(x,17));
+	return _mm_xor_si128(x,_mm_slli_epi32(x,5));
+}
+
+static __m128 psf_uniform_sse(__m128i x)
+{
+	return _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(x,9),_mm_set1_epi32(0x3f800000))),
+					  _mm_set1_ps(1.0f));
+}
+#else
+static float psf_uniform(unsigned int x)
+{
+	unsigned int bits = (x >> 9) | 0x3f800000u;
+	float f;
+
+	memcpy(&f,&bits,sizeof(float));
+	return f - 1.0f;
+}
+#endif
+
+/* return nsamps of TPDF noise, in the file's buffer (rounded up to four) */
+static const float *psf_ditherNoise(PSFFILE *sfdat, DWORD nsamps)
+{
+	DWORD i,nbuf = (nsamps + 3) & ~3u;
+	unsigned int *state = sfdat->ditherstate;
+	float *dst;
+
+	if(nbuf > sfdat->ditherbufsize){
+		dst = (float *) realloc(sfdat->ditherbuf,nbuf * sizeof(float));
+		if(dst==NULL)
+			return NULL;
+		sfdat->ditherbuf = dst;
+		sfdat->ditherbufsize = nbuf;
+	}
+	dst = sfdat->ditherbuf;
+#ifdef __SSE2__
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *) state);
+
+		for(i=0;i < nbuf;i += 4){
+			__m128 u1,u2;
+			x = psf_xorshift_sse(x);
+			u1 = psf_uniform_sse(x);
+			x = psf_xorshift_sse(x);
+			u2 = psf_uniform_sse(x);
+			_mm_storeu_ps(dst + i,_mm_sub_ps(_mm_add_ps(u1,u2),_mm_set1_ps(1.0f)));
+		}
+		_mm_storeu_si128((__m128i *) state,x);
+	}
+#else
+	for(i=0;i < nbuf;i += 4){
+		int k;
+		for(k=0;k < 4;k++){
+			unsigned int x = state[k];
+			float u1,u2;
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			u1 = psf_uniform(x);
+			x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+			u2 = psf_uniform(x);
+			state[k] = x;
+			dst[i + k] = (u1 + u2) - 1.0f;
+		}
+	}
+#endif
+	return dst;
+}
+
+/******** block encoders: float -> raw samples (file byte order) ***********/
+/* Same scheme as the decoders. Samples are clipped to +-1 as they always were, 
+   rounded as psf_round() does (half away from zero), and saturated at +full scale:
+   a sample of 1.0 used to wrap round to -full scale in the integer formats.
+   The SSE2 loops work in single precision, taking care to round exactly as the
+   double precision scalar loops do. */
+
+#define PSF_CLIPF(f)	(max(min((f),1.0f),-1.0f))
+#define PSF_RNDOFF(d)	((d) < 0.0 ? -0.5 : 0.5)
+
+#ifdef __SSE2__
+/* clip four floats and scale them */
+static __m128 psf_clipscale_sse(__m128 f, __m128 scale)
+{
+	f = _mm_max_ps(_mm_min_ps(f,_mm_set1_ps(1.0f)),_mm_set1_ps(-1.0f));
+	return _mm_mul_ps(f,scale);
+}
+
+/* 16bit: adding +-0.5 before truncation is exact in single precision at this scale */
+static __m128i psf_round16_sse(__m128 f)
+{
+	return _mm_cvttps_epi32(_mm_add_ps(f,_mm_or_ps(_mm_and_ps(f,_mm_set1_ps(-0.0f)),_mm_set1_ps(0.5f))));
+}
+
+/* 32bit: f + 0.5 can round up in single precision, so truncate first and 
+   look at the (exact) fractional part. +full scale saturates to 0x7fffffff. */
+static __m128i psf_round32_sse(__m128 f)
+{
+	__m128i itrunc = _mm_cvttps_epi32(f);
+	__m128 frac = _mm_sub_ps(f,_mm_cvtepi32_ps(itrunc));
+	__m128i up = _mm_castps_si128(_mm_cmpge_ps(frac,_mm_set1_ps(0.5f)));
+	__m128i down = _mm_castps_si128(_mm_cmple_ps(frac,_mm_set1_ps(-0.5f)));
+	__m128i ovf = _mm_castps_si128(_mm_cmpge_ps(f,_mm_set1_ps((float) MAX_32BIT)));
+
+	itrunc = _mm_add_epi32(_mm_sub_epi32(itrunc,up),down);
+	return _mm_or_si128(_mm_andnot_si128(ovf,itrunc),_mm_and_si128(ovf,_mm_set1_epi32(0x7fffffff)));
+}
+#endif
+
+/* noise (from psf_ditherNoise) is NULL for no dither. Dithered samples are scaled to 32766,
+   leaving room for the noise, and worked in single precision by both loops */
+static void psf_encode16(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse, const float *noise)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	{
+		const __m128 scale = _mm_set1_ps(noise ? 32766.0f : (float) MAX_16BIT);
+		const __m128 two = _mm_set1_ps(2.0f);
+
+		for(;i + 8 <= nsamps;i += 8){
+			__m128 flo = psf_clipscale_sse(_mm_loadu_ps(src + i),scale);
+			__m128 fhi = psf_clipscale_sse(_mm_loadu_ps(src + i + 4),scale);
+			__m128i lo,hi,v;
+			if(noise){
+				flo = _mm_add_ps(flo,_mm_mul_ps(two,_mm_loadu_ps(noise + i)));
+				fhi = _mm_add_ps(fhi,_mm_mul_ps(two,_mm_loadu_ps(noise + i + 4)));
+			}
+			lo = psf_round16_sse(flo);
+			hi = psf_round16_sse(fhi);
+			/* packs saturates +32768 to 32767 for us */
+			v = _mm_packs_epi32(lo,hi);
+			if(do_reverse)
+				v = PSF_BSWAP16_SSE(v);
+			_mm_storeu_si128((__m128i *)(dst + i * sizeof(short)),v);
+		}
+	}
+#endif
+	for(;i < nsamps;i++){
+		float fsamp = PSF_CLIPF(src[i]);
+		unsigned short wsamp;
+		if(noise){
+			fsamp = fsamp * 32766.0f + 2.0f * noise[i];
+			fsamp += fsamp < 0.0f ? -0.5f : 0.5f;
+			wsamp = (unsigned short)(short) max(min((int) fsamp,32767),-32768);
+		}
+		else {
+			double dsamp = fsamp * MAX_16BIT;
+			dsamp = min(dsamp + PSF_RNDOFF(dsamp),32767.0);
+			wsamp = (unsigned short)(short)(int) dsamp;
+		}
+		if(do_reverse)
+			wsamp = (unsigned short) REVWBYTES(wsamp);
+		memcpy(dst + i * sizeof(short),&wsamp,sizeof(short));
+	}
+}
+
+/* noise-shaped: each sample depends on the last errors in its channel, so this one is serial.
+   err holds PSF_SHAPETAPS errors per channel, newest first; 
+   the error is taken before saturation, so clipping cannot run the filter away */
+static void psf_encode16Shaped(unsigned char *dst, const float *src, DWORD nsamps, int chans, 
+							   int do_reverse, const float *noise, float *err)
+{
+	DWORD i;
+	int j,ch = 0;
+
+	for(i=0;i < nsamps;i++){
+		float *e = err + ch * PSF_SHAPETAPS;
+		float want = PSF_CLIPF(src[i]) * 32766.0f;
+		int isamp;
+		unsigned short wsamp;
+
+		for(j=0;j < PSF_SHAPETAPS;j++)
+			want -= psf_shapecoefs[j] * e[j];
+		{
+			float fsamp = want + 2.0f * noise[i];
+			isamp = (int)(fsamp + (fsamp < 0.0f ? -0.5f : 0.5f));
+		}
+		for(j=PSF_SHAPETAPS-1;j > 0;j--)
+			e[j] = e[j-1];
+		e[0] = (float) isamp - want;
+		wsamp = (unsigned short)(short) max(min(isamp,32767),-32768);
+		if(do_reverse)
+			wsamp = (unsigned short) REVWBYTES(wsamp);
+		memcpy(dst + i * sizeof(short),&wsamp,sizeof(short));
+		if(++ch == chans)
+			ch = 0;
+	}
+}
+
+/* do_shift set for (little-endian) WAVE; bytes are stored individually, so no do_reverse */
+static void psf_encode24(unsigned char *dst, const float *src, DWORD nsamps, int do_shift)
+{
+	DWORD i = 0;
+	DWORD dwsamp;
+#ifdef __SSE2__
+	const __m128 scale = _mm_set1_ps((float) MAX_32BIT);
+	int j,lsamps[4];
+
+	for(;i + 4 <= nsamps;i += 4){
+		_mm_storeu_si128((__m128i *) lsamps,psf_round32_sse(psf_clipscale_sse(_mm_loadu_ps(src + i),scale)));
+		for(j=0;j < 4;j++, dst += 3){
+			dwsamp = (DWORD) lsamps[j];
+			dst[0] = (unsigned char)(dwsamp >> (do_shift ? 8 : 24));
+			dst[1] = (unsigned char)(dwsamp >> 16);
+			dst[2] = (unsigned char)(dwsamp >> (do_shift ? 24 : 8));
+		}
+	}
+#endif
+	for(;i < nsamps;i++, dst += 3){
+		float fsamp = PSF_CLIPF(src[i]);
+		double dsamp = fsamp * MAX_32BIT;
+		dsamp = min(dsamp + PSF_RNDOFF(dsamp),MAX_32BIT - 1.0);
+		dwsamp = (DWORD)(int) dsamp;
+		dst[0] = (unsigned char)(dwsamp >> (do_shift ? 8 : 24));
+		dst[1] = (unsigned char)(dwsamp >> 16);
+		dst[2] = (unsigned char)(dwsamp >> (do_shift ? 24 : 8));
+	}
+}
+
+static void psf_encode32(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	const __m128 scale = _mm_set1_ps((float) MAX_32BIT);
+
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = psf_round32_sse(psf_clipscale_sse(_mm_loadu_ps(src + i),scale));
+		if(do_reverse)
+			v = PSF_BSWAP32_SSE(v);
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(int)),v);
+	}
+#endif
+	for(;i < nsamps;i++){
+		float fsamp = PSF_CLIPF(src[i]);
+		double dsamp = fsamp * MAX_32BIT;
+		DWORD dwsamp;
+		dsamp = min(dsamp + PSF_RNDOFF(dsamp),MAX_32BIT - 1.0);
+		dwsamp = (DWORD)(int) dsamp;
+		if(do_reverse)
+			dwsamp = REVDWBYTES(dwsamp);
+		memcpy(dst + i * sizeof(int),&dwsamp,sizeof(int));
+	}
+}
+
+/* doubles for 24 and 32bit files go straight to integers, rounding as the scalar float loops do,
+   so no precision is lost on the way through float. 24bit keeps the top 24 bits, as before. */
+#ifdef __SSE2__
+/* clip, scale, and round two doubles (half away from zero), +full scale saturating to 0x7fffffff.
+   All exact in double precision. The two ints are in the low half. */
+static __m128i psf_round32_sse2d(__m128d d)
+{
+	const __m128d sign = _mm_set1_pd(-0.0);
+
+	d = _mm_max_pd(_mm_min_pd(d,_mm_set1_pd(1.0)),_mm_set1_pd(-1.0));
+	d = _mm_mul_pd(d,_mm_set1_pd(MAX_32BIT));
+	d = _mm_add_pd(d,_mm_or_pd(_mm_and_pd(d,sign),_mm_set1_pd(0.5)));
+	d = _mm_min_pd(d,_mm_set1_pd(MAX_32BIT - 1.0));
+	return _mm_cvttpd_epi32(d);
+}
+
+/* four doubles to four ints */
+#define PSF_ROUND32X4_SSE2D(src)	\
+	_mm_unpacklo_epi64(psf_round32_sse2d(_mm_loadu_pd(src)),psf_round32_sse2d(_mm_loadu_pd((src) + 2)))
+#endif
+
+static DWORD psf_round32d(double dsamp)
+{
+	dsamp = max(min(dsamp,1.0),-1.0) * MAX_32BIT;
+	dsamp = min(dsamp + PSF_RNDOFF(dsamp),MAX_32BIT - 1.0);
+	return (DWORD)(int) dsamp;
+}
+
+static void psf_encode24Double(unsigned char *dst, const double *src, DWORD nsamps, int do_shift)
+{
+	DWORD i = 0;
+	DWORD dwsamp;
+#ifdef __SSE2__
+	int j,lsamps[4];
+
+	for(;i + 4 <= nsamps;i += 4){
+		_mm_storeu_si128((__m128i *) lsamps,PSF_ROUND32X4_SSE2D(src + i));
+		for(j=0;j < 4;j++, dst += 3){
+			dwsamp = (DWORD) lsamps[j];
+			dst[0] = (unsigned char)(dwsamp >> (do_shift ? 8 : 24));
+			dst[1] = (unsigned char)(dwsamp >> 16);
+			dst[2] = (unsigned char)(dwsamp >> (do_shift ? 24 : 8));
+		}
+	}
+#endif
+	for(;i < nsamps;i++, dst += 3){
+		dwsamp = psf_round32d(src[i]);
+		dst[0] = (unsigned char)(dwsamp >> (do_shift ? 8 : 24));
+		dst[1] = (unsigned char)(dwsamp >> 16);
+		dst[2] = (unsigned char)(dwsamp >> (do_shift ? 24 : 8));
+	}
+}
+
+static void psf_encode32Double(unsigned char *dst, const double *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = PSF_ROUND32X4_SSE2D(src + i);
+		if(do_reverse)
+			v = PSF_BSWAP32_SSE(v);
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(int)),v);
+	}
+#endif
+	for(;i < nsamps;i++){
+		DWORD dwsamp = psf_round32d(src[i]);
+		if(do_reverse)
+			dwsamp = REVDWBYTES(dwsamp);
+		memcpy(dst + i * sizeof(int),&dwsamp,sizeof(int));
+	}
+}
+
+/* doubles to floats, for PEAK data and the float and 16bit encoders; clipped for float files with clip_floats */
+static void psf_narrowDoubles(float *dst, const double *src, DWORD nsamps, int clip)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	const __m128 one = _mm_set1_ps(1.0f),minusone = _mm_set1_ps(-1.0f);
+
+	for(;i + 4 <= nsamps;i += 4){
+		__m128 f = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(src + i)),_mm_cvtpd_ps(_mm_loadu_pd(src + i + 2)));
+		if(clip)
+			f = _mm_max_ps(_mm_min_ps(f,one),minusone);
+		_mm_storeu_ps(dst + i,f);
+	}
+#endif
+	if(clip){
+		for(;i < nsamps;i++){
+			float fsamp = (float) src[i];
+			dst[i] = PSF_CLIPF(fsamp);
+		}
+	}
+	else {
+		for(;i < nsamps;i++)
+			dst[i] = (float) src[i];
+	}
+}
+
+/* floats are written as given: clip_floats only affects the PEAK data, as it always has */
+static void psf_encodeFloatRev(unsigned char *dst, const float *src, DWORD nsamps)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(float)),PSF_BSWAP32_SSE(v));
+	}
+#endif
+	for(;i < nsamps;i++){
+		DWORD dwsamp;
+		memcpy(&dwsamp,src + i,sizeof(float));
+		dwsamp = REVDWBYTES(dwsamp);
+		memcpy(dst + i * sizeof(float),&dwsamp,sizeof(float));
+	}
+}
+
+/* update PEAK data for a block; integer formats are clipped, so their peaks are too.
+   We find each channel's max over the whole block, and only if that beats the
+   current peak go back for the first frame holding it: the same result as testing
+   every sample in turn. NaNs never count, as before. */
+
+#define PSF_ABSCLIP(f,clip)	((float) fabs((double)((clip) ? PSF_CLIPF(f) : (f))))
+/* most channels handled by the SSE2 scan; more than that, and we do it sample by sample */
+#define PSF_PEAKVECS	(64)
+
+/* the per-channel maxima of the first frames of a block, into maxes[chans]. Returns the frames done:
+   what is left over (or the lot, with too many channels) is for psf_trackPeaks to finish */
+static DWORD psf_peakScan(float *maxes, const float *buf, DWORD nFrames, int chans, int clip)
+{
+	DWORD done = 0;
+#ifdef __SSE2__
+	__m128 acc[PSF_PEAKVECS];
+	float lanes[4 * PSF_PEAKVECS];
+	DWORD i;
+	int j,k;
+
+	/* four frames = chans vectors, so lane n of the accumulators always sees channel n % chans */
+	if(chans <= PSF_PEAKVECS){
+		const __m128 signbit = _mm_set1_ps(-0.0f);
+		const __m128 one = _mm_set1_ps(1.0f), minusone = _mm_set1_ps(-1.0f);
+		const float *pbuf = buf;
+
+		done = nFrames & ~3;
+		for(k=0;k < chans;k++)
+			acc[k] = _mm_setzero_ps();
+		for(i=0;i < done;i += 4, pbuf += 4 * chans){
+			for(k=0;k < chans;k++){
+				__m128 f = _mm_loadu_ps(pbuf + 4 * k);
+				if(clip)
+					f = _mm_max_ps(_mm_min_ps(f,one),minusone);
+				/* max_ps returns the second operand if either is NaN */
+				acc[k] = _mm_max_ps(_mm_andnot_ps(signbit,f),acc[k]);
+			}
+		}
+		for(k=0;k < chans;k++)
+			_mm_storeu_ps(lanes + 4 * k,acc[k]);
+		for(j=0;j < chans;j++){
+			maxes[j] = 0.0f;
+			for(k=j;k < 4 * chans;k += chans)
+				if(lanes[k] > maxes[j])
+					maxes[j] = lanes[k];
+		}
+	}
+#endif
+	return done;
+}
+
+/******** kernel dispatch ***********/
+/* The block kernels above are built for the baseline ISA (SSE2 on x86-64), as the library always was.
+   On x86 builds with gcc or clang there are AVX2 and AVX-512 versions too, compiled with target
+   attributes: psf_init() asks the CPU what it has and points psf_kern at the widest set it can run, so one
+   binary runs at full speed anywhere. Each wide kernel does the bulk of the block, and passes the rest
+   to the next one down. They all give exactly the same samples as the baseline, and so as the plain C loops.
+   PSF_KERNELS=sse2 or PSF_KERNELS=avx2 in the environment caps the choice. */
+
+typedef struct psf_kernels {
+	const char	*name;
+	void	(*decode16)(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse);
+	void	(*decode24)(float *dst, const unsigned char *src, DWORD nsamps, int do_shift);
+	void	(*decode32)(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse);
+	void	(*decodeFloatRev)(float *dst, const unsigned char *src, DWORD nsamps);
+	void	(*encode16)(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse, const float *noise);
+	void	(*encode24)(unsigned char *dst, const float *src, DWORD nsamps, int do_shift);
+	void	(*encode32)(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse);
+	void	(*encodeFloatRev)(unsigned char *dst, const float *src, DWORD nsamps);
+	void	(*swap16)(unsigned char *dst, const unsigned char *src, DWORD nsamps);
+	void	(*swap32)(unsigned char *dst, const unsigned char *src, DWORD nsamps);
+	DWORD	(*peakScan)(float *maxes, const float *buf, DWORD nFrames, int chans, int clip);
+	void	(*deinterleave)(float *const *dst, DWORD offset, const float *src, DWORD nFrames, int chans);
+	void	(*interleave)(float *dst, const float *const *src, DWORD offset, DWORD nFrames, int chans);
+} PSF_KERNELS;
+
+/* defined with the planar and integer frames */
+static void psf_deinterleave(float *const *dst, DWORD offset, const float *src, DWORD nFrames, int chans);
+static void psf_interleave(float *dst, const float *const *src, DWORD offset, DWORD nFrames, int chans);
+static void psf_swap16(unsigned char *dst, const unsigned char *src, DWORD nsamps);
+static void psf_swap32(unsigned char *dst, const unsigned char *src, DWORD nsamps);
+
+static const PSF_KERNELS psf_kernBase = {
+#ifdef __SSE2__
+	"sse2",
+#else
+	"generic",
+#endif
+	psf_decode16,psf_decode24,psf_decode32,psf_decodeFloatRev,
+	psf_encode16,psf_encode24,psf_encode32,psf_encodeFloatRev,
+	psf_swap16,psf_swap32,psf_peakScan,psf_deinterleave,psf_interleave
+};
+
+#ifdef PSF_DISPATCH
+#define PSF_AVX2	__attribute__((target("avx2")))
+#define PSF_AVX512	__attribute__((target("avx512f,avx512bw")))
+
+/* byte shuffles for the swaps, the same in each 128bit lane */
+#define PSF_SWAP16_MASK	15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0
+#define PSF_REV16_MASK	1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14
+#define PSF_REV32_MASK	3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12
+
+PSF_AVX2 static __m256i psf_bswap16_avx2(__m256i v)
+{
+	return _mm256_shuffle_epi8(v,_mm256_setr_epi8(PSF_REV16_MASK,PSF_REV16_MASK));
+}
+
+PSF_AVX2 static __m256i psf_bswap32_avx2(__m256i v)
+{
+	return _mm256_shuffle_epi8(v,_mm256_setr_epi8(PSF_REV32_MASK,PSF_REV32_MASK));
+}
+
+PSF_AVX2 static __m256 psf_clipscale_avx2(__m256 f, __m256 scale)
+{
+	f = _mm256_max_ps(_mm256_min_ps(f,_mm256_set1_ps(1.0f)),_mm256_set1_ps(-1.0f));
+	return _mm256_mul_ps(f,scale);
+}
+
+/* as psf_round16_sse and psf_round32_sse */
+PSF_AVX2 static __m256i psf_round16_avx2(__m256 f)
+{
+	return _mm256_cvttps_epi32(_mm256_add_ps(f,_mm256_or_ps(_mm256_and_ps(f,_mm256_set1_ps(-0.0f)),_mm256_set1_ps(0.5f))));
+}
+
+PSF_AVX2 static __m256i psf_round32_avx2(__m256 f)
+{
+	__m256i itrunc = _mm256_cvttps_epi32(f);
+	__m256 frac = _mm256_sub_ps(f,_mm256_cvtepi32_ps(itrunc));
+	__m256i up = _mm256_castps_si256(_mm256_cmp_ps(frac,_mm256_set1_ps(0.5f),_CMP_GE_OQ));
+	__m256i down = _mm256_castps_si256(_mm256_cmp_ps(frac,_mm256_set1_ps(-0.5f),_CMP_LE_OQ));
+	__m256i ovf = _mm256_castps_si256(_mm256_cmp_ps(f,_mm256_set1_ps((float) MAX_32BIT),_CMP_GE_OQ));
+
+	itrunc = _mm256_add_epi32(_mm256_sub_epi32(itrunc,up),down);
+	return _mm256_blendv_epi8(itrunc,_mm256_set1_epi32(0x7fffffff),ovf);
+}
+
+PSF_AVX2 static void psf_decode16_avx2(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const __m256 vfac = _mm256_set1_ps((float)(1.0 / MAX_16BIT));
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(short)));
+		if(do_reverse)
+			v = psf_bswap16_avx2(v);
+		_mm256_storeu_ps(dst + i,_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v))),vfac));
+		_mm256_storeu_ps(dst + i + 8,_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v,1))),vfac));
+	}
+	psf_decode16(dst + i,src + i * sizeof(short),nsamps - i,do_reverse);
+}
+
+/* eight 3-byte samples a time: the first four from a load at src, the next four from one at src + 8,
+   each byte shuffled to the top of its int, so the load never reaches past the block */
+PSF_AVX2 static void psf_decode24_avx2(float *dst, const unsigned char *src, DWORD nsamps, int do_shift)
+{
+	DWORD i = 0;
+	const __m256 vfac = _mm256_set1_ps((float)(1.0 / MAX_32BIT));
+	const __m256i mask = do_shift ?
+		_mm256_setr_epi8(-1,0,1,2,-1,3,4,5,-1,6,7,8,-1,9,10,11,-1,4,5,6,-1,7,8,9,-1,10,11,12,-1,13,14,15)
+		: _mm256_setr_epi8(-1,2,1,0,-1,5,4,3,-1,8,7,6,-1,11,10,9,-1,6,5,4,-1,9,8,7,-1,12,11,10,-1,15,14,13);
+
+	for(;i + 8 <= nsamps;i += 8, src += 24){
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) src)),
+											_mm_loadu_si128((const __m128i *)(src + 8)),1);
+		_mm256_storeu_ps(dst + i,_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_shuffle_epi8(v,mask)),vfac));
+	}
+	psf_decode24(dst + i,src,nsamps - i,do_shift);
+}
+
+PSF_AVX2 static void psf_decode32_avx2(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const __m256 vfac = _mm256_set1_ps((float)(1.0 / MAX_32BIT));
+
+	for(;i + 8 <= nsamps;i += 8){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(int)));
+		if(do_reverse)
+			v = psf_bswap32_avx2(v);
+		_mm256_storeu_ps(dst + i,_mm256_mul_ps(_mm256_cvtepi32_ps(v),vfac));
+	}
+	psf_decode32(dst + i,src + i * sizeof(int),nsamps - i,do_reverse);
+}
+
+PSF_AVX2 static void psf_swap16_avx2(unsigned char *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(short)));
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(short)),psf_bswap16_avx2(v));
+	}
+	psf_swap16(dst + i * sizeof(short),src + i * sizeof(short),nsamps - i);
+}
+
+PSF_AVX2 static void psf_swap32_avx2(unsigned char *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+
+	for(;i + 8 <= nsamps;i += 8){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(int)));
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(int)),psf_bswap32_avx2(v));
+	}
+	psf_swap32(dst + i * sizeof(int),src + i * sizeof(int),nsamps - i);
+}
+
+/* reversed floats are just swapped words */
+PSF_AVX2 static void psf_decodeFloatRev_avx2(float *dst, const unsigned char *src, DWORD nsamps)
+{
+	psf_swap32_avx2((unsigned char *) dst,src,nsamps);
+}
+
+PSF_AVX2 static void psf_encodeFloatRev_avx2(unsigned char *dst, const float *src, DWORD nsamps)
+{
+	psf_swap32_avx2(dst,(const unsigned char *) src,nsamps);
+}
+
+PSF_AVX2 static void psf_encode16_avx2(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse, const float *noise)
+{
+	DWORD i = 0;
+	const __m256 scale = _mm256_set1_ps(noise ? 32766.0f : (float) MAX_16BIT);
+	const __m256 two = _mm256_set1_ps(2.0f);
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m256 flo = psf_clipscale_avx2(_mm256_loadu_ps(src + i),scale);
+		__m256 fhi = psf_clipscale_avx2(_mm256_loadu_ps(src + i + 8),scale);
+		__m256i v;
+		if(noise){
+			flo = _mm256_add_ps(flo,_mm256_mul_ps(two,_mm256_loadu_ps(noise + i)));
+			fhi = _mm256_add_ps(fhi,_mm256_mul_ps(two,_mm256_loadu_ps(noise + i + 8)));
+		}
+		/* packs works within each 128bit lane, so put the quads back in order after */
+		v = _mm256_packs_epi32(psf_round16_avx2(flo),psf_round16_avx2(fhi));
+		v = _mm256_permute4x64_epi64(v,_MM_SHUFFLE(3,1,2,0));
+		if(do_reverse)
+			v = psf_bswap16_avx2(v);
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(short)),v);
+	}
+	psf_encode16(dst + i * sizeof(short),src + i,nsamps - i,do_reverse,noise ? noise + i : NULL);
+}
+
+/* the top three bytes of each int, packed into the bottom 12 bytes of each lane */
+PSF_AVX2 static void psf_encode24_avx2(unsigned char *dst, const float *src, DWORD nsamps, int do_shift)
+{
+	DWORD i = 0;
+	const __m256 scale = _mm256_set1_ps((float) MAX_32BIT);
+	const __m256i mask = do_shift ?
+		_mm256_setr_epi8(1,2,3,5,6,7,9,10,11,13,14,15,-1,-1,-1,-1,1,2,3,5,6,7,9,10,11,13,14,15,-1,-1,-1,-1)
+		: _mm256_setr_epi8(3,2,1,7,6,5,11,10,9,15,14,13,-1,-1,-1,-1,3,2,1,7,6,5,11,10,9,15,14,13,-1,-1,-1,-1);
+
+	for(;i + 8 <= nsamps;i += 8, dst += 24){
+		__m256i v = _mm256_shuffle_epi8(psf_round32_avx2(psf_clipscale_avx2(_mm256_loadu_ps(src + i),scale)),mask);
+		__m128i hi = _mm256_extracti128_si256(v,1);
+		int last;
+		/* the spare 4 bytes of the first store are overwritten by the second */
+		_mm_storeu_si128((__m128i *) dst,_mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i *)(dst + 12),hi);
+		last = _mm_cvtsi128_si32(_mm_srli_si128(hi,8));
+		memcpy(dst + 20,&last,sizeof(int));
+	}
+	psf_encode24(dst,src + i,nsamps - i,do_shift);
+}
+
+PSF_AVX2 static void psf_encode32_avx2(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const __m256 scale = _mm256_set1_ps((float) MAX_32BIT);
+
+	for(;i + 8 <= nsamps;i += 8){
+		__m256i v = psf_round32_avx2(psf_clipscale_avx2(_mm256_loadu_ps(src + i),scale));
+		if(do_reverse)
+			v = psf_bswap32_avx2(v);
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(int)),v);
+	}
+	psf_encode32(dst + i * sizeof(int),src + i,nsamps - i,do_reverse);
+}
+
+/* as psf_peakScan, eight frames at a time */
+PSF_AVX2 static DWORD psf_peakScan_avx2(float *maxes, const float *buf, DWORD nFrames, int chans, int clip)
+{
+	__m256 acc[PSF_PEAKVECS];
+	float lanes[8 * PSF_PEAKVECS];
+	const __m256 signbit = _mm256_set1_ps(-0.0f);
+	const __m256 one = _mm256_set1_ps(1.0f), minusone = _mm256_set1_ps(-1.0f);
+	DWORD i,done;
+	int j,k;
+
+	if(chans > PSF_PEAKVECS)
+		return 0;
+	done = nFrames & ~7;
+	for(k=0;k < chans;k++)
+		acc[k] = _mm256_setzero_ps();
+	for(i=0;i < done;i += 8, buf += 8 * chans){
+		for(k=0;k < chans;k++){
+			__m256 f = _mm256_loadu_ps(buf + 8 * k);
+			if(clip)
+				f = _mm256_max_ps(_mm256_min_ps(f,one),minusone);
+			acc[k] = _mm256_max_ps(_mm256_andnot_ps(signbit,f),acc[k]);
+		}
+	}
+	for(k=0;k < chans;k++)
+		_mm256_storeu_ps(lanes + 8 * k,acc[k]);
+	for(j=0;j < chans;j++){
+		maxes[j] = 0.0f;
+		for(k=j;k < 8 * chans;k += chans)
+			if(lanes[k] > maxes[j])
+				maxes[j] = lanes[k];
+	}
+	return done;
+}
+
+/* stereo, eight frames at a time; the rest as before */
+PSF_AVX2 static void psf_deinterleave_avx2(float *const *dst, DWORD offset, const float *src, DWORD nFrames, int chans)
+{
+	DWORD i = 0;
+
+	if(chans==2){
+		float *l = dst[0] + offset,*r = dst[1] + offset;
+		for(;i + 8 <= nFrames;i += 8){
+			__m256 a = _mm256_loadu_ps(src + i * 2);
+			__m256 b = _mm256_loadu_ps(src + i * 2 + 8);
+			/* the shuffles work within lanes: L0 L1 L4 L5 L2 L3 L6 L7, so swap the middle pairs */
+			__m256 lv = _mm256_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+			__m256 rv = _mm256_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+			_mm256_storeu_ps(l + i,_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(lv),_MM_SHUFFLE(3,1,2,0))));
+			_mm256_storeu_ps(r + i,_mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(rv),_MM_SHUFFLE(3,1,2,0))));
+		}
+	}
+	psf_deinterleave(dst,offset + i,src + i * chans,nFrames - i,chans);
+}
+
+PSF_AVX2 static void psf_interleave_avx2(float *dst, const float *const *src, DWORD offset, DWORD nFrames, int chans)
+{
+	DWORD i = 0;
+
+	if(chans==2){
+		const float *l = src[0] + offset,*r = src[1] + offset;
+		for(;i + 8 <= nFrames;i += 8){
+			__m256 a = _mm256_loadu_ps(l + i);
+			__m256 b = _mm256_loadu_ps(r + i);
+			__m256 lo = _mm256_unpacklo_ps(a,b);
+			__m256 hi = _mm256_unpackhi_ps(a,b);
+			_mm256_storeu_ps(dst + i * 2,_mm256_permute2f128_ps(lo,hi,0x20));
+			_mm256_storeu_ps(dst + i * 2 + 8,_mm256_permute2f128_ps(lo,hi,0x31));
+		}
+	}
+	psf_interleave(dst + i * chans,src,offset + i,nFrames - i,chans);
+}
+
+static const PSF_KERNELS psf_kernAVX2 = {
+	"avx2",
+	psf_decode16_avx2,psf_decode24_avx2,psf_decode32_avx2,psf_decodeFloatRev_avx2,
+	psf_encode16_avx2,psf_encode24_avx2,psf_encode32_avx2,psf_encodeFloatRev_avx2,
+	psf_swap16_avx2,psf_swap32_avx2,psf_peakScan_avx2,psf_deinterleave_avx2,psf_interleave_avx2
+};
+
+/* AVX-512 (F and BW): sixteen samples a time for the plain conversions and swaps; 
+   24bit, peaks and interleaving gain little over AVX2, so use those */
+PSF_AVX512 static __m512i psf_bswap16_avx512(__m512i v)
+{
+	return _mm512_shuffle_epi8(v,_mm512_broadcast_i32x4(_mm_setr_epi8(PSF_REV16_MASK)));
+}
+
+PSF_AVX512 static __m512i psf_bswap32_avx512(__m512i v)
+{
+	return _mm512_shuffle_epi8(v,_mm512_broadcast_i32x4(_mm_setr_epi8(PSF_REV32_MASK)));
+}
+
+PSF_AVX512 static __m512 psf_clipscale_avx512(__m512 f, __m512 scale)
+{
+	f = _mm512_max_ps(_mm512_min_ps(f,_mm512_set1_ps(1.0f)),_mm512_set1_ps(-1.0f));
+	return _mm512_mul_ps(f,scale);
+}
+
+PSF_AVX512 static __m512i psf_round32_avx512(__m512 f)
+{
+	__m512i itrunc = _mm512_cvttps_epi32(f);
+	__m512 frac = _mm512_sub_ps(f,_mm512_cvtepi32_ps(itrunc));
+	__mmask16 up = _mm512_cmp_ps_mask(frac,_mm512_set1_ps(0.5f),_CMP_GE_OQ);
+	__mmask16 down = _mm512_cmp_ps_mask(frac,_mm512_set1_ps(-0.5f),_CMP_LE_OQ);
+	__mmask16 ovf = _mm512_cmp_ps_mask(f,_mm512_set1_ps((float) MAX_32BIT),_CMP_GE_OQ);
+
+	itrunc = _mm512_mask_add_epi32(itrunc,up,itrunc,_mm512_set1_epi32(1));
+	itrunc = _mm512_mask_sub_epi32(itrunc,down,itrunc,_mm512_set1_epi32(1));
+	return _mm512_mask_mov_epi32(itrunc,ovf,_mm512_set1_epi32(0x7fffffff));
+}
+
+PSF_AVX512 static void psf_decode16_avx512(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const __m512 vfac = _mm512_set1_ps((float)(1.0 / MAX_16BIT));
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i * sizeof(short)));
+		if(do_reverse)
+			v = psf_bswap16_avx2(v);
+		_mm512_storeu_ps(dst + i,_mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(v)),vfac));
+	}
+	psf_decode16_avx2(dst + i,src + i * sizeof(short),nsamps - i,do_reverse);
+}
+
+PSF_AVX512 static void psf_decode32_avx512(float *dst, const unsigned char *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const __m512 vfac = _mm512_set1_ps((float)(1.0 / MAX_32BIT));
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m512i v = _mm512_loadu_si512(src + i * sizeof(int));
+		if(do_reverse)
+			v = psf_bswap32_avx512(v);
+		_mm512_storeu_ps(dst + i,_mm512_mul_ps(_mm512_cvtepi32_ps(v),vfac));
+	}
+	psf_decode32_avx2(dst + i,src + i * sizeof(int),nsamps - i,do_reverse);
+}
+
+PSF_AVX512 static void psf_swap16_avx512(unsigned char *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+
+	for(;i + 32 <= nsamps;i += 32)
+		_mm512_storeu_si512(dst + i * sizeof(short),psf_bswap16_avx512(_mm512_loadu_si512(src + i * sizeof(short))));
+	psf_swap16_avx2(dst + i * sizeof(short),src + i * sizeof(short),nsamps - i);
+}
+
+PSF_AVX512 static void psf_swap32_avx512(unsigned char *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+
+	for(;i + 16 <= nsamps;i += 16)
+		_mm512_storeu_si512(dst + i * sizeof(int),psf_bswap32_avx512(_mm512_loadu_si512(src + i * sizeof(int))));
+	psf_swap32_avx2(dst + i * sizeof(int),src + i * sizeof(int),nsamps - i);
+}
+
+PSF_AVX512 static void psf_decodeFloatRev_avx512(float *dst, const unsigned char *src, DWORD nsamps)
+{
+	psf_swap32_avx512((unsigned char *) dst,src,nsamps);
+}
+
+PSF_AVX512 static void psf_encodeFloatRev_avx512(unsigned char *dst, const float *src, DWORD nsamps)
+{
+	psf_swap32_avx512(dst,(const unsigned char *) src,nsamps);
+}
+
+/* the saturating narrow does what packs does for SSE2: +32768 becomes 32767 */
+PSF_AVX512 static void psf_encode16_avx512(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse, const float *noise)
+{
+	DWORD i = 0;
+	const __m512 scale = _mm512_set1_ps(noise ? 32766.0f : (float) MAX_16BIT);
+	const __m512 two = _mm512_set1_ps(2.0f);
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m512 f = psf_clipscale_avx512(_mm512_loadu_ps(src + i),scale);
+		__m256i v;
+		if(noise)
+			f = _mm512_add_ps(f,_mm512_mul_ps(two,_mm512_loadu_ps(noise + i)));
+		/* +-0.5 as psf_round16_sse: the float and/or are AVX512DQ, so use the integer ones */
+		f = _mm512_add_ps(f,_mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(_mm512_castps_si512(f),
+							_mm512_set1_epi32((int) 0x80000000)),_mm512_castps_si512(_mm512_set1_ps(0.5f)))));
+		v = _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(f));
+		if(do_reverse)
+			v = psf_bswap16_avx2(v);
+		_mm256_storeu_si256((__m256i *)(dst + i * sizeof(short)),v);
+	}
+	psf_encode16_avx2(dst + i * sizeof(short),src + i,nsamps - i,do_reverse,noise ? noise + i : NULL);
+}
+
+PSF_AVX512 static void psf_encode32_avx512(unsigned char *dst, const float *src, DWORD nsamps, int do_reverse)
+{
+	DWORD i = 0;
+	const __m512 scale = _mm512_set1_ps((float) MAX_32BIT);
+
+	for(;i + 16 <= nsamps;i += 16){
+		__m512i v = psf_round32_avx512(psf_clipscale_avx512(_mm512_loadu_ps(src + i),scale));
+		if(do_reverse)
+			v = psf_bswap32_avx512(v);
+		_mm512_storeu_si512(dst + i * sizeof(int),v);
+	}
+	psf_encode32_avx2(dst + i * sizeof(int),src + i,nsamps - i,do_reverse);
+}
+
+static const PSF_KERNELS psf_kernAVX512 = {
+	"avx512",
+	psf_decode16_avx512,psf_decode24_avx2,psf_decode32_avx512,psf_decodeFloatRev_avx512,
+	psf_encode16_avx512,psf_encode24_avx2,psf_encode32_avx512,psf_encodeFloatRev_avx512,
+	psf_swap16_avx512,psf_swap32_avx512,psf_peakScan_avx2,psf_deinterleave_avx2,psf_interleave_avx2
+};
+#endif
+
+/* the baseline until psf_init() has looked at the CPU */
+static const PSF_KERNELS *psf_kern = &psf_kernBase;
+
+static void psf_selectKernels(void)
+{
+#ifdef PSF_DISPATCH
+	const char *cap = getenv("PSF_KERNELS");
+	int level = 2;
+
+	if(cap && strcmp(cap,"avx512") != 0)
+		level = strcmp(cap,"avx2")==0 ? 1 : 0;
+	__builtin_cpu_init();
+	if(level >= 2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		psf_kern = &psf_kernAVX512;
+	else if(level >= 1 && __builtin_cpu_supports("avx2"))
+		psf_kern = &psf_kernAVX2;
+	else
+		psf_kern = &psf_kernBase;
+#endif
+}
+
+const char *psf_kernels(void)
+{
+	return psf_kern->name;
+}
+
+static void psf_trackPeaks(PSFFILE *sfdat, const float *buf, DWORD nFrames, int clip)
+{
+	int j,chans;
+	DWORD i,done;
+	float absfsamp,blockmax;
+	float maxes[PSF_PEAKVECS] = {0.0f};	/* only read when the kernel did frames */
+
+	if(sfdat->pPeaks==NULL)
+		return;
+	chans = sfdat->fmt.Format.nChannels;
+	done = psf_kern->peakScan(maxes,buf,nFrames,chans,clip);
+	for(j=0;j < chans; j++) {
+		blockmax = done ? maxes[j] : 0.0f;
+		for(i=done; i < nFrames; i++){
+			absfsamp = PSF_ABSCLIP(buf[i * chans + j],clip);
+			if(absfsamp > blockmax)
+				blockmax = absfsamp;
+		}
+		if(sfdat->pPeaks[j].val < blockmax){
+			for(i=0; i < nFrames; i++){
+				if(PSF_ABSCLIP(buf[i * chans + j],clip) == blockmax)
+					break;
+			}
+			sfdat->pPeaks[j].pos = (DWORD)(sfdat->nFrames + i);	/* PEAK has only 32bits */
+			sfdat->pPeaks[j].val = blockmax;
+		}
+	}
+}
+
+/* write PEAK chunk if we have the data */
+static int wavWriteHeader(PSFFILE *sfdat)
+{
+	DWORD tag,size;
+	WORD cbSize = 0;
+	WAVEFORMATEX *pfmt;
+	PSF_CHPEAK *peaks;
+    fpos_t bytepos;
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(sfdat->riff_format == PSF_STDWAVE);
+	assert(sfdat->nFrames == 0);
+	assert(!sfdat->isRead);
+	assert(sfdat->fmt.Format.nChannels != 0);
+#endif
+
+	/*clear pPeaks array*/
+	if(sfdat->pPeaks)
+		memset((char *)sfdat->pPeaks,0,sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+
+
+	tag = TAG('R','I','F','F');
+	size = 0;
+	if(!sfdat->is_little_endian)
+		size = REVDWBYTES(size);
+	else
+		tag = REVDWBYTES(tag);
+	
+
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+
+	tag = TAG('W','A','V','E');
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	/* room for ds64, should the file grow beyond 4GB */
+	if(!sfdat->minheader){
+		int rc = wavReserveDs64(sfdat);
+		if(rc < PSF_E_NOERROR)
+			return rc;
+	}
+
+	pfmt = &(sfdat->fmt.Format);
+
+	tag = TAG('f','m','t',' ');	
+	size = sizeof(WAVEFORMAT);
+	if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT)
+		size += sizeof(WORD);		  /* for cbSize: WAVEOFRMATEX */
+	if(!sfdat->is_little_endian){
+		size = REVDWBYTES(size);
+		fmtSwapBytes(sfdat);
+	}
+	else
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))		
+		return PSF_E_CANT_WRITE;
+        if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->fmtoffset = bytepos;
+	
+	if(wavDoWrite(sfdat,(char *)pfmt,sizeof(WAVEFORMAT)))
+		return PSF_E_CANT_WRITE;
+	/*add cbSize if floatsams */
+	if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT)
+		if(wavDoWrite(sfdat,(char *)&cbSize,sizeof(WORD)))
+			return PSF_E_CANT_WRITE;
+        /* reswap it all */
+        if(!sfdat->is_little_endian){
+            fmtSwapBytes(sfdat);
+        }
+        
+	if(sfdat->pPeaks){
+		DWORD version = 1, now = 0;
+		peaks = sfdat->pPeaks;
+		
+		tag = TAG('P','E','A','K');		
+		size = 2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * pfmt->nChannels;
+		if(!sfdat->is_little_endian){
+			size = REVDWBYTES(size);
+			version  = REVDWBYTES(version);
+		}
+		else
+			tag = REVDWBYTES(tag);
+
+		if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&version,sizeof(DWORD)))
+			return PSF_E_CANT_WRITE;
+		if(fgetpos(sfdat->file,&bytepos))
+		    return PSF_E_CANT_SEEK;
+		sfdat->peakoffset = bytepos;  /*we need to update time*/
+
+		if(wavDoWrite(sfdat,(char *) &now,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *) peaks, sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels))
+			return PSF_E_CANT_WRITE;
+	}	
+	tag = TAG('d','a','t','a');	
+	size = 0;	
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))		
+		return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->dataoffset = bytepos;	
+	return PSF_E_NOERROR;
+}
+
+
+static int waveExWriteHeader(PSFFILE *sfdat)
+{
+	DWORD tag,size;	
+	WAVEFORMATEXTENSIBLE *pfmt;
+	PSF_CHPEAK *peaks;	
+	GUID *pGuid = NULL;
+	fpos_t bytepos;
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(sfdat->chformat > STDWAVE);
+	assert(sfdat->nFrames==0);
+	assert(!sfdat->isRead);
+	assert(sfdat->fmt.Format.nChannels != 0);
+#endif
+	/*clear pPeaks array*/
+	if(sfdat->pPeaks)
+		memset((char *)sfdat->pPeaks,0,sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+	/* complete WAVE-EX format fields: */
+    if(sfdat->chformat==MC_BFMT){
+        if(sfdat->samptype== PSF_SAMP_IEEE_FLOAT){				
+            pGuid = (GUID *)  &SUBTYPE_AMBISONIC_B_FORMAT_IEEE_FLOAT;
+        }
+        else{		
+            pGuid =(GUID *) &SUBTYPE_AMBISONIC_B_FORMAT_PCM;
+        }
+        
+    }else {
+        if(sfdat->fmt.Format.wFormatTag==  WAVE_FORMAT_IEEE_FLOAT){				
+            pGuid = (GUID *)  &KSDATAFORMAT_SUBTYPE_IEEE_FLOAT;
+        }
+        else{		
+            pGuid =(GUID *) &KSDATAFORMAT_SUBTYPE_PCM;
+        }
+    }
+	sfdat->fmt.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+	memcpy((char *) &(sfdat->fmt.SubFormat),(char *)pGuid,sizeof(GUID));
+	tag = TAG('R','I','F','F');
+	size = 0;
+	if(!sfdat->is_little_endian)
+		size = REVDWBYTES(size);
+	else
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	tag = TAG('W','A','V','E');
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	/* room for ds64, should the file grow beyond 4GB */
+	if(!sfdat->minheader){
+		int rc = wavReserveDs64(sfdat);
+		if(rc < PSF_E_NOERROR)
+			return rc;
+	}
+	pfmt = &(sfdat->fmt);
+	tag = TAG('f','m','t',' ');	
+	size = sizeof_WFMTEX;	
+	if(!sfdat->is_little_endian){
+		size = REVDWBYTES(size);
+		fmtExSwapBytes(sfdat);
+	}
+	else
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))		
+		return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->fmtoffset = bytepos;
+	/* write fmt elementwise, to avoid C alignment traps with WORD */
+	/* 16byte format...*/
+	if(wavDoWrite(sfdat,(char *)pfmt,sizeof(WAVEFORMAT))	
+	/** cbSize... */
+	||wavDoWrite(sfdat,(char *) &(pfmt->Format.cbSize),sizeof(WORD))	
+	/* validbits... */
+	||wavDoWrite(sfdat,(char *) &(pfmt->Samples.wValidBitsPerSample),sizeof(WORD))	
+	/* ChannelMask .... */
+	||wavDoWrite(sfdat,(char *) &(pfmt->dwChannelMask),sizeof(DWORD))		
+	/*  and the GUID */
+	||wavDoWrite(sfdat,(char *) &(pfmt->SubFormat),sizeof(GUID)))
+		return PSF_E_CANT_WRITE;
+        /* reswap it all */
+        if(!sfdat->is_little_endian){
+            fmtExSwapBytes(sfdat);
+        }
+	if(sfdat->pPeaks){
+		DWORD version = 1, now = 0;
+		
+        peaks = sfdat->pPeaks;		
+		tag = TAG('P','E','A','K');		
+		size = 2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * pfmt->Format.nChannels;
+		if(!sfdat->is_little_endian){
+			size = REVDWBYTES(size);
+			version  = REVDWBYTES(version);
+		}
+		else
+			tag = REVDWBYTES(tag);
+		if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&version,sizeof(DWORD)))
+			return PSF_E_CANT_WRITE;
+		if(fgetpos(sfdat->file,&bytepos))
+		    return PSF_E_CANT_SEEK;
+		sfdat->peakoffset = bytepos;  /*we need to update time*/
+		if(wavDoWrite(sfdat,(char *) &now,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *) peaks, sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels))
+			return PSF_E_CANT_WRITE;
+	}
+	
+	tag = TAG('d','a','t','a');	
+	size = 0;	
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))		
+		return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->dataoffset = bytepos;
+	return PSF_E_NOERROR;
+}
+
+static int aiffWriteHeader(PSFFILE *sfdat)
+{
+	DWORD tag,size;		
+	PSF_CHPEAK *peaks;	
+	DWORD dwData,offset,blocksize;
+	unsigned char ieee[10];
+	WORD wData;
+	fpos_t bytepos;
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(sfdat->chformat > STDWAVE);
+	assert(sfdat->nFrames==0);
+	assert(!sfdat->isRead);
+	assert(sfdat->riff_format == PSF_AIFF);
+	assert(sfdat->fmt.Format.nChannels != 0);
+#endif
+
+	/*clear pPeaks array*/
+	if(sfdat->pPeaks)
+		memset((char *)sfdat->pPeaks,0,sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+
+	tag = TAG('F','O','R','M');
+	size = 0;
+
+	if(sfdat->is_little_endian) {
+		size = REVDWBYTES(size);	
+		tag = REVDWBYTES(tag);
+	}
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	tag = TAG('A','I','F','F');
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+
+	tag = TAG('C','O','M','M');
+	size = 18;
+	if(sfdat->is_little_endian){
+		size = REVDWBYTES(size);	
+		tag = REVDWBYTES(tag);
+	}
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->fmtoffset = bytepos;
+
+	wData = sfdat->fmt.Format.nChannels;
+	if(sfdat->is_little_endian)
+		wData = (WORD) REVWBYTES(wData);
+	if(wavDoWrite(sfdat,(char *)&wData,sizeof(WORD)))
+		return PSF_E_CANT_WRITE;
+
+	dwData = 0;			/* nFrames */
+	if(wavDoWrite(sfdat,(char *)&dwData,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+
+	wData = sfdat->fmt.Format.wBitsPerSample;
+	if(sfdat->is_little_endian)
+		wData = (WORD) REVWBYTES(wData);
+	if(wavDoWrite(sfdat,(char *)&wData,sizeof(WORD)))
+		return PSF_E_CANT_WRITE;
+	double_to_ieee_80((double)sfdat->fmt.Format.nSamplesPerSec,ieee);
+	
+	if(wavDoWrite(sfdat,ieee,10))
+		return PSF_E_CANT_WRITE;
+	if(sfdat->pPeaks){
+		DWORD version = 1, now = 0;
+		peaks = sfdat->pPeaks;
+		
+		tag = TAG('P','E','A','K');		
+		size = 2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels;
+		if(sfdat->is_little_endian){
+			size = REVDWBYTES(size);
+			version  = REVDWBYTES(version);
+			tag = REVDWBYTES(tag);
+		}
+		if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&version,sizeof(DWORD)))
+			return PSF_E_CANT_WRITE;
+		if(fgetpos(sfdat->file,&bytepos))
+		    return PSF_E_CANT_SEEK;
+		sfdat->peakoffset = bytepos;  /*we need to update time*/
+
+		if(wavDoWrite(sfdat,(char *) &now,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *) peaks, sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels))
+			return PSF_E_CANT_WRITE;
+	}
+
+	tag = TAG('S','S','N','D');
+	size = offset = blocksize = 0;
+	if(sfdat->is_little_endian)
+			tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&offset,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&blocksize,sizeof(DWORD)))
+			return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->dataoffset = bytepos;
+	return PSF_E_NOERROR;
+}
+
+
+static int aifcWriteHeader(PSFFILE *sfdat)
+{
+	DWORD tag,size;		
+	PSF_CHPEAK *peaks;	
+	DWORD dwData,offset,blocksize,aifcver = AIFC_VERSION_1,ID_compression;
+	/*assume 32bit floats, but we may be asked to use aifc for integer formats too*/
+	char *str_compressed = (char *) aifc_floatstring;
+	int pstring_size = 10;
+	unsigned char ieee[10];
+	WORD wData;
+	fpos_t bytepos;
+
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(sfdat->nFrames==0);
+	assert(!sfdat->isRead);
+	assert(sfdat->riff_format == PSF_AIFC);
+	assert(sfdat->fmt.Format.nChannels != 0);
+#endif
+
+	if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT)
+		ID_compression = TAG('f','l','3','2');
+	else {
+		ID_compression = TAG('N','O','N','E');
+		pstring_size = 16;
+		str_compressed = (char *) aifc_notcompressed;
+	}
+	/*clear pPeaks array*/
+	if(sfdat->pPeaks)
+		memset((char *)sfdat->pPeaks,0,sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+
+	tag = TAG('F','O','R','M');
+	size = 0;
+
+	if(sfdat->is_little_endian) {
+		size = REVDWBYTES(size);	
+		tag = REVDWBYTES(tag);
+	}
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	tag = TAG('A','I','F','C');
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+
+	tag = TAG('F','V','E','R');
+	size = sizeof(DWORD);
+	if(sfdat->is_little_endian){
+		size = REVDWBYTES(size);	
+		tag = REVDWBYTES(tag);
+		aifcver = REVDWBYTES(aifcver);
+	}
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&aifcver,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+
+	tag = TAG('C','O','M','M');
+	size = 22 + pstring_size;
+	if(sfdat->is_little_endian){
+		size = REVDWBYTES(size);	
+		tag = REVDWBYTES(tag);
+	}
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->fmtoffset = bytepos;
+
+	wData = sfdat->fmt.Format.nChannels;
+	if(sfdat->is_little_endian)
+		wData = (WORD) REVWBYTES(wData);
+	if(wavDoWrite(sfdat,(char *)&wData,sizeof(WORD)))
+		return PSF_E_CANT_WRITE;
+
+	dwData = 0;			/* nFrames */
+	if(wavDoWrite(sfdat,(char *)&dwData,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+
+	wData = sfdat->fmt.Format.wBitsPerSample;
+	if(sfdat->is_little_endian)
+		wData = (WORD) REVWBYTES(wData);
+	if(wavDoWrite(sfdat,(char *)&wData,sizeof(WORD)))
+		return PSF_E_CANT_WRITE;
+	double_to_ieee_80((double)sfdat->fmt.Format.nSamplesPerSec,ieee);
+	
+	if(wavDoWrite(sfdat,ieee,10))
+		return PSF_E_CANT_WRITE;
+	/*AIFC bits */
+	if(sfdat->is_little_endian)
+		ID_compression = REVDWBYTES(ID_compression);
+	if(wavDoWrite(sfdat,(char *)&ID_compression,sizeof(DWORD)))
+		return PSF_E_CANT_WRITE;
+	if(wavDoWrite(sfdat,str_compressed,pstring_size))
+		return PSF_E_CANT_WRITE;
+
+	if(sfdat->pPeaks){
+		DWORD version = 1, now = 0;
+
+		peaks = sfdat->pPeaks;		
+		tag = TAG('P','E','A','K');		
+		size = 2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels;
+		if(sfdat->is_little_endian){
+			size = REVDWBYTES(size);
+			version  = REVDWBYTES(version);
+			tag = REVDWBYTES(tag);
+		}
+		if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&version,sizeof(DWORD)))
+			return PSF_E_CANT_WRITE;
+		if(fgetpos(sfdat->file,&bytepos))
+		    return PSF_E_CANT_SEEK;
+		sfdat->peakoffset = bytepos;  /*we need to update time*/
+
+		if(wavDoWrite(sfdat,(char *) &now,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *) peaks, sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels))
+			return PSF_E_CANT_WRITE;
+	}
+
+	tag = TAG('S','S','N','D');
+	size = offset = blocksize = 0;
+	if(sfdat->is_little_endian)
+	    tag = REVDWBYTES(tag);
+	if(wavDoWrite(sfdat,(char *)&tag,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&size,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&offset,sizeof(DWORD))
+			|| wavDoWrite(sfdat,(char *)&blocksize,sizeof(DWORD)))
+			return PSF_E_CANT_WRITE;
+	if(fgetpos(sfdat->file,&bytepos))
+	    return PSF_E_CANT_SEEK;
+	sfdat->dataoffset = bytepos;
+	return PSF_E_NOERROR;
+}
+
+/* create soundfile. return descriptor, or some PSF_error value < 0 */
+/* supported clipping or non-clipping of floats to 0dbFS, 
+   minimum header (or PEAK), and RDWR or RDONLY (but last not implemented yet!) */
+/* we expect full format info to be set in props */
+/* I want to offer share-read access (easy with WIN32), but can't with  ANSI! */
+/* possible TODO:  enforce non-destructive by e.g. rejecting create on existing file */
+/* PSF_LAC: the coder writes its own header, and the blocks after it */
+static int lacWriteHeader(PSFFILE *sfdat)
+{
+	PSF_LACINFO info;
+	int rc;
+
+	info.srate = sfdat->fmt.Format.nSamplesPerSec;
+	info.chans = sfdat->fmt.Format.nChannels;
+	info.bits = sfdat->fmt.Format.wBitsPerSample;
+	info.isfloat = sfdat->samptype==PSF_SAMP_IEEE_FLOAT;
+	info.chformat = sfdat->chformat;
+	info.chmask = sfdat->fmt.dwChannelMask;
+	info.nFrames = 0;
+	info.peaktime = 0;
+	sfdat->lac = psf_lacCreate(sfdat->file,&info,&rc);
+	if(sfdat->lac==NULL)
+		return rc;
+	if(fgetpos(sfdat->file,&sfdat->dataoffset))
+		return PSF_E_CANT_SEEK;
+	sfdat->lastop = PSF_OP_WRITE;
+	return PSF_E_NOERROR;
+}
+
+static int lacReadHeader(PSFFILE *sfdat)
+{
+	PSF_LACINFO info;
+	int rc;
+
+	sfdat->lac = psf_lacOpen(sfdat->file,&info,&rc);
+	if(sfdat->lac==NULL)
+		return rc;
+	sfdat->fmt.Format.wFormatTag = (WORD)(info.isfloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+	sfdat->fmt.Format.nChannels = (WORD) info.chans;
+	sfdat->fmt.Format.nSamplesPerSec = info.srate;
+	sfdat->fmt.Format.wBitsPerSample = (WORD) info.bits;
+	sfdat->fmt.Format.nBlockAlign = (WORD)(info.chans * (info.bits / BITS_PER_BYTE));
+	sfdat->fmt.Format.nAvgBytesPerSec = sfdat->fmt.Format.nBlockAlign * info.srate;
+	sfdat->fmt.Samples.wValidBitsPerSample = (WORD) info.bits;
+	sfdat->fmt.dwChannelMask = info.chmask;
+	sfdat->chformat = (psf_channelformat) info.chformat;
+	switch(info.bits){
+	case(16):
+		sfdat->samptype = PSF_SAMP_16;
+		break;
+	case(24):
+		sfdat->samptype = PSF_SAMP_24;
+		break;
+	default:
+		sfdat->samptype = info.isfloat ? PSF_SAMP_IEEE_FLOAT : PSF_SAMP_32;
+		break;
+	}
+	sfdat->nFrames = info.nFrames;
+	POS64(sfdat->dataoffset) = PSF_LAC_DATAOFFSET(info.chans);
+	/* PEAK data, and the rescale factor, as for WAVE */
+	if(info.peaktime){
+		sfdat->pPeaks = (PSF_CHPEAK *) malloc(sizeof(PSF_CHPEAK) * info.chans);
+		if(sfdat->pPeaks==NULL)
+			return PSF_E_NOMEM;
+		psf_lacPeaks(sfdat->lac,sfdat->pPeaks);
+		sfdat->peaktime = (time_t) info.peaktime;
+		if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT){
+			float fac = 0.0f;
+			int i;
+			for(i=0;i < info.chans;i++)
+				fac = max(fac,sfdat->pPeaks[i].val);
+			if(fac > 1.0f)
+				sfdat->rescale_fac = 1.0f / fac;
+		}
+	}
+	sfdat->lastop = PSF_OP_READ;
+	return PSF_E_NOERROR;
+}
+
+/* the rest of a create, once sfdat has its file and name: write the header, and find a handle */
+static int psf_createFile(PSFFILE *sfdat, psf_format fmt, const PSF_PROPS *props)
+{
+	int i,rc = PSF_E_UNSUPPORTED;
+
+	if(!sfdat->minheader){
+		sfdat->pPeaks = (PSF_CHPEAK *) calloc(sfdat->fmt.Format.nChannels,sizeof(PSF_CHPEAK));
+		if(sfdat->pPeaks==NULL){
+			DBGFPRINTF((stderr, "wavOpenWrite: no memory for peak data\n"));
+			psf_release_file(sfdat);
+			psf_freeFile(sfdat);
+			return PSF_E_NOMEM;
+		}
+	}
+    sfdat->isRead = 0;    	
+	sfdat->nFrames = 0;
+	/* force aif f/p data to go to aifc format */
+	if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT && fmt==PSF_AIFF){
+		DBGFPRINTF((stderr, "Warning: writing floating point data in AIFC format\n"));
+		fmt= PSF_AIFC;
+	}
+	/* .wav extension can be either std WAVE or WAVE-EX */
+	if(fmt==PSF_STDWAVE){
+		if(props->format==PSF_WAVE_EX)
+			fmt = PSF_WAVE_EX;
+	}
+	sfdat->riff_format = fmt;
+
+	switch((int) fmt){
+	case(PSF_STDWAVE):		
+		rc = wavWriteHeader(sfdat);
+		break;
+	case(PSF_AIFF):
+		
+		rc = aiffWriteHeader(sfdat);
+		break;
+	case(PSF_AIFC):
+		
+		rc = aifcWriteHeader(sfdat);
+		break;
+	case (PSF_WAVE_EX):		
+		rc = waveExWriteHeader(sfdat);
+		break;
+	case (PSF_RAW):
+		/* no header: the samples start at 0 */
+		rc = PSF_E_NOERROR;
+		break;
+	case (PSF_LAC):
+		rc = lacWriteHeader(sfdat);
+		break;
+	default:
+		sfdat->riff_format = PSF_FMT_UNKNOWN;
+		break;
+	}
+	if(rc < PSF_E_NOERROR){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+		return rc;
+	}
+	i = psf_newHandle(sfdat);
+	if(i < 0){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+	}
+	else
+		/* files open together get different noise */
+		psf_ditherSeed(sfdat,(unsigned int) i);
+	return i;
+}
+
+int psf_sndCreate(const char *path,const PSF_PROPS *props,int clip_floats,int minheader, int mode)
+{		
+	psf_format fmt;
+	PSFFILE *sfdat;
+	char *fmtstr = "wb+";	/* default is READ+WRITE */
+	/*  disallow props = NULL here, until/unless I can offer mechanism to set default props via psf_init() */
+	if(path == NULL || props == NULL)
+		return PSF_E_BADARG;
+
+	sfdat = psf_newFile(props);
+	if(sfdat == NULL)		
+		return PSF_E_NOMEM;
+	
+	sfdat->clip_floats = clip_floats;	
+	sfdat->minheader = minheader;
+	fmt = psf_getFormatExt(path);		
+	if(fmt==PSF_FMT_UNKNOWN)
+		return PSF_E_UNSUPPORTED;
+	if(sfdat->samptype == PSF_SAMP_UNKNOWN)
+		return PSF_E_BADARG;
+
+	sfdat->filename = (char *) malloc(strlen(path)+1);
+	if(sfdat->filename==NULL) {
+		DBGFPRINTF((stderr, "wavOpenWrite: no memory for filename\n"));
+		return PSF_E_NOMEM;
+	}
+	/*switch (mode).... */
+	if(mode==PSF_CREATE_WRONLY)
+		fmtstr = "wb";
+	/* deal with CREATE_TEMPORARY later on! */
+	if(strcmp(path,"-")==0){
+		sfdat->file = psf_sampout ? psf_sampout : stdout;
+		sfdat->isstream = 1;
+	}
+	else if((sfdat->file = fopen(path,fmtstr))  == NULL) {
+		DBGFPRINTF((stderr, "wavOpenWrite: cannot create '%s'\n", path));
+        return PSF_E_CANT_OPEN;
+	}
+	
+    strcpy(sfdat->filename, path);
+	return psf_createFile(sfdat,fmt,props);
+}
+	
+/* snd close:  automatically completes PEAK data when writing */
+/* return 0 for success. pbuf (or NULL): psf_sndCloseMem */
+static int psf_closeFile(int sfd, void **pbuf, size_t *psize)
+{
+	int rc = PSF_E_NOERROR,asyncrc,srcrc;
+	PSFFILE *sfdat;
+	PSF_OVERVIEW *ovw;
+	char *ovwpath = NULL;
+	
+	sfdat  = psf_getFile(sfd);
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+#endif
+	if(sfdat->file==NULL || (pbuf && sfdat->mem==NULL)){
+		psf_unlockFile(sfdat);
+		return PSF_E_BADARG;
+	}
+	/* the converter's last frames, then any async writes, before we touch the header */
+	srcrc = psf_rateFinish(sfdat);
+	asyncrc = psf_asyncStop(sfdat);
+	if(asyncrc==PSF_E_NOERROR)
+		asyncrc = srcrc;
+	if(!sfdat->isRead){
+		switch((int) sfdat->riff_format){
+		case(PSF_STDWAVE):
+		case(PSF_WAVE_EX):
+			rc = wavUpdate(sfdat);
+			break;
+		case(PSF_AIFF):
+		case(PSF_AIFC):
+			rc = aiffUpdate(sfdat);
+			break;
+		case(PSF_RAW):
+			/* no header to update */
+			break;
+		case(PSF_LAC):
+			/* the last blocks, the index, and the header */
+			rc = psf_lacFinish(sfdat->lac,sfdat->pPeaks,(DWORD) time(0));
+			break;
+		default:
+			rc = PSF_E_CANT_CLOSE;
+			break;
+		}
+	}
+	if(rc==PSF_E_NOERROR)
+		rc = asyncrc;
+	/* the overview is saved once the file is closed, so it is stamped with the final mtime and size */
+	ovw = sfdat->ovw;
+	sfdat->ovw = NULL;
+	if(ovw && rc==PSF_E_NOERROR){
+		ovwpath = (char *) malloc(strlen(sfdat->filename) + 1);
+		if(ovwpath)
+			strcpy(ovwpath,sfdat->filename);
+		else
+			rc = PSF_E_NOMEM;
+	}
+#ifdef unix
+	/* the image is complete once stdio has let go of it: then it is the caller's */
+	if(pbuf){
+		if(rc==PSF_E_NOERROR && fflush(sfdat->file))
+			rc = PSF_E_CANT_WRITE;
+		if(rc==PSF_E_NOERROR){
+			*pbuf = sfdat->mem->buf;
+			*psize = sfdat->mem->size;
+			sfdat->mem->grow = 0;
+		}
+	}
+#endif
+	if(psf_release_file(sfdat)){
+		rc = PSF_E_CANT_CLOSE;
+		psf_unlockFile(sfdat);
+	}
+	else {
+		psf_freeHandle(sfd);
+		psf_unlockFile(sfdat);
+		psf_freeFile(sfdat);
+	}
+	if(ovwpath && rc==PSF_E_NOERROR)
+		rc = psf_overviewSave(ovw,ovwpath);
+	psf_overviewFree(ovw);
+	free(ovwpath);
+	return rc;	
+}
+
+int psf_sndClose(int sfd)
+{
+	return psf_closeFile(sfd,NULL,NULL);
+}
+
+int psf_sndCloseMem(int sfd, void **pbuf, size_t *psize)
+{
+	if(pbuf==NULL || psize==NULL)
+		return PSF_E_BADARG;
+	return psf_closeFile(sfd,pbuf,psize);
+}
+
+/* the overview follows the samples as the file will hold them, from where the last write ended:
+   a write anywhere else (after a seek) drops it */
+static void psf_overviewWrite(PSFFILE *sfdat, const float *buf, DWORD nFrames, int clip)
+{
+	if(sfdat->ovw->nFrames != (psf_int64) POS64(sfdat->lastwritepos)
+		|| psf_overviewAdd(sfdat->ovw,buf,nFrames,clip) != PSF_E_NOERROR){
+		psf_overviewFree(sfdat->ovw);
+		sfdat->ovw = NULL;
+	}
+}
+
+/* integer frames (sbuf for 16bit, else lbuf) scaled to floats, as psf_trackPeaksInt does */
+static void psf_overviewWriteInt(PSFFILE *sfdat, const short *sbuf, const int *lbuf, DWORD nFrames, double fac)
+{
+	DWORD i,nsamps = nFrames * sfdat->fmt.Format.nChannels;
+	float *fbuf = psf_getFloatBuf(sfdat,nsamps);
+
+	if(fbuf==NULL){
+		psf_overviewFree(sfdat->ovw);
+		sfdat->ovw = NULL;
+		return;
+	}
+	for(i=0;i < nsamps;i++)
+		fbuf[i] = (float)((sbuf ? (double) sbuf[i] : (double) lbuf[i]) * fac);
+	psf_overviewWrite(sfdat,fbuf,nFrames,1);
+}
+
+/* PEAK data and overview for a block once it is written (or queued): a failed write leaves them
+   as they were */
+static void psf_trackWritten(PSFFILE *sfdat, const float *buf, DWORD nFrames)
+{
+	int clip = sfdat->samptype != PSF_SAMP_IEEE_FLOAT || sfdat->clip_floats;
+
+	psf_trackPeaks(sfdat,buf,nFrames,clip);
+	if(sfdat->ovw)
+		psf_overviewWrite(sfdat,buf,nFrames,clip);
+}
+
+/* common back end for the float and double writers: 
+   encode the block into the staging buffer, write it with one call, then track PEAK data.
+   dbuf (or NULL) holds the same samples as doubles, for the 24 and 32bit encoders */
+static int psf_writeFloatBlock(PSFFILE *sfdat, const float *buf, const double *dbuf, DWORD nFrames)
+{
+	int do_reverse,do_shift;
+	DWORD nsamps,nbytes;
+	unsigned char *rawbuf;
+
+	switch((int) sfdat->riff_format){
+	case(PSF_STDWAVE):
+	case(PSF_WAVE_EX):
+	case(PSF_RAW):
+	case(PSF_LAC):
+		do_reverse = (sfdat->is_little_endian ? 0 : 1 );
+        do_shift = 1;
+		break;
+	case(PSF_AIFF):
+	case(PSF_AIFC):
+		do_reverse = (sfdat->is_little_endian ? 1 : 0 );
+        do_shift = 0;
+		break;
+	default:
+		return PSF_E_UNSUPPORTED;
+	}
+	nsamps = nFrames * sfdat->fmt.Format.nChannels;
+	nbytes = nsamps * psf_wordsize(sfdat->samptype);
+	if(nbytes==0){
+		DBGFPRINTF((stderr, "wavOpenWrite: unsupported sample format\n"));
+		return PSF_E_UNSUPPORTED;
+	}
+	if(psf_checkLength(sfdat,nFrames))
+		return PSF_E_CANT_WRITE;
+	if(sfdat->lastop  == PSF_OP_READ)
+		fflush(sfdat->file);
+	/* async: encode into the next free slot (the caller may reuse buf as soon as we return) */
+	if(sfdat->async)
+		rawbuf = psf_asyncSlot(sfdat,nbytes);
+	else if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT && !do_reverse){
+		if(wavDoWrite(sfdat,(char *)buf,nbytes)){
+			DBGFPRINTF((stderr, "wavOpenWrite: write error\n"));
+			return PSF_E_CANT_WRITE;				
+		}
+		psf_trackWritten(sfdat,buf,nFrames);
+		return PSF_E_NOERROR;
+	}
+	else
+		rawbuf = psf_getIObuf(sfdat,nbytes);
+	if(rawbuf==NULL)
+		return PSF_E_NOMEM;
+	switch(sfdat->samptype){
+	case(PSF_SAMP_IEEE_FLOAT):
+		if(do_reverse)
+			psf_kern->encodeFloatRev(rawbuf,buf,nsamps);
+		else
+			memcpy(rawbuf,buf,nbytes);
+		break;
+	case(PSF_SAMP_16):
+		if(sfdat->dithertype==PSF_DITHER_OFF)
+			psf_kern->encode16(rawbuf,buf,nsamps,do_reverse,NULL);
+		else {
+			const float *noise = psf_ditherNoise(sfdat,nsamps);
+			if(noise==NULL)
+				return PSF_E_NOMEM;
+			if(sfdat->dithertype==PSF_DITHER_SHAPED)
+				psf_encode16Shaped(rawbuf,buf,nsamps,sfdat->fmt.Format.nChannels,do_reverse,noise,sfdat->shapeerr);
+			else
+				psf_kern->encode16(rawbuf,buf,nsamps,do_reverse,noise);
+		}
+		break;
+	case(PSF_SAMP_24):
+		if(dbuf)
+			psf_encode24Double(rawbuf,dbuf,nsamps,do_shift);
+		else
+			psf_kern->encode24(rawbuf,buf,nsamps,do_shift);
+		break;
+	case(PSF_SAMP_32):
+		if(dbuf)
+			psf_encode32Double(rawbuf,dbuf,nsamps,do_reverse);
+		else
+			psf_kern->encode32(rawbuf,buf,nsamps,do_reverse);
+		break;
+	default:
+		DBGFPRINTF((stderr, "wavOpenWrite: unsupported sample format\n"));
+		if(sfdat->async)
+			psf_asyncQueue(sfdat,0);
+		return PSF_E_UNSUPPORTED;		
+	}
+	if(sfdat->async){
+		int rc = psf_asyncQueue(sfdat,nbytes);
+		if(rc < PSF_E_NOERROR)
+			return rc;
+	}
+	else if(wavDoWrite(sfdat,rawbuf,nbytes)){
+		DBGFPRINTF((stderr, "wavOpenWrite: write error\n"));
+		return PSF_E_CANT_WRITE;
+	}
+	psf_trackWritten(sfdat,buf,nFrames);
+	return PSF_E_NOERROR;
+}
+
+/* write floats (multi-channel) framebuf to whichever target format. tracks PEAK data.*/ 
+/* bend over backwards not to modify source data */
+/* returns nFrames, or errval < 0 */
+static int psf_writeFloatFrames(PSFFILE *sfdat, const float *buf, DWORD nFrames)
+{
+	int rc;
+
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);	
+#endif
+
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(nFrames == 0)
+		return nFrames;
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	rc = psf_writeFloatBlock(sfdat,buf,NULL,nFrames);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+    POS64(sfdat->lastwritepos) += nFrames;
+	sfdat->curframepos = (psf_int64) POS64(sfdat->lastwritepos);
+	sfdat->nFrames = max(sfdat->nFrames,(psf_int64) POS64(sfdat->lastwritepos));
+/*	fflush(sfdat->file); */	/* ? may need this if reading/seeking as well as  write, etc */
+	return nFrames; 
+		
+}
+
+int psf_sndWriteFloatFrames(int sfd, const float *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = sfdat->src ? psf_rateWrite(sfdat,buf,nFrames) : psf_writeFloatFrames(sfdat,buf,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* doubles are narrowed to floats (clipped, for float output with clip_floats set) for the PEAK data,
+   and for the float and 16bit encoders; 24 and 32bit samples are made from the doubles */
+static int psf_writeDoubleFrames(PSFFILE *sfdat, const double *buf, DWORD nFrames)
+{
+	int rc,clip;
+	DWORD nsamps;
+	float *fbuf;
+
+	
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);	
+#endif
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(nFrames == 0)
+		return nFrames;
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	/* psf_sndSetRate: floats only */
+	if(sfdat->src)
+		return PSF_E_UNSUPPORTED;
+	nsamps = nFrames * sfdat->fmt.Format.nChannels;
+	fbuf = psf_getFloatBuf(sfdat,nsamps);
+	if(fbuf==NULL)
+		return PSF_E_NOMEM;
+	clip = (sfdat->samptype==PSF_SAMP_IEEE_FLOAT && sfdat->clip_floats);
+	psf_narrowDoubles(fbuf,buf,nsamps,clip);
+	rc = psf_writeFloatBlock(sfdat,fbuf,buf,nFrames);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	POS64(sfdat->lastwritepos) += nFrames;
+    /* keep this as is for now, don't optimize, work in progress, etc */
+	sfdat->curframepos =  (psf_int64) POS64(sfdat->lastwritepos);
+	sfdat->nFrames = max(sfdat->nFrames, ((psf_int64) POS64(sfdat->lastwritepos)));
+/*	fflush(sfdat->file);*/	/* ? need this if reading/seeking as well as  write, etc */
+	return nFrames; 
+		
+}
+
+int psf_sndWriteDoubleFrames(int sfd, const double *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_writeDoubleFrames(sfdat,buf,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+
+/******** planar frames ***********/
+/* Planar calls go through the interleaved ones PSF_PLANARFRAMES at a time, so the interleaved
+   block is still in cache when it is split (or was just made). Multiples of 4 channels are
+   moved as 4x4 transposes, stereo with one shuffle; anything else sample by sample. */
+#define PSF_PLANARFRAMES	(1024)
+
+/* frames from src (interleaved) to dst[ch] + offset */
+static void psf_deinterleave(float *const *dst, DWORD offset, const float *src, DWORD nFrames, int chans)
+{
+	DWORD i = 0;
+	int ch;
+
+#ifdef __SSE2__
+	if(chans==2){
+		float *l = dst[0] + offset,*r = dst[1] + offset;
+		for(;i + 4 <= nFrames;i += 4){
+			__m128 a = _mm_loadu_ps(src + i * 2);
+			__m128 b = _mm_loadu_ps(src + i * 2 + 4);
+			_mm_storeu_ps(l + i,_mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0)));
+			_mm_storeu_ps(r + i,_mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1)));
+		}
+	}
+	else if((chans & 3)==0){
+		for(;i + 4 <= nFrames;i += 4){
+			for(ch=0;ch < chans;ch += 4){
+				__m128 r0 = _mm_loadu_ps(src + i * chans + ch);
+				__m128 r1 = _mm_loadu_ps(src + (i + 1) * chans + ch);
+				__m128 r2 = _mm_loadu_ps(src + (i + 2) * chans + ch);
+				__m128 r3 = _mm_loadu_ps(src + (i + 3) * chans + ch);
+				_MM_TRANSPOSE4_PS(r0,r1,r2,r3);
+				_mm_storeu_ps(dst[ch] + offset + i,r0);
+				_mm_storeu_ps(dst[ch + 1] + offset + i,r1);
+				_mm_storeu_ps(dst[ch + 2] + offset + i,r2);
+				_mm_storeu_ps(dst[ch + 3] + offset + i,r3);
+			}
+		}
+	}
+#endif
+	for(ch=0;ch < chans;ch++){
+		float *d = dst[ch] + offset;
+		DWORD j;
+		for(j=i;j < nFrames;j++)
+			d[j] = src[j * chans + ch];
+	}
+}
+
+/* the other way: src[ch] + offset to dst (interleaved) */
+static void psf_interleave(float *dst, const float *const *src, DWORD offset, DWORD nFrames, int chans)
+{
+	DWORD i = 0;
+	int ch;
+
+#ifdef __SSE2__
+	if(chans==2){
+		const float *l = src[0] + offset,*r = src[1] + offset;
+		for(;i + 4 <= nFrames;i += 4){
+			__m128 a = _mm_loadu_ps(l + i);
+			__m128 b = _mm_loadu_ps(r + i);
+			_mm_storeu_ps(dst + i * 2,_mm_unpacklo_ps(a,b));
+			_mm_storeu_ps(dst + i * 2 + 4,_mm_unpackhi_ps(a,b));
+		}
+	}
+	else if((chans & 3)==0){
+		for(;i + 4 <= nFrames;i += 4){
+			for(ch=0;ch < chans;ch += 4){
+				__m128 r0 = _mm_loadu_ps(src[ch] + offset + i);
+				__m128 r1 = _mm_loadu_ps(src[ch + 1] + offset + i);
+				__m128 r2 = _mm_loadu_ps(src[ch + 2] + offset + i);
+				__m128 r3 = _mm_loadu_ps(src[ch + 3] + offset + i);
+				_MM_TRANSPOSE4_PS(r0,r1,r2,r3);
+				_mm_storeu_ps(dst + i * chans + ch,r0);
+				_mm_storeu_ps(dst + (i + 1) * chans + ch,r1);
+				_mm_storeu_ps(dst + (i + 2) * chans + ch,r2);
+				_mm_storeu_ps(dst + (i + 3) * chans + ch,r3);
+			}
+		}
+	}
+#endif
+	for(ch=0;ch < chans;ch++){
+		const float *s = src[ch] + offset;
+		DWORD j;
+		for(j=i;j < nFrames;j++)
+			dst[j * chans + ch] = s[j];
+	}
+}
+
+static int psf_writeFloatPlanar(PSFFILE *sfdat, const float *const *bufs, DWORD nFrames)
+{
+	int ch,chans,rc;
+	DWORD done,n;
+	float *fbuf;
+
+	if(bufs==NULL)
+		return PSF_E_BADARG;
+	chans = sfdat->fmt.Format.nChannels;
+	for(ch=0;ch < chans;ch++)
+		if(bufs[ch]==NULL)
+			return PSF_E_BADARG;
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	fbuf = psf_getFloatBuf(sfdat,min(nFrames,PSF_PLANARFRAMES) * chans);
+	if(fbuf==NULL && nFrames > 0)
+		return PSF_E_NOMEM;
+	for(done=0;done < nFrames;done += n){
+		n = min(nFrames - done,PSF_PLANARFRAMES);
+		psf_kern->interleave(fbuf,bufs,done,n,chans);
+		rc = sfdat->src ? psf_rateWrite(sfdat,fbuf,n) : psf_writeFloatFrames(sfdat,fbuf,n);
+		if(rc < PSF_E_NOERROR)
+			return rc;
+	}
+	return nFrames;
+}
+
+int psf_sndWriteFloatPlanar(int sfd, const float *const *bufs, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_writeFloatPlanar(sfdat,bufs,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/******** integer frames ***********/
+/* Samples move between the caller and the file with no conversion: at most the bytes are
+   swapped (16 and 32bit), or packed and unpacked (24bit). So the file must hold the same
+   sample type as the call. 24bit samples are ints, sign-extended from the low 3 bytes. */
+
+/* copy nsamps 16bit samples, swapping the bytes of each; dst may be src */
+static void psf_swap16(unsigned char *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	for(;i + 8 <= nsamps;i += 8){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(short)));
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(short)),PSF_BSWAP16_SSE(v));
+	}
+#endif
+	for(;i < nsamps;i++){
+		unsigned short wsamp;
+		memcpy(&wsamp,src + i * sizeof(short),sizeof(short));
+		wsamp = (unsigned short) REVWBYTES(wsamp);
+		memcpy(dst + i * sizeof(short),&wsamp,sizeof(short));
+	}
+}
+
+static void psf_swap32(unsigned char *dst, const unsigned char *src, DWORD nsamps)
+{
+	DWORD i = 0;
+#ifdef __SSE2__
+	for(;i + 4 <= nsamps;i += 4){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * sizeof(int)));
+		_mm_storeu_si128((__m128i *)(dst + i * sizeof(int)),PSF_BSWAP32_SSE(v));
+	}
+#endif
+	for(;i < nsamps;i++){
+		DWORD dwsamp;
+		memcpy(&dwsamp,src + i * sizeof(int),sizeof(int));
+		dwsamp = REVDWBYTES(dwsamp);
+		memcpy(dst + i * sizeof(int),&dwsamp,sizeof(int));
+	}
+}
+
+/* do_shift set for (little-endian) WAVE, as for psf_encode24. Out of range samples are clipped */
+static void psf_pack24(unsigned char *dst, const int *src, DWORD nsamps, int do_shift)
+{
+	DWORD i;
+
+	for(i=0;i < nsamps;i++, dst += 3){
+		int lsamp = max(min(src[i],0x7fffff),-0x800000);
+		DWORD dwsamp = (DWORD) lsamp;
+		dst[0] = (unsigned char)(dwsamp >> (do_shift ? 0 : 16));
+		dst[1] = (unsigned char)(dwsamp >> 8);
+		dst[2] = (unsigned char)(dwsamp >> (do_shift ? 16 : 0));
+	}
+}
+
+static void psf_unpack24(int *dst, const unsigned char *src, DWORD nsamps, int do_shift)
+{
+	DWORD i;
+
+	if(do_shift){
+		for(i=0;i < nsamps;i++, src += 3)
+			dst[i] = (int)(((DWORD) src[0] << 8) | ((DWORD) src[1] << 16) | ((DWORD) src[2] << 24)) >> 8;
+	}
+	else {
+		for(i=0;i < nsamps;i++, src += 3)
+			dst[i] = (int)(((DWORD) src[2] << 8) | ((DWORD) src[1] << 16) | ((DWORD) src[0] << 24)) >> 8;
+	}
+}
+
+/* PEAK data for integer frames (sbuf for 16bit, else lbuf), found as psf_trackPeaks does */
+static void psf_trackPeaksInt(PSFFILE *sfdat, const short *sbuf, const int *lbuf, DWORD nFrames, double fac)
+{
+	int j,chans;
+	DWORD i;
+	double absmax,absval;
+
+	if(sfdat->pPeaks==NULL)
+		return;
+	chans = sfdat->fmt.Format.nChannels;
+	for(j=0;j < chans;j++){
+		absmax = 0.0;
+		for(i=0;i < nFrames;i++){
+			absval = fabs(sbuf ? (double) sbuf[i * chans + j] : (double) lbuf[i * chans + j]);
+			if(absval > absmax)
+				absmax = absval;
+		}
+		if(sfdat->pPeaks[j].val < (float)(absmax * fac)){
+			for(i=0;i < nFrames;i++){
+				absval = fabs(sbuf ? (double) sbuf[i * chans + j] : (double) lbuf[i * chans + j]);
+				if(absval == absmax)
+					break;
+			}
+			sfdat->pPeaks[j].pos = (DWORD)(sfdat->nFrames + i);
+			sfdat->pPeaks[j].val = (float)(absmax * fac);
+		}
+	}
+}
+
+static int psf_writeIntFrames(PSFFILE *sfdat, const void *buf, DWORD nFrames, psf_stype samptype)
+{
+	int do_reverse,do_shift;
+	DWORD nsamps,nbytes;
+	unsigned char *rawbuf;
+	double fac;
+
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);	
+#endif
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(nFrames == 0)
+		return nFrames;
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	if(sfdat->samptype != samptype || sfdat->src)
+		return PSF_E_UNSUPPORTED;
+	switch((int) sfdat->riff_format){
+	case(PSF_STDWAVE):
+	case(PSF_WAVE_EX):
+	case(PSF_RAW):
+	case(PSF_LAC):
+		do_reverse = (sfdat->is_little_endian ? 0 : 1 );
+        do_shift = 1;
+		break;
+	case(PSF_AIFF):
+	case(PSF_AIFC):
+		do_reverse = (sfdat->is_little_endian ? 1 : 0 );
+        do_shift = 0;
+		break;
+	default:
+		return PSF_E_UNSUPPORTED;
+	}
+	nsamps = nFrames * sfdat->fmt.Format.nChannels;
+	nbytes = nsamps * psf_wordsize(samptype);
+	if(psf_checkLength(sfdat,nFrames))
+		return PSF_E_CANT_WRITE;
+	if(sfdat->lastop  == PSF_OP_READ)
+		fflush(sfdat->file);
+	if(sfdat->async)
+		rawbuf = psf_asyncSlot(sfdat,nbytes);
+	else if(samptype != PSF_SAMP_24 && !do_reverse){
+		/* already as the file wants them */
+		if(wavDoWrite(sfdat,buf,nbytes))
+			return PSF_E_CANT_WRITE;
+		rawbuf = NULL;
+	}
+	else
+		rawbuf = psf_getIObuf(sfdat,nbytes);
+	if(rawbuf != NULL || sfdat->async){
+		if(rawbuf==NULL)
+			return PSF_E_NOMEM;
+		if(samptype==PSF_SAMP_24)
+			psf_pack24(rawbuf,(const int *) buf,nsamps,do_shift);
+		else if(!do_reverse)
+			memcpy(rawbuf,buf,nbytes);
+		else if(samptype==PSF_SAMP_16)
+			psf_kern->swap16(rawbuf,(const unsigned char *) buf,nsamps);
+		else
+			psf_kern->swap32(rawbuf,(const unsigned char *) buf,nsamps);
+		if(sfdat->async){
+			int rc = psf_asyncQueue(sfdat,nbytes);
+			if(rc < PSF_E_NOERROR)
+				return rc;
+		}
+		else if(wavDoWrite(sfdat,rawbuf,nbytes))
+			return PSF_E_CANT_WRITE;
+	}
+	/* written (or queued): now the PEAK data and overview */
+	fac = samptype==PSF_SAMP_16 ? 1.0 / MAX_16BIT
+		: samptype==PSF_SAMP_24 ? 1.0 / (MAX_32BIT / 256.0) : 1.0 / MAX_32BIT;
+	if(samptype==PSF_SAMP_16){
+		psf_trackPeaksInt(sfdat,(const short *) buf,NULL,nFrames,fac);
+		if(sfdat->ovw)
+			psf_overviewWriteInt(sfdat,(const short *) buf,NULL,nFrames,fac);
+	}
+	else {
+		psf_trackPeaksInt(sfdat,NULL,(const int *) buf,nFrames,fac);
+		if(sfdat->ovw)
+			psf_overviewWriteInt(sfdat,NULL,(const int *) buf,nFrames,fac);
+	}
+	POS64(sfdat->lastwritepos) += nFrames;
+	sfdat->curframepos = (psf_int64) POS64(sfdat->lastwritepos);
+	sfdat->nFrames = max(sfdat->nFrames,(psf_int64) POS64(sfdat->lastwritepos));
+	return nFrames;
+}
+
+int psf_sndWriteInt16Frames(int sfd, const short *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_writeIntFrames(sfdat,buf,nFrames,PSF_SAMP_16);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+int psf_sndWriteInt24Frames(int sfd, const int *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_writeIntFrames(sfdat,buf,nFrames,PSF_SAMP_24);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+int psf_sndWriteInt32Frames(int sfd, const int *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_writeIntFrames(sfdat,buf,nFrames,PSF_SAMP_32);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* deprecated! Do not use. Now the same as psf_sndWriteInt16Frames: 16bit files only */
+static int psf_writeShortFrames(PSFFILE *sfdat, const short *buf, DWORD nFrames)
+{
+	return psf_writeIntFrames(sfdat,buf,nFrames,PSF_SAMP_16);
+}
+
+int psf_sndWriteShortFrames(int sfd, const short *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_writeShortFrames(sfdat,buf,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_WRITE,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+ /******** READ ***********/
+static int wavReadHeader(PSFFILE *sfdat)
+{
+	DWORD tag,version,peaktime;
+	DWORD size;
+	WORD cbSize;
+	fpos_t bytepos;
+	psf_int64 riffsize64,datasize64 = 0,samplecount64;
+
+	if(sfdat==NULL || sfdat->file == NULL)
+		return PSF_E_BADARG;
+
+	if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoRead(sfdat,(char *) &size,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(!sfdat->is_little_endian)
+		size = REVDWBYTES(size);
+	else
+		tag = REVDWBYTES(tag);
+	if(tag == TAG('R','F','6','4'))
+		sfdat->is_rf64 = 1;
+	else if(tag != TAG('R','I','F','F'))
+		return PSF_E_NOT_WAVE;
+	if(size < (sizeof(WAVEFORMAT) + 3 * sizeof(WORD)))
+		return PSF_E_BAD_FORMAT;
+
+	if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(tag != TAG('W','A','V','E'))
+		return PSF_E_NOT_WAVE;
+	for(;;){
+		if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD))
+				|| wavDoRead(sfdat,(char *) &size,sizeof(DWORD)))
+			return PSF_E_CANT_READ;
+		if(!sfdat->is_little_endian)
+			size = REVDWBYTES(size);
+		else
+			tag = REVDWBYTES(tag);
+		switch(tag){
+		case(TAG('d','s','6','4')):
+			/* RF64: the 32bit sizes we need are here; ignore any table */
+			if(!sfdat->is_rf64 || size < PSF_DS64_SIZE)
+				return PSF_E_BAD_FORMAT;
+			if(wavReadQword(sfdat,&riffsize64)
+				|| wavReadQword(sfdat,&datasize64)
+				|| wavReadQword(sfdat,&samplecount64))
+				return PSF_E_CANT_READ;
+			if(fseek(sfdat->file,size - 3 * sizeof(psf_int64),SEEK_CUR))
+				return PSF_E_CANT_READ;
+			break;
+		case(TAG('f','m','t',' ')):
+			if( size < sizeof(WAVEFORMAT))
+				return PSF_E_BAD_FORMAT;
+			if(size > sizeof_WFMTEX)
+				return PSF_E_UNSUPPORTED;
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->fmtoffset = bytepos;
+			if(wavDoRead(sfdat,(char *)&(sfdat->fmt.Format),sizeof(WAVEFORMAT))){				
+				return PSF_E_CANT_READ;
+			}
+			if(!sfdat->is_little_endian)		
+				fmtSwapBytes(sfdat);	
+			/* calling function decides if format is supported*/
+			if(size > sizeof(WAVEFORMAT)) {
+				if(wavDoRead(sfdat,(char*)&cbSize,sizeof(WORD)))
+					return PSF_E_CANT_READ;
+				if(!sfdat->is_little_endian)		
+					cbSize = (WORD) REVWBYTES(cbSize);
+				if(cbSize != (WORD)0) {
+					if(sfdat->fmt.Format.wFormatTag	== WAVE_FORMAT_EXTENSIBLE){
+						if(cbSize != 22)
+							return PSF_E_BAD_FORMAT;
+						sfdat->riff_format = PSF_WAVE_EX;						
+					}
+				}				
+				else {
+                    int fmtsize = 18;
+					/* cbSize = 0: has to be 18-byte WAVEFORMATEX */
+					if((sfdat->fmt.Format.wFormatTag == WAVE_FORMAT_PCM
+						|| sfdat->fmt.Format.wFormatTag	== WAVE_FORMAT_IEEE_FLOAT))
+						sfdat->riff_format = PSF_STDWAVE;
+					else  /* some horribly mangled format! */
+						return PSF_E_BAD_FORMAT;
+                    /* hack to handle bad files created by company X with overlarge fmt chunk! */
+                    while (size > fmtsize){
+                        char dummy;
+                        if(wavDoRead(sfdat,(char*)&dummy,sizeof(char)))
+					        return PSF_E_CANT_READ;
+                        fmtsize++;
+                        /* TODO: send irate message to user about illformed files*/
+                    }
+				}				
+				sfdat->fmt.Format.cbSize = cbSize;
+				/* fill in as if basic Format; may change later from WAVE-EX */
+				sfdat->fmt.Samples.wValidBitsPerSample = sfdat->fmt.Format.wBitsPerSample;
+				sfdat->fmt.dwChannelMask = 0;			
+				/* get rest of WAVE-EX, if we have it */
+				if(sfdat->fmt.Format.wFormatTag	== WAVE_FORMAT_EXTENSIBLE){
+					WORD validbits;
+					DWORD chmask;
+					if(wavDoRead(sfdat,(char *) &validbits,sizeof(WORD)))
+						return PSF_E_CANT_READ;
+					if(!sfdat->is_little_endian)		
+						sfdat->fmt.Samples.wValidBitsPerSample = (WORD) REVWBYTES(validbits);
+					if(wavDoRead(sfdat,(char *) &chmask,sizeof(DWORD)))
+						return PSF_E_CANT_READ;
+                    sfdat->fmt.dwChannelMask = chmask;
+					if(!sfdat->is_little_endian)		
+						sfdat->fmt.dwChannelMask = REVDWBYTES(chmask);
+                    /* TODO: recognize more speaker layouts! */
+                    sfdat->chformat = get_speakerlayout(sfdat->fmt.dwChannelMask,sfdat->fmt.Format.nChannels);
+					if(wavDoRead(sfdat,(char *) &(sfdat->fmt.SubFormat),sizeof(GUID)))
+						return PSF_E_CANT_READ;
+					if(!sfdat->is_little_endian){
+						sfdat->fmt.SubFormat.Data1 = REVDWBYTES(sfdat->fmt.SubFormat.Data1);
+						sfdat->fmt.SubFormat.Data2 = (WORD) REVWBYTES(sfdat->fmt.SubFormat.Data2);
+						sfdat->fmt.SubFormat.Data3 = (WORD) REVWBYTES(sfdat->fmt.SubFormat.Data3);	
+					}
+					/* if we get a good GUID, this sets up sfdat with samplesize info */
+					if(check_guid(sfdat))											
+						return PSF_E_UNSUPPORTED;
+				}
+			}			
+			break;
+		case(TAG('P','E','A','K')):	
+            /* I SHOULD  report an error if this is after data chunk; 
+               but I suppose innocent users (e.g. of Cubase ) will grumble... */
+            if(wavDoRead(sfdat,(char  *) &version,sizeof(DWORD)))
+				return PSF_E_CANT_READ;
+            if(!sfdat->is_little_endian)				
+				version = REVDWBYTES(version);		            
+            if(version != 1) {
+                DBGFPRINTF((stderr, "Unexpected version level for PEAK chunk!\n"));
+					return PSF_E_UNSUPPORTED;
+            }
+            if(size != (2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels)) {
+                DBGFPRINTF((stderr, "\nBad size for PEAK chunk\n"));
+				return PSF_E_BAD_FORMAT;
+            }
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->peakoffset = bytepos;
+            if(wavDoRead(sfdat,(char *) &peaktime,sizeof(DWORD))){				
+			    DBGFPRINTF((stderr,"Error reading PEAK time\n"));
+                return PSF_E_CANT_READ;
+            }
+            if(!sfdat->is_little_endian)
+                peaktime = REVDWBYTES(peaktime);
+            sfdat->peaktime = (time_t) peaktime;
+            sfdat->pPeaks = (PSF_CHPEAK *) malloc(sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+			if(sfdat->pPeaks==NULL){
+				DBGFPRINTF((stderr, "wavOpenWrite: no memory for peak data\n"));
+				return PSF_E_NOMEM;
+			}
+            if(wavDoRead(sfdat,(char *) sfdat->pPeaks,sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels)) {
+                DBGFPRINTF((stderr,"Error reading PEAK peak data\n"));
+				return PSF_E_CANT_READ;
+            }
+			if(!sfdat->is_little_endian){
+                DWORD *pBlock;
+				int i;			
+				pBlock = (DWORD *) (sfdat->pPeaks);
+				for(i=0;i < sfdat->fmt.Format.nChannels * 2; i++)
+					pBlock[i] = REVDWBYTES(pBlock[i]);
+			}            
+			break;
+		case(TAG('d','a','t','a')):
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->dataoffset = bytepos;
+			if(POS64(sfdat->fmtoffset)==0)
+				return PSF_E_BAD_FORMAT;
+			if(sfdat->is_rf64 && size == PSF_RF64_MARKER)
+				sfdat->nFrames = datasize64 / sfdat->fmt.Format.nBlockAlign;
+			else
+				sfdat->nFrames = size / sfdat->fmt.Format.nBlockAlign;			
+			/* get rescale factor if available */
+			/* NB in correct format, val is always >= 0.0 */
+			if(sfdat->pPeaks && POS64(sfdat->peakoffset) != 0){
+				float fac = 0.0f;
+				int i;
+				for(i=0;i < sfdat->fmt.Format.nChannels; i++)
+					fac = max(fac,sfdat->pPeaks[i].val);
+				if(fac > 1.0f)
+					sfdat->rescale_fac = 1.0f / fac;
+			}
+			/* set sampletype */
+			switch(sfdat->fmt.Format.wFormatTag){
+			case(WAVE_FORMAT_IEEE_FLOAT):
+				sfdat->samptype = PSF_SAMP_IEEE_FLOAT;
+				if(sfdat->fmt.Format.wBitsPerSample != 32) {
+					/*return PSF_E_BAD_FORMAT;*/
+					if(sfdat->fmt.Format.wBitsPerSample == sizeof(double))
+						return PSF_E_UNSUPPORTED;			
+					else
+					    return PSF_E_BAD_FORMAT;
+				}
+				sfdat->lastop  = PSF_OP_READ;
+				return PSF_E_NOERROR;
+			case(WAVE_FORMAT_PCM):
+			case(WAVE_FORMAT_EXTENSIBLE):
+				switch(sfdat->fmt.Format.wBitsPerSample){
+				case(8):
+					sfdat->samptype = PSF_SAMP_8;
+					break;
+				case(16):
+					sfdat->samptype = PSF_SAMP_16;
+					break;
+				case(24):
+					sfdat->samptype = PSF_SAMP_24;
+					break;
+				case(32):
+					sfdat->samptype = PSF_SAMP_32;
+					if(compare_guids(&(sfdat->fmt.SubFormat),&KSDATAFORMAT_SUBTYPE_IEEE_FLOAT))
+						sfdat->samptype = PSF_SAMP_IEEE_FLOAT;
+					else if(!compare_guids(&(sfdat->fmt.SubFormat),&KSDATAFORMAT_SUBTYPE_PCM))
+						sfdat->samptype = PSF_SAMP_UNKNOWN;
+					break;
+				default:
+					sfdat->samptype = PSF_SAMP_UNKNOWN;
+					break;					
+				}				
+				if(sfdat->samptype == PSF_SAMP_UNKNOWN)
+					return PSF_E_UNSUPPORTED;
+				sfdat->lastop  = PSF_OP_READ;
+				return PSF_E_NOERROR;
+			}					
+			default:
+			/* unknown chunk - skip */
+			if(fseek(sfdat->file,size,SEEK_CUR))
+				return PSF_E_CANT_READ;
+			break;
+		}
+	}
+}
+
+static int aiffReadHeader(PSFFILE *sfdat)
+{
+	DWORD tag,version,peaktime,remain,offset,blocksize;
+	int have_comm =0,have_ssnd =0;	
+	DWORD dwData,size;
+	unsigned char ieee[10];
+	WORD wData;
+	fpos_t bytepos;
+
+	if(sfdat==NULL || sfdat->file == NULL)
+		return PSF_E_BADARG;
+
+	if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoRead(sfdat,(char *) &remain,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(sfdat->is_little_endian) {
+		remain = REVDWBYTES(remain);	
+		tag = REVDWBYTES(tag);
+	}
+	if(tag != TAG('F','O','R','M')){
+		DBGFPRINTF((stderr, "file is not AIFF: no PSF chunk\n"));
+		return PSF_E_BADARG;
+	}
+		
+	if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(tag != TAG('A','I','F','F')){
+		DBGFPRINTF((stderr, "file is not AIFF: no AIFF chunk\n"));
+		return PSF_E_BADARG;
+	}
+	remain -= sizeof(int);
+
+
+	while(remain > 0){
+		if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoRead(sfdat,(char *) &size,sizeof(DWORD)))
+			return PSF_E_CANT_READ;
+		if(sfdat->is_little_endian) {
+			size = REVDWBYTES(size);	
+			tag = REVDWBYTES(tag);
+		}
+		remain -=(int)( 2 * sizeof(DWORD));
+		switch(tag){
+		case(TAG('C','O','M','M')):
+			if(size != 18){
+				DBGFPRINTF((stderr,"AIFF file has bad size for COMM chunk\n")); 
+			    return PSF_E_BAD_FORMAT;
+			}
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->fmtoffset = bytepos;
+			if(wavDoRead(sfdat,(char *)&wData,sizeof(WORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian)
+				wData = (WORD) REVWBYTES(wData);
+			sfdat->fmt.Format.nChannels = wData;
+			if(wavDoRead(sfdat,(char *)&dwData,sizeof(DWORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian)
+				dwData = REVDWBYTES(dwData);
+			sfdat->nFrames = dwData;
+			if(wavDoRead(sfdat,(char *)&wData,sizeof(WORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian)
+				wData = (WORD) REVWBYTES(wData);
+			sfdat->fmt.Format.wBitsPerSample = wData;
+			if(wavDoRead(sfdat,ieee,10))
+				return PSF_E_CANT_READ;
+			sfdat->fmt.Format.nSamplesPerSec = (DWORD)(ieee_80_to_double(ieee));
+			/*we have to deduce blockalign, and hence containersize*/
+			/* no support (yet) for strange wordsizes such as 20 in 24 */
+			switch(sfdat->fmt.Format.wBitsPerSample){
+			case(32):
+				sfdat->fmt.Format.nBlockAlign = sizeof(int);
+				sfdat->samptype = PSF_SAMP_32;
+				break;			
+			case(24):
+				sfdat->fmt.Format.nBlockAlign = 3;
+				sfdat->samptype = PSF_SAMP_24;
+				break;
+			case(16):
+				sfdat->fmt.Format.nBlockAlign = sizeof(short);
+				sfdat->samptype = PSF_SAMP_16;
+				break;
+			default:
+				DBGFPRINTF((stderr, "unsupported sample format for AIFF file\n"));
+				return PSF_E_UNSUPPORTED;
+			}
+			sfdat->fmt.Format.nBlockAlign = (WORD) (sfdat->fmt.Format.nBlockAlign * sfdat->fmt.Format.nChannels);
+			remain -= 18;
+			have_comm = 1;
+			break;
+		case (TAG('P','E','A','K')):
+			if(!have_comm){
+				DBGFPRINTF((stderr, "AIFF file: found PEAK chunk before COMM chunk!\n"));
+				return PSF_E_BAD_FORMAT;
+			}
+			if(size != (2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels)){
+				DBGFPRINTF((stderr, "AIFF file has bad size for PEAK chunk\n"));
+				return PSF_E_BAD_FORMAT;
+			}
+            if(wavDoRead(sfdat,(char *)&version,sizeof(DWORD))) {
+                DBGFPRINTF((stderr,"Error reading PEAK version\n"));
+                return PSF_E_CANT_READ;
+            }
+            if(sfdat->is_little_endian)				
+				version  = REVDWBYTES(version);
+            if(version != 1){
+				DBGFPRINTF((stderr, "AIFF file has unexpected version level for PEAK chunk!\n"));
+				return PSF_E_UNSUPPORTED;
+			}
+		    if(fgetpos(sfdat->file,&bytepos))
+			return PSF_E_CANT_SEEK;
+		    sfdat->peakoffset = bytepos;
+            if(wavDoRead(sfdat,(char *) &peaktime,sizeof(DWORD))) {
+                DBGFPRINTF((stderr,"Error reading PEAK time\n"));
+				return PSF_E_CANT_READ;
+            }
+			if(sfdat->is_little_endian)								
+				peaktime = REVDWBYTES(peaktime);						
+			sfdat->peaktime = (time_t) peaktime;			
+			sfdat->pPeaks = (PSF_CHPEAK *)malloc(sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+            if(sfdat->pPeaks==NULL){
+			    DBGFPRINTF((stderr, "wavOpenWrite: no memory for peak data\n"));
+                return PSF_E_NOMEM;
+            }
+            if(wavDoRead(sfdat,(char *)(sfdat->pPeaks),sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels)){
+                DBGFPRINTF((stderr,"Error reading PEAK peak data\n"));   
+				return PSF_E_CANT_READ;
+             }
+			if(sfdat->is_little_endian){
+				DWORD *pBlock;
+				int i;
+				pBlock = (DWORD *) (sfdat->pPeaks);
+				for(i=0;i < sfdat->fmt.Format.nChannels * 2; i++)
+					pBlock[i] = REVDWBYTES(pBlock[i]); 
+			}			
+			remain -= size;
+			break;
+		case(TAG('S','S','N','D')):
+			if(wavDoRead(sfdat,(char *)&offset,sizeof(DWORD))
+					|| wavDoRead(sfdat,(char *) &blocksize,sizeof(DWORD)))
+			return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian){				
+				offset  = REVDWBYTES(offset);
+				blocksize = REVDWBYTES(blocksize);
+			}
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->dataoffset = bytepos;
+			POS64(sfdat->dataoffset) += offset;
+			sfdat->nFrames = (size - 2* sizeof(DWORD))/ sfdat->fmt.Format.nBlockAlign;
+			/* NB for seek: we used up 8 bytes with offset and blocksize */
+			/* if we already have COMM, we could finish here! */
+			if(fseek(sfdat->file,((size - 2* sizeof(DWORD))+1)&~1,SEEK_CUR))
+				return PSF_E_CANT_SEEK;				
+			have_ssnd = 1;
+			remain -= (size+1)&~1;
+			break;
+		/*HARSH! traps old linux sox error, for example */
+		case(0):
+			DBGFPRINTF((stderr, "AIFF file has bad main chunksize\n"));
+			return PSF_E_BAD_FORMAT;
+		default:
+			/* skip all unknown chunks */
+            if(fseek(sfdat->file,(size+1)&~1,SEEK_CUR))
+				return PSF_E_CANT_SEEK;
+			remain -= (size+1)&~1;
+			break;
+		}
+	}
+	if(!(have_ssnd && have_comm)){
+		DBGFPRINTF((stderr, "AIFF file has missing chunks\n"));
+		return PSF_E_BAD_FORMAT;
+	}
+	/* we have seeked to EOF, so rewind to start of data */
+	if(fsetpos(sfdat->file,&sfdat->dataoffset))
+		return PSF_E_CANT_SEEK;			
+	sfdat->curframepos = 0;	
+	sfdat->riff_format = PSF_AIFF;
+	/* get rescale factor if available */
+	/* NB in correct format, val is always >= 0.0 */
+	if(sfdat->pPeaks &&  POS64(sfdat->peakoffset) != 0){
+		float fac = 0.0f;
+		int i;
+		for(i=0;i < sfdat->fmt.Format.nChannels; i++)
+			fac = max(fac,sfdat->pPeaks[i].val);
+		if(fac > 1.0f)
+			sfdat->rescale_fac = 1.0f / fac;
+	}
+	sfdat->lastop  = PSF_OP_READ;
+	return PSF_E_NOERROR;
+}
+
+static int aifcReadHeader(PSFFILE *sfdat)
+{
+	DWORD tag,version,peaktime,remain,offset,blocksize;
+	int have_comm =0,have_ssnd =0,have_fver = 0;	
+	DWORD dwData,size,aifcver,ID_compression;
+	unsigned char ieee[10];
+	WORD wData;
+	fpos_t bytepos;
+
+	if(sfdat==NULL || sfdat->file == NULL)
+		return PSF_E_BADARG;
+
+	if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoRead(sfdat,(char *) &remain,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(sfdat->is_little_endian) {
+		remain = REVDWBYTES(remain);	
+		tag = REVDWBYTES(tag);
+	}
+	if(tag != TAG('F','O','R','M')){
+		DBGFPRINTF((stderr, "file is not AIFC: no FORM chunk\n"));
+		return PSF_E_BADARG;
+	}
+	
+	if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD)))
+		return PSF_E_CANT_READ;
+	if(sfdat->is_little_endian)
+		tag = REVDWBYTES(tag);
+	if(tag != TAG('A','I','F','C')){
+		DBGFPRINTF((stderr, "file is not AIFC: no AIFC chunk\n"));
+		return PSF_E_BADARG;
+	}
+	remain -= sizeof(DWORD);
+
+
+	while(remain > 0){
+		if(wavDoRead(sfdat,(char *)&tag,sizeof(DWORD))
+		|| wavDoRead(sfdat,(char *) &size,sizeof(DWORD)))
+			return PSF_E_CANT_READ;
+		if(sfdat->is_little_endian) {
+			size = REVDWBYTES(size);	
+			tag = REVDWBYTES(tag);
+		}
+		remain -= 2 * sizeof(DWORD);
+		switch(tag){
+		case(TAG('F','V','E','R')):
+			if(size != sizeof(DWORD)){
+				DBGFPRINTF((stderr, "AIFC file has bad size for FVER chunk\n"));
+				return PSF_E_BAD_FORMAT;
+			}
+			if(wavDoRead(sfdat,(char *) &aifcver,sizeof(DWORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian) 
+				aifcver = REVDWBYTES(aifcver);
+			remain-= sizeof(DWORD);
+			if(aifcver != AIFC_VERSION_1)
+				return PSF_E_UNSUPPORTED;
+			have_fver = 1;
+			break;
+		case(TAG('C','O','M','M')):
+			if(size < 22) {
+			   DBGFPRINTF((stderr, "AIFC file has bad size for COMM chunk\n"));
+			   return PSF_E_BAD_FORMAT;
+			}
+			if(fgetpos(sfdat->file,&sfdat->fmtoffset))
+			    return PSF_E_CANT_SEEK;
+			if(wavDoRead(sfdat,(char *)&wData,sizeof(WORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian)
+				wData = (WORD) REVWBYTES(wData);
+			sfdat->fmt.Format.nChannels = wData;
+			if(wavDoRead(sfdat,(char *)&dwData,sizeof(DWORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian)
+				dwData = REVDWBYTES(dwData);
+			sfdat->nFrames = dwData;
+			if(wavDoRead(sfdat,(char *)&wData,sizeof(WORD)))
+				return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian)
+				wData = (WORD) REVWBYTES(wData);
+			sfdat->fmt.Format.wBitsPerSample = wData;
+			if(wavDoRead(sfdat,ieee,10))
+				return PSF_E_CANT_READ;
+			sfdat->fmt.Format.nSamplesPerSec = (DWORD)(ieee_80_to_double(ieee));
+			/*we have to deduce blockalign, and hence containersize*/
+			/* no support for strange wordsizes such as 20 in 24 */
+			switch(sfdat->fmt.Format.wBitsPerSample){
+			case(32):
+				sfdat->fmt.Format.nBlockAlign = sizeof(DWORD);
+				sfdat->samptype = PSF_SAMP_32;
+				break;			
+			case(24):
+				sfdat->fmt.Format.nBlockAlign = 3;
+				sfdat->samptype = PSF_SAMP_24;
+				break;
+			case(16):
+				sfdat->fmt.Format.nBlockAlign = sizeof(short);
+				sfdat->samptype = PSF_SAMP_16;
+				break;			
+			default:
+				DBGFPRINTF((stderr, "unsupported sample format for AIFC file\n"));
+				return PSF_E_UNSUPPORTED;
+			}
+			sfdat->fmt.Format.nBlockAlign = (WORD) (sfdat->fmt.Format.nBlockAlign * sfdat->fmt.Format.nChannels);
+			if(wavDoRead(sfdat,(char *)&ID_compression,sizeof(DWORD))){
+				return PSF_E_CANT_READ;	
+			}
+			if(sfdat->is_little_endian)
+				ID_compression = REVDWBYTES(ID_compression);
+            /* TODO: recognize any more pcm quasi-compression formats? */    
+			if(!(    (ID_compression == TAG('N','O','N','E'))
+				  || (ID_compression == TAG('F','L','3','2'))	
+				  || (ID_compression == TAG('f','l','3','2'))
+                  || (ID_compression == TAG('i','n','2','4')))	
+						  ){
+				DBGFPRINTF((stderr, "AIFC file: unsupported compression format\n"));
+				return PSF_E_UNSUPPORTED;
+			}
+			/*set stype info */
+			if((ID_compression== TAG('F','L','3','2'))		  
+				|| ID_compression == TAG('f','l','3','2')){
+					if(sfdat->fmt.Format.wBitsPerSample != 32){						
+						DBGFPRINTF((stderr, "AIFC file: samples not 32bit in floats file\n"));
+						return PSF_E_BAD_FORMAT;
+					}
+					else {
+						sfdat->fmt.Format.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;			
+						sfdat->samptype = PSF_SAMP_IEEE_FLOAT;
+					}
+			}
+			/* yes, lazy! skip past pascal string*/
+			if(fseek(sfdat->file,((size-22)+1)&~1,SEEK_CUR))	/*written for documentation, not terseness!*/
+				return PSF_E_CANT_SEEK;
+			remain -= (size+1)&~1;
+			have_comm = 1;
+			break;
+		case (TAG('P','E','A','K')):
+			if(!have_comm){
+				DBGFPRINTF((stderr, "\nAIFC file: found PEAK chunk before COMM chunk!\n"));
+				return PSF_E_BAD_FORMAT;
+			}
+			if(size != (2 * sizeof(DWORD) + sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels)){
+				DBGFPRINTF((stderr, "\nBad size for PEAK chunk\n"));
+				return PSF_E_BAD_FORMAT;
+			}
+			if(wavDoRead(sfdat,(char *)&version,sizeof(DWORD)))
+				return PSF_E_CANT_READ;
+            if(sfdat->is_little_endian)				
+				version  = REVDWBYTES(version);	
+            if(version != 1) {
+				DBGFPRINTF((stderr, "Unexpected version level for PEAK chunk!\n"));
+				return PSF_E_UNSUPPORTED;
+			}
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->peakoffset = bytepos;
+            if(wavDoRead(sfdat,(char *) &peaktime,sizeof(DWORD))){
+                DBGFPRINTF((stderr,"Error reading PEAK time\n"));
+				return PSF_E_CANT_READ;
+            }
+			if(sfdat->is_little_endian)							
+				peaktime = REVDWBYTES(peaktime);			
+			sfdat->peaktime = (time_t) peaktime;			
+			sfdat->pPeaks = (PSF_CHPEAK *)malloc(sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels);
+            if(sfdat->pPeaks==NULL) {
+                DBGFPRINTF((stderr, "wavOpenWrite: no memory for peak data\n"));
+				return PSF_E_NOMEM;
+            }
+            if(wavDoRead(sfdat,(char *)(sfdat->pPeaks),sizeof(PSF_CHPEAK) * sfdat->fmt.Format.nChannels)) {
+                DBGFPRINTF((stderr,"Error reading PEAK peak data\n"));
+				return PSF_E_CANT_READ;
+            }
+			if(sfdat->is_little_endian){
+				DWORD *pBlock;
+				int i;
+				pBlock = (DWORD *) (sfdat->pPeaks);
+				for(i=0;i < sfdat->fmt.Format.nChannels * 2; i++)
+					pBlock[i] = REVDWBYTES(pBlock[i]); 
+			}			
+			remain -= (size+1)&~1;
+			break;
+		case(TAG('S','S','N','D')):
+			if(wavDoRead(sfdat,(char *)&offset,sizeof(DWORD))
+					|| wavDoRead(sfdat,(char *) &blocksize,sizeof(DWORD)))
+			return PSF_E_CANT_READ;
+			if(sfdat->is_little_endian){				
+				offset  = REVDWBYTES(offset);
+				blocksize = REVDWBYTES(blocksize);
+			}
+			if(fgetpos(sfdat->file,&bytepos))
+			    return PSF_E_CANT_SEEK;
+			sfdat->dataoffset = bytepos;
+			POS64(sfdat->dataoffset) += offset;
+			sfdat->nFrames = (size - 2* sizeof(DWORD))/ sfdat->fmt.Format.nBlockAlign;			
+			if(fseek(sfdat->file,((size - 2* sizeof(DWORD))+1)&~1,SEEK_CUR))
+				return PSF_E_CANT_SEEK;
+			have_ssnd = 1;
+			remain -= (size+1)&~1;
+			break;
+		/* HARSH! as above */
+		case(0):
+			DBGFPRINTF((stderr, "AIFC file has bad main chunksize\n"));
+			return PSF_E_BAD_FORMAT;
+		default:
+			/* skip all unknown chunks */
+			if(fseek(sfdat->file,(size+1)&~1,SEEK_CUR))
+				return PSF_E_CANT_SEEK;
+			remain -= (size+1)&~1;
+			break;
+		}
+	}
+	if(!(have_ssnd && have_comm && have_fver)){
+		DBGFPRINTF((stderr, "AIFC file has bad format\n"));
+		return PSF_E_BAD_FORMAT;
+	}
+	/* we have seeked (ugh) to EOF, so rewind to start of data */
+	if(fsetpos(sfdat->file,&sfdat->dataoffset))
+		return PSF_E_CANT_SEEK;			
+	sfdat->curframepos = 0;	
+	sfdat->riff_format = PSF_AIFC;
+	/* get rescale factor if available */
+	/* NB in correct format, val is always >= 0.0 */
+	if(sfdat->pPeaks &&  POS64(sfdat->peakoffset) != 0){
+		float fac = 0.0f;
+		int i;
+		for(i=0;i < sfdat->fmt.Format.nChannels; i++)
+			fac = max(fac,sfdat->pPeaks[i].val);
+		if(fac > 1.0f)
+			sfdat->rescale_fac = 1.0f / fac;
+	}
+	sfdat->lastop  = PSF_OP_READ;
+	return PSF_E_NOERROR;
+}
+#ifdef unix
+/* PSF_OPEN_MMAP: map the data chunk found by the header reader. 
+   Return 0 if mapped, non-zero if we must carry on with stdio reads. */
+static int psf_mapData(PSFFILE *sfdat)
+{
+	struct stat st;
+	long pagesize;
+	off_t dataoff,mapoff;
+	size_t datasize;
+	void *base;
+
+	if(fstat(fileno(sfdat->file),&st))
+		return 1;
+	dataoff = (off_t) POS64(sfdat->dataoffset);
+	datasize = (size_t) sfdat->nFrames * sfdat->fmt.Format.nBlockAlign;
+	/* a short file will fail reads as before, rather than fault in the mapping */
+	if(st.st_size < dataoff)
+		return 1;
+	datasize = min(datasize,(size_t)(st.st_size - dataoff));
+	if(datasize==0)
+		return 1;
+	pagesize = sysconf(_SC_PAGESIZE);
+	if(pagesize <= 0)
+		return 1;
+	mapoff = dataoff - (dataoff % pagesize);
+	base = mmap(NULL,(size_t)(dataoff - mapoff) + datasize,PROT_READ,MAP_SHARED,fileno(sfdat->file),mapoff);
+	if(base==MAP_FAILED){
+		DBGFPRINTF((stderr, "psf_mapData: cannot map '%s', using stdio\n", sfdat->filename));
+		return 1;
+	}
+	sfdat->mapbase = (unsigned char *) base;
+	sfdat->maplen  = (size_t)(dataoff - mapoff) + datasize;
+	sfdat->mapdata = sfdat->mapbase + (dataoff - mapoff);
+	sfdat->mapsize = datasize;
+	sfdat->mappos  = 0;
+	return 0;
+}
+#endif
+
+/* only RDONLY access supported */
+/* decide sfile format from the first 12 bytes (and rewind): RIFF or RF64 ... WAVE, FORM ... AIFF or AIFC, PLAC.
+   Either WAVE is reported as PSF_STDWAVE; wavReadHeader finds WAVE_EX */
+static psf_format psf_getFormatHeader(FILE *fp)
+{
+	unsigned char magic[12];
+	size_t got;
+
+	got = fread(magic,sizeof(char),sizeof(magic),fp);
+	rewind(fp);
+	if(got != sizeof(magic))
+		return PSF_FMT_UNKNOWN;
+	if((!memcmp(magic,"RIFF",4) || !memcmp(magic,"RF64",4)) && !memcmp(magic + 8,"WAVE",4))
+		return PSF_STDWAVE;
+	if(!memcmp(magic,"FORM",4)){
+		if(!memcmp(magic + 8,"AIFF",4))
+			return PSF_AIFF;
+		if(!memcmp(magic + 8,"AIFC",4))
+			return PSF_AIFC;
+	}
+	if(!memcmp(magic,"PLAC",4))
+		return PSF_LAC;
+	return PSF_FMT_UNKNOWN;
+}
+
+/* read the header of a file just opened for reading */
+static int psf_readHeader(PSFFILE *sfdat, psf_format fmt)
+{
+	int rc;
+
+	/* no need to calc header sizes */
+	switch((int) fmt){
+	case(PSF_STDWAVE):
+    case(PSF_WAVE_EX):
+		rc =  wavReadHeader(sfdat);
+		break;
+	case(PSF_AIFF):
+    /* some .aiff files may actually be aifc - esp if floats! */
+    case(PSF_AIFC):
+		rc = aiffReadHeader(sfdat);
+		/* try AIFC if AIFF fails */
+		if(rc < PSF_E_NOERROR) {
+			rewind(sfdat->file);
+			rc =  aifcReadHeader(sfdat);
+		}
+		break;
+	case(PSF_LAC):
+		rc = lacReadHeader(sfdat);
+		break;
+	default:
+		DBGFPRINTF((stderr, "psf_sndOpen: unsupported file format\n"));
+		rc =  PSF_E_UNSUPPORTED;
+	}
+	return rc;
+}
+
+/* fill props info */
+static void psf_getProps(PSFFILE *sfdat, psf_format fmt, PSF_PROPS *props)
+{
+	props->srate	= sfdat->fmt.Format.nSamplesPerSec;
+	props->chans	= sfdat->fmt.Format.nChannels;
+	props->samptype = sfdat->samptype;	
+	props->chformat = sfdat->chformat;
+	props->format      =  fmt;
+	if(fmt==PSF_STDWAVE && (sfdat->riff_format == PSF_WAVE_EX))	 
+		props->format = PSF_WAVE_EX;
+}
+
+int psf_sndOpen(const char *path,PSF_PROPS *props, int rescale)
+{
+	return psf_sndOpenEx(path,props,rescale,PSF_OPEN_DEFAULT);
+}
+
+int psf_sndOpenEx(const char *path,PSF_PROPS *props, int rescale, int flags)
+{
+	int i,rc = 0;
+	PSFFILE *sfdat;	
+	psf_format fmt;
+	char *fname = NULL;
+	
+	sfdat = psf_newFile(NULL);
+	if(sfdat==NULL){		
+		return PSF_E_NOMEM;
+	}	
+	sfdat->rescale = rescale;	
+	sfdat->is_little_endian = byte_order();
+	fmt = psf_getFormatExt(path);
+	if(!(fmt==PSF_STDWAVE || fmt==PSF_WAVE_EX || fmt==PSF_AIFF || fmt==PSF_AIFC || fmt==PSF_LAC))
+		return PSF_E_BADARG;	
+
+	if((sfdat->file = fopen(path,"rb"))  == NULL) {
+		DBGFPRINTF((stderr, "psf_sndOpen: cannot open '%s'\n", path));
+        return PSF_E_CANT_OPEN;
+	}
+	sfdat->filename = (char *) malloc(strlen(path)+1);
+	if(sfdat->filename==NULL) {		
+		return PSF_E_NOMEM;
+	}
+    strcpy(sfdat->filename, path);
+    sfdat->isRead =  1;	
+	sfdat->nFrames = 0;
+	rc = psf_readHeader(sfdat,fmt);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+#ifdef unix
+	/* (compressed data has to be decoded anyway) */
+	if((flags & PSF_OPEN_MMAP) && fmt != PSF_LAC)
+		psf_mapData(sfdat);
+#endif
+	/* reader thread starts with the first read */
+	if(flags & PSF_OPEN_READAHEAD){
+		sfdat->ra_nblocks = PSF_RA_DEFBLOCKS;
+		sfdat->ra_blockframes = PSF_RA_DEFFRAMES;
+	}
+	psf_getProps(sfdat,fmt,props);
+
+	i = psf_newHandle(sfdat);
+	if(i < 0){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+	}
+	return i;
+}
+
+/* raw data has no header: props tells us what is there */
+int psf_sndOpenRaw(const char *path, PSF_PROPS *props, int flags)
+{
+	int i;
+	PSFFILE *sfdat;
+	PSF_PROPS rawprops;
+	fpos_t start,end;
+
+	if(path==NULL || props==NULL)
+		return PSF_E_BADARG;
+	rawprops = *props;
+	rawprops.format = PSF_RAW;
+	sfdat = psf_newFile(&rawprops);
+	if(sfdat==NULL)
+		return PSF_E_BADARG;		/* (or no memory) */
+	if(strcmp(path,"-")==0)
+		sfdat->file = stdin;
+	else if((sfdat->file = fopen(path,"rb"))  == NULL) {
+		DBGFPRINTF((stderr, "psf_sndOpenRaw: cannot open '%s'\n", path));
+		psf_freeFile(sfdat);
+        return PSF_E_CANT_OPEN;
+	}
+	sfdat->filename = (char *) malloc(strlen(path)+1);
+	if(sfdat->filename==NULL) {
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+		return PSF_E_NOMEM;
+	}
+    strcpy(sfdat->filename, path);
+    sfdat->isRead = 1;
+	/* anything we can seek in has a length: the rest are streams */
+	if(fgetpos(sfdat->file,&start)==0 && fseek(sfdat->file,0,SEEK_END)==0
+		&& fgetpos(sfdat->file,&end)==0 && fsetpos(sfdat->file,&start)==0)
+		sfdat->nFrames = (POS64(end) - POS64(start)) / sfdat->fmt.Format.nBlockAlign;
+	else {
+		clearerr(sfdat->file);
+		sfdat->isstream = 1;
+		sfdat->nFrames = PSF_STREAMFRAMES;
+	}
+	if(!sfdat->isstream){
+		/* (stdin may be a file someone has already read some of) */
+		POS64(sfdat->dataoffset) = POS64(start);
+#ifdef unix
+		if(flags & PSF_OPEN_MMAP)
+			psf_mapData(sfdat);
+#endif
+		if(flags & PSF_OPEN_READAHEAD){
+			sfdat->ra_nblocks = PSF_RA_DEFBLOCKS;
+			sfdat->ra_blockframes = PSF_RA_DEFFRAMES;
+		}
+	}
+	props->format = PSF_RAW;
+
+	i = psf_newHandle(sfdat);
+	if(i < 0){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+	}
+	return i;
+}
+
+#ifdef unix
+/* stdio calls these for a file in memory */
+static ssize_t psf_memRead(void *cookie, char *buf, size_t nbytes)
+{
+	struct psf_memfile *mem = (struct psf_memfile *) cookie;
+
+	if(mem->pos >= mem->size)
+		return 0;
+	nbytes = min(nbytes,mem->size - mem->pos);
+	memcpy(buf,mem->buf + mem->pos,nbytes);
+	mem->pos += nbytes;
+	return (ssize_t) nbytes;
+}
+
+static ssize_t psf_memWrite(void *cookie, const char *buf, size_t nbytes)
+{
+	struct psf_memfile *mem = (struct psf_memfile *) cookie;
+	size_t end = mem->pos + nbytes,cap;
+	unsigned char *newbuf;
+
+	if(end < mem->pos){
+		errno = EFBIG;
+		return -1;
+	}
+	if(end > mem->cap){
+		if(!mem->grow){
+			errno = ENOSPC;
+			return -1;
+		}
+		/* doubling, so a long file is copied only a few times over */
+		cap = max(end,max(mem->cap * 2,PSF_MEM_MINSIZE));
+		newbuf = (unsigned char *) realloc(mem->buf,cap);
+		if(newbuf==NULL){
+			errno = ENOMEM;
+			return -1;
+		}
+		mem->buf = newbuf;
+		mem->cap = cap;
+	}
+	/* a seek beyond the end leaves a gap, as in a file */
+	if(mem->pos > mem->size)
+		memset(mem->buf + mem->size,0,mem->pos - mem->size);
+	memcpy(mem->buf + mem->pos,buf,nbytes);
+	mem->pos = end;
+	if(end > mem->size)
+		mem->size = end;
+	return (ssize_t) nbytes;
+}
+
+static int psf_memSeek(void *cookie, off64_t *offset, int whence)
+{
+	struct psf_memfile *mem = (struct psf_memfile *) cookie;
+	off64_t pos;
+
+	switch(whence){
+	case(SEEK_SET):
+		pos = *offset;
+		break;
+	case(SEEK_CUR):
+		pos = (off64_t) mem->pos + *offset;
+		break;
+	case(SEEK_END):
+		pos = (off64_t) mem->size + *offset;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+	if(pos < 0){
+		errno = EINVAL;
+		return -1;
+	}
+	mem->pos = (size_t) pos;
+	*offset = pos;
+	return 0;
+}
+
+/* the bytes belong to the PSFFILE: psf_release_file frees them */
+static int psf_memClose(void *cookie)
+{
+	return 0;
+}
+
+/* a FILE on mem: unbuffered, so each fread and fwrite is one memcpy */
+static FILE *psf_memOpen(struct psf_memfile *mem, const char *mode)
+{
+	cookie_io_functions_t io;
+	FILE *fp;
+
+	io.read = psf_memRead;
+	io.write = psf_memWrite;
+	io.seek = psf_memSeek;
+	io.close = psf_memClose;
+	fp = fopencookie(mem,mode,io);
+	if(fp)
+		setvbuf(fp,NULL,_IONBF,0);
+	return fp;
+}
+
+/* a new PSFFILE on the bytes in buf (cap of them, size in use): props for a new file to write,
+   or NULL to read */
+static PSFFILE *psf_newMemFile(const PSF_PROPS *props, void *buf, size_t size, size_t cap, int grow)
+{
+	PSFFILE *sfdat;
+	static const char memname[] = "<memory>";
+
+	sfdat = psf_newFile(props);
+	if(sfdat==NULL)
+		return NULL;
+	sfdat->mem = (struct psf_memfile *) malloc(sizeof(struct psf_memfile));
+	sfdat->filename = (char *) malloc(sizeof(memname));
+	if(sfdat->mem==NULL || sfdat->filename==NULL){
+		free(sfdat->mem);
+		sfdat->mem = NULL;
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+		return NULL;
+	}
+	strcpy(sfdat->filename,memname);
+	sfdat->mem->buf = (unsigned char *) buf;
+	sfdat->mem->size = size;
+	sfdat->mem->cap = cap;
+	sfdat->mem->pos = 0;
+	sfdat->mem->grow = grow;
+	sfdat->file = psf_memOpen(sfdat->mem,props ? "wb+" : "rb");
+	if(sfdat->file==NULL){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+		return NULL;
+	}
+	return sfdat;
+}
+
+/* as psf_sndOpenEx, but the format comes from the header, and the samples are read
+   straight from data, as from a mapping (there is no mapbase: nothing to unmap) */
+int psf_sndOpenMem(const void *data, size_t size, PSF_PROPS *props, int rescale)
+{
+	int i,rc;
+	PSFFILE *sfdat;
+	psf_format fmt;
+	size_t dataoff,datasize;
+
+	if(data==NULL || props==NULL)
+		return PSF_E_BADARG;
+	/* (never written: the FILE is read-only) */
+	sfdat = psf_newMemFile(NULL,(void *) data,size,size,0);
+	if(sfdat==NULL)
+		return PSF_E_NOMEM;
+	sfdat->rescale = rescale;
+	sfdat->is_little_endian = byte_order();
+	sfdat->isRead = 1;
+	sfdat->nFrames = 0;
+	fmt = psf_getFormatHeader(sfdat->file);
+	if(fmt==PSF_FMT_UNKNOWN)
+		rc = PSF_E_UNSUPPORTED;
+	else
+		rc = psf_readHeader(sfdat,fmt);
+	if(rc < PSF_E_NOERROR){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+		return rc;
+	}
+	/* (compressed data is decoded through the FILE) */
+	dataoff = (size_t) POS64(sfdat->dataoffset);
+	datasize = (size_t) sfdat->nFrames * sfdat->fmt.Format.nBlockAlign;
+	if(fmt != PSF_LAC && dataoff < size){
+		sfdat->mapdata = sfdat->mem->buf + dataoff;
+		sfdat->mapsize = min(datasize,size - dataoff);
+		sfdat->mappos = 0;
+	}
+	psf_getProps(sfdat,fmt,props);
+
+	i = psf_newHandle(sfdat);
+	if(i < 0){
+		psf_release_file(sfdat);
+		psf_freeFile(sfdat);
+	}
+	return i;
+}
+
+int psf_sndCreateMem(void *buf, size_t size, const PSF_PROPS *props, int clip_floats, int minheader)
+{
+	PSFFILE *sfdat;
+
+	if(props==NULL || (buf==NULL && size != 0))
+		return PSF_E_BADARG;
+	sfdat = psf_newMemFile(props,buf,0,size,buf==NULL);
+	if(sfdat==NULL)
+		return PSF_E_NOMEM;		/* (or bad props) */
+	sfdat->clip_floats = clip_floats;
+	sfdat->minheader = minheader;
+	return psf_createFile(sfdat,props->format,props);
+}
+#else
+int psf_sndOpenMem(const void *data, size_t size, PSF_PROPS *props, int rescale)
+{
+	return PSF_E_UNSUPPORTED;
+}
+
+int psf_sndCreateMem(void *buf, size_t size, const PSF_PROPS *props, int clip_floats, int minheader)
+{
+	return PSF_E_UNSUPPORTED;
+}
+#endif
+
+/* Read just the header: no handle, no buffers, no mapping, and the file is closed again
+   before we return. The format comes from the first 12 bytes, not the name. */
+int psf_sndProbe(const char *path, PSF_PROPS *props, PSF_PROBEINFO *info)
+{
+	int i,rc;
+	PSFFILE *sfdat;
+	psf_format fmt;
+
+	if(path==NULL || props==NULL)
+		return PSF_E_BADARG;
+	sfdat = psf_newFile(NULL);
+	if(sfdat==NULL)
+		return PSF_E_NOMEM;
+	sfdat->is_little_endian = byte_order();
+	if((sfdat->file = fopen(path,"rb"))  == NULL) {
+		psf_freeFile(sfdat);
+		return PSF_E_CANT_OPEN;
+	}
+	fmt = psf_getFormatHeader(sfdat->file);
+	if(fmt==PSF_FMT_UNKNOWN)
+		rc = PSF_E_UNSUPPORTED;
+	else
+		rc = psf_readHeader(sfdat,fmt);
+	if(rc >= PSF_E_NOERROR){
+		rc = PSF_E_NOERROR;
+		psf_getProps(sfdat,fmt,props);
+		if(info){
+			info->nFrames = sfdat->nFrames;
+			info->haspeaks = sfdat->pPeaks != NULL;
+			info->peaktime = info->haspeaks ? (MYLONG) sfdat->peaktime : 0;
+			if(info->peaks && sfdat->pPeaks){
+				for(i=0;i < info->maxpeaks && i < sfdat->fmt.Format.nChannels;i++)
+					info->peaks[i] = sfdat->pPeaks[i];
+			}
+		}
+	}
+	psf_release_file(sfdat);
+	psf_freeFile(sfdat);
+	return rc;
+}
+
+/* decode nsamps samples from raw (file byte order), applying any float rescale */
+static int psf_decodeBlock(PSFFILE *sfdat, float *dst, const unsigned char *raw, DWORD nsamps, int do_reverse, int do_shift)
+{
+	switch(sfdat->samptype){
+	case(PSF_SAMP_IEEE_FLOAT):
+		if(do_reverse)
+			psf_kern->decodeFloatRev(dst,raw,nsamps);
+		else
+			memcpy(dst,raw,nsamps * sizeof(float));
+		if(sfdat->rescale)
+			psf_scaleFloats(dst,nsamps,sfdat->rescale_fac);
+		break;
+	case(PSF_SAMP_16):
+		psf_kern->decode16(dst,raw,nsamps,do_reverse);
+		break;
+	case(PSF_SAMP_24):
+		psf_kern->decode24(dst,raw,nsamps,do_shift);
+		break;
+	case(PSF_SAMP_32):
+		psf_kern->decode32(dst,raw,nsamps,do_reverse);
+		break;
+	default:
+		DBGFPRINTF((stderr, "psf_sndOpen: unsupported sample format\n"));
+		return PSF_E_UNSUPPORTED;
+	}
+	return PSF_E_NOERROR;
+}
+
+static int psf_decodeBlockDouble(PSFFILE *sfdat, double *dst, const unsigned char *raw, DWORD nsamps, int do_reverse, int do_shift)
+{
+	switch(sfdat->samptype){
+	case(PSF_SAMP_IEEE_FLOAT):
+		psf_decodeFloatDouble(dst,raw,nsamps,do_reverse,sfdat->rescale ? (double) sfdat->rescale_fac : 1.0);
+		break;
+	case(PSF_SAMP_16):
+		psf_decode16Double(dst,raw,nsamps,do_reverse);
+		break;
+	case(PSF_SAMP_24):
+		psf_decode24Double(dst,raw,nsamps,do_shift);
+		break;
+	case(PSF_SAMP_32):
+		psf_decode32Double(dst,raw,nsamps,do_reverse);
+		break;
+	default:
+		DBGFPRINTF((stderr, "psf_sndOpen: unsupported sample format\n"));
+		return PSF_E_UNSUPPORTED;
+	}
+	return PSF_E_NOERROR;
+}
+
+/******** read-ahead (PSF_OPEN_READAHEAD, psf_sndSetReadAhead) ***********/
+/* A reader thread reads and decodes the file, a block at a time, into a ring of float slots,
+   and psf_sndReadFloatFrames just copies out of the oldest one. The same scheme as the
+   async writer: each side owns its ring index, and two semaphores count the slots.
+   A slot of 0 frames marks the end of the file, and one < 0 holds a read error.
+   Seeking stops the thread, puts the file where the caller expects it, and starts it again. */
+#ifdef unix
+typedef struct psf_readahead {
+	pthread_t		thread;
+	sem_t			freeslots;		/* slots the reader may fill */
+	sem_t			fullslots;		/* slots waiting for the caller */
+	int				nslots;
+	DWORD			blockframes;
+	float			**slot;
+	int				*slotframes;	/* frames in each slot, 0 = EOF, < 0 = error */
+	unsigned char	*raw;			/* reader's own buffer, if not mapped */
+	psf_int64		nextframe;		/* reader only */
+	int				head;			/* reader only */
+	int				tail;			/* caller only, with the three below */
+	int				holding;		/* caller has slot[tail] */
+	DWORD			slotpos;		/* frames already taken from it */
+	int				done;			/* 1 at EOF, or the error */
+	int				do_reverse,do_shift;
+	pthread_mutex_t	lock;			/* for stop */
+	int				stop;
+} PSF_READAHEAD;
+
+static int psf_raStopping(PSF_READAHEAD *ra)
+{
+	int stop;
+
+	pthread_mutex_lock(&ra->lock);
+	stop = ra->stop;
+	pthread_mutex_unlock(&ra->lock);
+	return stop;
+}
+
+static void *psf_raReader(void *arg)
+{
+	PSFFILE *sfdat = (PSFFILE *) arg;
+	PSF_READAHEAD *ra = sfdat->readahead;
+	const unsigned char *raw;
+	DWORD n,nbytes;
+	psf_int64 t0,t1;
+	int rc;
+
+	for(;;){
+		sem_wait(&ra->freeslots);
+		if(psf_raStopping(ra))
+			break;
+		n = (DWORD) min(sfdat->nFrames - ra->nextframe,(psf_int64) ra->blockframes);
+		rc = (int) n;
+		if(n > 0){
+			nbytes = n * sfdat->fmt.Format.nBlockAlign;
+			raw = ra->raw;
+			t0 = psf_nanos();
+			if(sfdat->mapdata){
+				size_t offset = (size_t)(ra->nextframe * sfdat->fmt.Format.nBlockAlign);
+				if(offset > sfdat->mapsize || nbytes > sfdat->mapsize - offset)
+					rc = PSF_E_CANT_READ;
+				raw = sfdat->mapdata + offset;
+			}
+			else if(sfdat->lac){
+				if(psf_lacRead(sfdat->lac,ra->raw,nbytes))
+					rc = PSF_E_CANT_READ;
+			}
+			else if(fread(ra->raw,sizeof(char),nbytes,sfdat->file) != nbytes)
+				rc = PSF_E_CANT_READ;
+			else
+				psf_ioTrim(sfdat,nbytes);
+			t1 = psf_nanos();
+			if(rc > 0)
+				rc = psf_decodeBlock(sfdat,ra->slot[ra->head],raw,n * sfdat->fmt.Format.nChannels,
+									ra->do_reverse,ra->do_shift);
+			if(rc==PSF_E_NOERROR)
+				rc = (int) n;
+			psf_statsIO(sfdat,PSF_OP_READ,nbytes,t1 - t0,psf_nanos() - t1);
+			ra->nextframe += n;
+		}
+		ra->slotframes[ra->head] = rc;
+		ra->head = (ra->head + 1) % ra->nslots;
+		sem_post(&ra->fullslots);
+		if(rc <= 0)
+			break;
+	}
+	return NULL;
+}
+
+static void psf_raFree(PSF_READAHEAD *ra)
+{
+	int i;
+
+	if(ra->slot){
+		for(i=0;i < ra->nslots;i++)
+			free(ra->slot[i]);
+		free(ra->slot);
+	}
+	free(ra->slotframes);
+	free(ra->raw);
+	free(ra);
+}
+
+/* stop the reader, and leave the file where the caller thinks it is */
+static int psf_raStop(PSFFILE *sfdat)
+{
+	PSF_READAHEAD *ra = sfdat->readahead;
+	fpos_t bytepos;
+
+	if(ra==NULL)
+		return PSF_E_NOERROR;
+	pthread_mutex_lock(&ra->lock);
+	ra->stop = 1;
+	pthread_mutex_unlock(&ra->lock);
+	sem_post(&ra->freeslots);
+	pthread_join(ra->thread,NULL);
+	sem_destroy(&ra->freeslots);
+	sem_destroy(&ra->fullslots);
+	pthread_mutex_destroy(&ra->lock);
+	psf_raFree(ra);
+	sfdat->readahead = NULL;
+	if(sfdat->mapdata){
+		sfdat->mappos = (size_t)(sfdat->curframepos * sfdat->fmt.Format.nBlockAlign);
+		return PSF_E_NOERROR;
+	}
+	if(sfdat->lac)
+		return psf_lacSeek(sfdat->lac,sfdat->curframepos);
+	POS64(bytepos) = POS64(sfdat->dataoffset) + sfdat->curframepos * sfdat->fmt.Format.nBlockAlign;
+	if(fsetpos(sfdat->file,&bytepos))
+		return PSF_E_CANT_SEEK;
+	return PSF_E_NOERROR;
+}
+
+/* start reading ahead from curframepos, with the ring set in sfdat */
+static int psf_raStart(PSFFILE *sfdat)
+{
+	PSF_READAHEAD *ra;
+	int i;
+
+	ra = (PSF_READAHEAD *) calloc(1,sizeof(PSF_READAHEAD));
+	if(ra==NULL)
+		return PSF_E_NOMEM;
+	ra->nslots = sfdat->ra_nblocks;
+	ra->blockframes = sfdat->ra_blockframes;
+	ra->slot = (float **) calloc(ra->nslots,sizeof(float *));
+	ra->slotframes = (int *) calloc(ra->nslots,sizeof(int));
+	if(!sfdat->mapdata)
+		ra->raw = (unsigned char *) malloc(ra->blockframes * sfdat->fmt.Format.nBlockAlign);
+	if(ra->slot==NULL || ra->slotframes==NULL || (!sfdat->mapdata && ra->raw==NULL)){
+		psf_raFree(ra);
+		return PSF_E_NOMEM;
+	}
+	for(i=0;i < ra->nslots;i++){
+		ra->slot[i] = (float *) malloc(ra->blockframes * sfdat->fmt.Format.nChannels * sizeof(float));
+		if(ra->slot[i]==NULL){
+			psf_raFree(ra);
+			return PSF_E_NOMEM;
+		}
+	}
+	if(sfdat->riff_format==PSF_AIFF || sfdat->riff_format==PSF_AIFC){
+		ra->do_reverse = sfdat->is_little_endian ? 1 : 0;
+		ra->do_shift = 0;
+	}
+	else {
+		ra->do_reverse = sfdat->is_little_endian ? 0 : 1;
+		ra->do_shift = 1;
+	}
+	ra->nextframe = sfdat->curframepos;
+	sem_init(&ra->freeslots,0,ra->nslots);
+	sem_init(&ra->fullslots,0,0);
+	pthread_mutex_init(&ra->lock,NULL);
+	sfdat->readahead = ra;
+	if(pthread_create(&ra->thread,NULL,psf_raReader,sfdat)){
+		sfdat->readahead = NULL;
+		sem_destroy(&ra->freeslots);
+		sem_destroy(&ra->fullslots);
+		pthread_mutex_destroy(&ra->lock);
+		psf_raFree(ra);
+		return PSF_E_UNSUPPORTED;
+	}
+	return PSF_E_NOERROR;
+}
+
+/* make sure we hold a slot with frames left in it. Return frames left, 0 at EOF, or error */
+static int psf_raNextSlot(PSFFILE *sfdat)
+{
+	PSF_READAHEAD *ra = sfdat->readahead;
+
+	if(ra->holding && ra->slotpos < (DWORD) ra->slotframes[ra->tail])
+		return ra->slotframes[ra->tail] - ra->slotpos;
+	if(ra->done)
+		return ra->done > 0 ? 0 : ra->done;
+	if(ra->holding){
+		ra->holding = 0;
+		ra->tail = (ra->tail + 1) % ra->nslots;
+		sem_post(&ra->freeslots);
+	}
+	psf_semWait(sfdat,&ra->fullslots);
+	ra->holding = 1;
+	ra->slotpos = 0;
+	if(ra->slotframes[ra->tail] <= 0){
+		ra->done = ra->slotframes[ra->tail]==0 ? 1 : ra->slotframes[ra->tail];
+		return ra->slotframes[ra->tail];
+	}
+	return ra->slotframes[ra->tail];
+}
+
+static int psf_raRead(PSFFILE *sfdat, float *buf, DWORD nFrames)
+{
+	PSF_READAHEAD *ra = sfdat->readahead;
+	DWORD chans = sfdat->fmt.Format.nChannels;
+	DWORD got = 0,n;
+	int left;
+
+	while(got < nFrames){
+		left = psf_raNextSlot(sfdat);
+		if(left < 0 && got==0)
+			return left;
+		if(left <= 0)
+			break;
+		n = min((DWORD) left,nFrames - got);
+		memcpy(buf + got * chans,ra->slot[ra->tail] + ra->slotpos * chans,n * chans * sizeof(float));
+		ra->slotpos += n;
+		got += n;
+	}
+	sfdat->curframepos += got;
+	return (int) got;
+}
+
+/* for psf_sndReadFloatView: no copy at all, but no more than what is left in the slot */
+static int psf_raView(PSFFILE *sfdat, const float **pbuf, DWORD nFrames)
+{
+	PSF_READAHEAD *ra = sfdat->readahead;
+	DWORD n;
+	int left;
+
+	left = psf_raNextSlot(sfdat);
+	if(left <= 0)
+		return left;
+	n = min((DWORD) left,nFrames);
+	*pbuf = ra->slot[ra->tail] + ra->slotpos * sfdat->fmt.Format.nChannels;
+	ra->slotpos += n;
+	sfdat->curframepos += n;
+	return (int) n;
+}
+#else
+static int psf_raStop(PSFFILE *sfdat)	{ return PSF_E_NOERROR; }
+static int psf_raStart(PSFFILE *sfdat)	{ return PSF_E_UNSUPPORTED; }
+static int psf_raRead(PSFFILE *sfdat, float *buf, DWORD nFrames) { return PSF_E_UNSUPPORTED; }
+static int psf_raView(PSFFILE *sfdat, const float **pbuf, DWORD nFrames) { return PSF_E_UNSUPPORTED; }
+#endif
+
+/* is the reader running? start it if it should be. */
+static int psf_raCheck(PSFFILE *sfdat)
+{
+	if(sfdat->ra_nblocks && sfdat->readahead==NULL && psf_raStart(sfdat) < PSF_E_NOERROR)
+		sfdat->ra_nblocks = 0;
+	return sfdat->readahead != NULL;
+}
+
+static int psf_setReadAhead(PSFFILE *sfdat, int nblocks, DWORD blockframes)
+{
+	int rc;
+
+	if(nblocks < 0)
+		return PSF_E_BADARG;
+	if(!sfdat->isRead || sfdat->isstream)
+		return PSF_E_UNSUPPORTED;
+	rc = psf_raStop(sfdat);
+	sfdat->ra_nblocks = 0;
+	if(rc < PSF_E_NOERROR || nblocks==0)
+		return rc;
+	sfdat->ra_nblocks = nblocks;
+	sfdat->ra_blockframes = blockframes ? blockframes : PSF_RA_DEFFRAMES;
+	rc = psf_raStart(sfdat);
+	if(rc < PSF_E_NOERROR)
+		sfdat->ra_nblocks = 0;
+	return rc;
+}
+
+int psf_sndSetReadAhead(int sfd, int nblocks, DWORD blockframes)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_setReadAhead(sfdat,nblocks,blockframes);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* a stream ends where it ends: read what we can, up to nFrames, and note the length if we reach the end.
+   Return frames read, or PSF_E_CANT_READ */
+static int psf_streamRead(PSFFILE *sfdat, void *buf, DWORD nFrames)
+{
+	size_t got,want;
+	psf_int64 t;
+
+	want = (size_t) nFrames * sfdat->fmt.Format.nBlockAlign;
+	t = psf_nanos();
+	got = fread(buf,sizeof(char),want,sfdat->file);
+	t = psf_nanos() - t;
+	sfdat->callnanos += t;
+	psf_statsIO(sfdat,PSF_OP_READ,got,t,0);
+	if(got < want){
+		if(ferror(sfdat->file))
+			return PSF_E_CANT_READ;
+		/* any part frame at the end is lost */
+		nFrames = (DWORD)(got / sfdat->fmt.Format.nBlockAlign);
+		sfdat->nFrames = sfdat->curframepos + nFrames;
+	}
+	sfdat->lastop = PSF_OP_READ;
+	return (int) nFrames;
+}
+
+/* the whole block is read with one call into the staging buffer, then converted in one pass */
+static int psf_readFloatFrames(PSFFILE *sfdat, float *buf, DWORD nFrames)
+{
+	int chans;
+	DWORD framesread;
+	DWORD blocksize,nbytes;
+	int do_reverse;
+	unsigned char *rawbuf;
+    int do_shift;
+
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(nFrames == 0)
+		return nFrames;
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(sfdat->filename);
+	/* must check our calcs! */
+	assert(sfdat->curframepos <= sfdat->nFrames);	 
+#endif
+	/* how much do we have left? return immediately if none! */
+	chans = sfdat->fmt.Format.nChannels;
+	framesread = (DWORD) min(sfdat->nFrames - sfdat->curframepos,(psf_int64) nFrames);	
+	if(framesread==0)
+		return (long) framesread;
+	if(psf_raCheck(sfdat))
+		return psf_raRead(sfdat,buf,framesread);
+	
+	blocksize =  framesread * chans;
+	switch((int) sfdat->riff_format){
+	case(PSF_STDWAVE):
+	case(PSF_WAVE_EX):
+	case(PSF_RAW):
+	case(PSF_LAC):
+		do_reverse = (sfdat->is_little_endian ? 0 : 1 );
+        do_shift = 1;
+		break;
+	case(PSF_AIFF):
+	case(PSF_AIFC):
+		do_reverse = (sfdat->is_little_endian ? 1 : 0 );
+        do_shift = 0;
+		break;
+	default:
+		return PSF_E_UNSUPPORTED;
+	}
+	if(sfdat->lastop == PSF_OP_WRITE){
+		psf_asyncSync(sfdat);
+		fflush(sfdat->file);
+	}
+	nbytes = blocksize * psf_wordsize(sfdat->samptype);
+	if(nbytes==0){
+		DBGFPRINTF((stderr, "psf_sndOpen: unsupported sample format\n"));
+		return PSF_E_UNSUPPORTED;
+	}
+	/* native floats can go straight into the user's buffer */
+	if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT && !do_reverse){
+		if(sfdat->isstream){
+			int rc = psf_streamRead(sfdat,buf,framesread);
+			if(rc < 0)
+				return rc;
+			framesread = (DWORD) rc;
+			blocksize = framesread * chans;
+		}
+		else if(wavDoRead(sfdat,(char *) buf,nbytes))
+			return PSF_E_CANT_READ;
+		if(sfdat->rescale)
+			psf_scaleFloats(buf,blocksize,sfdat->rescale_fac);
+		sfdat->curframepos += framesread;
+		return framesread;
+	}
+	/* mapped file: decode in place */
+	if(sfdat->mapdata){
+		if(nbytes > sfdat->mapsize - sfdat->mappos)
+			return PSF_E_CANT_READ;
+		rawbuf = sfdat->mapdata + sfdat->mappos;
+		sfdat->mappos += nbytes;
+		sfdat->lastop = PSF_OP_READ;
+		psf_statsIO(sfdat,PSF_OP_READ,nbytes,0,0);
+	}
+	else {
+		rawbuf = psf_getIObuf(sfdat,nbytes);
+		if(rawbuf==NULL)
+			return PSF_E_NOMEM;
+		if(sfdat->isstream){
+			int rc = psf_streamRead(sfdat,rawbuf,framesread);
+			if(rc < 0)
+				return rc;
+			framesread = (DWORD) rc;
+			blocksize = framesread * chans;
+		}
+		else if(wavDoRead(sfdat,rawbuf,nbytes))
+			return PSF_E_CANT_READ;
+	}
+	if(psf_decodeBlock(sfdat,buf,rawbuf,blocksize,do_reverse,do_shift))
+		return PSF_E_UNSUPPORTED;
+	sfdat->curframepos += framesread;
+
+	return framesread;
+}
+
+int psf_sndReadFloatFrames(int sfd, float *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = sfdat->src ? psf_rateRead(sfdat,buf,nFrames) : psf_readFloatFrames(sfdat,buf,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+
+/* no copy if we can point into the mapping; else decode into the file's float buffer */
+static int psf_readFloatView(PSFFILE *sfdat, const float **pbuf, DWORD nFrames)
+{
+	DWORD framesread;
+	float *fbuf;
+
+	if(pbuf==NULL)
+		return PSF_E_BADARG;
+	*pbuf = NULL;
+	if(sfdat->src){
+		fbuf = psf_getFloatBuf(sfdat,nFrames * sfdat->fmt.Format.nChannels);
+		if(fbuf==NULL)
+			return PSF_E_NOMEM;
+		*pbuf = fbuf;
+		return psf_rateRead(sfdat,fbuf,nFrames);
+	}
+	framesread = (DWORD) min(sfdat->nFrames - sfdat->curframepos,(psf_int64) nFrames);
+	if(framesread==0)
+		return 0;
+	if(psf_raCheck(sfdat))
+		return psf_raView(sfdat,pbuf,framesread);
+	if(sfdat->mapdata && sfdat->samptype==PSF_SAMP_IEEE_FLOAT && !sfdat->rescale
+		&& ((sfdat->riff_format==PSF_STDWAVE || sfdat->riff_format==PSF_WAVE_EX || sfdat->riff_format==PSF_RAW)
+			== (sfdat->is_little_endian != 0))
+		&& ((size_t)(sfdat->mapdata + sfdat->mappos) % sizeof(float)) == 0){
+		DWORD nbytes = framesread * sfdat->fmt.Format.nBlockAlign;
+
+		if(nbytes > sfdat->mapsize - sfdat->mappos)
+			return PSF_E_CANT_READ;
+		*pbuf = (const float *)(sfdat->mapdata + sfdat->mappos);
+		sfdat->mappos += nbytes;
+		sfdat->curframepos += framesread;
+		sfdat->lastop = PSF_OP_READ;
+		psf_statsIO(sfdat,PSF_OP_READ,nbytes,0,0);
+		return framesread;
+	}
+	fbuf = psf_getFloatBuf(sfdat,framesread * sfdat->fmt.Format.nChannels);
+	if(fbuf==NULL)
+		return PSF_E_NOMEM;
+	*pbuf = fbuf;
+	return psf_readFloatFrames(sfdat,fbuf,framesread);
+}
+
+int psf_sndReadFloatView(int sfd, const float **pbuf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_readFloatView(sfdat,pbuf,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* each block comes from psf_readFloatView (no copy, if it can point into the mapping or read-ahead slot) */
+static int psf_readFloatPlanar(PSFFILE *sfdat, float *const *bufs, DWORD nFrames)
+{
+	int ch,chans,rc;
+	DWORD done = 0;
+	const float *view;
+
+	if(bufs==NULL)
+		return PSF_E_BADARG;
+	chans = sfdat->fmt.Format.nChannels;
+	for(ch=0;ch < chans;ch++)
+		if(bufs[ch]==NULL)
+			return PSF_E_BADARG;
+	while(done < nFrames){
+		rc = psf_readFloatView(sfdat,&view,min(nFrames - done,PSF_PLANARFRAMES));
+		if(rc < PSF_E_NOERROR)
+			return rc;
+		if(rc==0)
+			break;
+		psf_kern->deinterleave(bufs,done,view,(DWORD) rc,chans);
+		done += (DWORD) rc;
+	}
+	return (int) done;
+}
+
+int psf_sndReadFloatPlanar(int sfd, float *const *bufs, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_readFloatPlanar(sfdat,bufs,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* as psf_readFloatFrames: one read for the block, then one pass to convert it, straight to double */
+static int psf_readDoubleFrames(PSFFILE *sfdat, double *buf, DWORD nFrames)
+{
+	int chans;
+	DWORD framesread;
+	DWORD blocksize,nbytes;
+	int do_reverse;
+	unsigned char *rawbuf;
+    int do_shift;
+
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(nFrames == 0)
+		return nFrames;
+	if(sfdat->src)
+		return PSF_E_UNSUPPORTED;
+#ifdef _DEBUG
+	assert(sfdat);
+	assert(sfdat->file);
+	assert(sfdat->filename);
+	/* must check our calcs! */
+	assert(sfdat->curframepos <= sfdat->nFrames);	 
+#endif
+	/* how much do we have left? return immediately if none! */
+	chans = sfdat->fmt.Format.nChannels;
+	framesread = (DWORD) min(sfdat->nFrames - sfdat->curframepos,(psf_int64) nFrames);	
+	if(framesread==0)
+		return (long) framesread;
+	/* doubles are converted from the raw samples, so take the file back from the reader;
+	   it restarts with the next float read */
+	if(psf_raStop(sfdat))
+		return PSF_E_CANT_READ;
+	
+	blocksize =  framesread * chans;
+	switch((int) sfdat->riff_format){
+	case(PSF_STDWAVE):
+	case(PSF_WAVE_EX):
+	case(PSF_RAW):
+	case(PSF_LAC):
+		do_reverse = (sfdat->is_little_endian ? 0 : 1 );
+        do_shift = 1;
+		break;
+	case(PSF_AIFF):
+	case(PSF_AIFC):
+		do_reverse = (sfdat->is_little_endian ? 1 : 0 );
+        do_shift = 0;
+		break;
+	default:
+		return PSF_E_UNSUPPORTED;
+	}
+	if(sfdat->lastop == PSF_OP_WRITE){
+		psf_asyncSync(sfdat);
+		fflush(sfdat->file);
+	}
+	nbytes = blocksize * psf_wordsize(sfdat->samptype);
+	if(nbytes==0){
+		DBGFPRINTF((stderr, "psf_sndOpen: unsupported sample format\n"));
+		return PSF_E_UNSUPPORTED;
+	}
+	if(sfdat->mapdata){
+		if(nbytes > sfdat->mapsize - sfdat->mappos)
+			return PSF_E_CANT_READ;
+		rawbuf = sfdat->mapdata + sfdat->mappos;
+		sfdat->mappos += nbytes;
+		sfdat->lastop = PSF_OP_READ;
+		psf_statsIO(sfdat,PSF_OP_READ,nbytes,0,0);
+	}
+	else {
+		rawbuf = psf_getIObuf(sfdat,nbytes);
+		if(rawbuf==NULL)
+			return PSF_E_NOMEM;
+		if(sfdat->isstream){
+			int rc = psf_streamRead(sfdat,rawbuf,framesread);
+			if(rc < 0)
+				return rc;
+			framesread = (DWORD) rc;
+			blocksize = framesread * chans;
+		}
+		else if(wavDoRead(sfdat,rawbuf,nbytes))
+			return PSF_E_CANT_READ;
+	}
+	if(psf_decodeBlockDouble(sfdat,buf,rawbuf,blocksize,do_reverse,do_shift))
+		return PSF_E_UNSUPPORTED;
+	sfdat->curframepos += framesread;
+
+	return framesread;
+}
+
+int psf_sndReadDoubleFrames(int sfd, double *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_readDoubleFrames(sfdat,buf,nFrames);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* integer frames, as for psf_writeIntFrames */
+static int psf_readIntFrames(PSFFILE *sfdat, void *buf, DWORD nFrames, psf_stype samptype)
+{
+	int chans;
+	DWORD framesread;
+	DWORD blocksize,nbytes;
+	int do_reverse,do_shift;
+	unsigned char *rawbuf;
+
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(nFrames == 0)
+		return nFrames;
+	if(sfdat->samptype != samptype || sfdat->src)
+		return PSF_E_UNSUPPORTED;
+	chans = sfdat->fmt.Format.nChannels;
+	framesread = (DWORD) min(sfdat->nFrames - sfdat->curframepos,(psf_int64) nFrames);	
+	if(framesread==0)
+		return (long) framesread;
+	/* we want the raw samples: take the file back from the reader */
+	if(psf_raStop(sfdat))
+		return PSF_E_CANT_READ;
+	switch((int) sfdat->riff_format){
+	case(PSF_STDWAVE):
+	case(PSF_WAVE_EX):
+	case(PSF_RAW):
+	case(PSF_LAC):
+		do_reverse = (sfdat->is_little_endian ? 0 : 1 );
+        do_shift = 1;
+		break;
+	case(PSF_AIFF):
+	case(PSF_AIFC):
+		do_reverse = (sfdat->is_little_endian ? 1 : 0 );
+        do_shift = 0;
+		break;
+	default:
+		return PSF_E_UNSUPPORTED;
+	}
+	if(sfdat->lastop == PSF_OP_WRITE){
+		psf_asyncSync(sfdat);
+		fflush(sfdat->file);
+	}
+	blocksize = framesread * chans;
+	nbytes = blocksize * psf_wordsize(samptype);
+	/* 16 and 32bit go straight into the caller's buffer, and are swapped there if need be */
+	if(samptype==PSF_SAMP_24){
+		if(sfdat->mapdata)
+			rawbuf = NULL;
+		else if((rawbuf = psf_getIObuf(sfdat,nbytes))==NULL)
+			return PSF_E_NOMEM;
+	}
+	else
+		rawbuf = (unsigned char *) buf;
+	if(sfdat->mapdata){
+		if(nbytes > sfdat->mapsize - sfdat->mappos)
+			return PSF_E_CANT_READ;
+		if(rawbuf==NULL)
+			rawbuf = sfdat->mapdata + sfdat->mappos;
+		else
+			memcpy(rawbuf,sfdat->mapdata + sfdat->mappos,nbytes);
+		sfdat->mappos += nbytes;
+		sfdat->lastop = PSF_OP_READ;
+		psf_statsIO(sfdat,PSF_OP_READ,nbytes,0,0);
+	}
+	else if(sfdat->isstream){
+		int rc = psf_streamRead(sfdat,rawbuf,framesread);
+		if(rc < 0)
+			return rc;
+		framesread = (DWORD) rc;
+		blocksize = framesread * chans;
+	}
+	else if(wavDoRead(sfdat,rawbuf,nbytes))
+		return PSF_E_CANT_READ;
+	if(samptype==PSF_SAMP_24)
+		psf_unpack24((int *) buf,rawbuf,blocksize,do_shift);
+	else if(do_reverse && samptype==PSF_SAMP_16)
+		psf_kern->swap16((unsigned char *) buf,(const unsigned char *) buf,blocksize);
+	else if(do_reverse)
+		psf_kern->swap32((unsigned char *) buf,(const unsigned char *) buf,blocksize);
+	sfdat->curframepos += framesread;
+	return framesread;
+}
+
+int psf_sndReadInt16Frames(int sfd, short *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_readIntFrames(sfdat,buf,nFrames,PSF_SAMP_16);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+int psf_sndReadInt24Frames(int sfd, int *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_readIntFrames(sfdat,buf,nFrames,PSF_SAMP_24);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+int psf_sndReadInt32Frames(int sfd, int *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 start;
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	start = psf_statsBegin(sfdat);
+	rc = psf_readIntFrames(sfdat,buf,nFrames,PSF_SAMP_32);
+	psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+
+#ifdef _DEBUG
+/* private test func to get raw file size */
+/* verify sfdat->nFrames always <= true EOF position */
+/* NB: size value is wrong if there is junk after data chunk! */
+static fpos_t getsize(FILE* fp){
+	fpos_t curpos;
+	fpos_t size;
+	if(fgetpos(fp,&curpos))
+	    return -1;
+
+	if(fseek(fp,0,SEEK_END))
+		return -1;
+
+	if(fgetpos(fp,&size))
+	    return -1;
+
+	if(fsetpos(fp,&curpos))
+		return -1;
+
+	return  size;
+}
+#endif
+
+/* return size in m/c frames */
+/* signed because we want error return */
+static psf_int64 psf_size64(PSFFILE *sfdat)
+{
+#ifdef _DEBUG
+    fpos_t size;
+	psf_int64 framesize;
+#endif
+	
+	/* not known until we have read to the end */
+	if(sfdat->isstream && sfdat->isRead && sfdat->nFrames==PSF_STREAMFRAMES)
+		return PSF_E_UNSUPPORTED;
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+	if(sfdat->isstream)
+		return sfdat->nFrames;
+    /* seems as good a place as any to verify chuncksize integrity of this file...*/
+	if((size = getsize(sfdat->file)) < 0)	{
+		DBGFPRINTF((stderr, "getsize() error in psf_sndSize().\n"));
+		return -1;
+	}
+    /* this will reveal if any other chunks etc after (ugh) data chunk */
+	framesize = (POS64(size) - POS64(sfdat->dataoffset)) / sfdat->fmt.Format.nBlockAlign;
+	assert(framesize >= sfdat->nFrames);
+	
+#endif
+	
+	return sfdat->nFrames;
+}
+
+psf_int64 psf_sndSize64(int sfd)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = sfdat->src && sfdat->isRead ? psf_rateSize(sfdat) : psf_size64(sfdat);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* 32bit version: error if the file is too long to say */
+int psf_sndSize(int sfd)
+{
+	psf_int64 size = psf_sndSize64(sfd);
+
+	if(size > 0x7fffffff)
+		return PSF_E_UNSUPPORTED;
+	return (int) size;
+}
+
+/* returns multi-channel (frame)  position */
+static psf_int64 psf_tell64(PSFFILE *sfdat)
+{
+	fpos_t pos;
+
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+#endif
+	/* the reader thread has moved the file on */
+	if(sfdat->readahead)
+		return sfdat->curframepos;
+	/* a pipe has no position to ask for */
+	if(sfdat->isstream)
+		return sfdat->isRead ? sfdat->curframepos : (psf_int64) POS64(sfdat->lastwritepos);
+	if(sfdat->mapdata)
+		return (psf_int64)(sfdat->mappos / sfdat->fmt.Format.nBlockAlign);
+	/* the file position is the coder's */
+	if(sfdat->lac)
+		return sfdat->isRead ? sfdat->curframepos : (psf_int64) POS64(sfdat->lastwritepos);
+	/* any write error is reported by the next write, or close */
+	psf_asyncSync(sfdat);
+	if(fgetpos(sfdat->file,&pos))
+	    return PSF_E_CANT_SEEK;
+	POS64(pos) -= POS64(sfdat->dataoffset);
+	POS64(pos) /= sfdat->fmt.Format.nBlockAlign;
+#ifdef _DEBUG
+	if(sfdat->lastop == PSF_OP_READ)
+		assert(pos== sfdat->curframepos);
+	else if(sfdat->lastop == PSF_OP_WRITE)
+		/* RWD this will be out (but == curframepos) if lastop was a read . so maybe say >=, or test for lastop ? */
+		assert(pos == sfdat->lastwritepos);
+#endif
+	return (psf_int64) POS64(pos);			 
+}
+
+psf_int64 psf_sndTell64(int sfd)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	psf_int64 rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = sfdat->src && sfdat->isRead ? sfdat->srcpos : psf_tell64(sfdat);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+int psf_sndTell(int sfd)
+{
+	psf_int64 pos = psf_sndTell64(sfd);
+
+	if(pos > 0x7fffffff)
+		return PSF_E_UNSUPPORTED;
+	return (int) pos;
+}
+
+int psf_sndSeek(int sfd,int offset, int mode)
+{
+	return psf_sndSeek64(sfd,(psf_int64) offset,mode);
+}
+
+static int psf_seek64(PSFFILE *sfdat, psf_int64 offset, int mode)
+{
+	psf_int64 byteoffset;    /* can be negative */
+    fpos_t data_end,pos_target,cur_pos;
+
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+#endif
+	/* RWD NB:dataoffset test only valid for files with headers! */
+	if(POS64(sfdat->dataoffset)==0 && sfdat->riff_format != PSF_RAW)
+		return PSF_E_BADARG;
+	/* a pipe only goes forward */
+	if(sfdat->isstream)
+		return PSF_E_CANT_SEEK;
+	psf_statsSeek(sfdat);
+
+	/* the next read restarts the reader from the new position */
+	if(psf_raStop(sfdat))
+		return PSF_E_CANT_SEEK;
+	byteoffset =  offset *  sfdat->fmt.Format.nBlockAlign;
+    POS64(data_end) = POS64(sfdat->dataoffset) + (sfdat->nFrames * sfdat->fmt.Format.nBlockAlign);
+	/* mapped file: no i/o, and we keep within the data chunk */
+	if(sfdat->mapdata){
+		psf_int64 target;
+		switch(mode){
+		case PSF_SEEK_SET:
+			target = byteoffset;
+			break;
+		case PSF_SEEK_END:
+			target = sfdat->nFrames * sfdat->fmt.Format.nBlockAlign + byteoffset;
+			break;
+		case PSF_SEEK_CUR:
+			target = (psf_int64) sfdat->mappos + byteoffset;
+			break;
+		default:
+			return PSF_E_BADARG;
+		}
+		if(target < 0 || (size_t) target > sfdat->mapsize)
+			return PSF_E_CANT_SEEK;
+		sfdat->mappos = (size_t) target;
+		sfdat->curframepos = target / sfdat->fmt.Format.nBlockAlign;
+		return PSF_E_NOERROR;
+	}
+	/* compressed: the block index finds the frame. Blocks are written in order, so a writer stays put */
+	if(sfdat->lac){
+		psf_int64 target,here = sfdat->isRead ? sfdat->curframepos : (psf_int64) POS64(sfdat->lastwritepos);
+		switch(mode){
+		case PSF_SEEK_SET:
+			target = offset;
+			break;
+		case PSF_SEEK_END:
+			target = sfdat->nFrames + offset;
+			break;
+		case PSF_SEEK_CUR:
+			target = here + offset;
+			break;
+		default:
+			return PSF_E_BADARG;
+		}
+		if(!sfdat->isRead)
+			return target==here ? PSF_E_NOERROR : PSF_E_CANT_SEEK;
+		if(psf_lacSeek(sfdat->lac,target))
+			return PSF_E_CANT_SEEK;
+		sfdat->curframepos = target;
+		return PSF_E_NOERROR;
+	}
+	/* any write error is reported by the next write, or close */
+	psf_asyncSync(sfdat);
+	switch(mode){
+	case PSF_SEEK_SET:  
+	    POS64(pos_target) =  POS64(sfdat->dataoffset) + byteoffset;
+	    if(fsetpos(sfdat->file,&pos_target))
+		    return PSF_E_CANT_SEEK;
+	    break;
+	case PSF_SEEK_END:	    
+        /* NB can't just seek to end of file as there may be junk after data chunk! */
+        POS64(pos_target) = POS64(data_end) + byteoffset;
+	    if(fsetpos(sfdat->file,&pos_target))
+		    return PSF_E_CANT_SEEK;
+	    break;
+	case PSF_SEEK_CUR:
+        /* fseek takes a long, so do it ourselves */
+        /* Currently UNDECIDED whether to allow seeks beyond end of file! */
+	    if(fgetpos(sfdat->file,&pos_target))
+		    return PSF_E_CANT_SEEK;
+	    POS64(pos_target) += byteoffset;
+	    if(fsetpos(sfdat->file,&pos_target))
+		    return PSF_E_CANT_SEEK;
+	    break;
+	}
+	if(fgetpos(sfdat->file,&cur_pos))
+	    return PSF_E_CANT_SEEK;
+	if(POS64(cur_pos) >= POS64(sfdat->dataoffset)){
+		sfdat->curframepos = (POS64(cur_pos) -  POS64(sfdat->dataoffset))  / sfdat->fmt.Format.nBlockAlign;
+		if(!sfdat->isRead)	{		/*RWD NEW*/
+			/* we are rewinding a file open for writing */
+		    POS64(sfdat->lastwritepos) = sfdat->curframepos;
+		}
+		return PSF_E_NOERROR;
+	}
+	else
+		return PSF_E_CANT_SEEK;
+}
+
+int psf_sndSeek64(int sfd, psf_int64 offset, int mode)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = sfdat->src ? psf_rateSeek(sfdat,offset,mode) : psf_seek64(sfdat,offset,mode);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/******** sample rate conversion ***********/
+/* psf_sndSetRate puts a PSF_SRC (psfsrc.c) between the caller and the file. Reads take blocks at the
+   file rate and push them through; writes push the caller's frames and write out what comes back.
+   Reading, positions at the caller's rate are exact: r caller frames span exactly fr file frames
+   (the rates reduced), so a seek restarts the converter on such a boundary, far enough back for
+   the filter to be full by the target, and discards the frames before it. */
+#define PSF_RATEFRAMES	(4096)
+
+static float *psf_rateBuf(PSFFILE *sfdat)
+{
+	if(sfdat->srcbuf==NULL)
+		sfdat->srcbuf = (float *) malloc(PSF_RATEFRAMES * sfdat->fmt.Format.nChannels * sizeof(float));
+	return sfdat->srcbuf;
+}
+
+/* the file's rate and the caller's, reduced */
+static void psf_rateRatio(PSFFILE *sfdat, psf_int64 *fr, psf_int64 *r)
+{
+	long a = (long) sfdat->fmt.Format.nSamplesPerSec,b = sfdat->srcrate,t;
+
+	while(b){
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	*fr = (long) sfdat->fmt.Format.nSamplesPerSec / a;
+	*r = sfdat->srcrate / a;
+}
+
+static psf_int64 psf_rateSize(PSFFILE *sfdat)
+{
+	psf_int64 size = psf_size64(sfdat),fr,r;
+
+	if(size < 0)
+		return size;
+	psf_rateRatio(sfdat,&fr,&r);
+	return (size * r + fr - 1) / fr;
+}
+
+static int psf_rateSeek(PSFFILE *sfdat, psf_int64 offset, int mode)
+{
+	psf_int64 target,size,fr,r,block;
+	int rc;
+
+	if(!sfdat->isRead)
+		return PSF_E_UNSUPPORTED;
+	size = psf_rateSize(sfdat);
+	if(size < 0)
+		return (int) size;
+	switch(mode){
+	case PSF_SEEK_SET:
+		target = offset;
+		break;
+	case PSF_SEEK_CUR:
+		target = sfdat->srcpos + offset;
+		break;
+	case PSF_SEEK_END:
+		target = size + offset;
+		break;
+	default:
+		return PSF_E_BADARG;
+	}
+	if(target < 0 || target > size)
+		return PSF_E_CANT_SEEK;
+	psf_rateRatio(sfdat,&fr,&r);
+	block = target * fr / r - psf_srcSpan(sfdat->src);
+	block = block > 0 ? block / fr : 0;
+	rc = psf_seek64(sfdat,block * fr,PSF_SEEK_SET);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	psf_srcReset(sfdat->src);
+	sfdat->srceof = 0;
+	sfdat->srcskip = (DWORD)(target - block * r);
+	sfdat->srcpos = target;
+	return PSF_E_NOERROR;
+}
+
+static int psf_rateRead(PSFFILE *sfdat, float *buf, DWORD nFrames)
+{
+	int chans = sfdat->fmt.Format.nChannels;
+	DWORD done = 0,n;
+	float *in;
+	int rc;
+
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(!sfdat->isRead)
+		return PSF_E_UNSUPPORTED;
+	if((in = psf_rateBuf(sfdat))==NULL)
+		return PSF_E_NOMEM;
+	while(done < nFrames){
+		/* after a seek, the frames before the target go through buf and are dropped */
+		if(sfdat->srcskip){
+			n = psf_srcPull(sfdat->src,buf + (size_t) done * chans,min(sfdat->srcskip,nFrames - done));
+			sfdat->srcskip -= n;
+		}
+		else {
+			n = psf_srcPull(sfdat->src,buf + (size_t) done * chans,nFrames - done);
+			done += n;
+		}
+		if(n > 0)
+			continue;
+		if(sfdat->srceof)
+			break;
+		rc = psf_readFloatFrames(sfdat,in,min(psf_srcSpace(sfdat->src),PSF_RATEFRAMES));
+		if(rc < PSF_E_NOERROR)
+			return rc;
+		if(rc==0){
+			psf_srcEnd(sfdat->src);
+			sfdat->srceof = 1;
+		}
+		else
+			psf_srcPush(sfdat->src,in,(DWORD) rc);
+	}
+	sfdat->srcpos += done;
+	return (int) done;
+}
+
+/* write out whatever the converter has ready */
+static int psf_rateDrain(PSFFILE *sfdat)
+{
+	float *out = psf_rateBuf(sfdat);
+	DWORD n;
+	int rc;
+
+	if(out==NULL)
+		return PSF_E_NOMEM;
+	while((n = psf_srcPull(sfdat->src,out,PSF_RATEFRAMES)) > 0){
+		rc = psf_writeFloatFrames(sfdat,out,n);
+		if(rc < PSF_E_NOERROR)
+			return rc;
+	}
+	return PSF_E_NOERROR;
+}
+
+static int psf_rateWrite(PSFFILE *sfdat, const float *buf, DWORD nFrames)
+{
+	int chans = sfdat->fmt.Format.nChannels;
+	DWORD done = 0;
+	int rc;
+
+	if(buf==NULL)
+		return PSF_E_BADARG;
+	if(sfdat->isRead)
+		return PSF_E_FILE_READONLY;
+	while(done < nFrames){
+		done += psf_srcPush(sfdat->src,buf + (size_t) done * chans,nFrames - done);
+		rc = psf_rateDrain(sfdat);
+		if(rc < PSF_E_NOERROR)
+			return rc;
+	}
+	return (int) nFrames;
+}
+
+/* on close, or a change of rate: a writer sends its last frames */
+static int psf_rateFinish(PSFFILE *sfdat)
+{
+	int rc = PSF_E_NOERROR;
+
+	if(sfdat->src==NULL)
+		return rc;
+	if(!sfdat->isRead){
+		psf_srcEnd(sfdat->src);
+		rc = psf_rateDrain(sfdat);
+	}
+	psf_srcFree(sfdat->src);
+	sfdat->src = NULL;
+	sfdat->srcrate = 0;
+	return rc;
+}
+
+static int psf_setRate(PSFFILE *sfdat, long srate, int quality)
+{
+	long filerate = (long) sfdat->fmt.Format.nSamplesPerSec;
+	psf_int64 pos = 0,fr,r;
+	int rc,hadsrc = sfdat->src != NULL;
+
+	if(srate < 0 || quality < PSF_SRC_FAST || quality > PSF_SRC_BEST)
+		return PSF_E_BADARG;
+	/* whatever a stream's converter holds cannot be read again */
+	if(sfdat->isRead && sfdat->isstream && hadsrc)
+		return PSF_E_UNSUPPORTED;
+	/* where the caller is, at the file rate */
+	if(sfdat->isRead){
+		if(hadsrc){
+			psf_rateRatio(sfdat,&fr,&r);
+			pos = sfdat->srcpos * fr / r;
+		}
+		else if((pos = psf_tell64(sfdat)) < 0)
+			return (int) pos;
+	}
+	rc = psf_rateFinish(sfdat);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	if(srate==0 || srate==filerate){
+		if(sfdat->isRead && hadsrc)
+			rc = psf_seek64(sfdat,pos,PSF_SEEK_SET);
+		return rc;
+	}
+	if(sfdat->isRead)
+		sfdat->src = psf_srcNew(sfdat->fmt.Format.nChannels,filerate,srate,quality);
+	else
+		sfdat->src = psf_srcNew(sfdat->fmt.Format.nChannels,srate,filerate,quality);
+	if(sfdat->src==NULL)
+		return PSF_E_NOMEM;
+	sfdat->srcrate = srate;
+	sfdat->srceof = 0;
+	sfdat->srcskip = 0;
+	if(sfdat->isRead){
+		psf_rateRatio(sfdat,&fr,&r);
+		sfdat->srcpos = (pos * r + fr - 1) / fr;
+		/* a stream starts converting where it is; a file, exactly at the caller's frame */
+		if(!sfdat->isstream && (rc = psf_rateSeek(sfdat,sfdat->srcpos,PSF_SEEK_SET)) < PSF_E_NOERROR){
+			psf_rateFinish(sfdat);
+			return rc;
+		}
+	}
+	return PSF_E_NOERROR;
+}
+
+int psf_sndSetRate(int sfd, long srate, int quality)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_setRate(sfdat,srate,quality);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/******** positional reads ***********/
+/* psf_sndReadFloatFramesAt holds the file lock only to check the request and flush any writes.
+   The read itself is a pread(), or a copy from the mapping: it neither moves nor waits for the
+   file position, so any number of threads can read one file at once. */
+#define PSF_PREADBYTES	(65536)
+
+typedef struct psf_readat {
+	psf_int64	offset;			/* bytes into the data chunk */
+	DWORD		nFrames;
+	int			do_reverse,do_shift;
+} PSF_READAT;
+
+/* with the file locked: how much is there, in what byte order? */
+static int psf_readAtBegin(PSFFILE *sfdat, psf_int64 frame, DWORD nFrames, PSF_READAT *at)
+{
+	if(frame < 0)
+		return PSF_E_BADARG;
+	if(sfdat->isstream)
+		return PSF_E_CANT_SEEK;
+	if(sfdat->src || (sfdat->lac && !sfdat->isRead))
+		return PSF_E_UNSUPPORTED;
+	/* memory has no fd to pread: only the samples read straight from it */
+	if(sfdat->mem && sfdat->mapdata==NULL)
+		return PSF_E_UNSUPPORTED;
+	switch((int) sfdat->riff_format){
+	case(PSF_STDWAVE):
+	case(PSF_WAVE_EX):
+	case(PSF_RAW):
+	case(PSF_LAC):
+		at->do_reverse = (sfdat->is_little_endian ? 0 : 1 );
+		at->do_shift = 1;
+		break;
+	case(PSF_AIFF):
+	case(PSF_AIFC):
+		at->do_reverse = (sfdat->is_little_endian ? 1 : 0 );
+		at->do_shift = 0;
+		break;
+	default:
+		return PSF_E_UNSUPPORTED;
+	}
+	if(psf_wordsize(sfdat->samptype)==0)
+		return PSF_E_UNSUPPORTED;
+	at->nFrames = frame >= sfdat->nFrames ? 0 : (DWORD) min(sfdat->nFrames - frame,(psf_int64) nFrames);
+	at->offset = frame * sfdat->fmt.Format.nBlockAlign;
+	/* so pread sees what has been written */
+	if(sfdat->lastop == PSF_OP_WRITE){
+		psf_asyncSync(sfdat);
+		fflush(sfdat->file);
+	}
+	return PSF_E_NOERROR;
+}
+
+#ifdef unix
+static int psf_preadAll(int fd, void *buf, size_t nbytes, psf_int64 pos)
+{
+	unsigned char *p = (unsigned char *) buf;
+	ssize_t got;
+
+	while(nbytes > 0){
+		got = pread(fd,p,nbytes,(off_t) pos);
+		if(got < 0 && errno==EINTR)
+			continue;
+		if(got <= 0)
+			return PSF_E_CANT_READ;
+		p += got;
+		pos += got;
+		nbytes -= (size_t) got;
+	}
+	return PSF_E_NOERROR;
+}
+
+/* without the lock: only the fields fixed at open are used. Time spent reading goes in *ionanos */
+static int psf_readAt(PSFFILE *sfdat, const PSF_READAT *at, float *buf, psf_int64 *ionanos)
+{
+	int chans = sfdat->fmt.Format.nChannels;
+	DWORD align = sfdat->fmt.Format.nBlockAlign;
+	DWORD done,n,chunk;
+	psf_int64 pos = (psf_int64) POS64(sfdat->dataoffset) + at->offset;
+	unsigned char *raw;
+	int rc = PSF_E_NOERROR;
+
+	if(sfdat->mapdata){
+		size_t offset = (size_t) at->offset,nbytes = (size_t) at->nFrames * align;
+
+		if(offset > sfdat->mapsize || nbytes > sfdat->mapsize - offset)
+			return PSF_E_CANT_READ;
+		if(psf_decodeBlock(sfdat,buf,sfdat->mapdata + offset,at->nFrames * chans,at->do_reverse,at->do_shift))
+			return PSF_E_UNSUPPORTED;
+		return (int) at->nFrames;
+	}
+	/* the coder decodes into the raw buffer, from the block that holds the frame */
+	if(sfdat->lac){
+		raw = (unsigned char *) malloc((size_t) at->nFrames * align);
+		if(raw==NULL)
+			return PSF_E_NOMEM;
+		*ionanos = psf_nanos();
+		rc = psf_lacReadAt(sfdat->lac,fileno(sfdat->file),at->offset / align,raw,at->nFrames);
+		*ionanos = psf_nanos() - *ionanos;
+		if(rc==PSF_E_NOERROR && psf_decodeBlock(sfdat,buf,raw,at->nFrames * chans,at->do_reverse,at->do_shift))
+			rc = PSF_E_UNSUPPORTED;
+		free(raw);
+		return rc < PSF_E_NOERROR ? rc : (int) at->nFrames;
+	}
+	/* native floats go straight into the user's buffer */
+	if(sfdat->samptype==PSF_SAMP_IEEE_FLOAT && !at->do_reverse){
+		*ionanos = psf_nanos();
+		rc = psf_preadAll(fileno(sfdat->file),buf,(size_t) at->nFrames * align,pos);
+		*ionanos = psf_nanos() - *ionanos;
+		if(rc < PSF_E_NOERROR)
+			return rc;
+		if(sfdat->rescale)
+			psf_scaleFloats(buf,at->nFrames * chans,sfdat->rescale_fac);
+		return (int) at->nFrames;
+	}
+	/* the file's staging buffer belongs to the handle: this call has its own */
+	chunk = max(PSF_PREADBYTES / align,1);
+	chunk = min(chunk,at->nFrames);
+	raw = (unsigned char *) malloc((size_t) chunk * align);
+	if(raw==NULL)
+		return PSF_E_NOMEM;
+	for(done=0;done < at->nFrames && rc==PSF_E_NOERROR;done += n){
+		psf_int64 t = psf_nanos();
+
+		n = min(chunk,at->nFrames - done);
+		rc = psf_preadAll(fileno(sfdat->file),raw,(size_t) n * align,pos + (psf_int64) done * align);
+		*ionanos += psf_nanos() - t;
+		if(rc==PSF_E_NOERROR && psf_decodeBlock(sfdat,buf + (size_t) done * chans,raw,n * chans,at->do_reverse,at->do_shift))
+			rc = PSF_E_UNSUPPORTED;
+	}
+	free(raw);
+	return rc < PSF_E_NOERROR ? rc : (int) at->nFrames;
+}
+#endif
+
+int psf_sndReadFloatFramesAt(int sfd, psf_int64 frame, float *buf, DWORD nFrames)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	PSF_READAT at;
+	psf_int64 start,io = 0;
+	int rc;
+
+	if(sfdat==NULL || buf==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_readAtBegin(sfdat,frame,nFrames,&at);
+#ifdef unix
+	psf_unlockFile(sfdat);
+	if(rc < PSF_E_NOERROR || at.nFrames==0)
+		return rc;
+	/* (other threads may be counting too: no callnanos here) */
+	start = psf_nanos();
+	rc = psf_readAt(sfdat,&at,buf,&io);
+	if(rc > 0){
+		start = psf_nanos() - start;
+		psf_statsIO(sfdat,PSF_OP_READ,(psf_int64) rc * sfdat->fmt.Format.nBlockAlign,io,0);
+		psf_statsFrames(sfdat,PSF_OP_READ,rc,start - io);
+	}
+	return rc;
+#else
+	/* no pread: seek there and back, holding the lock throughout */
+	if(rc==PSF_E_NOERROR && at.nFrames > 0){
+		psf_int64 pos = psf_tell64(sfdat);
+
+		start = psf_statsBegin(sfdat);
+		rc = psf_seek64(sfdat,frame,PSF_SEEK_SET);
+		if(rc==PSF_E_NOERROR)
+			rc = psf_readFloatFrames(sfdat,buf,at.nFrames);
+		if(pos >= 0 && psf_seek64(sfdat,pos,PSF_SEEK_SET) < PSF_E_NOERROR && rc >= 0)
+			rc = PSF_E_CANT_SEEK;
+		psf_statsEnd(sfdat,PSF_OP_READ,start,rc);
+	}
+	psf_unlockFile(sfdat);
+	return rc;
+#endif
+}
+
+
+/* decide sfile format from the filename extension */
+/* (psf_sndProbe looks at the header instead: see psf_getFormatHeader) */
+psf_format psf_getFormatExt(const char *path)
+{
+	char *lastdot;
+	/* stdin or stdout */
+	if(path && strcmp(path,"-")==0)
+		return PSF_RAW;
+	if(path==NULL || (strlen(path) < 4))
+		return PSF_FMT_UNKNOWN;
+	lastdot = strrchr(path,'.');
+	if(lastdot==NULL)
+		return PSF_FMT_UNKNOWN;
+
+	if(stricmp(lastdot,".wav")==0)
+		 return PSF_STDWAVE;
+	else if((stricmp(lastdot,".aif")==0) || stricmp(lastdot,".aiff")==0)
+		 return PSF_AIFF;
+	else if((stricmp(lastdot,".afc")==0) || stricmp(lastdot,".aifc")==0)
+			return PSF_AIFC;
+    /* Ambisonic b-format files */
+    else if(stricmp(lastdot,".wxyz")==0)
+		return PSF_STDWAVE;
+	else if(stricmp(lastdot,".amb")==0)
+		return PSF_WAVE_EX;
+	else if(stricmp(lastdot,".raw")==0 || stricmp(lastdot,".pcm")==0)
+		return PSF_RAW;
+	else if(stricmp(lastdot,".lac")==0)
+		return PSF_LAC;
+	else
+		return PSF_FMT_UNKNOWN;
+
+}
+
+/* raw data format from the command line: "srate,chans,type" */
+int psf_rawProps(const char *spec, PSF_PROPS *props)
+{
+	long srate,chans;
+	char type[8];
+
+	if(spec==NULL || props==NULL)
+		return PSF_E_BADARG;
+	if(sscanf(spec,"%ld,%ld,%7s",&srate,&chans,type) != 3 || srate <= 0 || chans <= 0)
+		return PSF_E_BADARG;
+	if(strcmp(type,"16")==0)
+		props->samptype = PSF_SAMP_16;
+	else if(strcmp(type,"24")==0)
+		props->samptype = PSF_SAMP_24;
+	else if(strcmp(type,"32")==0)
+		props->samptype = PSF_SAMP_32;
+	else if(stricmp(type,"float")==0)
+		props->samptype = PSF_SAMP_IEEE_FLOAT;
+	else
+		return PSF_E_BADARG;
+	props->srate = srate;
+	props->chans = (int) chans;
+	props->format = PSF_RAW;
+	props->chformat = STDWAVE;
+	return PSF_E_NOERROR;
+}
+
+/* keep the real stdout for samples, and point stdout itself at stderr */
+int psf_stdoutSamples(const char *outpath)
+{
+#ifdef unix
+	int fd;
+
+	if(outpath==NULL || strcmp(outpath,"-") != 0 || psf_sampout != NULL)
+		return PSF_E_NOERROR;
+	fflush(stdout);
+	fd = dup(STDOUT_FILENO);
+	if(fd < 0)
+		return PSF_E_CANT_OPEN;
+	psf_sampout = fdopen(fd,"wb");
+	if(psf_sampout==NULL){
+		close(fd);
+		return PSF_E_NOMEM;
+	}
+	if(dup2(STDERR_FILENO,STDOUT_FILENO) < 0){
+		fclose(psf_sampout);
+		psf_sampout = NULL;
+		return PSF_E_CANT_OPEN;
+	}
+	return PSF_E_NOERROR;
+#else
+	return PSF_E_UNSUPPORTED;
+#endif
+}
+
+/* return 0 for no PEAK data, 1 for success */
+/* NB: we read PEAK data from sfdat, so we can read peaks while writing the file, before closing */
+static int psf_readPeaks(PSFFILE *sfdat, PSF_CHPEAK peakdata[],MYLONG *peaktime)
+{
+	int i,nchans;
+
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+#endif
+	/* TODO: we may want to have this, for RAW files, even though we won't write it */
+	if(sfdat->pPeaks==NULL){		   /*NOT an error: just don't have the chunk*/
+		if(peaktime!= NULL)
+			*peaktime = 0;		
+		return 0;			
+
+	}
+	if(peaktime != NULL)
+		*peaktime = (int) sfdat->peaktime;
+	nchans = sfdat->fmt.Format.nChannels;
+	for(i=0;i < nchans;i++){
+		peakdata[i].val = sfdat->pPeaks[i].val;
+		peakdata[i].pos = sfdat->pPeaks[i].pos;
+	}
+	return 1;
+}
+
+int psf_sndReadPeaks(int sfd, PSF_CHPEAK peakdata[],MYLONG *peaktime)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_readPeaks(sfdat,peakdata,peaktime);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+static int psf_setDither(PSFFILE *sfdat, unsigned int dtype)
+{
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+#endif
+	if(dtype < PSF_DITHER_OFF || dtype > PSF_DITHER_SHAPED || sfdat->isRead)
+		return PSF_E_BADARG;
+	/* shaping starts from silence */
+	if(dtype==PSF_DITHER_SHAPED){
+		float *err = (float *) calloc(sfdat->fmt.Format.nChannels * PSF_SHAPETAPS,sizeof(float));
+		if(err==NULL)
+			return PSF_E_NOMEM;
+		free(sfdat->shapeerr);
+		sfdat->shapeerr = err;
+	}
+	sfdat->dithertype = dtype;
+
+	return PSF_E_NOERROR;
+	
+}
+
+int psf_sndSetDither(int sfd, unsigned int dtype)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_setDither(sfdat,dtype);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+/* get current dither setting */
+static int psf_getDither(PSFFILE *sfdat)
+{
+#ifdef _DEBUG		
+	assert(sfdat->file);
+	assert(sfdat->filename);
+#endif
+
+	return sfdat->dithertype;
+	
+}
+
+int psf_sndGetDither(int sfd)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_getDither(sfdat);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+psf_channelformat get_speakerlayout(DWORD chmask,DWORD chans)
+{
+    psf_channelformat chformat = MC_WAVE_EX;	// default is some weird format!
+    
+    /* accept chancount > numbits set in speakermask */
+    switch(chmask){
+        case(SPKRS_UNASSIGNED):
+            chformat = MC_STD;
+            break;
+        case(SPKRS_MONO):
+            if(chans==1)
+                chformat = MC_MONO;
+            break;
+        case(SPKRS_STEREO):
+            if(chans==2)
+                chformat = MC_STEREO;
+            break;
+        case(SPKRS_GENERIC_QUAD):
+            if(chans==4)
+                chformat = MC_QUAD;
+            break;			
+        case(SPKRS_SURROUND_LCRS):
+            if(chans==4)
+                chformat = MC_LCRS;
+            break;
+        case(SPKRS_DOLBY5_1):
+            if(chans==6)
+                chformat = MC_DOLBY_5_1;
+            break;
+        case(SPKRS_SURR_5_0):                   
+            if(chans==5)
+                chformat = MC_SURR_5_0;
+            break;
+        case(SPKRS_7_1):
+            if(chans==8)
+                chformat = MC_SURR_7_1;
+            break;
+        default:
+            break;
+    }
+    return chformat;
+}
+
+static int psf_getSpeakermask(PSFFILE *sfdat)
+{
+    return (int) sfdat->fmt.dwChannelMask;
+}
+
+int psf_speakermask(int sfd)
+{
+	PSFFILE *sfdat = psf_getFile(sfd);
+	int rc;
+
+	if(sfdat==NULL)
+		return PSF_E_BADARG;
+	psf_lockFile(sfdat);
+	rc = psf_getSpeakermask(sfdat);
+	psf_unlockFile(sfdat);
+	return rc;
+}
+
+/* TODO: define a psf_writePeak function; probably to a single nominated channel. 
+   This would be needed as soon as write is performed with random over-write activity.
+   This is probably something to discourage, however!
+*/
+
+
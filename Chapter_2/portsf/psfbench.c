@@ -0,0 +1,267 @@
+/* psfbench.c: read and write throughput of portsf, for every sample type, container (and so byte order),
+   channel count and buffer size, on files generated in a temporary directory.
+   The report is CSV on stdout, one line per test, so runs can be compared line by line:
+		make bench BENCHOUT=before.csv    ...    make bench BENCHOUT=after.csv
+   Each figure is the best of several runs, from create (or open) to close. The files are read back
+   straight after they are written, so reads mostly come from the page cache: this measures portsf,
+   not the disk. The iotime and convtime columns are from psf_sndGetStats.
+   The conversion kernels in use go to stderr: set PSF_KERNELS (see psfext.h) to compare them.
+   (PSF_SAMP_8 is not supported by portsf, so is not measured; floats go into AIFC, not AIFF.)
+
+   usage: psfbench [-dtmpdir] [-nsamples] [-rrepeats] [-q]
+		-d: where the files go (default $TMPDIR, or /tmp)
+		-n: samples per file, all channels (default 4194304)
+		-r: runs of each test, the best is reported (default 3)
+		-q: quick: 2 channels and 4096 frames per buffer only */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef unix
+#include <unistd.h>
+#endif
+#include "portsf.h"
+#include "psfext.h"
+
+typedef struct bench_stype {
+	psf_stype	type;
+	const char	*name;
+	int			bytes;
+} BENCH_STYPE;
+
+typedef struct bench_format {
+	psf_format	format;
+	const char	*name;
+	const char	*ext;
+	const char	*byteorder;		/* of the samples in the file */
+} BENCH_FORMAT;
+
+static const BENCH_STYPE stypes[] = {
+	{PSF_SAMP_16,"16",2},
+	{PSF_SAMP_24,"24",3},
+	{PSF_SAMP_32,"32",4},
+	{PSF_SAMP_IEEE_FLOAT,"float",4}
+};
+static const BENCH_FORMAT formats[] = {
+	{PSF_STDWAVE,"wav",".wav","le"},
+	{PSF_AIFF,"aiff",".aif","be"},
+	{PSF_AIFC,"aifc",".aifc","be"}
+};
+static const int chanlist[] = {1,2,8,32};
+static const DWORD buflist[] = {256,4096,65536};
+#define NSTYPES		(sizeof(stypes) / sizeof(stypes[0]))
+#define NFORMATS	(sizeof(formats) / sizeof(formats[0]))
+#define NCHANS		(sizeof(chanlist) / sizeof(chanlist[0]))
+#define NBUFS		(sizeof(buflist) / sizeof(buflist[0]))
+#define MAXCHANS	(32)
+#define MAXBUF		(65536)
+
+/* one run: the time taken, and what portsf says it spent it on */
+typedef struct bench_result {
+	double		secs;
+	PSF_STATS	stats;
+} BENCH_RESULT;
+
+/* wall time: clock() is CPU time, which leaves out waiting for I/O */
+static double bench_now(void)
+{
+#ifdef unix
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9;
+#else
+	return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* something like music: a few sines, and a little noise so nothing compresses to nothing */
+static void bench_signal(float *buf, long nsamps)
+{
+	unsigned int seed = 12345;
+	long i;
+
+	for(i=0;i < nsamps;i++){
+		seed = seed * 1664525 + 1013904223;
+		buf[i] = 0.5f * (float)(i % 97) / 97.0f - 0.25f
+				+ 0.3f * (float)((i * 7) % 61) / 61.0f
+				+ 0.05f * ((float)(seed >> 8) / 16777216.0f - 0.5f);
+	}
+}
+
+static int bench_write(const char *path, const PSF_PROPS *props, const float *buf, DWORD bufframes,
+					   long frames, BENCH_RESULT *res)
+{
+	int fd,rc = 0;
+	long done;
+	DWORD n;
+	double start;
+
+	start = bench_now();
+	fd = psf_sndCreate(path,props,0,0,PSF_CREATE_WRONLY);
+	if(fd < 0)
+		return fd;
+	for(done=0;done < frames;done += n){
+		n = (DWORD)(frames - done < (long) bufframes ? frames - done : (long) bufframes);
+		rc = psf_sndWriteFloatFrames(fd,buf,n);
+		if(rc != (int) n)
+			break;
+		rc = 0;
+	}
+	psf_sndGetStats(fd,&res->stats);
+	if(psf_sndClose(fd) && rc==0)
+		rc = PSF_E_CANT_CLOSE;
+	res->secs = bench_now() - start;
+	return rc < 0 ? rc : 0;
+}
+
+static int bench_read(const char *path, float *buf, DWORD bufframes, long frames, BENCH_RESULT *res)
+{
+	PSF_PROPS props;
+	int fd,rc;
+	long done = 0;
+	double start;
+
+	start = bench_now();
+	fd = psf_sndOpen(path,&props,0);
+	if(fd < 0)
+		return fd;
+	while((rc = psf_sndReadFloatFrames(fd,buf,bufframes)) > 0)
+		done += rc;
+	psf_sndGetStats(fd,&res->stats);
+	psf_sndClose(fd);
+	res->secs = bench_now() - start;
+	if(rc < 0)
+		return rc;
+	return done==frames ? 0 : PSF_E_CANT_READ;
+}
+
+static void bench_report(const char *op, const BENCH_FORMAT *fmt, const BENCH_STYPE *st, int chans,
+						 DWORD bufframes, long frames, const BENCH_RESULT *res)
+{
+	double secs = res->secs > 0.0 ? res->secs : 1.0e-9;
+
+	printf("%s,%s,%s,%s,%d,%u,%ld,%.6f,%.0f,%.2f,%.6f,%.6f\n",op,fmt->name,fmt->byteorder,st->name,
+		   chans,(unsigned int) bufframes,frames,res->secs,(double) frames / secs,
+		   (double) frames * chans * st->bytes / secs * 1.0e-6,res->stats.iotime,res->stats.convtime);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *tmpdir = NULL;
+	char dir[1024],path[1100];
+	long nsamples = 4194304,frames;
+	int repeats = 3,quick = 0,errors = 0;
+	unsigned int s,f,c,b;
+	int r,rc,chans;
+	float *buf,*rbuf;
+	BENCH_RESULT best[2],res;
+	PSF_PROPS props;
+
+	while(argc > 1 && argv[1][0]=='-'){
+		switch(argv[1][1]){
+		case('d'):
+			tmpdir = argv[1] + 2;
+			break;
+		case('n'):
+			nsamples = atol(argv[1] + 2);
+			break;
+		case('r'):
+			repeats = atoi(argv[1] + 2);
+			break;
+		case('q'):
+			quick = 1;
+			break;
+		default:
+			fprintf(stderr,"psfbench: unknown flag %s\n",argv[1]);
+			return 1;
+		}
+		argc--;
+		argv++;
+	}
+	if(argc > 1 || nsamples < MAXCHANS || repeats < 1){
+		fprintf(stderr,"usage: psfbench [-dtmpdir] [-nsamples] [-rrepeats] [-q]\n");
+		return 1;
+	}
+	if(tmpdir==NULL || *tmpdir=='\0')
+		tmpdir = getenv("TMPDIR");
+	if(tmpdir==NULL || *tmpdir=='\0')
+		tmpdir = "/tmp";
+#ifdef unix
+	/* a directory of our own, so runs at once do not collide */
+	sprintf(dir,"%.1000s/psfbenchXXXXXX",tmpdir);
+	if(mkdtemp(dir)==NULL){
+		fprintf(stderr,"psfbench: cannot make a directory in %s\n",tmpdir);
+		return 1;
+	}
+#else
+	sprintf(dir,"%.1000s",tmpdir);
+#endif
+	buf = (float *) malloc(sizeof(float) * MAXBUF * MAXCHANS);
+	rbuf = (float *) malloc(sizeof(float) * MAXBUF * MAXCHANS);
+	if(buf==NULL || rbuf==NULL){
+		fprintf(stderr,"psfbench: no memory\n");
+		return 1;
+	}
+	bench_signal(buf,(long) MAXBUF * MAXCHANS);
+	if(psf_init()){
+		fprintf(stderr,"psfbench: unable to start up portsf\n");
+		return 1;
+	}
+	fprintf(stderr,"psfbench: %s kernels\n",psf_kernels());
+
+	printf("op,format,byteorder,samptype,chans,bufframes,frames,secs,frames_per_sec,mbytes_per_sec,iotime,convtime\n");
+	for(s=0;s < NSTYPES;s++){
+		for(f=0;f < NFORMATS;f++){
+			if(formats[f].format==PSF_AIFF && stypes[s].type==PSF_SAMP_IEEE_FLOAT)
+				continue;
+			for(c=0;c < NCHANS;c++){
+				chans = chanlist[c];
+				if(quick && chans != 2)
+					continue;
+				frames = nsamples / chans;
+				props.srate = 48000;
+				props.chans = chans;
+				props.samptype = stypes[s].type;
+				props.format = formats[f].format;
+				props.chformat = chans > 2 ? MC_STD : STDWAVE;
+				/* more than 2 channels, or more than 16 bits, belong in WAVE-EX */
+				if(props.format==PSF_STDWAVE && (chans > 2 || props.samptype != PSF_SAMP_16))
+					props.format = PSF_WAVE_EX;
+				sprintf(path,"%s/bench%s",dir,formats[f].ext);
+				for(b=0;b < NBUFS;b++){
+					if(quick && buflist[b] != 4096)
+						continue;
+					rc = 0;
+					for(r=0;r < repeats && rc==0;r++){
+						rc = bench_write(path,&props,buf,buflist[b],frames,&res);
+						if(rc==0 && (r==0 || res.secs < best[0].secs))
+							best[0] = res;
+						if(rc==0)
+							rc = bench_read(path,rbuf,buflist[b],frames,&res);
+						if(rc==0 && (r==0 || res.secs < best[1].secs))
+							best[1] = res;
+					}
+					if(rc){
+						fprintf(stderr,"psfbench: %s %s %d chans, %u frames: error %d\n",formats[f].name,
+								stypes[s].name,chans,(unsigned int) buflist[b],rc);
+						errors++;
+						continue;
+					}
+					bench_report("write",&formats[f],&stypes[s],chans,buflist[b],frames,&best[0]);
+					bench_report("read",&formats[f],&stypes[s],chans,buflist[b],frames,&best[1]);
+				}
+				remove(path);
+			}
+		}
+	}
+#ifdef unix
+	rmdir(dir);
+#endif
+	free(buf);
+	free(rbuf);
+	psf_finish();
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psfext.h: extensions to the portsf API. Include after <portsf.h> */
+
+#ifndef __PSFEXT_H_INCLUDED
+#define __PSFEXT_H_INCLUDED
+
+#include <stddef.h>		/* size_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Threads (unix): there is no fixed limit on open files, and files may be opened and closed
+   from any thread. Different files may be used at once from different threads; calls on the
+   same file are serialized, but a file must not be closed while another thread is using it.
+   psf_init and psf_finish are not thread-safe: call them once, from one thread. */
+
+/* frame counts and positions beyond 2GB (RF64 files) */
+#ifdef _MSC_VER
+typedef __int64 psf_int64;
+#else
+typedef long long psf_int64;
+#endif
+
+/* flags for psf_sndOpenEx; may be OR'd together */
+#define PSF_OPEN_DEFAULT	(0)
+/* map the data chunk into memory (unix only: elsewhere, or if the map fails,
+   the file is read through stdio as usual). Seeks are then free, and reads are
+   served straight from the page cache. */
+#define PSF_OPEN_MMAP		(1)
+/* read-only files: read ahead in a background thread, 4 blocks of 4096 frames
+   (see psf_sndSetReadAhead). Falls back to plain reads if the thread cannot start. */
+#define PSF_OPEN_READAHEAD	(2)
+
+/* as psf_sndOpen, with extra open mode flags. Return sf descriptor >= 0, or some PSF_E_ value */
+int psf_sndOpenEx(const char *path,PSF_PROPS *props, int rescale, int flags);
+
+/* read up to nFrames without copying: *pbuf is set to the samples, as floats.
+   For a mapped native float file (no rescale) this points into the mapping itself;
+   otherwise the frames are decoded into a buffer owned by the file.
+   Either way the data is valid only until the next call on sfd (or close).
+   Returns frames read, 0 at end of file, or some PSF_E_ value. */
+int psf_sndReadFloatView(int sfd, const float **pbuf, DWORD nFrames);
+
+/* 64bit versions of psf_sndSize, psf_sndTell and psf_sndSeek. The int versions
+   return PSF_E_UNSUPPORTED if the answer will not fit. 
+   WAVE files are written with space reserved for a ds64 chunk (unless created with minheader),
+   and become RF64 files on close if they grow beyond 4GB. */
+psf_int64 psf_sndSize64(int sfd);
+psf_int64 psf_sndTell64(int sfd);
+int psf_sndSeek64(int sfd, psf_int64 offset, int mode);
+
+/* asynchronous writes: blocks are encoded as usual, then queued for a writer thread,
+   so the caller only waits when nblocks blocks are already queued (2 or more give double buffering).
+   nblocks = 0 waits for the queue to empty and returns to synchronous writes.
+   A write error is reported by a later write, psf_sndSetAsync or psf_sndClose.
+   unix only: elsewhere returns PSF_E_UNSUPPORTED, and writes stay synchronous. */
+int psf_sndSetAsync(int sfd, int nblocks);
+
+/* read-ahead: a reader thread decodes up to nblocks blocks of blockframes frames
+   (0 = 4096) ahead of the caller, so psf_sndReadFloatFrames only copies floats.
+   Seeking restarts it from the new position. nblocks = 0 returns to plain reads.
+   Read-only files; unix only: elsewhere returns PSF_E_UNSUPPORTED. */
+int psf_sndSetReadAhead(int sfd, int nblocks, DWORD blockframes);
+
+/* what psf_sndProbe finds in the header besides the PSF_PROPS */
+typedef struct psf_probeinfo {
+	psf_int64	nFrames;
+	int			haspeaks;		/* 1 if the file has a PEAK chunk */
+	MYLONG		peaktime;
+	PSF_CHPEAK	*peaks;			/* set by caller, room for maxpeaks channels; or NULL */
+	int			maxpeaks;
+} PSF_PROBEINFO;
+
+/* read the header only, for indexing: the format is found from the header itself (not the name),
+   and no handle is used, so any number of threads may probe at once. info may be NULL.
+   Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_sndProbe(const char *path, PSF_PROPS *props, PSF_PROBEINFO *info);
+
+/* raw (headerless) sample data: interleaved, little-endian as in WAVE. psf_getFormatExt gives PSF_RAW
+   for names ending .raw or .pcm, and for "-", which is stdin to psf_sndOpenRaw and stdout to psf_sndCreate.
+   Nothing is written but the samples, so there is no PEAK chunk (psf_sndReadPeaks works until close).
+   stdin, or any other pipe, is a stream: it cannot seek, and psf_sndSize64 returns PSF_E_UNSUPPORTED
+   until the end has been read. PSF_RAW is not in the psf_format enum of portsf.h: a switch with a case
+   for it switches on (int) format. */
+#define PSF_RAW		((psf_format)(PSF_AIFC + 1))
+
+/* open raw data: props must give srate, chans and samptype, as the file cannot; props->format is set
+   to PSF_RAW. flags as psf_sndOpenEx (ignored for a stream). Return sf descriptor >= 0, or some PSF_E_ value */
+int psf_sndOpenRaw(const char *path, PSF_PROPS *props, int flags);
+
+/* set srate, chans and samptype in props from a description such as "44100,2,16":
+   "srate,chans,type", where type is 16, 24, 32 or float. Return PSF_E_NOERROR or PSF_E_BADARG */
+int psf_rawProps(const char *spec, PSF_PROPS *props);
+
+/* for programs that can write samples to stdout: if outpath is "-", the samples keep stdout (for
+   psf_sndCreate("-")), and whatever else the program prints there, with printf or puts, goes to stderr.
+   Call it before printing anything. Any other outpath: nothing changes.
+   unix only: elsewhere returns PSF_E_UNSUPPORTED. Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_stdoutSamples(const char *outpath);
+
+/* psf_sndSetDither: TPDF dither with noise shaping, for 16bit output (5-tap Lipshitz filter,
+   best at 44.1kHz: the noise is moved up above 15kHz or so). Each file makes its own noise. */
+#define PSF_DITHER_SHAPED	(PSF_DITHER_TPDF + 1)
+
+/* integer frames, in native byte order: the file's samptype must match the call, or PSF_E_UNSUPPORTED.
+   Samples are copied as they are (bytes swapped or packed as the file needs): no rescale, dither or clip,
+   except that 24bit samples (ints, sign-extended) are clipped to 24 bits on write.
+   Return frames read or written, or some PSF_E_ value, as psf_sndReadFloatFrames. */
+int psf_sndReadInt16Frames(int sfd, short *buf, DWORD nFrames);
+int psf_sndReadInt24Frames(int sfd, int *buf, DWORD nFrames);
+int psf_sndReadInt32Frames(int sfd, int *buf, DWORD nFrames);
+int psf_sndWriteInt16Frames(int sfd, const short *buf, DWORD nFrames);
+int psf_sndWriteInt24Frames(int sfd, const int *buf, DWORD nFrames);
+int psf_sndWriteInt32Frames(int sfd, const int *buf, DWORD nFrames);
+
+/* planar (deinterleaved) frames: bufs holds one pointer per channel, each with room for nFrames.
+   Return frames read or written, or some PSF_E_ value, as psf_sndReadFloatFrames. */
+int psf_sndReadFloatPlanar(int sfd, float *const *bufs, DWORD nFrames);
+int psf_sndWriteFloatPlanar(int sfd, const float *const *bufs, DWORD nFrames);
+
+/* read up to nFrames from frame onwards, without using or moving the file position (psf_sndTell is
+   unchanged): any number of threads may read one file at once, each its own part. Writes are seen
+   once made. Not for streams. Return frames read, 0 beyond the end, or some PSF_E_ value. */
+int psf_sndReadFloatFramesAt(int sfd, psf_int64 frame, float *buf, DWORD nFrames);
+
+/* I/O policy for psf_sndSetIO. PSF_IO_DEFAULT: stdio's own buffer.
+   PSF_IO_BUFFERED: a page-aligned buffer of bufsize bytes (0 = 1MB), so big blocks take few system calls.
+   PSF_IO_DIRECT: as PSF_IO_BUFFERED, for one sequential pass through a big file without filling the page
+   cache: the kernel is told to read sequentially, and every 8MB what has been read, or written and synced
+   to disk, is dropped from the cache; at close (after the header update) the whole file is. This is done
+   with cache advice, not O_DIRECT, so headers and block sizes need no alignment (use psf_sndSetAsync
+   to keep the syncs off the caller's thread). Mapped files are only marked sequential, and dropped at close.
+   Where there is no cache advice PSF_IO_DIRECT is PSF_IO_BUFFERED. */
+#define PSF_IO_DEFAULT		(0)
+#define PSF_IO_BUFFERED		(1)
+#define PSF_IO_DIRECT		(2)
+
+/* set the policy for sfd, at any time. Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_sndSetIO(int sfd, int mode, DWORD bufsize);
+
+/* lossless compressed files (.lac), read and written with the usual calls. 16, 24 and 32bit samples
+   are coded FLAC-fashion (linear prediction and Rice codes) in blocks of 4096 frames, so a file is
+   typically half the size of the WAVE; floats are stored uncompressed. Blocks are coded and decoded
+   on several threads at once, and an index of blocks at the end of the file makes seeks cheap.
+   A file being written can only go forward: seeks to anywhere but the current position fail.
+   Like PSF_RAW, PSF_LAC is outside the psf_format enum. */
+#define PSF_LAC		((psf_format)(PSF_RAW + 1))
+
+/* what a file has done since it was opened, for psf_sndGetStats. Times are in seconds, summed over the
+   caller and any reader or writer thread (so they can add up to more than the time taken).
+   iotime is spent reading and writing the file; for a .lac file that includes the coding, and the bytes
+   are those of the samples, before compression. convtime is the rest of the caller's read and write
+   calls: converting samples, peaks, dither, rate conversion. waittime is the caller waiting for the
+   read-ahead or async writer thread. Mostly iotime and waittime: disk-bound; mostly convtime: CPU-bound. */
+typedef struct psf_stats {
+	psf_int64	bytesread;		/* headers and samples, to and from the file (or its mapping) */
+	psf_int64	byteswritten;
+	psf_int64	framesread;		/* by the caller */
+	psf_int64	frameswritten;
+	psf_int64	nreads;			/* reads and writes of the file or its mapping, and seeks */
+	psf_int64	nwrites;
+	psf_int64	nseeks;
+	double		iotime;
+	double		convtime;
+	double		waittime;
+} PSF_STATS;
+
+/* any thread may ask, at any time. Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_sndGetStats(int sfd, PSF_STATS *stats);
+
+/* files in memory (unix only: elsewhere these return PSF_E_UNSUPPORTED). Headers are read and written
+   as for files on disk, and every other call works as usual, except psf_sndReadFloatFramesAt on a file
+   being written, or on a .lac image (PSF_E_UNSUPPORTED).
+   psf_sndOpenMem reads the image of a file in data, which the caller keeps until close: the format is
+   found from the header, as psf_sndProbe. The samples are read straight from data, as from a mapping.
+   Return sf descriptor >= 0, or some PSF_E_ value */
+int psf_sndOpenMem(const void *data, size_t size, PSF_PROPS *props, int rescale);
+/* write a new file, of format props->format, into buf, which has room for size bytes (writes that
+   would overflow fail); or, with buf NULL, into a buffer that grows as needed.
+   Return sf descriptor >= 0, or some PSF_E_ value */
+int psf_sndCreateMem(void *buf, size_t size, const PSF_PROPS *props, int clip_floats, int minheader);
+/* close as psf_sndClose, and return the image: *pbuf and *psize are set to the bytes and their length
+   (for a growable buffer, now the caller's, to free). On error nothing is returned, and a growable
+   buffer is freed; psf_sndClose on a file in memory always does that. Return PSF_E_NOERROR,
+   or some PSF_E_ value (PSF_E_BADARG, and sfd is still open, if it is not a file in memory) */
+int psf_sndCloseMem(int sfd, void **pbuf, size_t *psize);
+
+/* the sample conversion kernels in use: "generic", "sse2", "avx2" or "avx512". psf_init() picks the widest
+   the CPU runs (x86 only); PSF_KERNELS=sse2 or avx2 in the environment caps the choice */
+const char *psf_kernels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
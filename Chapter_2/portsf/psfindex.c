@@ -0,0 +1,352 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psfindex.c: the soundfile index written by sfscan, and read by anything wanting
+   properties, durations or peaks without opening each file.
+   File layout, all little-endian:
+		"PSFX", version (4 bytes), number of entries (4 bytes), then for each entry:
+		path length (4), path (no terminator), mtime (8), size (8),
+		srate, chans, samptype, format, chformat (4 each), nFrames (8), haspeaks (4),
+		and if haspeaks, chans * { val (4, IEEE float), pos (4) }
+   Entries are stored sorted by path, so lookups are a binary search. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef unix
+#include <unistd.h>
+#include <limits.h>
+#endif
+#include "portsf.h"
+#include "psfext.h"
+#include "psfindex.h"
+
+#define PSF_INDEX_VERSION	(1)
+
+PSF_INDEX *psf_indexNew(void)
+{
+	PSF_INDEX *idx = (PSF_INDEX *) malloc(sizeof(PSF_INDEX));
+
+	if(idx==NULL)
+		return NULL;
+	idx->entries = NULL;
+	idx->nentries = 0;
+	idx->maxentries = 0;
+	return idx;
+}
+
+void psf_indexFree(PSF_INDEX *idx)
+{
+	int i;
+
+	if(idx==NULL)
+		return;
+	for(i=0;i < idx->nentries;i++){
+		free(idx->entries[i].path);
+		free(idx->entries[i].peaks);
+	}
+	free(idx->entries);
+	free(idx);
+}
+
+int psf_indexAdd(PSF_INDEX *idx, const PSF_INDEXENTRY *entry)
+{
+	PSF_INDEXENTRY *e;
+
+	if(idx->nentries == idx->maxentries){
+		int newmax = idx->maxentries ? idx->maxentries * 2 : 256;
+		e = (PSF_INDEXENTRY *) realloc(idx->entries,newmax * sizeof(PSF_INDEXENTRY));
+		if(e==NULL)
+			return PSF_E_NOMEM;
+		idx->entries = e;
+		idx->maxentries = newmax;
+	}
+	e = idx->entries + idx->nentries;
+	*e = *entry;
+	e->path = (char *) malloc(strlen(entry->path) + 1);
+	if(e->path==NULL)
+		return PSF_E_NOMEM;
+	strcpy(e->path,entry->path);
+	e->peaks = NULL;
+	if(entry->haspeaks){
+		e->peaks = (PSF_CHPEAK *) malloc(entry->props.chans * sizeof(PSF_CHPEAK));
+		if(e->peaks==NULL){
+			free(e->path);
+			return PSF_E_NOMEM;
+		}
+		memcpy(e->peaks,entry->peaks,entry->props.chans * sizeof(PSF_CHPEAK));
+	}
+	idx->nentries++;
+	return PSF_E_NOERROR;
+}
+
+static int psf_indexCompare(const void *a, const void *b)
+{
+	return strcmp(((const PSF_INDEXENTRY *) a)->path,((const PSF_INDEXENTRY *) b)->path);
+}
+
+void psf_indexSort(PSF_INDEX *idx)
+{
+	qsort(idx->entries,idx->nentries,sizeof(PSF_INDEXENTRY),psf_indexCompare);
+}
+
+const PSF_INDEXENTRY *psf_indexFind(const PSF_INDEX *idx, const char *path)
+{
+	int lo = 0, hi = idx->nentries - 1;
+
+	while(lo <= hi){
+		int mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(path,idx->entries[mid].path);
+		if(cmp==0)
+			return idx->entries + mid;
+		if(cmp < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+int psf_indexStat(const char *path, psf_int64 *mtime, psf_int64 *size)
+{
+	struct stat st;
+
+	if(stat(path,&st))
+		return PSF_E_CANT_OPEN;
+	*mtime = (psf_int64) st.st_mtime;
+	*size = (psf_int64) st.st_size;
+	return PSF_E_NOERROR;
+}
+
+const PSF_INDEXENTRY *psf_indexLookup(const PSF_INDEX *idx, const char *path)
+{
+	const PSF_INDEXENTRY *e;
+	psf_int64 mtime,size;
+#ifdef unix
+	char fullpath[PATH_MAX];
+
+	if(realpath(path,fullpath))
+		path = fullpath;
+#endif
+	e = psf_indexFind(idx,path);
+	if(e==NULL || psf_indexStat(path,&mtime,&size) < PSF_E_NOERROR)
+		return NULL;
+	if(mtime != e->mtime || size != e->size)
+		return NULL;
+	return e;
+}
+
+/******** the index file ***********/
+
+static void psf_put32(unsigned char *p, unsigned int val)
+{
+	p[0] = (unsigned char) val;
+	p[1] = (unsigned char)(val >> 8);
+	p[2] = (unsigned char)(val >> 16);
+	p[3] = (unsigned char)(val >> 24);
+}
+
+static void psf_put64(unsigned char *p, psf_int64 val)
+{
+	psf_put32(p,(unsigned int) val);
+	psf_put32(p + 4,(unsigned int)((unsigned long long) val >> 32));
+}
+
+static unsigned int psf_get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static psf_int64 psf_get64(const unsigned char *p)
+{
+	return (psf_int64)(psf_get32(p) | ((unsigned long long) psf_get32(p + 4) << 32));
+}
+
+#define PSF_ENTRYFIXED	(4 + 8 + 8 + 5 * 4 + 8 + 4)
+
+int psf_indexSave(PSF_INDEX *idx, const char *indexfile)
+{
+	FILE *fp;
+	char *tmpname;
+	unsigned char buf[PSF_ENTRYFIXED];
+	int i,j,rc = PSF_E_NOERROR;
+
+	psf_indexSort(idx);
+	tmpname = (char *) malloc(strlen(indexfile) + 5);
+	if(tmpname==NULL)
+		return PSF_E_NOMEM;
+	sprintf(tmpname,"%s.tmp",indexfile);
+	if((fp = fopen(tmpname,"wb"))==NULL){
+		free(tmpname);
+		return PSF_E_CANT_OPEN;
+	}
+	memcpy(buf,"PSFX",4);
+	psf_put32(buf + 4,PSF_INDEX_VERSION);
+	psf_put32(buf + 8,(unsigned int) idx->nentries);
+	if(fwrite(buf,1,12,fp) != 12)
+		rc = PSF_E_CANT_WRITE;
+	for(i=0;i < idx->nentries && rc==PSF_E_NOERROR;i++){
+		const PSF_INDEXENTRY *e = idx->entries + i;
+		unsigned int pathlen = (unsigned int) strlen(e->path);
+		unsigned char *p = buf;
+
+		psf_put32(p,pathlen);
+		if(fwrite(buf,1,4,fp) != 4 || fwrite(e->path,1,pathlen,fp) != pathlen){
+			rc = PSF_E_CANT_WRITE;
+			break;
+		}
+		psf_put64(p,e->mtime);					p += 8;
+		psf_put64(p,e->size);					p += 8;
+		psf_put32(p,e->props.srate);			p += 4;
+		psf_put32(p,e->props.chans);			p += 4;
+		psf_put32(p,e->props.samptype);			p += 4;
+		psf_put32(p,e->props.format);			p += 4;
+		psf_put32(p,e->props.chformat);			p += 4;
+		psf_put64(p,e->nFrames);				p += 8;
+		psf_put32(p,e->haspeaks ? 1 : 0);		p += 4;
+		if(fwrite(buf,1,p - buf,fp) != (size_t)(p - buf)){
+			rc = PSF_E_CANT_WRITE;
+			break;
+		}
+		if(e->haspeaks){
+			for(j=0;j < e->props.chans;j++){
+				unsigned int bits;
+				memcpy(&bits,&e->peaks[j].val,sizeof(float));
+				psf_put32(buf,bits);
+				psf_put32(buf + 4,e->peaks[j].pos);
+				if(fwrite(buf,1,8,fp) != 8){
+					rc = PSF_E_CANT_WRITE;
+					break;
+				}
+			}
+		}
+	}
+	if(fclose(fp) && rc==PSF_E_NOERROR)
+		rc = PSF_E_CANT_WRITE;
+	if(rc==PSF_E_NOERROR){
+#ifndef unix
+		/* rename will not replace a file here */
+		remove(indexfile);
+#endif
+		if(rename(tmpname,indexfile))
+			rc = PSF_E_CANT_WRITE;
+	}
+	else
+		remove(tmpname);
+	free(tmpname);
+	return rc;
+}
+
+int psf_indexLoad(PSF_INDEX *idx, const char *indexfile)
+{
+	FILE *fp;
+	unsigned char *data,*p,*end;
+	long len;
+	unsigned int i,j,count;
+	int rc = PSF_E_NOERROR;
+
+	if((fp = fopen(indexfile,"rb"))==NULL)
+		return PSF_E_CANT_OPEN;
+	if(fseek(fp,0,SEEK_END) || (len = ftell(fp)) < 12 || fseek(fp,0,SEEK_SET)){
+		fclose(fp);
+		return PSF_E_BAD_FORMAT;
+	}
+	data = (unsigned char *) malloc(len);
+	if(data==NULL){
+		fclose(fp);
+		return PSF_E_NOMEM;
+	}
+	if(fread(data,1,len,fp) != (size_t) len){
+		fclose(fp);
+		free(data);
+		return PSF_E_CANT_READ;
+	}
+	fclose(fp);
+	end = data + len;
+	if(memcmp(data,"PSFX",4) || psf_get32(data + 4) != PSF_INDEX_VERSION){
+		free(data);
+		return PSF_E_BAD_FORMAT;
+	}
+	count = psf_get32(data + 8);
+	p = data + 12;
+	for(i=0;i < count;i++){
+		PSF_INDEXENTRY e;
+		PSF_CHPEAK *peaks = NULL;
+		char *path;
+		unsigned int pathlen;
+
+		if(end - p < 4 || (unsigned int)(end - p - 4) < (pathlen = psf_get32(p))
+			|| (size_t)(end - p - 4 - pathlen) < PSF_ENTRYFIXED - 4){
+			rc = PSF_E_BAD_FORMAT;
+			break;
+		}
+		p += 4;
+		path = (char *) malloc(pathlen + 1);
+		if(path==NULL){
+			rc = PSF_E_NOMEM;
+			break;
+		}
+		memcpy(path,p,pathlen);
+		path[pathlen] = '\0';
+		p += pathlen;
+		e.path = path;
+		e.mtime = psf_get64(p);								p += 8;
+		e.size = psf_get64(p);								p += 8;
+		e.props.srate = (int) psf_get32(p);					p += 4;
+		e.props.chans = (int) psf_get32(p);					p += 4;
+		e.props.samptype = (psf_stype) psf_get32(p);		p += 4;
+		e.props.format = (psf_format) psf_get32(p);			p += 4;
+		e.props.chformat = (psf_channelformat) psf_get32(p);	p += 4;
+		e.nFrames = psf_get64(p);							p += 8;
+		e.haspeaks = (int) psf_get32(p);					p += 4;
+		e.peaks = NULL;
+		if(e.haspeaks){
+			if(e.props.chans <= 0 || (end - p) / 8 < e.props.chans
+				|| (peaks = (PSF_CHPEAK *) malloc(e.props.chans * sizeof(PSF_CHPEAK)))==NULL){
+				free(path);
+				rc = e.props.chans > 0 && (end - p) / 8 >= e.props.chans ? PSF_E_NOMEM : PSF_E_BAD_FORMAT;
+				break;
+			}
+			for(j=0;j < (unsigned int) e.props.chans;j++){
+				unsigned int bits = psf_get32(p);
+				memcpy(&peaks[j].val,&bits,sizeof(float));
+				peaks[j].pos = psf_get32(p + 4);
+				p += 8;
+			}
+			e.peaks = peaks;
+		}
+		rc = psf_indexAdd(idx,&e);
+		free(path);
+		free(peaks);
+		if(rc < PSF_E_NOERROR)
+			break;
+	}
+	free(data);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	psf_indexSort(idx);
+	return (int) count;
+}
@@ -0,0 +1,73 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psfindex.h: a persistent index of soundfile properties and peaks, as written by sfscan.
+   Include after <portsf.h> and <psfext.h> */
+
+#ifndef __PSFINDEX_H_INCLUDED
+#define __PSFINDEX_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct psf_indexentry {
+	char			*path;		/* absolute, as realpath() gives it (unix) */
+	psf_int64		mtime;		/* the file's modification time and size when indexed */
+	psf_int64		size;
+	PSF_PROPS		props;
+	psf_int64		nFrames;	/* duration is nFrames / props.srate */
+	int				haspeaks;
+	PSF_CHPEAK		*peaks;		/* props.chans of them, if haspeaks */
+} PSF_INDEXENTRY;
+
+typedef struct psf_index {
+	PSF_INDEXENTRY	*entries;	/* sorted by path, after psf_indexSort, Load or Save */
+	int				nentries;
+	int				maxentries;
+} PSF_INDEX;
+
+/* a new, empty index. Return NULL if no memory */
+PSF_INDEX *psf_indexNew(void);
+void psf_indexFree(PSF_INDEX *idx);
+/* add a copy of entry (path and peaks are copied too). Return PSF_E_NOERROR or PSF_E_NOMEM */
+int psf_indexAdd(PSF_INDEX *idx, const PSF_INDEXENTRY *entry);
+void psf_indexSort(PSF_INDEX *idx);
+/* read an index file, adding its entries to idx. Return number of entries, or some PSF_E_ value */
+int psf_indexLoad(PSF_INDEX *idx, const char *indexfile);
+/* sort and write idx: written to a temporary file, then renamed over indexfile */
+int psf_indexSave(PSF_INDEX *idx, const char *indexfile);
+/* exact path match in a sorted index, or NULL */
+const PSF_INDEXENTRY *psf_indexFind(const PSF_INDEX *idx, const char *path);
+/* as psf_indexFind, for a path as the user gives it; NULL unless the entry is
+   still current (file mtime and size unchanged) */
+const PSF_INDEXENTRY *psf_indexLookup(const PSF_INDEX *idx, const char *path);
+/* mtime and size of a file, as stored in the index. Return PSF_E_NOERROR, or PSF_E_CANT_OPEN */
+int psf_indexStat(const char *path, psf_int64 *mtime, psf_int64 *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
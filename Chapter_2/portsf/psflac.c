@@ -0,0 +1,1602 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psflac.c: lossless compression for PSF_LAC files, in the manner of FLAC.
+   The data is cut into blocks of PSF_LAC_BLOCKFRAMES frames, each coded on its own: a stereo pair
+   may be turned into mid/side (or left/side, side/right); each channel is then a constant, verbatim,
+   or predicted by a fixed polynomial (orders 0 to 4) or by LPC (orders 1 to 12, coefficients
+   quantized to 15 bits), whichever takes fewest bits. The residual is Rice coded in up to 256
+   partitions, each with its own parameter, or stored raw where that is smaller.
+   Floats are stored as they are. Blocks are coded, and decoded, a batch at a time by a few threads.
+
+   File layout, all little-endian:
+	0	"PLAC", version, srate, chans (16bit), bits (16), isfloat (16), chformat (16),
+		chmask, blockframes, peaktime, nFrames (64), index offset (64)
+	48	PEAK data: chans * (float val, DWORD pos)
+		blocks: size, nFrames, then size bytes of coded data
+		index: the file offset of each block (64)
+   nFrames, the index offset and the PEAK data are filled in at close. */
+
+#include <stdio.h>
+#ifdef unix
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "portsf.h"
+#include "psfext.h"
+#include "psflac.h"
+
+#ifndef max
+#define max(x,y) ((x) > (y) ? (x) : (y))
+#endif
+#ifndef min
+#define min(x,y) ((x) < (y) ? (x) : (y))
+#endif
+#ifdef linux
+#define POS64(x) (x.__pos)
+#else
+#define POS64(x) (x)
+#endif
+
+#ifdef _MSC_VER
+typedef unsigned __int64 lac_uint64;
+#else
+typedef unsigned long long lac_uint64;
+#endif
+
+#define PSF_LAC_VERSION		(1)
+#define PSF_LAC_HDRSIZE		(48)
+#define PSF_LAC_MAXBLOCK	(65536)
+#define PSF_LAC_MAXORDER	(12)
+#define PSF_LAC_QBITS		(15)		/* LPC coefficients, with sign */
+#define PSF_LAC_MAXSHIFT	(15)
+#define PSF_LAC_MAXPORDER	(8)
+#define PSF_LAC_MAXRICE		(30)
+#define PSF_LAC_ESCAPE		(31)		/* Rice parameter for a raw partition */
+#define PSF_LAC_MAXTHREADS	(8)
+#define PSF_LAC_MAXBATCH	(32)
+#define PSF_LAC_BATCHBYTES	(4 << 20)	/* samples held for a batch, at most */
+
+enum { LAC_CONSTANT, LAC_VERBATIM, LAC_FIXED, LAC_LPC };
+enum { LAC_INDEPENDENT, LAC_LEFTSIDE, LAC_SIDERIGHT, LAC_MIDSIDE };
+
+/* scratch for coding one block: each thread has its own */
+typedef struct lac_work {
+	int			*planes;		/* chans + 2 (mid, side) planes of blockframes */
+	psf_int64	*res,*res2;		/* residuals: the best so far, and the one being tried */
+	double		*wx;			/* windowed samples */
+	double		*window;
+	DWORD		windowlen;
+} LAC_WORK;
+
+typedef struct lac_job {
+	unsigned char	*data;		/* the coded block, after its header */
+	DWORD			size;
+	DWORD			nFrames;
+	unsigned char	*pcm;		/* its samples, within the batch */
+	int				rc;
+} LAC_JOB;
+
+struct psf_lac {
+	FILE			*fp;
+	PSF_LACINFO		info;
+	int				iswrite;
+	DWORD			blockframes;
+	DWORD			align;			/* bytes per frame of samples */
+	DWORD			maxblockbytes;	/* largest coded block, with its header */
+	psf_int64		dataoffset;
+	psf_int64		*index;			/* reading: nblocks + 1 offsets, the last the end of the data */
+	psf_int64		nblocks;
+	psf_int64		maxblocks;
+	psf_int64		filepos;		/* where the file is: -1 if not known */
+	PSF_CHPEAK		*peaks;
+	/* the batch */
+	int				maxbatch;
+	unsigned char	*pcm;			/* maxbatch blocks of samples */
+	LAC_JOB			*jobs;
+	unsigned char	*coded;			/* writing: maxbatch blocks; reading: as read */
+	size_t			codedsize;
+	DWORD			pcmfill;		/* writing: bytes waiting to be coded */
+	psf_int64		written;		/* writing: frames coded */
+	psf_int64		pos;			/* reading: the next frame */
+	psf_int64		batchstart;		/* reading: the first frame decoded, */
+	DWORD			batchframes;	/* and how many */
+	/* threads: work[0] is the caller's */
+	LAC_WORK		work[PSF_LAC_MAXTHREADS];
+	int				nwork;
+	int				nthreads;
+#ifdef unix
+	pthread_t		threads[PSF_LAC_MAXTHREADS];
+	pthread_mutex_t	lock;
+	pthread_cond_t	go,done;
+	int				njobs,nextjob,nfinished,quit;
+#endif
+};
+
+/******** little-endian fields ***********/
+
+static void lac_put32(unsigned char *p, DWORD v)
+{
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char)(v >> 8);
+	p[2] = (unsigned char)(v >> 16);
+	p[3] = (unsigned char)(v >> 24);
+}
+
+static DWORD lac_get32(const unsigned char *p)
+{
+	return (DWORD) p[0] | ((DWORD) p[1] << 8) | ((DWORD) p[2] << 16) | ((DWORD) p[3] << 24);
+}
+
+static void lac_put64(unsigned char *p, psf_int64 v)
+{
+	lac_put32(p,(DWORD) v);
+	lac_put32(p + 4,(DWORD)((lac_uint64) v >> 32));
+}
+
+static psf_int64 lac_get64(const unsigned char *p)
+{
+	return (psf_int64)((lac_uint64) lac_get32(p) | ((lac_uint64) lac_get32(p + 4) << 32));
+}
+
+static int lac_seek(FILE *fp, psf_int64 offset)
+{
+	fpos_t pos;
+
+	if(fgetpos(fp,&pos))
+		return PSF_E_CANT_SEEK;
+	POS64(pos) = offset;
+	if(fsetpos(fp,&pos))
+		return PSF_E_CANT_SEEK;
+	return PSF_E_NOERROR;
+}
+
+/******** bits ***********/
+
+typedef struct lac_bitwriter {
+	unsigned char	*p;
+	lac_uint64		acc;
+	int				nbits;
+} LAC_BITW;
+
+static void lac_put(LAC_BITW *bw, DWORD val, int nbits)
+{
+	if(nbits==0)
+		return;
+	if(nbits < 32)
+		val &= ((DWORD) 1 << nbits) - 1;
+	bw->acc = (bw->acc << nbits) | val;
+	bw->nbits += nbits;
+	while(bw->nbits >= 8){
+		bw->nbits -= 8;
+		*bw->p++ = (unsigned char)(bw->acc >> bw->nbits);
+	}
+}
+
+static void lac_putWide(LAC_BITW *bw, lac_uint64 val, int nbits)
+{
+	if(nbits > 32){
+		lac_put(bw,(DWORD)(val >> 32),nbits - 32);
+		nbits = 32;
+	}
+	lac_put(bw,(DWORD) val,nbits);
+}
+
+/* q zeros and a one */
+static void lac_putUnary(LAC_BITW *bw, lac_uint64 q)
+{
+	while(q >= 32){
+		lac_put(bw,0,32);
+		q -= 32;
+	}
+	lac_put(bw,1,(int) q + 1);
+}
+
+static void lac_flush(LAC_BITW *bw)
+{
+	if(bw->nbits)
+		lac_put(bw,0,8 - bw->nbits);
+}
+
+/* reading past the end gives zeros: the cache may hold some, but only using them is an error */
+typedef struct lac_bitreader {
+	const unsigned char	*p,*end;
+	lac_uint64			cache;
+	int					nbits;
+	int					pad;		/* bits of the cache beyond the end */
+} LAC_BITR;
+
+static void lac_fill(LAC_BITR *br)
+{
+	int nbytes,i;
+
+	/* as many whole bytes as there is room for */
+	if(br->end - br->p >= 8){
+		nbytes = (64 - br->nbits) >> 3;
+		for(i=0;i < nbytes;i++)
+			br->cache = (br->cache << 8) | br->p[i];
+		br->p += nbytes;
+		br->nbits += nbytes << 3;
+		return;
+	}
+	while(br->nbits <= 56){
+		br->cache <<= 8;
+		if(br->p < br->end)
+			br->cache |= *br->p++;
+		else
+			br->pad += 8;
+		br->nbits += 8;
+	}
+}
+
+#define LAC_OVERRUN(br)	((br)->nbits < (br)->pad)
+
+static DWORD lac_get(LAC_BITR *br, int nbits)
+{
+	if(nbits==0)
+		return 0;
+	if(br->nbits < nbits)
+		lac_fill(br);
+	br->nbits -= nbits;
+	return (DWORD)((br->cache >> br->nbits) & (((lac_uint64) 1 << nbits) - 1));
+}
+
+static psf_int64 lac_getSigned(LAC_BITR *br, int nbits)
+{
+	lac_uint64 v;
+
+	if(nbits==0)
+		return 0;
+	if(nbits > 32)
+		v = ((lac_uint64) lac_get(br,nbits - 32) << 32) | lac_get(br,32);
+	else
+		v = lac_get(br,nbits);
+	if(nbits < 64 && ((v >> (nbits - 1)) & 1))
+		v |= ~(lac_uint64) 0 << nbits;
+	return (psf_int64) v;
+}
+
+static int lac_clz64(lac_uint64 v)
+{
+#ifdef __GNUC__
+	return __builtin_clzll(v);
+#else
+	int n = 0;
+
+	while(!(v & ((lac_uint64) 1 << 63))){
+		v <<= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+static lac_uint64 lac_getUnary(LAC_BITR *br)
+{
+	lac_uint64 q = 0,bits;
+	int z;
+
+	for(;;){
+		if(br->nbits==0)
+			lac_fill(br);
+		bits = br->cache << (64 - br->nbits);
+		if(bits){
+			z = lac_clz64(bits);
+			br->nbits -= z + 1;
+			return q + z;
+		}
+		q += br->nbits;
+		br->nbits = 0;
+		if(br->pad)
+			return q;
+	}
+}
+
+/******** samples ***********/
+
+/* data chunk bytes to channel planes (stride bf) and back */
+static void lac_unpack(int *planes, DWORD bf, const unsigned char *pcm, DWORD n, int chans, int bytes)
+{
+	const unsigned char *p;
+	int *x,ch,stride = chans * bytes;
+	DWORD i;
+
+	/* a channel at a time, so the switch is out of the loop */
+	for(ch=0;ch < chans;ch++){
+		p = pcm + ch * bytes;
+		x = planes + ch * bf;
+		switch(bytes){
+		case 2:
+			for(i=0;i < n;i++,p += stride)
+				x[i] = (short)(p[0] | (p[1] << 8));
+			break;
+		case 3:
+			for(i=0;i < n;i++,p += stride)
+				x[i] = (int)(((DWORD) p[0] << 8) | ((DWORD) p[1] << 16) | ((DWORD) p[2] << 24)) >> 8;
+			break;
+		default:
+			for(i=0;i < n;i++,p += stride)
+				x[i] = (int) lac_get32(p);
+			break;
+		}
+	}
+}
+
+static void lac_pack(unsigned char *pcm, const int *planes, DWORD bf, DWORD n, int chans, int bytes)
+{
+	unsigned char *p;
+	const int *x;
+	int ch,stride = chans * bytes;
+	DWORD i,v;
+
+	for(ch=0;ch < chans;ch++){
+		p = pcm + ch * bytes;
+		x = planes + ch * bf;
+		switch(bytes){
+		case 2:
+			for(i=0;i < n;i++,p += stride){
+				v = (DWORD) x[i];
+				p[0] = (unsigned char) v;
+				p[1] = (unsigned char)(v >> 8);
+			}
+			break;
+		case 3:
+			for(i=0;i < n;i++,p += stride){
+				v = (DWORD) x[i];
+				p[0] = (unsigned char) v;
+				p[1] = (unsigned char)(v >> 8);
+				p[2] = (unsigned char)(v >> 16);
+			}
+			break;
+		default:
+			for(i=0;i < n;i++,p += stride)
+				lac_put32(p,(DWORD) x[i]);
+			break;
+		}
+	}
+}
+
+/******** coding ***********/
+
+static lac_uint64 lac_zigzag(psf_int64 r)
+{
+	return r < 0 ? ((lac_uint64)(-(r + 1)) << 1) | 1 : (lac_uint64) r << 1;
+}
+
+static int lac_bitlength(lac_uint64 u)
+{
+	int w = 0;
+
+	while(u){
+		w++;
+		u >>= 1;
+	}
+	return w;
+}
+
+/* how the residual is coded: a Rice parameter (or PSF_LAC_ESCAPE and a width) per partition */
+typedef struct lac_rice {
+	int			porder;
+	int			k[1 << PSF_LAC_MAXPORDER];
+	int			w[1 << PSF_LAC_MAXPORDER];
+	lac_uint64	bits;
+} LAC_RICE;
+
+/* bits for cnt values summing to sum, the largest max. The estimate for Rice is never too small */
+static lac_uint64 lac_partitionBits(lac_uint64 sum, lac_uint64 umax, DWORD cnt, int *pk, int *pw)
+{
+	lac_uint64 bits,best;
+	int k = 0,w;
+
+	while(k < PSF_LAC_MAXRICE && ((lac_uint64) cnt << (k + 1)) < sum)
+		k++;
+	best = 5 + (lac_uint64) cnt * (k + 1) + (sum >> k);
+	*pk = k;
+	if(k < PSF_LAC_MAXRICE){
+		bits = 5 + (lac_uint64) cnt * (k + 2) + (sum >> (k + 1));
+		if(bits < best){
+			best = bits;
+			*pk = k + 1;
+		}
+	}
+	w = lac_bitlength(umax);
+	bits = 5 + 6 + (lac_uint64) cnt * w;
+	if(bits <= best){
+		best = bits;
+		*pk = PSF_LAC_ESCAPE;
+	}
+	*pw = w;
+	return best;
+}
+
+/* the best partition order for residuals order..n-1 */
+static void lac_chooseRice(const psf_int64 *r, DWORD n, int order, LAC_RICE *rice)
+{
+	lac_uint64 sums[1 << PSF_LAC_MAXPORDER],maxs[1 << PSF_LAC_MAXPORDER],u,bits;
+	int k[1 << PSF_LAC_MAXPORDER],w[1 << PSF_LAC_MAXPORDER];
+	int maxp = 0,p,parts,i;
+	DWORD psize,j,end;
+
+	while(maxp < PSF_LAC_MAXPORDER && (n % (2u << maxp))==0 && (n >> (maxp + 1)) > (DWORD) order)
+		maxp++;
+	parts = 1 << maxp;
+	psize = n >> maxp;
+	for(i=0,j=order;i < parts;i++){
+		sums[i] = maxs[i] = 0;
+		for(end=(DWORD)(i + 1) * psize;j < end;j++){
+			u = lac_zigzag(r[j]);
+			sums[i] += u;
+			if(u > maxs[i])
+				maxs[i] = u;
+		}
+	}
+	rice->bits = ~(lac_uint64) 0;
+	for(p=maxp;p >= 0;p--){
+		parts = 1 << p;
+		bits = 4;
+		for(i=0;i < parts;i++)
+			bits += lac_partitionBits(sums[i],maxs[i],(n >> p) - (i==0 ? order : 0),k + i,w + i);
+		if(bits < rice->bits){
+			rice->bits = bits;
+			rice->porder = p;
+			memcpy(rice->k,k,parts * sizeof(int));
+			memcpy(rice->w,w,parts * sizeof(int));
+		}
+		/* pairs of partitions make the next order down */
+		for(i=0;i < parts / 2;i++){
+			sums[i] = sums[2 * i] + sums[2 * i + 1];
+			maxs[i] = max(maxs[2 * i],maxs[2 * i + 1]);
+		}
+	}
+}
+
+static void lac_putResidual(LAC_BITW *bw, const psf_int64 *r, DWORD n, int order, const LAC_RICE *rice)
+{
+	int parts = 1 << rice->porder,i,k;
+	DWORD psize = n >> rice->porder,j = order,end;
+	lac_uint64 u;
+
+	lac_put(bw,rice->porder,4);
+	for(i=0;i < parts;i++){
+		k = rice->k[i];
+		lac_put(bw,k,5);
+		end = (DWORD)(i + 1) * psize;
+		if(k==PSF_LAC_ESCAPE){
+			lac_put(bw,rice->w[i],6);
+			for(;j < end;j++)
+				lac_putWide(bw,(lac_uint64) r[j],rice->w[i]);
+		}
+		else {
+			for(;j < end;j++){
+				u = lac_zigzag(r[j]);
+				lac_putUnary(bw,u >> k);
+				lac_put(bw,(DWORD) u,k);
+			}
+		}
+	}
+}
+
+/* sum of |residual| for each fixed order, over the same samples */
+static void lac_fixedSums(const int *x, DWORD n, lac_uint64 sums[5])
+{
+	psf_int64 e0,e1,e2,e3,e4,last0,last1,last2,last3;
+	DWORD i;
+
+	memset(sums,0,5 * sizeof(lac_uint64));
+	if(n <= 4)
+		return;
+	last0 = x[3];
+	last1 = (psf_int64) x[3] - x[2];
+	last2 = last1 - ((psf_int64) x[2] - x[1]);
+	last3 = last2 - (((psf_int64) x[2] - x[1]) - ((psf_int64) x[1] - x[0]));
+	for(i=4;i < n;i++){
+		e0 = x[i];
+		e1 = e0 - last0;
+		e2 = e1 - last1;
+		e3 = e2 - last2;
+		e4 = e3 - last3;
+		sums[0] += e0 < 0 ? -e0 : e0;
+		sums[1] += e1 < 0 ? -e1 : e1;
+		sums[2] += e2 < 0 ? -e2 : e2;
+		sums[3] += e3 < 0 ? -e3 : e3;
+		sums[4] += e4 < 0 ? -e4 : e4;
+		last0 = e0;
+		last1 = e1;
+		last2 = e2;
+		last3 = e3;
+	}
+}
+
+static int lac_bestFixed(const int *x, DWORD n, lac_uint64 *psum)
+{
+	lac_uint64 sums[5];
+	int order,best = 0;
+
+	lac_fixedSums(x,n,sums);
+	for(order=1;order < 5;order++)
+		if(sums[order] < sums[best])
+			best = order;
+	if(psum)
+		*psum = sums[best];
+	return n <= 4 ? 0 : best;
+}
+
+static void lac_fixedResidual(const int *x, DWORD n, int order, psf_int64 *r)
+{
+	DWORD i;
+
+	for(i=order;i < n;i++){
+		switch(order){
+		case 0:
+			r[i] = x[i];
+			break;
+		case 1:
+			r[i] = (psf_int64) x[i] - x[i-1];
+			break;
+		case 2:
+			r[i] = (psf_int64) x[i] - 2 * (psf_int64) x[i-1] + x[i-2];
+			break;
+		case 3:
+			r[i] = (psf_int64) x[i] - 3 * (psf_int64) x[i-1] + 3 * (psf_int64) x[i-2] - x[i-3];
+			break;
+		default:
+			r[i] = (psf_int64) x[i] - 4 * (psf_int64) x[i-1] + 6 * (psf_int64) x[i-2] - 4 * (psf_int64) x[i-3] + x[i-4];
+			break;
+		}
+	}
+}
+
+/* Tukey (0.5) window */
+static void lac_window(double *w, DWORD n)
+{
+	DWORD i,taper = n / 4;
+
+	for(i=0;i < n;i++)
+		w[i] = 1.0;
+	for(i=0;i < taper;i++){
+		w[i] = 0.5 - 0.5 * cos(3.14159265358979323846 * i / taper);
+		w[n - 1 - i] = w[i];
+	}
+}
+
+/* Levinson-Durbin: lpc[o][] predicts with order o + 1, leaving err[o]. Return the highest order found */
+static int lac_levinson(const double *autoc, int maxorder, double lpc[][PSF_LAC_MAXORDER], double *err)
+{
+	double a[PSF_LAC_MAXORDER],e = autoc[0],r,tmp;
+	int i,j;
+
+	for(i=0;i < maxorder;i++){
+		r = -autoc[i + 1];
+		for(j=0;j < i;j++)
+			r -= a[j] * autoc[i - j];
+		r /= e;
+		a[i] = r;
+		for(j=0;j < (i >> 1);j++){
+			tmp = a[j];
+			a[j] += r * a[i - 1 - j];
+			a[i - 1 - j] += r * tmp;
+		}
+		if(i & 1)
+			a[j] += a[j] * r;
+		e *= 1.0 - r * r;
+		for(j=0;j <= i;j++)
+			lpc[i][j] = -a[j];
+		err[i] = e;
+		if(e <= 0.0)
+			return i + 1;
+	}
+	return maxorder;
+}
+
+/* return 0, or -1 if the coefficients cannot be quantized */
+static int lac_quantize(const double *lpc, int order, int *qc, int *pshift)
+{
+	double cmax = 0.0,err = 0.0,q;
+	int i,shift,log2cmax,qmax = (1 << (PSF_LAC_QBITS - 1)) - 1,qmin = -(1 << (PSF_LAC_QBITS - 1));
+
+	for(i=0;i < order;i++)
+		cmax = max(cmax,fabs(lpc[i]));
+	if(cmax <= 0.0)
+		return -1;
+	frexp(cmax,&log2cmax);
+	shift = (PSF_LAC_QBITS - 1) - log2cmax;
+	if(shift < 0)
+		return -1;
+	shift = min(shift,PSF_LAC_MAXSHIFT);
+	for(i=0;i < order;i++){
+		err += lpc[i] * (double)(1 << shift);
+		q = floor(err + 0.5);
+		q = max(q,(double) qmin);
+		q = min(q,(double) qmax);
+		qc[i] = (int) q;
+		err -= q;
+	}
+	*pshift = shift;
+	return 0;
+}
+
+/* the prediction for x[0], from x[-1] back to x[-12]: all 12 taps, those beyond the order 0.
+   Written out, the oldest first, so the sum waits least on the sample just found */
+#define LAC_PREDICT(q,x) \
+	((psf_int64) q[11] * x[-12] + (psf_int64) q[10] * x[-11] + (psf_int64) q[9] * x[-10] \
+	+ (psf_int64) q[8] * x[-9] + (psf_int64) q[7] * x[-8] + (psf_int64) q[6] * x[-7] \
+	+ (psf_int64) q[5] * x[-6] + (psf_int64) q[4] * x[-5] + (psf_int64) q[3] * x[-4] \
+	+ (psf_int64) q[2] * x[-3] + (psf_int64) q[1] * x[-2] + (psf_int64) q[0] * x[-1])
+
+static void lac_lpcResidual(const int *x, DWORD n, const int *qc, int order, int shift, psf_int64 *r)
+{
+	psf_int64 sum;
+	DWORD i;
+	int j;
+
+	int q[PSF_LAC_MAXORDER];
+
+	for(j=0;j < PSF_LAC_MAXORDER;j++)
+		q[j] = j < order ? qc[j] : 0;
+	for(i=order;i < n && i < PSF_LAC_MAXORDER;i++){
+		sum = 0;
+		for(j=0;j < order;j++)
+			sum += (psf_int64) q[j] * x[i - 1 - j];
+		r[i] = x[i] - (sum >> shift);
+	}
+	for(;i < n;i++)
+		r[i] = x[i] - (LAC_PREDICT(q,(x + i)) >> shift);
+}
+
+/* code one channel of n samples, each sbits wide: the cheapest way */
+static void lac_putChannel(PSF_LACFILE *lac, LAC_BITW *bw, const int *x, DWORD n, int sbits, LAC_WORK *wk)
+{
+	LAC_RICE fixedrice,lpcrice;
+	lac_uint64 verbatimbits,fixedbits,lpcbits = ~(lac_uint64) 0;
+	double autoc[PSF_LAC_MAXORDER + 1],lpc[PSF_LAC_MAXORDER][PSF_LAC_MAXORDER],err[PSF_LAC_MAXORDER];
+	double bps,bits,bestbits,scale;
+	int qc[PSF_LAC_MAXORDER];
+	int fixedorder,lpcorder = 0,shift = 0,maxorder,order,i;
+	DWORD j;
+
+	for(j=1;j < n && x[j]==x[0];j++)
+		;
+	if(j==n){
+		lac_put(bw,LAC_CONSTANT,2);
+		lac_putWide(bw,(lac_uint64)(psf_int64) x[0],sbits);
+		return;
+	}
+	verbatimbits = (lac_uint64) n * sbits;
+	if(lac->info.isfloat)
+		goto verbatim;
+	/* the best fixed predictor, into res */
+	fixedorder = lac_bestFixed(x,n,NULL);
+	lac_fixedResidual(x,n,fixedorder,wk->res);
+	lac_chooseRice(wk->res,n,fixedorder,&fixedrice);
+	fixedbits = 3 + (lac_uint64) fixedorder * sbits + fixedrice.bits;
+	/* LPC, into res2 */
+	maxorder = (int) min((DWORD) PSF_LAC_MAXORDER,n / 4);
+	if(maxorder > 0){
+		if(wk->windowlen != n){
+			lac_window(wk->window,n);
+			wk->windowlen = n;
+		}
+		for(j=0;j < n;j++)
+			wk->wx[j] = x[j] * wk->window[j];
+		for(i=0;i <= maxorder;i++){
+			double sum = 0.0;
+			for(j=i;j < n;j++)
+				sum += wk->wx[j] * wk->wx[j - i];
+			autoc[i] = sum;
+		}
+		if(autoc[0] > 0.0){
+			maxorder = lac_levinson(autoc,maxorder,lpc,err);
+			/* the order by the expected bits for each */
+			scale = 0.5 / n;
+			bestbits = 0.0;
+			for(order=1;order <= maxorder;order++){
+				bps = err[order - 1] > 0.0 ? 0.5 * log(scale * err[order - 1]) / log(2.0) : 0.0;
+				bits = max(bps,0.0) * (n - order) + order * (PSF_LAC_QBITS + sbits);
+				if(lpcorder==0 || bits < bestbits){
+					bestbits = bits;
+					lpcorder = order;
+				}
+			}
+			if(lac_quantize(lpc[lpcorder - 1],lpcorder,qc,&shift)==0){
+				lac_lpcResidual(x,n,qc,lpcorder,shift,wk->res2);
+				lac_chooseRice(wk->res2,n,lpcorder,&lpcrice);
+				lpcbits = 4 + 4 + 5 + (lac_uint64) lpcorder * (sbits + PSF_LAC_QBITS) + lpcrice.bits;
+			}
+		}
+	}
+	if(lpcbits < fixedbits && lpcbits < verbatimbits){
+		lac_put(bw,LAC_LPC,2);
+		lac_put(bw,lpcorder - 1,4);
+		lac_put(bw,PSF_LAC_QBITS - 1,4);
+		lac_put(bw,shift,5);
+		for(i=0;i < lpcorder;i++)
+			lac_putWide(bw,(lac_uint64)(psf_int64) x[i],sbits);
+		for(i=0;i < lpcorder;i++)
+			lac_put(bw,(DWORD) qc[i],PSF_LAC_QBITS);
+		lac_putResidual(bw,wk->res2,n,lpcorder,&lpcrice);
+		return;
+	}
+	if(fixedbits < verbatimbits){
+		lac_put(bw,LAC_FIXED,2);
+		lac_put(bw,fixedorder,3);
+		for(i=0;i < fixedorder;i++)
+			lac_putWide(bw,(lac_uint64)(psf_int64) x[i],sbits);
+		lac_putResidual(bw,wk->res,n,fixedorder,&fixedrice);
+		return;
+	}
+verbatim:
+	lac_put(bw,LAC_VERBATIM,2);
+	for(j=0;j < n;j++)
+		lac_putWide(bw,(lac_uint64)(psf_int64) x[j],sbits);
+}
+
+/* a block: its header (size, frames) then the coded channels */
+static int lac_encodeBlock(PSF_LACFILE *lac, LAC_JOB *job, LAC_WORK *wk)
+{
+	int chans = lac->info.chans,bits = lac->info.bits,mode = LAC_INDEPENDENT,ch;
+	DWORD bf = lac->blockframes,n = job->nFrames,i;
+	int *planes = wk->planes,*mid = planes + chans * bf,*side = mid + bf;
+	LAC_BITW bw;
+
+	lac_unpack(planes,bf,job->pcm,n,chans,lac->align / chans);
+	if(chans==2 && !lac->info.isfloat && bits <= 24){
+		lac_uint64 left,right,msum,ssum,best;
+
+		for(i=0;i < n;i++){
+			side[i] = planes[i] - planes[bf + i];
+			mid[i] = (planes[i] + planes[bf + i]) >> 1;
+		}
+		lac_bestFixed(planes,n,&left);
+		lac_bestFixed(planes + bf,n,&right);
+		lac_bestFixed(mid,n,&msum);
+		lac_bestFixed(side,n,&ssum);
+		best = left + right;
+		if(left + ssum < best){
+			best = left + ssum;
+			mode = LAC_LEFTSIDE;
+		}
+		if(ssum + right < best){
+			best = ssum + right;
+			mode = LAC_SIDERIGHT;
+		}
+		if(msum + ssum < best)
+			mode = LAC_MIDSIDE;
+	}
+	bw.p = job->data + 8;
+	bw.acc = 0;
+	bw.nbits = 0;
+	lac_put(&bw,mode,2);
+	switch(mode){
+	case LAC_LEFTSIDE:
+		lac_putChannel(lac,&bw,planes,n,bits,wk);
+		lac_putChannel(lac,&bw,side,n,bits + 1,wk);
+		break;
+	case LAC_SIDERIGHT:
+		lac_putChannel(lac,&bw,side,n,bits + 1,wk);
+		lac_putChannel(lac,&bw,planes + bf,n,bits,wk);
+		break;
+	case LAC_MIDSIDE:
+		lac_putChannel(lac,&bw,mid,n,bits,wk);
+		lac_putChannel(lac,&bw,side,n,bits + 1,wk);
+		break;
+	default:
+		for(ch=0;ch < chans;ch++)
+			lac_putChannel(lac,&bw,planes + ch * bf,n,bits,wk);
+		break;
+	}
+	lac_flush(&bw);
+	job->size = (DWORD)(bw.p - job->data);
+	lac_put32(job->data,job->size - 8);
+	lac_put32(job->data + 4,n);
+	return PSF_E_NOERROR;
+}
+
+/******** decoding ***********/
+
+static int lac_getResidual(LAC_BITR *br, psf_int64 *r, DWORD n, int order)
+{
+	int porder = (int) lac_get(br,4),parts,i,k,w,z;
+	DWORD psize,j = order,end;
+	lac_uint64 u,bits,mask;
+
+	if(porder > PSF_LAC_MAXPORDER || ((n >> porder) << porder) != n || (n >> porder) < (DWORD) order)
+		return PSF_E_CANT_READ;
+	parts = 1 << porder;
+	psize = n >> porder;
+	for(i=0;i < parts && !LAC_OVERRUN(br);i++){
+		k = (int) lac_get(br,5);
+		end = (DWORD)(i + 1) * psize;
+		if(k==PSF_LAC_ESCAPE){
+			w = (int) lac_get(br,6);
+			if(w==0 || w > 32){
+				for(;j < end;j++)
+					r[j] = lac_getSigned(br,w);
+				continue;
+			}
+			mask = ((lac_uint64) 1 << w) - 1;
+			for(;j < end;j++){
+				if(br->nbits < w)
+					lac_fill(br);
+				br->nbits -= w;
+				u = (br->cache >> br->nbits) & mask;
+				r[j] = (psf_int64)(u ^ ((lac_uint64) 1 << (w - 1))) - ((psf_int64) 1 << (w - 1));
+			}
+		}
+		else {
+			mask = ((lac_uint64) 1 << k) - 1;
+			for(;j < end;j++){
+				/* usually the whole code is in the cache: past the end, zeros soon finish the partition */
+				if(br->nbits < 32)
+					lac_fill(br);
+				bits = br->cache << (64 - br->nbits);
+				if(bits && (z = lac_clz64(bits)) + 1 + k <= br->nbits){
+					br->nbits -= z + 1 + k;
+					u = ((lac_uint64) z << k) | ((br->cache >> br->nbits) & mask);
+				}
+				else
+					u = (lac_getUnary(br) << k) | lac_get(br,k);
+				r[j] = (psf_int64)(u >> 1) ^ -(psf_int64)(u & 1);
+			}
+		}
+	}
+	return LAC_OVERRUN(br) ? PSF_E_CANT_READ : PSF_E_NOERROR;
+}
+
+static int lac_getChannel(LAC_BITR *br, int *x, DWORD n, int sbits, LAC_WORK *wk)
+{
+	psf_int64 *r = wk->res,sum;
+	int type = (int) lac_get(br,2),order,qbits,shift,qc[PSF_LAC_MAXORDER],i,j;
+	DWORD k;
+
+	switch(type){
+	case LAC_CONSTANT:
+		x[0] = (int) lac_getSigned(br,sbits);
+		for(k=1;k < n;k++)
+			x[k] = x[0];
+		break;
+	case LAC_VERBATIM:
+		for(k=0;k < n;k++)
+			x[k] = (int) lac_getSigned(br,sbits);
+		break;
+	case LAC_FIXED:
+		order = (int) lac_get(br,3);
+		if(order > 4 || (DWORD) order > n)
+			return PSF_E_CANT_READ;
+		for(i=0;i < order;i++)
+			x[i] = (int) lac_getSigned(br,sbits);
+		if(lac_getResidual(br,r,n,order))
+			return PSF_E_CANT_READ;
+		/* (a loop for each order: this is most of the decoding) */
+		switch(order){
+		case 0:
+			for(k=0;k < n;k++)
+				x[k] = (int) r[k];
+			break;
+		case 1:
+			for(k=1;k < n;k++)
+				x[k] = (int)(r[k] + x[k-1]);
+			break;
+		case 2:
+			for(k=2;k < n;k++)
+				x[k] = (int)(r[k] + 2 * (psf_int64) x[k-1] - x[k-2]);
+			break;
+		case 3:
+			for(k=3;k < n;k++)
+				x[k] = (int)(r[k] + 3 * ((psf_int64) x[k-1] - x[k-2]) + x[k-3]);
+			break;
+		default:
+			for(k=4;k < n;k++)
+				x[k] = (int)(r[k] + 4 * ((psf_int64) x[k-1] + x[k-3]) - 6 * (psf_int64) x[k-2] - x[k-4]);
+			break;
+		}
+		break;
+	default:
+		order = (int) lac_get(br,4) + 1;
+		qbits = (int) lac_get(br,4) + 1;
+		shift = (int) lac_get(br,5);
+		if((DWORD) order > n)
+			return PSF_E_CANT_READ;
+		for(i=0;i < order;i++)
+			x[i] = (int) lac_getSigned(br,sbits);
+		for(i=0;i < PSF_LAC_MAXORDER;i++)
+			qc[i] = i < order ? (int) lac_getSigned(br,qbits) : 0;
+		if(lac_getResidual(br,r,n,order))
+			return PSF_E_CANT_READ;
+		for(k=order;k < n && k < PSF_LAC_MAXORDER;k++){
+			sum = 0;
+			for(j=0;j < order;j++)
+				sum += (psf_int64) qc[j] * x[k - 1 - j];
+			x[k] = (int)(r[k] + (sum >> shift));
+		}
+		for(;k < n;k++)
+			x[k] = (int)(r[k] + (LAC_PREDICT(qc,(x + k)) >> shift));
+		break;
+	}
+	return LAC_OVERRUN(br) ? PSF_E_CANT_READ : PSF_E_NOERROR;
+}
+
+static int lac_decodeBlock(const PSF_LACFILE *lac, const unsigned char *data, DWORD size, DWORD n,
+						   unsigned char *pcm, LAC_WORK *wk)
+{
+	int chans = lac->info.chans,bits = lac->info.bits,mode,ch,rc = PSF_E_NOERROR;
+	DWORD bf = lac->blockframes,i;
+	int *planes = wk->planes,mid,side;
+	LAC_BITR br;
+
+	br.p = data;
+	br.end = data + size;
+	br.cache = 0;
+	br.nbits = 0;
+	br.pad = 0;
+	mode = (int) lac_get(&br,2);
+	if(mode != LAC_INDEPENDENT && (chans != 2 || lac->info.isfloat || bits > 24))
+		return PSF_E_CANT_READ;
+	for(ch=0;ch < chans && rc==PSF_E_NOERROR;ch++){
+		int side_ch = (mode==LAC_SIDERIGHT && ch==0) || ((mode==LAC_LEFTSIDE || mode==LAC_MIDSIDE) && ch==1);
+		rc = lac_getChannel(&br,planes + ch * bf,n,bits + side_ch,wk);
+	}
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	for(i=0;i < n;i++){
+		switch(mode){
+		case LAC_LEFTSIDE:
+			planes[bf + i] = planes[i] - planes[bf + i];
+			break;
+		case LAC_SIDERIGHT:
+			planes[i] += planes[bf + i];
+			break;
+		case LAC_MIDSIDE:
+			side = planes[bf + i];
+			mid = (int)(((DWORD) planes[i] << 1) | (side & 1));
+			planes[i] = (mid + side) >> 1;
+			planes[bf + i] = (mid - side) >> 1;
+			break;
+		default:
+			break;
+		}
+	}
+	lac_pack(pcm,planes,bf,n,chans,lac->align / chans);
+	return PSF_E_NOERROR;
+}
+
+/******** threads ***********/
+
+static int lac_workInit(LAC_WORK *wk, DWORD bf, int chans)
+{
+	wk->planes = (int *) malloc((size_t)(chans + 2) * bf * sizeof(int));
+	wk->res = (psf_int64 *) malloc(2 * (size_t) bf * sizeof(psf_int64));
+	wk->res2 = wk->res ? wk->res + bf : NULL;
+	wk->wx = (double *) malloc(2 * (size_t) bf * sizeof(double));
+	wk->window = wk->wx ? wk->wx + bf : NULL;
+	wk->windowlen = 0;
+	if(wk->planes==NULL || wk->res==NULL || wk->wx==NULL)
+		return PSF_E_NOMEM;
+	return PSF_E_NOERROR;
+}
+
+static void lac_workFree(LAC_WORK *wk)
+{
+	free(wk->planes);
+	free(wk->res);
+	free(wk->wx);
+	memset(wk,0,sizeof(LAC_WORK));
+}
+
+static void lac_doJob(PSF_LACFILE *lac, int j, LAC_WORK *wk)
+{
+	LAC_JOB *job = lac->jobs + j;
+
+	if(lac->iswrite)
+		job->rc = lac_encodeBlock(lac,job,wk);
+	else
+		job->rc = lac_decodeBlock(lac,job->data,job->size,job->nFrames,job->pcm,wk);
+}
+
+#ifdef unix
+typedef struct lac_thread {
+	PSF_LACFILE	*lac;
+	int		id;
+} LAC_THREAD;
+
+static void *lac_worker(void *arg)
+{
+	PSF_LACFILE *lac = ((LAC_THREAD *) arg)->lac;
+	LAC_WORK *wk = lac->work + ((LAC_THREAD *) arg)->id;
+	int j;
+
+	free(arg);
+	pthread_mutex_lock(&lac->lock);
+	for(;;){
+		while(!lac->quit && lac->nextjob >= lac->njobs)
+			pthread_cond_wait(&lac->go,&lac->lock);
+		if(lac->quit)
+			break;
+		j = lac->nextjob++;
+		pthread_mutex_unlock(&lac->lock);
+		lac_doJob(lac,j,wk);
+		pthread_mutex_lock(&lac->lock);
+		if(++lac->nfinished==lac->njobs)
+			pthread_cond_signal(&lac->done);
+	}
+	pthread_mutex_unlock(&lac->lock);
+	return NULL;
+}
+
+/* with the first batch: as many threads as we can get, up to nwork - 1 */
+static void lac_startThreads(PSF_LACFILE *lac)
+{
+	LAC_THREAD *t;
+	int i;
+
+	for(i=1;i < lac->nwork;i++){
+		if(lac->work[i].planes==NULL && lac_workInit(lac->work + i,lac->blockframes,lac->info.chans)){
+			lac_workFree(lac->work + i);
+			break;
+		}
+		t = (LAC_THREAD *) malloc(sizeof(LAC_THREAD));
+		if(t==NULL)
+			break;
+		t->lac = lac;
+		t->id = i;
+		if(pthread_create(&lac->threads[i],NULL,lac_worker,t)){
+			free(t);
+			break;
+		}
+		lac->nthreads++;
+	}
+	/* no more tries */
+	lac->nwork = lac->nthreads + 1;
+}
+#endif
+
+/* code or decode jobs 0..njobs-1: the caller takes jobs too */
+static void lac_run(PSF_LACFILE *lac, int njobs)
+{
+	int j;
+
+#ifdef unix
+	if(njobs > 1 && lac->nwork > 1 && lac->nthreads==0)
+		lac_startThreads(lac);
+	if(njobs > 1 && lac->nthreads > 0){
+		pthread_mutex_lock(&lac->lock);
+		lac->njobs = njobs;
+		lac->nextjob = 0;
+		lac->nfinished = 0;
+		pthread_cond_broadcast(&lac->go);
+		while(lac->nextjob < lac->njobs){
+			j = lac->nextjob++;
+			pthread_mutex_unlock(&lac->lock);
+			lac_doJob(lac,j,lac->work);
+			pthread_mutex_lock(&lac->lock);
+			lac->nfinished++;
+		}
+		while(lac->nfinished < lac->njobs)
+			pthread_cond_wait(&lac->done,&lac->lock);
+		pthread_mutex_unlock(&lac->lock);
+		return;
+	}
+#endif
+	for(j=0;j < njobs;j++)
+		lac_doJob(lac,j,lac->work);
+}
+
+/******** the coder ***********/
+
+static PSF_LACFILE *lac_new(FILE *fp, const PSF_LACINFO *info, int iswrite, int *rc)
+{
+	PSF_LACFILE *lac;
+	int bytes,ncpu = 1;
+
+	*rc = PSF_E_BADARG;
+	if(info->chans <= 0 || info->chans > 0xffff || info->srate <= 0)
+		return NULL;
+	if(info->isfloat ? info->bits != 32 : !(info->bits==16 || info->bits==24 || info->bits==32))
+		return NULL;
+	*rc = PSF_E_NOMEM;
+	lac = (PSF_LACFILE *) calloc(1,sizeof(PSF_LACFILE));
+	if(lac==NULL)
+		return NULL;
+	lac->fp = fp;
+	lac->info = *info;
+	lac->iswrite = iswrite;
+	lac->blockframes = PSF_LAC_BLOCKFRAMES;
+	bytes = info->bits / 8;
+	lac->align = (DWORD)(bytes * info->chans);
+	lac->maxblockbytes = 8 + 1 + (DWORD) info->chans * ((lac->blockframes * 33 + 2) / 8 + 2);
+	lac->dataoffset = PSF_LAC_DATAOFFSET((psf_int64) info->chans);
+	lac->filepos = -1;
+#ifdef unix
+	ncpu = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_mutex_init(&lac->lock,NULL);
+	pthread_cond_init(&lac->go,NULL);
+	pthread_cond_init(&lac->done,NULL);
+#endif
+	lac->nwork = max(1,min(ncpu,PSF_LAC_MAXTHREADS));
+	lac->maxbatch = min(2 * lac->nwork,PSF_LAC_MAXBATCH);
+	lac->maxbatch = max(1,min(lac->maxbatch,(int)(PSF_LAC_BATCHBYTES / ((size_t) lac->blockframes * lac->align))));
+	lac->pcm = (unsigned char *) malloc((size_t) lac->maxbatch * lac->blockframes * lac->align);
+	lac->jobs = (LAC_JOB *) calloc(lac->maxbatch,sizeof(LAC_JOB));
+	lac->peaks = (PSF_CHPEAK *) calloc(info->chans,sizeof(PSF_CHPEAK));
+	if(lac->pcm==NULL || lac->jobs==NULL || lac->peaks==NULL
+	   || lac_workInit(lac->work,lac->blockframes,info->chans)){
+		psf_lacFree(lac);
+		return NULL;
+	}
+	if(iswrite){
+		int j;
+
+		lac->codedsize = (size_t) lac->maxbatch * lac->maxblockbytes;
+		lac->coded = (unsigned char *) malloc(lac->codedsize);
+		if(lac->coded==NULL){
+			psf_lacFree(lac);
+			return NULL;
+		}
+		for(j=0;j < lac->maxbatch;j++){
+			lac->jobs[j].data = lac->coded + (size_t) j * lac->maxblockbytes;
+			lac->jobs[j].pcm = lac->pcm + (size_t) j * lac->blockframes * lac->align;
+		}
+	}
+	*rc = PSF_E_NOERROR;
+	return lac;
+}
+
+void psf_lacFree(PSF_LACFILE *lac)
+{
+	int i;
+
+	if(lac==NULL)
+		return;
+#ifdef unix
+	pthread_mutex_lock(&lac->lock);
+	lac->quit = 1;
+	pthread_cond_broadcast(&lac->go);
+	pthread_mutex_unlock(&lac->lock);
+	for(i=1;i <= lac->nthreads;i++)
+		pthread_join(lac->threads[i],NULL);
+	pthread_mutex_destroy(&lac->lock);
+	pthread_cond_destroy(&lac->go);
+	pthread_cond_destroy(&lac->done);
+#endif
+	for(i=0;i < PSF_LAC_MAXTHREADS;i++)
+		lac_workFree(lac->work + i);
+	free(lac->index);
+	free(lac->peaks);
+	free(lac->pcm);
+	free(lac->jobs);
+	free(lac->coded);
+	free(lac);
+}
+
+static void lac_header(const PSF_LACFILE *lac, unsigned char *hdr, const PSF_CHPEAK *peaks, DWORD peaktime, psf_int64 indexoffset)
+{
+	DWORD v;
+	int ch;
+
+	memset(hdr,0,(size_t) lac->dataoffset);
+	memcpy(hdr,"PLAC",4);
+	lac_put32(hdr + 4,PSF_LAC_VERSION);
+	lac_put32(hdr + 8,(DWORD) lac->info.srate);
+	lac_put32(hdr + 12,(DWORD) lac->info.chans | ((DWORD) lac->info.bits << 16));
+	lac_put32(hdr + 16,(DWORD) lac->info.isfloat | ((DWORD) lac->info.chformat << 16));
+	lac_put32(hdr + 20,lac->info.chmask);
+	lac_put32(hdr + 24,lac->blockframes);
+	lac_put32(hdr + 28,peaks ? peaktime : 0);
+	lac_put64(hdr + 32,lac->written);
+	lac_put64(hdr + 40,indexoffset);
+	if(peaks){
+		for(ch=0;ch < lac->info.chans;ch++){
+			memcpy(&v,&peaks[ch].val,sizeof(DWORD));
+			lac_put32(hdr + PSF_LAC_HDRSIZE + 8 * ch,v);
+			lac_put32(hdr + PSF_LAC_HDRSIZE + 8 * ch + 4,peaks[ch].pos);
+		}
+	}
+}
+
+PSF_LACFILE *psf_lacCreate(FILE *fp, const PSF_LACINFO *info, int *rc)
+{
+	PSF_LACFILE *lac;
+	unsigned char *hdr;
+
+	lac = lac_new(fp,info,1,rc);
+	if(lac==NULL)
+		return NULL;
+	hdr = (unsigned char *) malloc((size_t) lac->dataoffset);
+	if(hdr==NULL){
+		psf_lacFree(lac);
+		*rc = PSF_E_NOMEM;
+		return NULL;
+	}
+	lac_header(lac,hdr,NULL,0,0);
+	if(fwrite(hdr,1,(size_t) lac->dataoffset,fp) != (size_t) lac->dataoffset){
+		free(hdr);
+		psf_lacFree(lac);
+		*rc = PSF_E_CANT_WRITE;
+		return NULL;
+	}
+	free(hdr);
+	lac->filepos = lac->dataoffset;
+	return lac;
+}
+
+static int lac_addBlock(PSF_LACFILE *lac, psf_int64 offset)
+{
+	psf_int64 *index;
+
+	/* one spare, for the end of the data */
+	if(lac->nblocks + 1 >= lac->maxblocks){
+		psf_int64 newmax = lac->maxblocks ? lac->maxblocks * 2 : 1024;
+		index = (psf_int64 *) realloc(lac->index,(size_t) newmax * sizeof(psf_int64));
+		if(index==NULL)
+			return PSF_E_NOMEM;
+		lac->index = index;
+		lac->maxblocks = newmax;
+	}
+	lac->index[lac->nblocks++] = offset;
+	return PSF_E_NOERROR;
+}
+
+/* code the batch, and write its blocks in order */
+static int lac_writeBatch(PSF_LACFILE *lac)
+{
+	DWORD frames = lac->pcmfill / lac->align;
+	int nb = (int)((frames + lac->blockframes - 1) / lac->blockframes),j;
+
+	for(j=0;j < nb;j++)
+		lac->jobs[j].nFrames = min(lac->blockframes,frames - (DWORD) j * lac->blockframes);
+	lac_run(lac,nb);
+	for(j=0;j < nb;j++){
+		if(lac->jobs[j].rc < PSF_E_NOERROR)
+			return lac->jobs[j].rc;
+		if(lac_addBlock(lac,lac->filepos))
+			return PSF_E_NOMEM;
+		if(fwrite(lac->jobs[j].data,1,lac->jobs[j].size,lac->fp) != lac->jobs[j].size)
+			return PSF_E_CANT_WRITE;
+		lac->filepos += lac->jobs[j].size;
+	}
+	lac->written += frames;
+	lac->pcmfill = 0;
+	return PSF_E_NOERROR;
+}
+
+int psf_lacWrite(PSF_LACFILE *lac, const void *buf, DWORD nBytes)
+{
+	const unsigned char *src = (const unsigned char *) buf;
+	DWORD batchbytes = (DWORD) lac->maxbatch * lac->blockframes * lac->align,n;
+	int rc;
+
+	if(!lac->iswrite)
+		return PSF_E_FILE_READONLY;
+	if(nBytes % lac->align)
+		return PSF_E_BADARG;
+	while(nBytes > 0){
+		n = min(nBytes,batchbytes - lac->pcmfill);
+		memcpy(lac->pcm + lac->pcmfill,src,n);
+		lac->pcmfill += n;
+		src += n;
+		nBytes -= n;
+		if(lac->pcmfill==batchbytes && (rc = lac_writeBatch(lac)) < PSF_E_NOERROR)
+			return rc;
+	}
+	return PSF_E_NOERROR;
+}
+
+int psf_lacFinish(PSF_LACFILE *lac, const PSF_CHPEAK *peaks, DWORD peaktime)
+{
+	unsigned char *hdr,entry[8];
+	psf_int64 indexoffset,i;
+	int rc = PSF_E_NOERROR;
+
+	if(!lac->iswrite)
+		return PSF_E_NOERROR;
+	if(lac->pcmfill && (rc = lac_writeBatch(lac)) < PSF_E_NOERROR)
+		return rc;
+	indexoffset = lac->filepos;
+	for(i=0;i < lac->nblocks;i++){
+		lac_put64(entry,lac->index[i]);
+		if(fwrite(entry,1,8,lac->fp) != 8)
+			return PSF_E_CANT_WRITE;
+	}
+	hdr = (unsigned char *) malloc((size_t) lac->dataoffset);
+	if(hdr==NULL)
+		return PSF_E_NOMEM;
+	lac_header(lac,hdr,peaks,peaktime,indexoffset);
+	if(lac_seek(lac->fp,0) || fwrite(hdr,1,(size_t) lac->dataoffset,lac->fp) != (size_t) lac->dataoffset)
+		rc = PSF_E_CANT_WRITE;
+	free(hdr);
+	lac->filepos = -1;
+	return rc;
+}
+
+/* a file never finished: find the blocks one by one, as far as they are whole */
+static int lac_walk(PSF_LACFILE *lac)
+{
+	unsigned char bhdr[8];
+	psf_int64 pos = lac->dataoffset,end;
+	fpos_t fend;
+	DWORD size,frames;
+
+	if(fseek(lac->fp,0,SEEK_END) || fgetpos(lac->fp,&fend))
+		return PSF_E_CANT_SEEK;
+	end = (psf_int64) POS64(fend);
+	lac->info.nFrames = 0;
+	for(;;){
+		if(pos + 8 > end || lac_seek(lac->fp,pos) || fread(bhdr,1,8,lac->fp) != 8)
+			break;
+		size = lac_get32(bhdr);
+		frames = lac_get32(bhdr + 4);
+		if(frames==0 || frames > lac->blockframes || pos + 8 + size > end)
+			break;
+		if(lac_addBlock(lac,pos))
+			return PSF_E_NOMEM;
+		lac->info.nFrames += frames;
+		pos += 8 + size;
+		if(frames < lac->blockframes)
+			break;
+	}
+	if(lac_addBlock(lac,pos))
+		return PSF_E_NOMEM;
+	lac->nblocks--;
+	return PSF_E_NOERROR;
+}
+
+PSF_LACFILE *psf_lacOpen(FILE *fp, PSF_LACINFO *info, int *rc)
+{
+	unsigned char hdr[PSF_LAC_HDRSIZE],*bytes;
+	PSF_LACINFO hinfo;
+	PSF_LACFILE *lac;
+	psf_int64 indexoffset,i;
+	DWORD blockframes,v;
+	int ch;
+
+	*rc = PSF_E_CANT_READ;
+	if(fread(hdr,1,PSF_LAC_HDRSIZE,fp) != PSF_LAC_HDRSIZE)
+		return NULL;
+	*rc = PSF_E_BAD_FORMAT;
+	if(memcmp(hdr,"PLAC",4))
+		return NULL;
+	*rc = PSF_E_UNSUPPORTED;
+	if(lac_get32(hdr + 4) != PSF_LAC_VERSION)
+		return NULL;
+	memset(&hinfo,0,sizeof(hinfo));
+	hinfo.srate = (long) lac_get32(hdr + 8);
+	hinfo.chans = (int)(lac_get32(hdr + 12) & 0xffff);
+	hinfo.bits = (int)(lac_get32(hdr + 12) >> 16);
+	hinfo.isfloat = (int)(lac_get32(hdr + 16) & 0xffff);
+	hinfo.chformat = (int)(lac_get32(hdr + 16) >> 16);
+	hinfo.chmask = lac_get32(hdr + 20);
+	blockframes = lac_get32(hdr + 24);
+	hinfo.peaktime = lac_get32(hdr + 28);
+	hinfo.nFrames = lac_get64(hdr + 32);
+	indexoffset = lac_get64(hdr + 40);
+	if(blockframes==0 || blockframes > PSF_LAC_MAXBLOCK || hinfo.nFrames < 0)
+		return NULL;
+	lac = lac_new(fp,&hinfo,0,rc);
+	if(lac==NULL)
+		return NULL;
+	/* (lac_new sized things for the usual block) */
+	if(blockframes != lac->blockframes){
+		psf_lacFree(lac);
+		*rc = PSF_E_UNSUPPORTED;
+		return NULL;
+	}
+	*rc = PSF_E_CANT_READ;
+	bytes = (unsigned char *) malloc(8 * (size_t) hinfo.chans);
+	if(bytes==NULL || fread(bytes,1,8 * (size_t) hinfo.chans,fp) != 8 * (size_t) hinfo.chans){
+		free(bytes);
+		psf_lacFree(lac);
+		return NULL;
+	}
+	for(ch=0;ch < hinfo.chans;ch++){
+		v = lac_get32(bytes + 8 * ch);
+		memcpy(&lac->peaks[ch].val,&v,sizeof(float));
+		lac->peaks[ch].pos = lac_get32(bytes + 8 * ch + 4);
+	}
+	free(bytes);
+	if(indexoffset==0){
+		/* (no PEAK data either) */
+		lac->info.peaktime = 0;
+		*rc = lac_walk(lac);
+	}
+	else {
+		lac->nblocks = (hinfo.nFrames + blockframes - 1) / blockframes;
+		lac->maxblocks = lac->nblocks + 1;
+		lac->index = (psf_int64 *) malloc((size_t) lac->maxblocks * sizeof(psf_int64));
+		bytes = (unsigned char *) malloc((size_t) lac->nblocks * 8 + 1);
+		if(lac->index==NULL || bytes==NULL)
+			*rc = PSF_E_NOMEM;
+		else if(lac_seek(fp,indexoffset) || fread(bytes,1,(size_t) lac->nblocks * 8,fp) != (size_t) lac->nblocks * 8)
+			*rc = PSF_E_CANT_READ;
+		else {
+			*rc = PSF_E_NOERROR;
+			for(i=0;i < lac->nblocks;i++)
+				lac->index[i] = lac_get64(bytes + 8 * i);
+			lac->index[lac->nblocks] = indexoffset;
+			for(i=0;i < lac->nblocks;i++){
+				if(lac->index[i] < (i ? lac->index[i-1] + 8 : lac->dataoffset) || lac->index[i] + 8 > lac->index[i+1])
+					*rc = PSF_E_BAD_FORMAT;
+			}
+		}
+		free(bytes);
+	}
+	if(*rc < PSF_E_NOERROR){
+		psf_lacFree(lac);
+		return NULL;
+	}
+	lac->filepos = -1;
+	*info = lac->info;
+	return lac;
+}
+
+int psf_lacPeaks(const PSF_LACFILE *lac, PSF_CHPEAK *peaks)
+{
+	if(lac->info.peaktime==0)
+		return 0;
+	memcpy(peaks,lac->peaks,lac->info.chans * sizeof(PSF_CHPEAK));
+	return 1;
+}
+
+/* check a block's header against the index */
+static int lac_blockHeader(const PSF_LACFILE *lac, const unsigned char *p, psf_int64 block, LAC_JOB *job)
+{
+	job->size = lac_get32(p);
+	job->nFrames = lac_get32(p + 4);
+	job->data = (unsigned char *) p + 8;
+	if((psf_int64) job->size + 8 != lac->index[block + 1] - lac->index[block]
+	   || job->nFrames != (DWORD) min((psf_int64) lac->blockframes,lac->info.nFrames - block * lac->blockframes))
+		return PSF_E_CANT_READ;
+	return PSF_E_NOERROR;
+}
+
+/* decode a batch of blocks from block on */
+static int lac_readBatch(PSF_LACFILE *lac, psf_int64 block)
+{
+	int nb = (int) min((psf_int64) lac->maxbatch,lac->nblocks - block),j;
+	size_t nbytes = (size_t)(lac->index[block + nb] - lac->index[block]);
+	unsigned char *p;
+
+	lac->batchframes = 0;
+	if(nbytes > lac->codedsize){
+		p = (unsigned char *) realloc(lac->coded,nbytes);
+		if(p==NULL)
+			return PSF_E_NOMEM;
+		lac->coded = p;
+		lac->codedsize = nbytes;
+	}
+	if(lac->filepos != lac->index[block] && lac_seek(lac->fp,lac->index[block]))
+		return PSF_E_CANT_SEEK;
+	lac->filepos = -1;
+	if(fread(lac->coded,1,nbytes,lac->fp) != nbytes)
+		return PSF_E_CANT_READ;
+	lac->filepos = lac->index[block + nb];
+	for(j=0,p=lac->coded;j < nb;j++){
+		if(lac_blockHeader(lac,p,block + j,lac->jobs + j))
+			return PSF_E_CANT_READ;
+		lac->jobs[j].pcm = lac->pcm + (size_t) j * lac->blockframes * lac->align;
+		p += lac->jobs[j].size + 8;
+	}
+	lac_run(lac,nb);
+	for(j=0;j < nb;j++){
+		if(lac->jobs[j].rc < PSF_E_NOERROR)
+			return lac->jobs[j].rc;
+		lac->batchframes += lac->jobs[j].nFrames;
+	}
+	lac->batchstart = block * lac->blockframes;
+	return PSF_E_NOERROR;
+}
+
+int psf_lacRead(PSF_LACFILE *lac, void *buf, DWORD nBytes)
+{
+	unsigned char *dst = (unsigned char *) buf;
+	DWORD nFrames = nBytes / lac->align,n;
+	int rc;
+
+	if(lac->iswrite)
+		return PSF_E_UNSUPPORTED;
+	if(nBytes % lac->align || lac->pos + nFrames > lac->info.nFrames)
+		return PSF_E_CANT_READ;
+	while(nFrames > 0){
+		if(lac->pos < lac->batchstart || lac->pos >= lac->batchstart + lac->batchframes){
+			rc = lac_readBatch(lac,lac->pos / lac->blockframes);
+			if(rc < PSF_E_NOERROR)
+				return rc;
+		}
+		n = (DWORD) min((psf_int64) nFrames,lac->batchstart + lac->batchframes - lac->pos);
+		memcpy(dst,lac->pcm + (size_t)(lac->pos - lac->batchstart) * lac->align,(size_t) n * lac->align);
+		dst += (size_t) n * lac->align;
+		lac->pos += n;
+		nFrames -= n;
+	}
+	return PSF_E_NOERROR;
+}
+
+int psf_lacSeek(PSF_LACFILE *lac, psf_int64 frame)
+{
+	if(lac->iswrite)
+		return frame==lac->written + lac->pcmfill / lac->align ? PSF_E_NOERROR : PSF_E_CANT_SEEK;
+	if(frame < 0 || frame > lac->info.nFrames)
+		return PSF_E_CANT_SEEK;
+	lac->pos = frame;
+	return PSF_E_NOERROR;
+}
+
+#ifdef unix
+static int lac_pread(int fd, unsigned char *p, size_t nbytes, psf_int64 pos)
+{
+	ssize_t got;
+
+	while(nbytes > 0){
+		got = pread(fd,p,nbytes,(off_t) pos);
+		if(got < 0 && errno==EINTR)
+			continue;
+		if(got <= 0)
+			return PSF_E_CANT_READ;
+		p += got;
+		pos += got;
+		nbytes -= (size_t) got;
+	}
+	return PSF_E_NOERROR;
+}
+
+int psf_lacReadAt(const PSF_LACFILE *lac, int fd, psf_int64 frame, void *buf, DWORD nFrames)
+{
+	unsigned char *dst = (unsigned char *) buf,*coded,*pcm;
+	psf_int64 block = frame / lac->blockframes;
+	DWORD skip = (DWORD)(frame - block * lac->blockframes),n;
+	LAC_WORK wk;
+	LAC_JOB job;
+	int rc;
+
+	if(lac->iswrite)
+		return PSF_E_UNSUPPORTED;
+	if(frame < 0 || frame + nFrames > lac->info.nFrames)
+		return PSF_E_CANT_READ;
+	coded = (unsigned char *) malloc(lac->maxblockbytes);
+	pcm = (unsigned char *) malloc((size_t) lac->blockframes * lac->align);
+	rc = lac_workInit(&wk,lac->blockframes,lac->info.chans);
+	if(coded==NULL || pcm==NULL)
+		rc = PSF_E_NOMEM;
+	for(;nFrames > 0 && rc==PSF_E_NOERROR;block++,skip=0){
+		size_t nbytes = (size_t)(lac->index[block + 1] - lac->index[block]);
+
+		if(nbytes > lac->maxblockbytes)
+			rc = PSF_E_CANT_READ;
+		else if((rc = lac_pread(fd,coded,nbytes,lac->index[block]))==PSF_E_NOERROR
+				&& (rc = lac_blockHeader(lac,coded,block,&job))==PSF_E_NOERROR
+				&& (rc = lac_decodeBlock(lac,job.data,job.size,job.nFrames,pcm,&wk))==PSF_E_NOERROR){
+			n = min(nFrames,job.nFrames - skip);
+			memcpy(dst,pcm + (size_t) skip * lac->align,(size_t) n * lac->align);
+			dst += (size_t) n * lac->align;
+			nFrames -= n;
+		}
+	}
+	lac_workFree(&wk);
+	free(coded);
+	free(pcm);
+	return rc;
+}
+#endif
@@ -0,0 +1,81 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psflac.h: lossless compressed sample data, for PSF_LAC (.lac) files.
+   Used by portsf: the samples go in and out as the bytes of a WAVE data chunk
+   (little-endian, 24bit packed), so all of portsf's sample conversions work as for WAVE. */
+
+#ifndef __PSFLAC_H_INCLUDED
+#define __PSFLAC_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* frames per block: each block can be decoded on its own */
+#define PSF_LAC_BLOCKFRAMES	(4096)
+/* where the blocks start: a 48 byte header, then PEAK data for each channel */
+#define PSF_LAC_DATAOFFSET(chans)	(48 + 8 * (chans))
+
+typedef struct psf_lac PSF_LACFILE;
+
+/* what the header holds */
+typedef struct psf_lacinfo {
+	long		srate;
+	int			chans;
+	int			bits;			/* 16, 24 or 32 */
+	int			isfloat;		/* 32bit floats: stored as they are, uncompressed */
+	int			chformat;		/* psf_channelformat */
+	DWORD		chmask;			/* WAVE-EX speaker mask */
+	psf_int64	nFrames;
+	DWORD		peaktime;		/* 0: no PEAK data */
+} PSF_LACINFO;
+
+/* write the header of a new file at the start of fp, and return a coder for it; or NULL, with *rc set */
+PSF_LACFILE *psf_lacCreate(FILE *fp, const PSF_LACINFO *info, int *rc);
+/* read the header and block index of the file in fp; or NULL, with *rc set.
+   A file that was never closed has no index: it is rebuilt from the blocks themselves. */
+PSF_LACFILE *psf_lacOpen(FILE *fp, PSF_LACINFO *info, int *rc);
+/* copy the PEAK data (info->chans of it) found by psf_lacOpen. Return 0 if there is none */
+int psf_lacPeaks(const PSF_LACFILE *lac, PSF_CHPEAK *peaks);
+/* samples in whole frames: nBytes as in the data chunk. Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_lacWrite(PSF_LACFILE *lac, const void *buf, DWORD nBytes);
+int psf_lacRead(PSF_LACFILE *lac, void *buf, DWORD nBytes);
+/* the next read starts at frame */
+int psf_lacSeek(PSF_LACFILE *lac, psf_int64 frame);
+#ifdef unix
+/* read nFrames from frame on, with pread on fd, without moving the position or using the coder's
+   buffers: any number of threads may do this at once. */
+int psf_lacReadAt(const PSF_LACFILE *lac, int fd, psf_int64 frame, void *buf, DWORD nFrames);
+#endif
+/* writing: code the last frames, write the block index, and complete the header */
+int psf_lacFinish(PSF_LACFILE *lac, const PSF_CHPEAK *peaks, DWORD peaktime);
+/* stop any threads and free the coder: the file is not closed */
+void psf_lacFree(PSF_LACFILE *lac);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
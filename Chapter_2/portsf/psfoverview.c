@@ -0,0 +1,526 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+/* psfoverview.c: min/max/RMS overviews of soundfiles, and their sidecar files.
+   Sidecar layout, all little-endian:
+		"PSFO", version (4 bytes), chans, srate, blockframes (4 each), nFrames (8), mtime (8), size (8),
+		then level 0: for each block, chans * { min, max (4 each, IEEE float), sumsq (8, IEEE double) }
+   The coarser levels are made again from level 0 as it is loaded: that takes a fraction of the
+   time reading them would, and keeps the sidecar small. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "portsf.h"
+#include "psfext.h"
+#include "psfindex.h"
+#include "psfoverview.h"
+
+#ifndef max
+#define max(x,y) ((x) > (y) ? (x) : (y))
+#endif
+#ifndef min
+#define min(x,y) ((x) < (y) ? (x) : (y))
+#endif
+
+#define PSF_OVW_VERSION		(2)		/* 1 had sumsq as a float */
+#define PSF_OVW_HEADSIZE	(4 + 4 + 3 * 4 + 3 * 8)
+#define PSF_OVW_BLKSIZE		(4 + 4 + 8)	/* per channel per block */
+/* level 0 starts with room for this many blocks, and doubles */
+#define PSF_OVW_MINBLOCKS	(1024)
+/* psf_overviewBuild reads this many frames at a time */
+#define PSF_OVW_BUILDFRAMES	(16384)
+
+PSF_OVERVIEW *psf_overviewNew(int chans, int srate, DWORD blockframes)
+{
+	PSF_OVERVIEW *ov;
+
+	if(blockframes==0)
+		blockframes = PSF_OVW_DEFBLOCK;
+	if(chans <= 0 || (blockframes & (blockframes - 1)))
+		return NULL;
+	ov = (PSF_OVERVIEW *) malloc(sizeof(PSF_OVERVIEW));
+	if(ov==NULL)
+		return NULL;
+	ov->chans = chans;
+	ov->srate = srate;
+	ov->blockframes = blockframes;
+	ov->nFrames = 0;
+	ov->mtime = ov->size = 0;
+	ov->nlevels = 0;
+	ov->maxblocks = 0;
+	ov->curframes = 0;
+	ov->nblocks = (psf_int64 *) malloc(sizeof(psf_int64));
+	ov->levels = (PSF_OVWBLOCK **) malloc(sizeof(PSF_OVWBLOCK *));
+	ov->cursumsq = (double *) calloc(chans,sizeof(double));
+	if(ov->nblocks==NULL || ov->levels==NULL || ov->cursumsq==NULL){
+		free(ov->nblocks);
+		free(ov->levels);
+		free(ov->cursumsq);
+		free(ov);
+		return NULL;
+	}
+	ov->nblocks[0] = 0;
+	ov->levels[0] = NULL;
+	return ov;
+}
+
+void psf_overviewFree(PSF_OVERVIEW *ov)
+{
+	int l;
+
+	if(ov==NULL)
+		return;
+	for(l=0;l < (ov->nlevels ? ov->nlevels : 1);l++)
+		free(ov->levels[l]);
+	free(ov->levels);
+	free(ov->nblocks);
+	free(ov->cursumsq);
+	free(ov);
+}
+
+/* the last level 0 block is complete */
+static void psf_overviewEndBlock(PSF_OVERVIEW *ov)
+{
+	PSF_OVWBLOCK *blk = ov->levels[0] + (ov->nblocks[0] - 1) * ov->chans;
+	int ch;
+
+	for(ch=0;ch < ov->chans;ch++){
+		/* nothing but NaNs */
+		if(blk[ch].min > blk[ch].max)
+			blk[ch].min = blk[ch].max = 0.0f;
+		blk[ch].sumsq = ov->cursumsq[ch];
+		ov->cursumsq[ch] = 0.0;
+	}
+	ov->curframes = 0;
+}
+
+int psf_overviewAdd(PSF_OVERVIEW *ov, const float *buf, DWORD nFrames, int clip)
+{
+	DWORD i,n;
+	int ch,chans = ov->chans;
+
+	if(ov->nlevels)
+		return PSF_E_BADARG;
+	while(nFrames > 0){
+		PSF_OVWBLOCK *blk;
+
+		if(ov->curframes==0){
+			if(ov->nblocks[0]==ov->maxblocks){
+				psf_int64 newmax = ov->maxblocks ? ov->maxblocks * 2 : PSF_OVW_MINBLOCKS;
+				blk = (PSF_OVWBLOCK *) realloc(ov->levels[0],(size_t) newmax * chans * sizeof(PSF_OVWBLOCK));
+				if(blk==NULL)
+					return PSF_E_NOMEM;
+				ov->levels[0] = blk;
+				ov->maxblocks = newmax;
+			}
+			blk = ov->levels[0] + ov->nblocks[0] * chans;
+			for(ch=0;ch < chans;ch++){
+				blk[ch].min = FLT_MAX;
+				blk[ch].max = -FLT_MAX;
+			}
+			ov->nblocks[0]++;
+		}
+		blk = ov->levels[0] + (ov->nblocks[0] - 1) * chans;
+		n = min(nFrames,ov->blockframes - ov->curframes);
+		for(i=0;i < n;i++, buf += chans){
+			for(ch=0;ch < chans;ch++){
+				float f = buf[ch];
+				if(clip){
+					if(f > 1.0f)
+						f = 1.0f;
+					else if(f < -1.0f)
+						f = -1.0f;
+				}
+				/* NaNs fail every test, and are not added in */
+				if(f < blk[ch].min)
+					blk[ch].min = f;
+				if(f > blk[ch].max)
+					blk[ch].max = f;
+				if(f==f)
+					ov->cursumsq[ch] += (double) f * f;
+			}
+		}
+		ov->curframes += n;
+		ov->nFrames += n;
+		nFrames -= n;
+		if(ov->curframes==ov->blockframes)
+			psf_overviewEndBlock(ov);
+	}
+	return PSF_E_NOERROR;
+}
+
+int psf_overviewFinish(PSF_OVERVIEW *ov)
+{
+	int l,nlevels,ch,chans = ov->chans;
+	psf_int64 n,k;
+	psf_int64 *nblocks;
+	PSF_OVWBLOCK **levels;
+
+	if(ov->nlevels)
+		return PSF_E_NOERROR;
+	if(ov->curframes)
+		psf_overviewEndBlock(ov);
+	for(nlevels=1,n=ov->nblocks[0];n > 1;nlevels++)
+		n = (n + 1) / 2;
+	nblocks = (psf_int64 *) realloc(ov->nblocks,nlevels * sizeof(psf_int64));
+	if(nblocks==NULL)
+		return PSF_E_NOMEM;
+	ov->nblocks = nblocks;
+	levels = (PSF_OVWBLOCK **) realloc(ov->levels,nlevels * sizeof(PSF_OVWBLOCK *));
+	if(levels==NULL)
+		return PSF_E_NOMEM;
+	ov->levels = levels;
+	/* each block is the pair below it, or the last one alone */
+	for(l=1;l < nlevels;l++){
+		const PSF_OVWBLOCK *below = levels[l-1];
+		PSF_OVWBLOCK *blk;
+
+		nblocks[l] = (nblocks[l-1] + 1) / 2;
+		blk = levels[l] = (PSF_OVWBLOCK *) malloc((size_t) nblocks[l] * chans * sizeof(PSF_OVWBLOCK));
+		if(blk==NULL){
+			while(--l > 0)
+				free(levels[l]);
+			return PSF_E_NOMEM;
+		}
+		for(k=0;k < nblocks[l];k++, blk += chans){
+			const PSF_OVWBLOCK *a = below + 2 * k * chans;
+			for(ch=0;ch < chans;ch++)
+				blk[ch] = a[ch];
+			if(2 * k + 1 < nblocks[l-1]){
+				const PSF_OVWBLOCK *b = a + chans;
+				for(ch=0;ch < chans;ch++){
+					blk[ch].min = min(a[ch].min,b[ch].min);
+					blk[ch].max = max(a[ch].max,b[ch].max);
+					blk[ch].sumsq = a[ch].sumsq + b[ch].sumsq;
+				}
+			}
+		}
+	}
+	ov->nlevels = nlevels;
+	return PSF_E_NOERROR;
+}
+
+static void psf_overviewTake(PSF_OVWSTATS *stats, const PSF_OVWBLOCK *blk, int chans)
+{
+	int ch;
+
+	for(ch=0;ch < chans;ch++){
+		stats[ch].min = min(stats[ch].min,blk[ch].min);
+		stats[ch].max = max(stats[ch].max,blk[ch].max);
+		stats[ch].rms += blk[ch].sumsq;
+	}
+}
+
+/* The stretch as level 0 blocks [b0,b1) is covered by at most two blocks a level: at each level, 
+   an odd block at either end has no partner in its pair, so is taken as it is; 
+   the rest pair up exactly into the blocks of the next level. */
+int psf_overviewQuery(const PSF_OVERVIEW *ov, psf_int64 frame, psf_int64 nFrames, PSF_OVWSTATS *stats)
+{
+	psf_int64 end,b0,b1,covered;
+	int l,ch,chans = ov->chans;
+
+	if(ov->nlevels==0 || frame < 0 || nFrames < 0 || stats==NULL)
+		return PSF_E_BADARG;
+	end = min(frame + nFrames,ov->nFrames);
+	for(ch=0;ch < chans;ch++){
+		stats[ch].min = FLT_MAX;
+		stats[ch].max = -FLT_MAX;
+		stats[ch].rms = 0.0;
+	}
+	b0 = b1 = covered = 0;
+	if(frame < end){
+		b0 = frame / ov->blockframes;
+		b1 = (end + ov->blockframes - 1) / ov->blockframes;
+		covered = min(b1 * ov->blockframes,ov->nFrames) - b0 * ov->blockframes;
+	}
+	for(l=0;b0 < b1;l++, b0 >>= 1, b1 >>= 1){
+		if(b0 & 1)
+			psf_overviewTake(stats,ov->levels[l] + (b0++) * chans,chans);
+		if(b1 & 1)
+			psf_overviewTake(stats,ov->levels[l] + (--b1) * chans,chans);
+	}
+	for(ch=0;ch < chans;ch++){
+		if(stats[ch].min > stats[ch].max)
+			stats[ch].min = stats[ch].max = 0.0f;
+		stats[ch].peak = max(-stats[ch].min,stats[ch].max);
+		stats[ch].rms = covered ? sqrt(stats[ch].rms / (double) covered) : 0.0;
+	}
+	return PSF_E_NOERROR;
+}
+
+int psf_overviewBuild(const char *path, DWORD blockframes, PSF_OVERVIEW **pov)
+{
+	PSF_PROPS props;
+	PSF_OVERVIEW *ov;
+	const float *view;
+	int ifd,rc = PSF_E_NOERROR;
+	long framesread;
+
+	ifd = psf_sndOpenEx(path,&props,0,PSF_OPEN_MMAP);
+	if(ifd < 0)
+		return ifd;
+	ov = psf_overviewNew(props.chans,props.srate,blockframes);
+	if(ov==NULL){
+		psf_sndClose(ifd);
+		return blockframes & (blockframes - 1) ? PSF_E_BADARG : PSF_E_NOMEM;
+	}
+	while((framesread = psf_sndReadFloatView(ifd,&view,PSF_OVW_BUILDFRAMES)) > 0){
+		rc = psf_overviewAdd(ov,view,(DWORD) framesread,0);
+		if(rc < PSF_E_NOERROR)
+			break;
+	}
+	if(framesread < 0)
+		rc = (int) framesread;
+	psf_sndClose(ifd);
+	if(rc==PSF_E_NOERROR)
+		rc = psf_overviewFinish(ov);
+	if(rc < PSF_E_NOERROR){
+		psf_overviewFree(ov);
+		return rc;
+	}
+	*pov = ov;
+	return PSF_E_NOERROR;
+}
+
+/******** the sidecar file ***********/
+
+static void psf_put32(unsigned char *p, unsigned int val)
+{
+	p[0] = (unsigned char) val;
+	p[1] = (unsigned char)(val >> 8);
+	p[2] = (unsigned char)(val >> 16);
+	p[3] = (unsigned char)(val >> 24);
+}
+
+static void psf_put64(unsigned char *p, psf_int64 val)
+{
+	psf_put32(p,(unsigned int) val);
+	psf_put32(p + 4,(unsigned int)((unsigned long long) val >> 32));
+}
+
+static void psf_putFloat(unsigned char *p, float val)
+{
+	unsigned int bits;
+
+	memcpy(&bits,&val,sizeof(float));
+	psf_put32(p,bits);
+}
+
+static void psf_putDouble(unsigned char *p, double val)
+{
+	psf_int64 bits;
+
+	memcpy(&bits,&val,sizeof(double));
+	psf_put64(p,bits);
+}
+
+static unsigned int psf_get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static psf_int64 psf_get64(const unsigned char *p)
+{
+	return (psf_int64)(psf_get32(p) | ((unsigned long long) psf_get32(p + 4) << 32));
+}
+
+static float psf_getFloat(const unsigned char *p)
+{
+	unsigned int bits = psf_get32(p);
+	float val;
+
+	memcpy(&val,&bits,sizeof(float));
+	return val;
+}
+
+static double psf_getDouble(const unsigned char *p)
+{
+	psf_int64 bits = psf_get64(p);
+	double val;
+
+	memcpy(&val,&bits,sizeof(double));
+	return val;
+}
+
+/* sfpath + suffix, or NULL */
+static char *psf_overviewName(const char *sfpath, const char *suffix)
+{
+	char *name = (char *) malloc(strlen(sfpath) + strlen(PSF_OVW_EXT) + strlen(suffix) + 1);
+
+	if(name)
+		sprintf(name,"%s%s%s",sfpath,PSF_OVW_EXT,suffix);
+	return name;
+}
+
+int psf_overviewSave(PSF_OVERVIEW *ov, const char *sfpath)
+{
+	FILE *fp;
+	char *name,*tmpname;
+	unsigned char buf[PSF_OVW_HEADSIZE];
+	psf_int64 k;
+	int ch,rc;
+
+	rc = psf_overviewFinish(ov);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	rc = psf_indexStat(sfpath,&ov->mtime,&ov->size);
+	if(rc < PSF_E_NOERROR)
+		return rc;
+	name = psf_overviewName(sfpath,"");
+	tmpname = psf_overviewName(sfpath,".tmp");
+	if(name==NULL || tmpname==NULL){
+		free(name);
+		free(tmpname);
+		return PSF_E_NOMEM;
+	}
+	if((fp = fopen(tmpname,"wb"))==NULL){
+		free(name);
+		free(tmpname);
+		return PSF_E_CANT_OPEN;
+	}
+	memcpy(buf,"PSFO",4);
+	psf_put32(buf + 4,PSF_OVW_VERSION);
+	psf_put32(buf + 8,(unsigned int) ov->chans);
+	psf_put32(buf + 12,(unsigned int) ov->srate);
+	psf_put32(buf + 16,ov->blockframes);
+	psf_put64(buf + 20,ov->nFrames);
+	psf_put64(buf + 28,ov->mtime);
+	psf_put64(buf + 36,ov->size);
+	if(fwrite(buf,1,PSF_OVW_HEADSIZE,fp) != PSF_OVW_HEADSIZE)
+		rc = PSF_E_CANT_WRITE;
+	for(k=0;k < ov->nblocks[0] && rc==PSF_E_NOERROR;k++){
+		const PSF_OVWBLOCK *blk = ov->levels[0] + k * ov->chans;
+		for(ch=0;ch < ov->chans;ch++){
+			psf_putFloat(buf,blk[ch].min);
+			psf_putFloat(buf + 4,blk[ch].max);
+			psf_putDouble(buf + 8,blk[ch].sumsq);
+			if(fwrite(buf,1,PSF_OVW_BLKSIZE,fp) != PSF_OVW_BLKSIZE){
+				rc = PSF_E_CANT_WRITE;
+				break;
+			}
+		}
+	}
+	if(fclose(fp) && rc==PSF_E_NOERROR)
+		rc = PSF_E_CANT_WRITE;
+	if(rc==PSF_E_NOERROR){
+#ifndef unix
+		/* rename will not replace a file here */
+		remove(name);
+#endif
+		if(rename(tmpname,name))
+			rc = PSF_E_CANT_WRITE;
+	}
+	else
+		remove(tmpname);
+	free(name);
+	free(tmpname);
+	return rc;
+}
+
+int psf_overviewLoad(const char *sfpath, PSF_OVERVIEW **pov)
+{
+	FILE *fp;
+	char *name;
+	unsigned char *data,*p;
+	long len;
+	psf_int64 k,nblocks = 0,nFrames,mtime,size;
+	PSF_OVERVIEW *ov;
+	int ch,chans,rc;
+	DWORD blockframes;
+
+	name = psf_overviewName(sfpath,"");
+	if(name==NULL)
+		return PSF_E_NOMEM;
+	fp = fopen(name,"rb");
+	free(name);
+	if(fp==NULL)
+		return PSF_E_CANT_OPEN;
+	if(fseek(fp,0,SEEK_END) || (len = ftell(fp)) < PSF_OVW_HEADSIZE || fseek(fp,0,SEEK_SET)){
+		fclose(fp);
+		return PSF_E_BAD_FORMAT;
+	}
+	data = (unsigned char *) malloc(len);
+	if(data==NULL){
+		fclose(fp);
+		return PSF_E_NOMEM;
+	}
+	if(fread(data,1,len,fp) != (size_t) len){
+		fclose(fp);
+		free(data);
+		return PSF_E_CANT_READ;
+	}
+	fclose(fp);
+	chans = (int) psf_get32(data + 8);
+	blockframes = psf_get32(data + 16);
+	nFrames = psf_get64(data + 20);
+	/* it must be ours, all there, and still match the soundfile */
+	rc = PSF_E_BAD_FORMAT;
+	if(memcmp(data,"PSFO",4)==0 && psf_get32(data + 4)==PSF_OVW_VERSION
+		&& chans > 0 && blockframes > 0 && nFrames >= 0){
+		nblocks = (nFrames + blockframes - 1) / blockframes;
+		if((psf_int64)(len - PSF_OVW_HEADSIZE) / PSF_OVW_BLKSIZE / chans==nblocks
+			&& (psf_int64)(len - PSF_OVW_HEADSIZE)==nblocks * PSF_OVW_BLKSIZE * chans
+			&& psf_indexStat(sfpath,&mtime,&size)==PSF_E_NOERROR
+			&& mtime==psf_get64(data + 28) && size==psf_get64(data + 36))
+			rc = PSF_E_NOERROR;
+	}
+	if(rc < PSF_E_NOERROR){
+		free(data);
+		return rc;
+	}
+	ov = psf_overviewNew(chans,(int) psf_get32(data + 12),blockframes);
+	if(ov==NULL){
+		free(data);
+		return blockframes & (blockframes - 1) ? PSF_E_BAD_FORMAT : PSF_E_NOMEM;
+	}
+	ov->levels[0] = (PSF_OVWBLOCK *) malloc((size_t)(nblocks ? nblocks : 1) * chans * sizeof(PSF_OVWBLOCK));
+	if(ov->levels[0]==NULL){
+		psf_overviewFree(ov);
+		free(data);
+		return PSF_E_NOMEM;
+	}
+	p = data + PSF_OVW_HEADSIZE;
+	for(k=0;k < nblocks;k++){
+		PSF_OVWBLOCK *blk = ov->levels[0] + k * chans;
+		for(ch=0;ch < chans;ch++, p += PSF_OVW_BLKSIZE){
+			blk[ch].min = psf_getFloat(p);
+			blk[ch].max = psf_getFloat(p + 4);
+			blk[ch].sumsq = psf_getDouble(p + 8);
+		}
+	}
+	ov->nblocks[0] = ov->maxblocks = nblocks;
+	ov->nFrames = nFrames;
+	ov->mtime = mtime;
+	ov->size = size;
+	free(data);
+	rc = psf_overviewFinish(ov);
+	if(rc < PSF_E_NOERROR){
+		psf_overviewFree(ov);
+		return rc;
+	}
+	*pov = ov;
+	return PSF_E_NOERROR;
+}
@@ -0,0 +1,109 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psfoverview.h: a multi-resolution overview of a soundfile, for waveform displays and level queries.
+   For each channel it holds min, max and the sum of squares over blocks of blockframes frames, then over
+   blocks twice that size, and so on up to the whole file. Peak and RMS over any stretch then take
+   O(log n) blocks, and no samples are read. An overview is built while a file is written
+   (psf_sndSetOverview), or in one pass over an existing file (psf_overviewBuild).
+   It is kept in a sidecar file, named as the soundfile plus ".ovw".
+   Include after <portsf.h> and <psfext.h> */
+
+#ifndef __PSFOVERVIEW_H_INCLUDED
+#define __PSFOVERVIEW_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PSF_OVW_EXT			".ovw"
+#define PSF_OVW_DEFBLOCK	(256)
+
+typedef struct psf_ovwblock {
+	float	min;
+	float	max;
+	double	sumsq;				/* of the samples; NaNs are left out of all three */
+} PSF_OVWBLOCK;
+
+typedef struct psf_overview {
+	int				chans;
+	int				srate;
+	DWORD			blockframes;	/* of the level 0 blocks: a power of two */
+	psf_int64		nFrames;
+	psf_int64		mtime;			/* of the soundfile when saved, as psf_indexStat gives them */
+	psf_int64		size;
+	int				nlevels;		/* 0 until psf_overviewFinish */
+	psf_int64		*nblocks;		/* per level */
+	PSF_OVWBLOCK	**levels;		/* levels[l][block * chans + ch]: level l blocks are blockframes << l
+									   frames long, the last perhaps shorter */
+	/* while building */
+	psf_int64		maxblocks;		/* room at level 0 */
+	DWORD			curframes;		/* in the last level 0 block so far */
+	double			*cursumsq;
+} PSF_OVERVIEW;
+
+/* what a query finds, per channel */
+typedef struct psf_ovwstats {
+	float	min;
+	float	max;
+	float	peak;				/* the larger of -min and max */
+	double	rms;
+} PSF_OVWSTATS;
+
+/* a new, empty overview; blockframes 0 for PSF_OVW_DEFBLOCK. Return NULL for no memory,
+   or if blockframes is not a power of two */
+PSF_OVERVIEW *psf_overviewNew(int chans, int srate, DWORD blockframes);
+void psf_overviewFree(PSF_OVERVIEW *ov);
+/* add nFrames interleaved frames; with clip set samples are clipped to +-1 first, as for PEAK data.
+   Return PSF_E_NOERROR, PSF_E_NOMEM, or PSF_E_BADARG once finished */
+int psf_overviewAdd(PSF_OVERVIEW *ov, const float *buf, DWORD nFrames, int clip);
+/* build the coarser levels: needed before a query. Return PSF_E_NOERROR, or PSF_E_NOMEM */
+int psf_overviewFinish(PSF_OVERVIEW *ov);
+/* min, max, peak and RMS of each channel (stats[chans]) over nFrames from frame. The stretch is widened
+   to whole level 0 blocks, and cut at the end of the file; stats are zero if nothing is left.
+   Return PSF_E_NOERROR, or PSF_E_BADARG (or if ov is not finished) */
+int psf_overviewQuery(const PSF_OVERVIEW *ov, psf_int64 frame, psf_int64 nFrames, PSF_OVWSTATS *stats);
+/* read soundfile path in one pass into a new finished overview *pov, for psf_overviewSave.
+   Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_overviewBuild(const char *path, DWORD blockframes, PSF_OVERVIEW **pov);
+/* finish ov, and write it as the sidecar of soundfile sfpath, stamped with that file's mtime and size
+   (written to a temporary file, then renamed). Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_overviewSave(PSF_OVERVIEW *ov, const char *sfpath);
+/* read the sidecar of soundfile sfpath into a new overview *pov. Return PSF_E_NOERROR; PSF_E_CANT_OPEN
+   if there is none; PSF_E_BAD_FORMAT if it is damaged, or out of date (the soundfile has changed since) */
+int psf_overviewLoad(const char *sfpath, PSF_OVERVIEW **pov);
+
+/* in portsf.c: build an overview of sfd as it is written, in blocks of blockframes (0 for PSF_OVW_DEFBLOCK),
+   and save it as the sidecar when the file is closed. Set before the first frames are written. It follows
+   the PEAK data: float and double frames as clipped for the file, integer frames scaled to +-1.
+   A write anywhere but straight on from the last one (after a seek) drops it, as does an error at close. Return PSF_E_NOERROR; PSF_E_BADARG if frames
+   have been written or blockframes is not a power of two; PSF_E_FILE_READONLY; or PSF_E_UNSUPPORTED
+   for a stream or a file in memory (use psf_overviewAdd) */
+int psf_sndSetOverview(int sfd, DWORD blockframes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
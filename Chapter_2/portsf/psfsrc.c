@@ -0,0 +1,348 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psfsrc.c: streaming sample rate conversion.
+   Output frame j is at input time j * inrate / outrate (rates reduced by their gcd), held exactly as
+   an input index and a remainder. Each output is a dot product of ntaps input samples with a
+   Kaiser-windowed sinc, low-passed at the lower of the two Nyquist rates. The filter for each
+   fractional position comes from a table of nphases + 1 filters, interpolated linearly between the
+   two nearest; it is made once per output frame and then used for every channel. Input is held
+   per channel, so the taps are contiguous, and the dot products are done 4 at a time with SSE2. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "portsf.h"
+#include "psfext.h"
+#include "psfsrc.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+/* input frames taken per push, beyond the filter's own span */
+#define PSF_SRC_BLOCK	(4096)
+
+static const struct psf_srcpreset {
+	int		zerocross;		/* either side, at the lower rate */
+	int		nphases;
+	double	beta;			/* Kaiser window */
+	double	rolloff;		/* cutoff, as a fraction of the lower Nyquist rate */
+} psf_srcpresets[] = {
+	{ 8,	64,		6.0,	0.83 },		/* PSF_SRC_FAST */
+	{ 24,	256,	8.6,	0.90 },		/* PSF_SRC_MEDIUM */
+	{ 48,	1024,	12.0,	0.95 }		/* PSF_SRC_BEST */
+};
+
+struct psf_src {
+	int			chans;
+	long		inrate,outrate;		/* reduced by their gcd */
+	int			half;				/* input samples either side of the output time */
+	int			ntaps;				/* 2 * half, rounded up to a multiple of 4 */
+	int			nphases;
+	float		*table;				/* nphases + 1 filters of ntaps */
+	float		*coefs;				/* this frame's filter */
+	float		**hist;				/* input, per channel, from the first tap of the next output */
+	DWORD		histsize;			/* room per channel */
+	DWORD		nhist;				/* samples held */
+	DWORD		ipos;				/* first tap of the next output */
+	long		rem;				/* its fractional position: rem / outrate of an input sample */
+	psf_int64	inframes,outframes;
+	int			ended;
+	DWORD		padleft;			/* zeros still to follow the input, once ended */
+};
+
+/* zeroth-order modified Bessel function, for the Kaiser window */
+static double psf_srcI0(double x)
+{
+	double sum = 1.0,term = 1.0,q = x * x / 4.0;
+	int k;
+
+	for(k=1;k < 64;k++){
+		term *= q / ((double) k * k);
+		sum += term;
+		if(term < sum * 1e-17)
+			break;
+	}
+	return sum;
+}
+
+static long psf_srcGcd(long a, long b)
+{
+	while(b){
+		long t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* each filter is normalized to unity gain, so DC passes exactly whatever the phase */
+static void psf_srcMakeTable(PSF_SRC *src, double fc, double beta)
+{
+	double i0beta = psf_srcI0(beta);
+	int p,k;
+
+	for(p=0;p <= src->nphases;p++){
+		float *row = src->table + (size_t) p * src->ntaps;
+		double sum = 0.0;
+
+		for(k=0;k < src->ntaps;k++){
+			/* distance from the output time to tap k, in input samples */
+			double d = (double) p / src->nphases + (src->half - 1 - k);
+			double x = d / src->half,h;
+
+			if(k >= 2 * src->half || fabs(x) > 1.0)
+				h = 0.0;
+			else {
+				h = fc * psf_srcI0(beta * sqrt(1.0 - x * x)) / i0beta;
+				if(d != 0.0)
+					h *= sin(M_PI * fc * d) / (M_PI * fc * d);
+			}
+			row[k] = (float) h;
+			sum += h;
+		}
+		for(k=0;k < src->ntaps;k++)
+			row[k] = (float)(row[k] / sum);
+	}
+}
+
+PSF_SRC *psf_srcNew(int chans, long inrate, long outrate, int quality)
+{
+	const struct psf_srcpreset *q;
+	PSF_SRC *src;
+	double ratio;
+	long g;
+	int ch;
+
+	if(chans <= 0 || inrate <= 0 || outrate <= 0 || quality < PSF_SRC_FAST || quality > PSF_SRC_BEST)
+		return NULL;
+	q = &psf_srcpresets[quality];
+	src = (PSF_SRC *) calloc(1,sizeof(PSF_SRC));
+	if(src==NULL)
+		return NULL;
+	g = psf_srcGcd(inrate,outrate);
+	src->chans = chans;
+	src->inrate = inrate / g;
+	src->outrate = outrate / g;
+	ratio = (double) outrate / inrate;
+	/* converting down: the filter is wider, in input samples, by the same factor */
+	src->half = ratio < 1.0 ? (int) ceil(q->zerocross / ratio) : q->zerocross;
+	src->ntaps = (2 * src->half + 3) & ~3;
+	src->nphases = q->nphases;
+	src->histsize = (DWORD) src->ntaps * 2 + PSF_SRC_BLOCK;
+	src->table = (float *) malloc((size_t)(src->nphases + 1) * src->ntaps * sizeof(float));
+	src->coefs = (float *) malloc(src->ntaps * sizeof(float));
+	src->hist = (float **) calloc(chans,sizeof(float *));
+	if(src->table==NULL || src->coefs==NULL || src->hist==NULL){
+		psf_srcFree(src);
+		return NULL;
+	}
+	for(ch=0;ch < chans;ch++){
+		src->hist[ch] = (float *) malloc(src->histsize * sizeof(float));
+		if(src->hist[ch]==NULL){
+			psf_srcFree(src);
+			return NULL;
+		}
+	}
+	psf_srcMakeTable(src,q->rolloff * (ratio < 1.0 ? ratio : 1.0),q->beta);
+	psf_srcReset(src);
+	return src;
+}
+
+void psf_srcFree(PSF_SRC *src)
+{
+	int ch;
+
+	if(src==NULL)
+		return;
+	if(src->hist){
+		for(ch=0;ch < src->chans;ch++)
+			free(src->hist[ch]);
+		free(src->hist);
+	}
+	free(src->table);
+	free(src->coefs);
+	free(src);
+}
+
+/* the first output needs half - 1 samples before the first input: silence */
+void psf_srcReset(PSF_SRC *src)
+{
+	int ch;
+
+	for(ch=0;ch < src->chans;ch++)
+		memset(src->hist[ch],0,(src->half - 1) * sizeof(float));
+	src->nhist = src->half - 1;
+	src->ipos = 0;
+	src->rem = 0;
+	src->inframes = 0;
+	src->outframes = 0;
+	src->ended = 0;
+	src->padleft = 0;
+}
+
+/* drop what no output needs any more */
+static void psf_srcCompact(PSF_SRC *src)
+{
+	int ch;
+
+	if(src->ipos==0)
+		return;
+	for(ch=0;ch < src->chans;ch++)
+		memmove(src->hist[ch],src->hist[ch] + src->ipos,(src->nhist - src->ipos) * sizeof(float));
+	src->nhist -= src->ipos;
+	src->ipos = 0;
+}
+
+DWORD psf_srcSpace(const PSF_SRC *src)
+{
+	if(src->ended)
+		return 0;
+	return src->histsize - (src->nhist - src->ipos);
+}
+
+DWORD psf_srcPush(PSF_SRC *src, const float *in, DWORD nFrames)
+{
+	DWORD n,i;
+	int ch;
+
+	if(src->ended)
+		return 0;
+	if(nFrames > src->histsize - src->nhist)
+		psf_srcCompact(src);
+	n = nFrames < src->histsize - src->nhist ? nFrames : src->histsize - src->nhist;
+	for(ch=0;ch < src->chans;ch++){
+		float *dst = src->hist[ch] + src->nhist;
+		for(i=0;i < n;i++)
+			dst[i] = in[i * src->chans + ch];
+	}
+	src->nhist += n;
+	src->inframes += n;
+	return n;
+}
+
+void psf_srcEnd(PSF_SRC *src)
+{
+	if(!src->ended){
+		src->ended = 1;
+		src->padleft = src->ntaps;
+	}
+}
+
+/* after the end, silence for the last filters to run into */
+static void psf_srcPad(PSF_SRC *src)
+{
+	DWORD n;
+	int ch;
+
+	psf_srcCompact(src);
+	n = src->histsize - src->nhist;
+	if(n > src->padleft)
+		n = src->padleft;
+	for(ch=0;ch < src->chans;ch++)
+		memset(src->hist[ch] + src->nhist,0,n * sizeof(float));
+	src->nhist += n;
+	src->padleft -= n;
+}
+
+/* this frame's filter: between the two table rows either side of its phase */
+static void psf_srcFilter(PSF_SRC *src)
+{
+	double pos = (double) src->rem / src->outrate * src->nphases;
+	int p = (int) pos,k = 0;
+	const float *r0 = src->table + (size_t) p * src->ntaps;
+	const float *r1 = r0 + src->ntaps;
+	float f = (float)(pos - p);
+	float *c = src->coefs;
+
+#ifdef __SSE2__
+	__m128 vf = _mm_set1_ps(f);
+	for(;k < src->ntaps;k += 4){
+		__m128 a = _mm_loadu_ps(r0 + k);
+		_mm_storeu_ps(c + k,_mm_add_ps(a,_mm_mul_ps(vf,_mm_sub_ps(_mm_loadu_ps(r1 + k),a))));
+	}
+#endif
+	for(;k < src->ntaps;k++)
+		c[k] = r0[k] + f * (r1[k] - r0[k]);
+}
+
+static float psf_srcDot(const float *x, const float *h, int ntaps)
+{
+	int k = 0;
+	float sum;
+#ifdef __SSE2__
+	__m128 acc0 = _mm_setzero_ps(),acc1 = _mm_setzero_ps();
+	float lanes[4];
+
+	for(;k + 8 <= ntaps;k += 8){
+		acc0 = _mm_add_ps(acc0,_mm_mul_ps(_mm_loadu_ps(x + k),_mm_loadu_ps(h + k)));
+		acc1 = _mm_add_ps(acc1,_mm_mul_ps(_mm_loadu_ps(x + k + 4),_mm_loadu_ps(h + k + 4)));
+	}
+	for(;k + 4 <= ntaps;k += 4)
+		acc0 = _mm_add_ps(acc0,_mm_mul_ps(_mm_loadu_ps(x + k),_mm_loadu_ps(h + k)));
+	_mm_storeu_ps(lanes,_mm_add_ps(acc0,acc1));
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+	sum = 0.0f;
+#endif
+	for(;k < ntaps;k++)
+		sum += x[k] * h[k];
+	return sum;
+}
+
+DWORD psf_srcPull(PSF_SRC *src, float *out, DWORD nFrames)
+{
+	DWORD done = 0;
+	int ch;
+
+	while(done < nFrames){
+		if(src->ended){
+			psf_int64 total = (src->inframes * src->outrate + src->inrate - 1) / src->inrate;
+			if(src->outframes >= total)
+				break;
+			if(src->ipos + src->ntaps > src->nhist && src->padleft)
+				psf_srcPad(src);
+		}
+		if(src->ipos + src->ntaps > src->nhist)
+			break;
+		psf_srcFilter(src);
+		for(ch=0;ch < src->chans;ch++)
+			out[done * src->chans + ch] = psf_srcDot(src->hist[ch] + src->ipos,src->coefs,src->ntaps);
+		done++;
+		src->outframes++;
+		src->rem += src->inrate;
+		src->ipos += (DWORD)(src->rem / src->outrate);
+		src->rem %= src->outrate;
+	}
+	return done;
+}
+
+int psf_srcSpan(const PSF_SRC *src)
+{
+	return src->half;
+}
@@ -0,0 +1,75 @@
+/* Copyright (c) 2026 agent
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following
+conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* psfsrc.h: streaming sample rate conversion (polyphase windowed sinc).
+   Used by psf_sndSetRate, or on its own. Include after <portsf.h> */
+
+#ifndef __PSFSRC_H_INCLUDED
+#define __PSFSRC_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* quality presets: longer filters, flatter passband and deeper stopband, for less speed.
+   Half-lengths of 8, 24 and 48 zero crossings (scaled up when converting down), 
+   stopbands of about 60, 90 and 120dB, passbands to about 60%, 78% and 87% of the lower Nyquist rate */
+#define PSF_SRC_FAST	(0)
+#define PSF_SRC_MEDIUM	(1)
+#define PSF_SRC_BEST	(2)
+
+typedef struct psf_src PSF_SRC;
+
+/* a converter for chans channels from inrate to outrate. Return NULL if no memory, or bad args */
+PSF_SRC *psf_srcNew(int chans, long inrate, long outrate, int quality);
+void psf_srcFree(PSF_SRC *src);
+/* forget all input: start again, as new */
+void psf_srcReset(PSF_SRC *src);
+/* how many input frames psf_srcPush will take now */
+DWORD psf_srcSpace(const PSF_SRC *src);
+/* add interleaved input frames. Return frames taken: no more than psf_srcSpace */
+DWORD psf_srcPush(PSF_SRC *src, const float *in, DWORD nFrames);
+/* there is no more input: the rest of the output can be pulled */
+void psf_srcEnd(PSF_SRC *src);
+/* take up to nFrames of interleaved output, as far as the input allows. The output is aligned with
+   the input (no delay), so the filter needs some input beyond each frame before it can be pulled.
+   After psf_srcEnd, 0 means all done: inframes * outrate / inrate frames in all (rounded up) */
+DWORD psf_srcPull(PSF_SRC *src, float *out, DWORD nFrames);
+/* input frames either side of an output frame that affect it: output more than this far
+   from the start of the input is as if the input had no start */
+int psf_srcSpan(const PSF_SRC *src);
+
+/* convert a file's frames to or from srate (0, or the file's rate, to stop). Reading, the file is decoded
+   at its own rate and psf_sndReadFloatFrames (and the float view and planar reads) deliver frames at srate;
+   psf_sndSize, Tell and Seek count frames at srate too, and seeks are exact. Writing, the caller's frames
+   at srate are converted to the file's rate as they are written, and the last of them at close.
+   Other sample calls, and seeks on a file being written, return PSF_E_UNSUPPORTED while a rate is set.
+   Return PSF_E_NOERROR, or some PSF_E_ value */
+int psf_sndSetRate(int sfd, long srate, int quality);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif